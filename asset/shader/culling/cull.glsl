@@ -0,0 +1,29 @@
+// Cluster visibility tests shared by every culling stage
+
+bool is_outside_frustum(vec4 frustum[6], vec3 center, float radius)
+{
+    bool is_outside = false;
+    for (int p = 0; p < 6; p++) {
+        is_outside = is_outside || dot(frustum[p].xyz, center) + frustum[p].w < -radius;
+    }
+
+    return is_outside;
+}
+
+// Clusters of every level of an instance share its bounding sphere, so only
+// the coarsest level whose error projects to at most a pixel passes. Scaling
+// by lod_scale turns an error into the distance where it covers a pixel.
+bool is_lod_selected(vec3 camera_position, float lod_scale, vec3 lod_center, float lod_radius, float lod_error, float coarser_lod_error)
+{
+    float distance = max(length(lod_center - camera_position) - lod_radius, 0.0);
+
+    return lod_error * lod_scale <= distance && coarser_lod_error * lod_scale > distance;
+}
+
+// Every triangle of the cluster faces away from the camera, see struct Meshlet
+bool is_backfacing(vec3 camera_position, vec3 center, float radius, vec3 cone_axis, float cone_cutoff)
+{
+    vec3 d = center - camera_position;
+
+    return dot(d, cone_axis) >= cone_cutoff * length(d) + radius;
+}
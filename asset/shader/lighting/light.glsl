@@ -0,0 +1,116 @@
+// Clustered forward lighting shared by the light binning pass and the
+// fragment shaders. The includer defines LIGHT_BINDING and CLUSTER_BINDING,
+// and LIGHT_BINNING when it is the pass writing the clusters. Bindless
+// fragment shaders include bindless.glsl first and index the buffers of the
+// frame instead.
+
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_COUNT (CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+#define CLUSTER_MAX_LIGHTS 128
+
+struct Light {
+    vec3 position;
+    float radius;
+    vec3 color;
+    float intensity;
+};
+
+layout(binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+    vec4 frustum[6];
+    vec4 camera_position;
+    float lod_scale;
+    float z_near;
+    float z_far;
+    uint light_count;
+    vec2 viewport;
+} frame;
+
+#ifdef BINDLESS
+layout(set = BINDLESS_SET, binding = 0) readonly buffer LightBuffer {
+    Light lights[];
+} light_buffers[];
+
+layout(set = BINDLESS_SET, binding = 0) readonly buffer ClusterBuffer {
+    uint cluster_light_counts[CLUSTER_COUNT];
+    uint cluster_light_indices[CLUSTER_COUNT * CLUSTER_MAX_LIGHTS];
+} cluster_buffers[];
+
+#define lights light_buffers[bindless.light_buffer].lights
+#define cluster_light_counts cluster_buffers[bindless.cluster_buffer].cluster_light_counts
+#define cluster_light_indices cluster_buffers[bindless.cluster_buffer].cluster_light_indices
+#else
+layout(binding = LIGHT_BINDING) readonly buffer Lights {
+    Light lights[];
+};
+
+// the lights of a cluster are the first counts[cluster] of its indices
+#ifdef LIGHT_BINNING
+layout(binding = CLUSTER_BINDING) writeonly buffer Clusters {
+#else
+layout(binding = CLUSTER_BINDING) readonly buffer Clusters {
+#endif
+    uint cluster_light_counts[CLUSTER_COUNT];
+    uint cluster_light_indices[CLUSTER_COUNT * CLUSTER_MAX_LIGHTS];
+};
+#endif
+
+// Slices get exponentially deeper from z_near to z_far, so that clusters
+// stay about as deep as they are wide
+float get_slice_depth(uint slice)
+{
+    return frame.z_near * pow(frame.z_far / frame.z_near, float(slice) / float(CLUSTER_COUNT_Z));
+}
+
+uint get_cluster(vec2 frag_coord, float view_depth)
+{
+    uvec2 tile = uvec2(clamp(
+        frag_coord / frame.viewport * vec2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y),
+        vec2(0.0),
+        vec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1)
+    ));
+    float slice = log(view_depth / frame.z_near) / log(frame.z_far / frame.z_near) * float(CLUSTER_COUNT_Z);
+
+    return (uint(clamp(slice, 0.0, float(CLUSTER_COUNT_Z - 1))) * CLUSTER_COUNT_Y + tile.y) * CLUSTER_COUNT_X + tile.x;
+}
+
+#ifndef LIGHT_BINNING
+
+// Specialized per pipeline, so that the driver folds them into each variant.
+// The ids match enum ShadingConstant in graphics.c.
+layout(constant_id = 0) const bool IS_DYNAMIC_LIGHTING = true;
+layout(constant_id = 1) const float BAKED_LIGHT_SCALE = 1.0;
+layout(constant_id = 2) const float DYNAMIC_LIGHT_SCALE = 1.0;
+
+// Adds the lights of the cluster of a fragment to its baked color. Faces are
+// lit flat with the normal turned toward the camera. Single sided objects
+// only show front faces, where that is their winding normal, and double
+// sided objects have no winding to take a facing from.
+vec3 shade(vec3 base_color, vec3 position)
+{
+    vec3 color = base_color * BAKED_LIGHT_SCALE;
+    if (!IS_DYNAMIC_LIGHTING) {
+        return color;
+    }
+
+    vec3 normal = normalize(cross(dFdx(position), dFdy(position)));
+    if (dot(normal, frame.camera_position.xyz - position) < 0.0) {
+        normal = -normal;
+    }
+
+    uint cluster = get_cluster(gl_FragCoord.xy, (frame.view * vec4(position, 1.0)).z);
+    uint count = cluster_light_counts[cluster];
+    for (uint i = 0; i < count; i++) {
+        Light light = lights[cluster_light_indices[cluster * CLUSTER_MAX_LIGHTS + i]];
+        vec3 l = light.position - position;
+        float d2 = dot(l, l);
+        float falloff = max(1.0 - d2 / (light.radius * light.radius), 0.0);
+        color += DYNAMIC_LIGHT_SCALE * light.color * light.intensity * falloff * falloff * max(dot(normal, l) * inversesqrt(d2), 0.0);
+    }
+
+    return color;
+}
+#endif
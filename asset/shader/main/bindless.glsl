@@ -0,0 +1,54 @@
+// Resources of the bindless shading pipelines, see struct Bindless. Every
+// storage buffer sits in the array of set 1 and the blocks below alias it,
+// a draw finds its object through its first instance and the vertices
+// through the object. The lights and clusters of the frame come from the
+// push constants. Vertex shaders define VERTEX_PULLING for get_vertex.
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define BINDLESS_SET 1
+
+struct DrawObject {
+    vec3 center;
+    float radius;
+    vec3 cone_axis;
+    float cone_cutoff;
+    uint first_vertex;
+    uint vertex_count;
+    uint meshlet_vertex_offset;
+    uint meshlet_vertex_count;
+    vec3 lod_center;
+    float lod_radius;
+    float lod_error;
+    float coarser_lod_error;
+    uint flags;
+    uint vertex_buffer;
+};
+
+// struct Vertex is packed, so its vectors are read as floats
+struct Vertex {
+    float position[3];
+    float color[3];
+};
+
+layout(push_constant) uniform BindlessConstants {
+    uint object_buffer;
+    uint light_buffer;
+    uint cluster_buffer;
+} bindless;
+
+layout(set = BINDLESS_SET, binding = 0) readonly buffer ObjectBuffer {
+    DrawObject objects[];
+} object_buffers[];
+
+layout(set = BINDLESS_SET, binding = 0) readonly buffer VertexBuffer {
+    Vertex vertices[];
+} vertex_buffers[];
+
+#ifdef VERTEX_PULLING
+Vertex get_vertex()
+{
+    DrawObject object = object_buffers[bindless.object_buffer].objects[gl_InstanceIndex];
+    return vertex_buffers[object.vertex_buffer].vertices[gl_VertexIndex];
+}
+#endif
@@ -0,0 +1,27 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+#ifdef BINDLESS
+#define VERTEX_PULLING
+#include "bindless.glsl"
+#else
+layout(location = 0) in vec3 pos;
+#endif
+
+// must match shader.vert exactly for the EQUAL depth test of the shading pass
+invariant gl_Position;
+
+void main() {
+#ifdef BINDLESS
+    Vertex vertex = get_vertex();
+    vec3 pos = vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+#endif
+
+    gl_Position = ubo.proj * ubo.view * vec4(pos, 1.0);
+}
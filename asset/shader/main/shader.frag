@@ -1,11 +1,20 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#ifdef BINDLESS
+#include "bindless.glsl"
+#endif
+
+#define LIGHT_BINDING 1
+#define CLUSTER_BINDING 2
+#include "../lighting/light.glsl"
 
 layout(location = 0) in vec3 color;
+layout(location = 1) in vec3 world_position;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(color, 1.0);
+    outColor = vec4(shade(color, world_position), 1.0);
 }
-
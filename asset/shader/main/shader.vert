@@ -1,5 +1,6 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
 const float PI = 3.1415926535897932384626433832795;
 const float PI_2 = 1.57079632679489661923;
@@ -9,16 +10,30 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+#ifdef BINDLESS
+#define VERTEX_PULLING
+#include "bindless.glsl"
+#else
 layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 midpoint;
+layout(location = 1) in vec3 color;
+#endif
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 world_position;
+
+// the depth prepass must produce bit identical depth for the EQUAL test
+invariant gl_Position;
 
 void main() {
-    const float MAX_LIGHT_DISTANCE = 90.0;
-    float d = distance(midpoint, vec3(0.0, 0.0, 0.0));
-    float i = clamp(d, 0, MAX_LIGHT_DISTANCE) / MAX_LIGHT_DISTANCE;
-    fragColor = (1 - i) * vec3(1.0, 0.0, 0.0);
+#ifdef BINDLESS
+    Vertex vertex = get_vertex();
+    vec3 pos = vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+    vec3 color = vec3(vertex.color[0], vertex.color[1], vertex.color[2]);
+#endif
+
+    // lighting is baked per face by the mesh converter
+    fragColor = color;
+    world_position = pos;
 
     gl_Position = ubo.proj * ubo.view * vec4(pos, 1.0);
 }
@@ -0,0 +1,49 @@
+// Resources shared by the task and mesh stages, see init_mesh_descriptor_layout
+
+#define TASK_GROUP_SIZE 32
+#define MESH_GROUP_SIZE 64
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+#define DRAW_OBJECT_FLAG_DOUBLE_SIDED 1u
+
+struct DrawObject {
+    vec3 center;
+    float radius;
+    vec3 cone_axis;
+    float cone_cutoff;
+    uint first_vertex;
+    uint vertex_count;
+    uint meshlet_vertex_offset;
+    uint meshlet_vertex_count;
+    vec3 lod_center;
+    float lod_radius;
+    float lod_error;
+    float coarser_lod_error;
+    // DRAW_OBJECT_FLAG_* bits, see enum DrawObjectFlag
+    uint flags;
+    uint vertex_buffer;
+};
+
+struct TaskPayload {
+    uint object_indices[TASK_GROUP_SIZE];
+};
+
+layout(binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+    vec4 frustum[6];
+    vec4 camera_position;
+    float lod_scale;
+} frame;
+
+layout(binding = 1) readonly buffer Objects {
+    DrawObject objects[];
+};
+
+// draws cover the draw order slots from first_object on, single sided
+// objects come first
+layout(push_constant) uniform Constants {
+    uint first_object;
+    uint object_count;
+} constants;
@@ -0,0 +1,16 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_GOOGLE_include_directive : require
+
+#define LIGHT_BINDING 8
+#define CLUSTER_BINDING 9
+#include "../lighting/light.glsl"
+
+layout(location = 0) perprimitiveEXT in vec3 color;
+layout(location = 1) in vec3 world_position;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = vec4(shade(color, world_position), 1.0);
+}
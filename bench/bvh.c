@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/bvh.h"
+#include "common/linmath.h"
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+// BVH benchmark over growing numbers of small boxes scattered in a cube whose
+// volume grows with them, so that a query keeps finding about as many items.
+// The queries run on the built tree, then again after every item moved and
+// the tree was refit. Every query is checked against brute force.
+#define QUERY_COUNT 256
+#define ITEM_DENSITY 0.001f
+#define ITEM_SIZE 2.0f
+#define RANGE_SIZE 20.0f
+#define MOVE_SIZE 4.0f
+
+static double
+get_time_ms(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static float
+random_float(float const min, float const max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static int
+is_inside_frustum(float planes[static 6][4], struct BvhBounds const *bounds)
+{
+    for (int p = 0; p < 6; p++) {
+        float distance = planes[p][3];
+        for (int j = 0; j < 3; j++) {
+            distance += planes[p][j] * (planes[p][j] >= 0.0f ? bounds->max[j] : bounds->min[j]);
+        }
+        if (distance < 0.0f) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int
+is_inside_range(struct BvhBounds const *range, struct BvhBounds const *bounds)
+{
+    for (int j = 0; j < 3; j++) {
+        if (bounds->min[j] > range->max[j] || bounds->max[j] < range->min[j]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void
+query(
+    char const *label,
+    struct Bvh const *bvh,
+    uint32_t const count,
+    struct BvhBounds const bounds[static const count],
+    float const world_size,
+    uint32_t result[static const count])
+{
+    // views look along z from random points and see about 100 units
+    float proj[4][4];
+    mat4_perspective(proj, 16.0f/9.0f, 90.0f * M_PI / 180.0f, 0.01f, 100.0f);
+
+    double frustum_ms = 0.0;
+    double frustum_brute_ms = 0.0;
+    double range_ms = 0.0;
+    double range_brute_ms = 0.0;
+    uint64_t frustum_items = 0;
+    uint64_t range_items = 0;
+    for (uint32_t q = 0; q < QUERY_COUNT; q++) {
+        float yaw = random_float(0.0f, 2.0f * M_PI);
+        float camera_pos[3] = {random_float(0.0f, world_size), random_float(0.0f, world_size), random_float(0.0f, world_size)};
+        float view[4][4];
+        float view_proj[4][4];
+        float planes[6][4];
+        mat4_view(view, camera_pos, cosf(yaw), sinf(yaw), 1.0f, 0.0f);
+        mat4_mul(view_proj, view, proj);
+        mat4_frustum(planes, view_proj);
+
+        double begin = get_time_ms();
+        uint32_t found = bvh_query_frustum(bvh, planes, result);
+        double middle = get_time_ms();
+        uint32_t expected = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            expected += is_inside_frustum(planes, &bounds[i]);
+        }
+        frustum_ms += middle - begin;
+        frustum_brute_ms += get_time_ms() - middle;
+        if (found != expected) {
+            fprintf(stderr, "%s frustum query found %u items instead of %u\n", label, found, expected);
+            exit(EXIT_FAILURE);
+        }
+        frustum_items += found;
+
+        struct BvhBounds range;
+        for (int j = 0; j < 3; j++) {
+            range.min[j] = camera_pos[j] - RANGE_SIZE * 0.5f;
+            range.max[j] = camera_pos[j] + RANGE_SIZE * 0.5f;
+        }
+        begin = get_time_ms();
+        found = bvh_query_range(bvh, &range, result);
+        middle = get_time_ms();
+        expected = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            expected += is_inside_range(&range, &bounds[i]);
+        }
+        range_ms += middle - begin;
+        range_brute_ms += get_time_ms() - middle;
+        if (found != expected) {
+            fprintf(stderr, "%s range query found %u items instead of %u\n", label, found, expected);
+            exit(EXIT_FAILURE);
+        }
+        range_items += found;
+    }
+
+    printf(
+        "  %s frustum: %.1f us (brute force %.1f us), %.1f items\n",
+        label,
+        1000.0 * frustum_ms / QUERY_COUNT,
+        1000.0 * frustum_brute_ms / QUERY_COUNT,
+        (double)frustum_items / QUERY_COUNT
+    );
+    printf(
+        "  %s range: %.2f us (brute force %.1f us), %.1f items\n",
+        label,
+        1000.0 * range_ms / QUERY_COUNT,
+        1000.0 * range_brute_ms / QUERY_COUNT,
+        (double)range_items / QUERY_COUNT
+    );
+}
+
+static void
+run(uint32_t const count)
+{
+    float const world_size = cbrtf(count / ITEM_DENSITY);
+    struct BvhBounds *bounds = malloc(count * sizeof *bounds);
+    uint32_t *result = malloc(count * sizeof *result);
+    for (uint32_t i = 0; i < count; i++) {
+        for (int j = 0; j < 3; j++) {
+            bounds[i].min[j] = random_float(0.0f, world_size);
+            bounds[i].max[j] = bounds[i].min[j] + random_float(0.0f, ITEM_SIZE);
+        }
+    }
+
+    double begin = get_time_ms();
+    struct Bvh bvh;
+    bvh_build(&bvh, count, bounds);
+    double build_ms = get_time_ms() - begin;
+    printf("items: %u, nodes: %u, build: %.1f ms\n", count, bvh.node_count, build_ms);
+    query("built", &bvh, count, bounds, world_size, result);
+
+    // every item moves a few units, some out of the bounds of their node
+    for (uint32_t i = 0; i < count; i++) {
+        for (int j = 0; j < 3; j++) {
+            float const offset = random_float(-MOVE_SIZE, MOVE_SIZE);
+            bounds[i].min[j] += offset;
+            bounds[i].max[j] += offset;
+        }
+    }
+
+    begin = get_time_ms();
+    bvh_refit(&bvh, count, bounds);
+    double refit_ms = get_time_ms() - begin;
+    printf("  refit: %.2f ms\n", refit_ms);
+    query("refit", &bvh, count, bounds, world_size, result);
+
+    bvh_free(&bvh);
+    free(result);
+    free(bounds);
+}
+
+int
+main(void)
+{
+    srand(1);
+    run(1000);
+    run(100000);
+    run(1000000);
+
+    return EXIT_SUCCESS;
+}
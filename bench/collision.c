@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "game/collision.h"
+#include "game/io.h"
+#include "graphics/mesh.h"
+#include "graphics/vertex.h"
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+// Collision benchmark
+//   A sphere wanders with a downward pull, so that it keeps sliding along the
+//   floor and into walls, on map1 and on a generated terrain of about a
+//   million triangles. Every tick is checked to stay out of the surfaces.
+#define TICK_COUNT 100000
+#define SPEED 0.3f
+#define FALL_SPEED 0.2f
+#define TERRAIN_SIZE 708
+#define MAX_PENETRATION 0.01f
+
+struct Walk {
+    float position[3];
+    float radius;
+    float yaw;
+    float home[3];
+    float home_radius;
+};
+
+static double
+get_time_us(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000000.0 + time.tv_nsec / 1000.0;
+}
+
+static float
+get_terrain_height(float x, float z)
+{
+    return 2.0f * sinf(x * 0.1f) * cosf(z * 0.13f);
+}
+
+// Turns randomly and heads back once it strays too far from home
+static void
+step(struct Walk *walk, float delta[static 3])
+{
+    walk->yaw += (rand() / (float)RAND_MAX - 0.5f) * 0.3f;
+    float dx = walk->position[0] - walk->home[0];
+    float dz = walk->position[2] - walk->home[2];
+    if (dx * dx + dz * dz > walk->home_radius * walk->home_radius) {
+        walk->yaw = atan2f(-dz, -dx);
+    }
+
+    delta[0] = cosf(walk->yaw) * SPEED;
+    delta[1] = -FALL_SPEED;
+    delta[2] = sinf(walk->yaw) * SPEED;
+}
+
+static void
+report(char const *name, uint32_t triangle_count, double build_us, double total_us, double max_us, uint32_t penetrations)
+{
+    printf(
+        "%s: %u triangles, build: %.1f ms, move: %.2f us mean, %.2f us max, penetrations: %u\n",
+        name,
+        triangle_count,
+        build_us / 1000.0,
+        total_us / TICK_COUNT,
+        max_us,
+        penetrations
+    );
+}
+
+static void
+run_map1(void)
+{
+    FILE *file = fopen("asset/mesh/map1.vertex", "rb");
+    struct Mesh mesh;
+    if (!file || !io_load_mesh(file, &mesh)) {
+        fprintf(stderr, "asset/mesh/map1.vertex: not a mesh container of version %u\n", MESH_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+
+    double begin = get_time_us();
+    collision.init();
+    uint32_t triangle_count = 0;
+    for (uint32_t c = 0; c < mesh.chunk_count; c++) {
+        struct MeshLod const *lod = &mesh.lods[mesh.chunks[c].lod_offset];
+        uint32_t first_vertex = mesh.meshlets[lod->meshlet_offset].triangle_offset * 3;
+        collision.add_collider(lod->triangle_count * 3, &mesh.vertices[first_vertex]);
+        triangle_count += lod->triangle_count;
+    }
+    collision.build();
+    double build_us = get_time_us() - begin;
+
+    // the room has walls at x = -100 and x = 100 standing on a floor at
+    // y = -1 that ends at z = -100 and z = 100
+    struct Walk walk = {
+        .position = {0.0f, 9.5f, 0.0f},
+        .radius = 1.0f,
+        .home_radius = 120.0f,
+    };
+    double total_us = 0.0;
+    double max_us = 0.0;
+    uint32_t penetrations = 0;
+    for (uint32_t tick = 0; tick < TICK_COUNT; tick++) {
+        float delta[3];
+        step(&walk, delta);
+        float const *p = walk.position;
+        int const was_inside = fabsf(p[0]) < 100.0f && fabsf(p[2]) < 100.0f && p[1] > -1.0f;
+
+        begin = get_time_us();
+        collision.move_sphere(walk.position, walk.radius, delta);
+        double us = get_time_us() - begin;
+        total_us += us;
+        max_us = fmax(max_us, us);
+
+        // moves starting in the room may only leave it over the ends of the floor
+        float const limit = 100.0f - walk.radius + MAX_PENETRATION;
+        if (was_inside && fabsf(p[2]) < 100.0f && (p[1] < -1.0f + walk.radius - MAX_PENETRATION || fabsf(p[0]) > limit)) {
+            penetrations++;
+        }
+    }
+    report("map1", triangle_count, build_us, total_us, max_us, penetrations);
+
+    collision.deinit();
+    io_free_mesh(&mesh);
+}
+
+static void
+run_terrain(void)
+{
+    uint32_t const vertex_count = TERRAIN_SIZE * TERRAIN_SIZE * 6;
+    struct Vertex *vertices = malloc(vertex_count * sizeof *vertices);
+    uint32_t v = 0;
+    for (uint32_t z = 0; z < TERRAIN_SIZE; z++) {
+        for (uint32_t x = 0; x < TERRAIN_SIZE; x++) {
+            float const corners[4][2] = {{x, z}, {x + 1, z}, {x + 1, z + 1}, {x, z + 1}};
+            int const order[6] = {0, 2, 1, 0, 3, 2};
+            for (int k = 0; k < 6; k++) {
+                float const *corner = corners[order[k]];
+                vertices[v++].pos = (struct VertexPos) {corner[0], get_terrain_height(corner[0], corner[1]), corner[1]};
+            }
+        }
+    }
+
+    double begin = get_time_us();
+    collision.init();
+    collision.add_collider(vertex_count, vertices);
+    collision.build();
+    double build_us = get_time_us() - begin;
+
+    float const center = TERRAIN_SIZE * 0.5f;
+    struct Walk walk = {
+        .position = {center, get_terrain_height(center, center) + 5.0f, center},
+        .radius = 0.5f,
+        .home = {center, 0.0f, center},
+        .home_radius = TERRAIN_SIZE * 0.4f,
+    };
+    double total_us = 0.0;
+    double max_us = 0.0;
+    uint32_t penetrations = 0;
+    for (uint32_t tick = 0; tick < TICK_COUNT; tick++) {
+        float delta[3];
+        step(&walk, delta);
+        begin = get_time_us();
+        collision.move_sphere(walk.position, walk.radius, delta);
+        double us = get_time_us() - begin;
+        total_us += us;
+        max_us = fmax(max_us, us);
+
+        // the triangles of a cell lie between its lowest and highest corner,
+        // a center below the lowest one went through the terrain
+        float const x = floorf(walk.position[0]);
+        float const z = floorf(walk.position[2]);
+        float const lowest = fminf(
+            fminf(get_terrain_height(x, z), get_terrain_height(x + 1.0f, z)),
+            fminf(get_terrain_height(x, z + 1.0f), get_terrain_height(x + 1.0f, z + 1.0f))
+        );
+        if (walk.position[1] < lowest) {
+            penetrations++;
+        }
+    }
+    report("terrain", vertex_count / 3, build_us, total_us, max_us, penetrations);
+
+    collision.deinit();
+    free(vertices);
+}
+
+int
+main(void)
+{
+    srand(1);
+    run_map1();
+    run_terrain();
+
+    return EXIT_SUCCESS;
+}
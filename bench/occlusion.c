@@ -0,0 +1,188 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/job.h"
+#include "common/linmath.h"
+#include "game/io.h"
+#include "game/occlusion.h"
+#include "graphics/mesh.h"
+#include "graphics/vertex.h"
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+// Software occlusion benchmark on map1
+//   Occludees are the full resolution meshlets of the map and the monkey.
+//   The baseline without culling submits every triangle from every view.
+#define VIEW_COUNT 16
+#define ITERATION_COUNT 20
+
+static double
+get_time_ms(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static void
+load_mesh(char const *path, struct Mesh *mesh)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file || !io_load_mesh(file, mesh)) {
+        fprintf(stderr, "%s: not a mesh container of version %u\n", path, MESH_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+}
+
+static void
+init_box(uint32_t const count, struct Vertex const vertices[static const count], struct OcclusionBox *box)
+{
+    for (int j = 0; j < 3; j++) {
+        box->min[j] = INFINITY;
+        box->max[j] = -INFINITY;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        float const pos[3] = {vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z};
+        for (int j = 0; j < 3; j++) {
+            box->min[j] = fminf(box->min[j], pos[j]);
+            box->max[j] = fmaxf(box->max[j], pos[j]);
+        }
+    }
+}
+
+// Same tests as asset/shader/culling/cull.glsl
+static int
+is_cluster_visible(struct Meshlet const *meshlet, float frustum[static 6][4], float camera_pos[static 3])
+{
+    for (int p = 0; p < 6; p++) {
+        float distance = frustum[p][0] * meshlet->center[0] + frustum[p][1] * meshlet->center[1] + frustum[p][2] * meshlet->center[2] + frustum[p][3];
+        if (distance < -meshlet->radius) {
+            return 0;
+        }
+    }
+
+    float d[3] = {
+        meshlet->center[0] - camera_pos[0],
+        meshlet->center[1] - camera_pos[1],
+        meshlet->center[2] - camera_pos[2],
+    };
+    float axis_distance = d[0] * meshlet->cone_axis[0] + d[1] * meshlet->cone_axis[1] + d[2] * meshlet->cone_axis[2];
+
+    return axis_distance < meshlet->cone_cutoff * vec3_length(d) + meshlet->radius;
+}
+
+int
+main(void)
+{
+    jobs.init();
+    occlusion.init();
+
+    struct Mesh meshes[2];
+    load_mesh("asset/mesh/map1.vertex", &meshes[0]);
+    load_mesh("asset/mesh/monkey.vertex", &meshes[1]);
+
+    uint32_t box_count = 0;
+    uint32_t occluder_triangle_count = 0;
+    for (int i = 0; i < 2; i++) {
+        for (uint32_t c = 0; c < meshes[i].chunk_count; c++) {
+            struct MeshLod const *lod = &meshes[i].lods[meshes[i].chunks[c].lod_offset];
+            if (meshes[i].flags & MESH_FLAG_OCCLUDER) {
+                uint32_t first_vertex = meshes[i].meshlets[lod->meshlet_offset].triangle_offset * 3;
+                occlusion.add_occluder(lod->triangle_count * 3, &meshes[i].vertices[first_vertex]);
+                occluder_triangle_count += lod->triangle_count;
+            }
+            box_count += lod->meshlet_count;
+        }
+    }
+
+    struct OcclusionBox *boxes = malloc(box_count * sizeof *boxes);
+    uint32_t *box_triangle_count = malloc(box_count * sizeof *box_triangle_count);
+    uint8_t *visible = malloc(box_count);
+    struct Meshlet const **box_meshlet = malloc(box_count * sizeof *box_meshlet);
+    uint32_t box = 0;
+    for (int i = 0; i < 2; i++) {
+        for (uint32_t c = 0; c < meshes[i].chunk_count; c++) {
+            struct MeshLod const *lod = &meshes[i].lods[meshes[i].chunks[c].lod_offset];
+            for (uint32_t m = lod->meshlet_offset; m < lod->meshlet_offset + lod->meshlet_count; m++) {
+                struct Meshlet const *meshlet = &meshes[i].meshlets[m];
+                init_box(meshlet->triangle_count * 3, &meshes[i].vertices[meshlet->triangle_offset * 3], &boxes[box]);
+                box_triangle_count[box] = meshlet->triangle_count;
+                box_meshlet[box] = meshlet;
+                box++;
+            }
+        }
+    }
+
+    float proj[4][4];
+    mat4_perspective(proj, 16.0f/9.0f, 90.0f * M_PI / 180.0f, 0.01f, 1000.0f);
+
+    printf("threads: %u, occluder triangles: %u, occludees: %u\n", jobs.get_thread_count(), occluder_triangle_count, box_count);
+
+    double render_ms = 0.0;
+    double test_ms = 0.0;
+    uint64_t total_triangles = 0;
+    uint64_t drawn_triangles = 0;
+    uint64_t culled_boxes = 0;
+    uint64_t cluster_drawn_triangles = 0;
+    for (uint32_t view = 0; view < VIEW_COUNT; view++) {
+        float yaw = view * 2.0f * M_PI / VIEW_COUNT;
+        float camera_pos[3] = {0.0f, 9.5f, 0.0f};
+        float view_matrix[4][4];
+        float view_proj[4][4];
+        mat4_view(view_matrix, camera_pos, cosf(yaw), sinf(yaw), 1.0f, 0.0f);
+        mat4_mul(view_proj, view_matrix, proj);
+        float frustum[6][4];
+        mat4_frustum(frustum, view_proj);
+
+        for (uint32_t iteration = 0; iteration < ITERATION_COUNT; iteration++) {
+            double begin = get_time_ms();
+            occlusion.render(view_proj);
+            double middle = get_time_ms();
+            occlusion.test(box_count, boxes, visible);
+            double end = get_time_ms();
+            render_ms += middle - begin;
+            test_ms += end - middle;
+        }
+
+        for (uint32_t i = 0; i < box_count; i++) {
+            total_triangles += box_triangle_count[i];
+            drawn_triangles += visible[i] ? box_triangle_count[i] : 0;
+            culled_boxes += !visible[i];
+            cluster_drawn_triangles += is_cluster_visible(box_meshlet[i], frustum, camera_pos) ? box_triangle_count[i] : 0;
+        }
+    }
+
+    uint32_t sample_count = VIEW_COUNT * ITERATION_COUNT;
+    printf("render: %.3f ms, test: %.3f ms per view\n", render_ms / sample_count, test_ms / sample_count);
+    printf(
+        "no culling: %" PRIu64 " triangles, occlusion: %" PRIu64 " triangles (%.1f%%), culled occludees: %.1f%%\n",
+        total_triangles,
+        drawn_triangles,
+        100.0 * drawn_triangles / total_triangles,
+        100.0 * culled_boxes / (VIEW_COUNT * box_count)
+    );
+    printf(
+        "frustum and cone: %" PRIu64 " triangles (%.1f%%)\n",
+        cluster_drawn_triangles,
+        100.0 * cluster_drawn_triangles / total_triangles
+    );
+
+    free(box_meshlet);
+    free(visible);
+    free(box_triangle_count);
+    free(boxes);
+    io_free_mesh(&meshes[1]);
+    io_free_mesh(&meshes[0]);
+    occlusion.deinit();
+    jobs.deinit();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,244 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/job.h"
+#include "game/io.h"
+#include "game/pvs.h"
+#include "game/raycast.h"
+#include "graphics/mesh.h"
+#include "graphics/vertex.h"
+
+// PVS benchmark
+//   Looks up the cell of random camera positions in and around the grid of
+//   each mesh with potentially visible sets and unpacks its row, as the game
+//   does every frame. Then casts segments from random cameras inside the grid
+//   to random points of every chunk. A chunk that one of them reaches must be
+//   in the row of the camera's cell, and the two closed rooms of rooms.vertex
+//   must hide some chunks behind their partition.
+#define LOOKUP_COUNT 1000000
+#define CAMERA_COUNT 256
+#define SAMPLE_COUNT 16
+
+struct Scene {
+    uint32_t vertex_count;
+    struct Vertex *vertices;
+    // chunk of every level 0 triangle, and the first one of every chunk
+    uint32_t *triangle_chunks;
+    uint32_t *chunk_triangles;
+};
+
+static double
+get_time_us(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000000.0 + time.tv_nsec / 1000.0;
+}
+
+static float
+random_float(float const min, float const max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static void
+measure_lookup(char const *path, struct Mesh const *mesh)
+{
+    // a tenth of the positions fall outside of the grid
+    float (*positions)[3] = malloc(LOOKUP_COUNT * sizeof *positions);
+    for (uint32_t i = 0; i < LOOKUP_COUNT; i++) {
+        for (int j = 0; j < 3; j++) {
+            float const size = mesh->pvs->cell_size * mesh->pvs->cell_count[j];
+            positions[i][j] = mesh->pvs->origin[j] + random_float(-0.05f * size, 1.05f * size);
+        }
+    }
+
+    uint8_t *visible = malloc(mesh->chunk_count);
+    uint64_t visible_count = 0;
+    double begin = get_time_us();
+    for (uint32_t i = 0; i < LOOKUP_COUNT; i++) {
+        pvs_get_visible_chunks(mesh, pvs_find_cell(mesh, positions[i]), visible);
+        visible_count += visible[i % mesh->chunk_count];
+    }
+    double us = get_time_us() - begin;
+
+    printf(
+        "%s: %u cells, %u bytes of rows, lookup: %.3f us, %.1f%% of chunks visible\n",
+        path,
+        mesh->pvs_cell_count,
+        mesh->pvs_data_size,
+        us / LOOKUP_COUNT,
+        100.0 * visible_count / LOOKUP_COUNT
+    );
+
+    free(visible);
+    free(positions);
+}
+
+// Gathers the level 0 triangles of every chunk for the ray casts
+static void
+load_scene(struct Mesh const *mesh, struct Scene *scene)
+{
+    scene->vertex_count = 0;
+    scene->vertices = malloc(mesh->vertex_count * sizeof *scene->vertices);
+    scene->triangle_chunks = malloc(mesh->vertex_count / 3 * sizeof *scene->triangle_chunks);
+    scene->chunk_triangles = malloc((mesh->chunk_count + 1) * sizeof *scene->chunk_triangles);
+    for (uint32_t c = 0; c < mesh->chunk_count; c++) {
+        struct MeshLod const *lod = &mesh->lods[mesh->chunks[c].lod_offset];
+        uint32_t first_vertex = mesh->meshlets[lod->meshlet_offset].triangle_offset * 3;
+        scene->chunk_triangles[c] = scene->vertex_count / 3;
+        for (uint32_t i = 0; i < lod->triangle_count * 3; i++) {
+            scene->triangle_chunks[scene->vertex_count / 3] = c;
+            scene->vertices[scene->vertex_count++] = mesh->vertices[first_vertex + i];
+        }
+    }
+    scene->chunk_triangles[mesh->chunk_count] = scene->vertex_count / 3;
+
+    raycast.init();
+    raycast.add_geometry(scene->vertex_count, scene->vertices);
+    raycast.build();
+}
+
+static void
+free_scene(struct Scene *scene)
+{
+    raycast.deinit();
+    free(scene->chunk_triangles);
+    free(scene->triangle_chunks);
+    free(scene->vertices);
+}
+
+// Segments from camera to random points of every chunk, SAMPLE_COUNT per
+// chunk
+static void
+setup_rays(struct Scene const *scene, uint32_t const chunk_count, float const camera[static 3], struct Ray rays[static const chunk_count * SAMPLE_COUNT])
+{
+    for (uint32_t c = 0; c < chunk_count; c++) {
+        uint32_t const first = scene->chunk_triangles[c];
+        uint32_t const count = scene->chunk_triangles[c + 1] - first;
+        for (uint32_t s = 0; s < SAMPLE_COUNT; s++) {
+            struct Vertex const *triangle = &scene->vertices[(first + (uint32_t)rand() % count) * 3];
+            float u = random_float(0.0f, 1.0f);
+            float v = random_float(0.0f, 1.0f);
+            if (u + v > 1.0f) {
+                u = 1.0f - u;
+                v = 1.0f - v;
+            }
+            float const target[3] = {
+                triangle[0].pos.x + u * (triangle[1].pos.x - triangle[0].pos.x) + v * (triangle[2].pos.x - triangle[0].pos.x),
+                triangle[0].pos.y + u * (triangle[1].pos.y - triangle[0].pos.y) + v * (triangle[2].pos.y - triangle[0].pos.y),
+                triangle[0].pos.z + u * (triangle[1].pos.z - triangle[0].pos.z) + v * (triangle[2].pos.z - triangle[0].pos.z),
+            };
+            rays[c * SAMPLE_COUNT + s] = (struct Ray) {
+                .origin = {camera[0], camera[1], camera[2]},
+                .direction = {target[0] - camera[0], target[1] - camera[1], target[2] - camera[2]},
+                .max_distance = 1.0f,
+            };
+        }
+    }
+}
+
+// Counts the chunks some segment reaches that the row of their cell leaves
+// out, and the chunks no segment reaches that it leaves out. A segment
+// reaches its chunk when the first triangle it hits belongs to it, or when
+// it stops short of its target triangle.
+static void
+check(char const *path, struct Mesh const *mesh, bool const is_culling_expected)
+{
+    struct Scene scene;
+    load_scene(mesh, &scene);
+    uint32_t const ray_count = mesh->chunk_count * SAMPLE_COUNT;
+    struct Ray *rays = malloc(ray_count * sizeof *rays);
+    struct RayHit *hits = malloc(ray_count * sizeof *hits);
+    uint8_t *visible = malloc(mesh->chunk_count);
+
+    uint32_t seen_count = 0;
+    uint32_t hidden_count = 0;
+    uint32_t wrongly_culled_count = 0;
+    uint32_t culled_count = 0;
+    for (uint32_t i = 0; i < CAMERA_COUNT; i++) {
+        float camera[3];
+        for (int j = 0; j < 3; j++) {
+            camera[j] = mesh->pvs->origin[j] + random_float(0.0f, mesh->pvs->cell_size * mesh->pvs->cell_count[j]);
+        }
+        pvs_get_visible_chunks(mesh, pvs_find_cell(mesh, camera), visible);
+        setup_rays(&scene, mesh->chunk_count, camera, rays);
+        raycast.cast(ray_count, rays, hits);
+
+        for (uint32_t c = 0; c < mesh->chunk_count; c++) {
+            bool is_seen = false;
+            for (uint32_t s = 0; s < SAMPLE_COUNT; s++) {
+                struct RayHit const *hit = &hits[c * SAMPLE_COUNT + s];
+                is_seen |= hit->triangle == RAYCAST_MISS || scene.triangle_chunks[hit->triangle] == c;
+            }
+            if (is_seen) {
+                seen_count++;
+                wrongly_culled_count += !visible[c];
+            } else {
+                hidden_count++;
+                culled_count += !visible[c];
+            }
+        }
+    }
+
+    printf(
+        "  %u cameras: %u seen chunks, %u culled, %u hidden chunks, %u culled\n",
+        CAMERA_COUNT,
+        seen_count,
+        wrongly_culled_count,
+        hidden_count,
+        culled_count
+    );
+
+    free(visible);
+    free(hits);
+    free(rays);
+    free_scene(&scene);
+    if (wrongly_culled_count) {
+        fprintf(stderr, "%s: chunks in sight were culled\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (is_culling_expected && !culled_count) {
+        fprintf(stderr, "%s: no hidden chunk was culled\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+run(char const *path, bool const is_culling_expected)
+{
+    FILE *file = fopen(path, "rb");
+    struct Mesh mesh;
+    if (!file || !io_load_mesh(file, &mesh)) {
+        fprintf(stderr, "%s: not a mesh container of version %u\n", path, MESH_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    if (!mesh.pvs) {
+        fprintf(stderr, "%s: no potentially visible sets\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    measure_lookup(path, &mesh);
+    check(path, &mesh, is_culling_expected);
+    io_free_mesh(&mesh);
+}
+
+int
+main(void)
+{
+    srand(1);
+    jobs.init();
+
+    // map1 is open to the sky and hides nothing, the rooms hide each other
+    run("asset/mesh/map1.vertex", false);
+    run("asset/mesh/rooms.vertex", true);
+
+    jobs.deinit();
+
+    return EXIT_SUCCESS;
+}
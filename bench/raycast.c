@@ -0,0 +1,300 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/job.h"
+#include "game/io.h"
+#include "game/raycast.h"
+#include "graphics/mesh.h"
+#include "graphics/vertex.h"
+
+// Ray casting benchmark
+//   Casts a tiled image of primary rays from a camera and as many rays from
+//   random points in random directions on map1 and monkey. A sample of both
+//   is checked against brute force, and rays from the center of the closed
+//   cube through every vertex and edge of it must never leak out.
+#define IMAGE_SIZE 1024
+#define TILE_WIDTH 4
+#define TILE_HEIGHT 2
+#define REPEAT_COUNT 8
+#define CHECK_COUNT 2048
+#define MAX_DISTANCE 1e30f
+#define MAX_MISMATCH_RATIO 0.001
+
+struct Scene {
+    uint32_t vertex_count;
+    struct Vertex *vertices;
+    float min[3];
+    float max[3];
+};
+
+static double
+get_time_ms(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+static float
+random_float(float const min, float const max)
+{
+    return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// Gathers the level 0 triangles of every chunk
+static void
+load_scene(char const *path, struct Scene *scene)
+{
+    FILE *file = fopen(path, "rb");
+    struct Mesh mesh;
+    if (!file || !io_load_mesh(file, &mesh)) {
+        fprintf(stderr, "%s: not a mesh container of version %u\n", path, MESH_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+
+    scene->vertex_count = 0;
+    scene->vertices = malloc(mesh.vertex_count * sizeof *scene->vertices);
+    for (int j = 0; j < 3; j++) {
+        scene->min[j] = INFINITY;
+        scene->max[j] = -INFINITY;
+    }
+    for (uint32_t c = 0; c < mesh.chunk_count; c++) {
+        struct MeshLod const *lod = &mesh.lods[mesh.chunks[c].lod_offset];
+        uint32_t first_vertex = mesh.meshlets[lod->meshlet_offset].triangle_offset * 3;
+        for (uint32_t i = 0; i < lod->triangle_count * 3; i++) {
+            scene->vertices[scene->vertex_count++] = mesh.vertices[first_vertex + i];
+        }
+        for (int j = 0; j < 3; j++) {
+            scene->min[j] = fminf(scene->min[j], mesh.chunks[c].min[j]);
+            scene->max[j] = fmaxf(scene->max[j], mesh.chunks[c].max[j]);
+        }
+    }
+    io_free_mesh(&mesh);
+
+    raycast.init();
+    raycast.add_geometry(scene->vertex_count, scene->vertices);
+    raycast.build();
+}
+
+static void
+free_scene(struct Scene *scene)
+{
+    raycast.deinit();
+    free(scene->vertices);
+}
+
+// Two sided Moeller-Trumbore in double
+static int
+intersect_reference(struct Ray const *ray, struct Vertex const vertices[static 3], double *t)
+{
+    double const p0[3] = {vertices[0].pos.x, vertices[0].pos.y, vertices[0].pos.z};
+    double const p1[3] = {vertices[1].pos.x, vertices[1].pos.y, vertices[1].pos.z};
+    double const p2[3] = {vertices[2].pos.x, vertices[2].pos.y, vertices[2].pos.z};
+    double e1[3], e2[3], s[3];
+    for (int j = 0; j < 3; j++) {
+        e1[j] = p1[j] - p0[j];
+        e2[j] = p2[j] - p0[j];
+        s[j] = ray->origin[j] - p0[j];
+    }
+    double const *d = (double[3]) {ray->direction[0], ray->direction[1], ray->direction[2]};
+    double const h[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+    double const det = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+    if (det == 0.0) {
+        return 0;
+    }
+    double const u = (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]) / det;
+    double const q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+    double const v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+    double const distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+    if (u < 0.0 || v < 0.0 || u + v > 1.0 || distance < 0.0 || distance >= *t) {
+        return 0;
+    }
+
+    *t = distance;
+    return 1;
+}
+
+// Counts sampled rays whose closest hit differs from brute force, rays
+// grazing an edge may pick either triangle but never another distance
+static uint32_t
+check(struct Scene const *scene, uint32_t const count, struct Ray const rays[static const count], struct RayHit const hits[static const count])
+{
+    uint32_t mismatches = 0;
+    for (uint32_t c = 0; c < CHECK_COUNT; c++) {
+        uint32_t const r = (uint32_t)rand() % count;
+        double t = rays[r].max_distance;
+        int is_hit = 0;
+        for (uint32_t i = 0; i + 2 < scene->vertex_count; i += 3) {
+            is_hit |= intersect_reference(&rays[r], &scene->vertices[i], &t);
+        }
+
+        if (is_hit != (hits[r].triangle != RAYCAST_MISS) || (is_hit && fabs(t - hits[r].distance) > 1e-4 * fmax(t, 1.0))) {
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+static void
+run(char const *name, struct Scene const *scene, uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count])
+{
+    raycast.cast(count, rays, hits);
+    double begin = get_time_ms();
+    for (uint32_t i = 0; i < REPEAT_COUNT; i++) {
+        raycast.cast(count, rays, hits);
+    }
+    double ms = (get_time_ms() - begin) / REPEAT_COUNT;
+
+    uint32_t hit_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        hit_count += hits[i].triangle != RAYCAST_MISS;
+    }
+    uint32_t mismatches = check(scene, count, rays, hits);
+    printf(
+        "  %s: %.1f Mrays/s, %.1f%% hit, mismatches: %u/%u\n",
+        name,
+        count / ms / 1000.0,
+        100.0 * hit_count / count,
+        mismatches,
+        CHECK_COUNT
+    );
+    if (mismatches > CHECK_COUNT * MAX_MISMATCH_RATIO) {
+        fprintf(stderr, "%s: too many rays disagree with brute force\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Primary rays of a square image with a 90 degree field of view looking
+// along z, ordered in tiles so that a packet covers neighbouring pixels
+static void
+setup_primary_rays(float const camera[static 3], struct Ray rays[static IMAGE_SIZE * IMAGE_SIZE])
+{
+    uint32_t const tiles_per_row = IMAGE_SIZE / TILE_WIDTH;
+    for (uint32_t i = 0; i < IMAGE_SIZE * IMAGE_SIZE; i++) {
+        uint32_t const tile = i / (TILE_WIDTH * TILE_HEIGHT);
+        uint32_t const lane = i % (TILE_WIDTH * TILE_HEIGHT);
+        uint32_t const x = tile % tiles_per_row * TILE_WIDTH + lane % TILE_WIDTH;
+        uint32_t const y = tile / tiles_per_row * TILE_HEIGHT + lane / TILE_WIDTH;
+        rays[i] = (struct Ray) {
+            .origin = {camera[0], camera[1], camera[2]},
+            .direction = {
+                2.0f * (x + 0.5f) / IMAGE_SIZE - 1.0f,
+                1.0f - 2.0f * (y + 0.5f) / IMAGE_SIZE,
+                1.0f,
+            },
+            .max_distance = MAX_DISTANCE,
+        };
+    }
+}
+
+static void
+setup_random_rays(struct Scene const *scene, uint32_t const count, struct Ray rays[static const count])
+{
+    for (uint32_t i = 0; i < count; i++) {
+        float direction[3];
+        float length;
+        do {
+            for (int j = 0; j < 3; j++) {
+                direction[j] = random_float(-1.0f, 1.0f);
+            }
+            length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+        } while (length < 0.1f || length > 1.0f);
+
+        for (int j = 0; j < 3; j++) {
+            rays[i].origin[j] = random_float(scene->min[j], scene->max[j]);
+            rays[i].direction[j] = direction[j] / length;
+        }
+        rays[i].max_distance = MAX_DISTANCE;
+    }
+}
+
+static void
+run_scene(char const *path, float const camera[static 3])
+{
+    uint32_t const count = IMAGE_SIZE * IMAGE_SIZE;
+    struct Ray *rays = malloc(count * sizeof *rays);
+    struct RayHit *hits = malloc(count * sizeof *hits);
+    struct Scene scene;
+    double begin = get_time_ms();
+    load_scene(path, &scene);
+    printf("%s: %u triangles, load and build: %.1f ms\n", path, scene.vertex_count / 3, get_time_ms() - begin);
+
+    setup_primary_rays(camera, rays);
+    run("primary", &scene, count, rays, hits);
+    setup_random_rays(&scene, count, rays);
+    run("random", &scene, count, rays, hits);
+
+    free_scene(&scene);
+    free(hits);
+    free(rays);
+}
+
+// Every ray from inside a closed mesh hits it, also through its edges and
+// vertices where a test that is not watertight lets some of them slip out
+static void
+run_watertight(void)
+{
+    struct Scene scene;
+    load_scene("asset/mesh/cube.vertex", &scene);
+    uint32_t const count = scene.vertex_count * 2;
+    struct Ray *rays = malloc(count * sizeof *rays);
+    struct RayHit *hits = malloc(count * sizeof *hits);
+    float center[3];
+    for (int j = 0; j < 3; j++) {
+        center[j] = (scene.min[j] + scene.max[j]) * 0.5f;
+    }
+
+    for (uint32_t i = 0; i < scene.vertex_count; i++) {
+        struct VertexPos const *a = &scene.vertices[i].pos;
+        struct VertexPos const *b = &scene.vertices[i / 3 * 3 + (i + 1) % 3].pos;
+        float const targets[2][3] = {
+            {a->x, a->y, a->z},
+            {(a->x + b->x) * 0.5f, (a->y + b->y) * 0.5f, (a->z + b->z) * 0.5f},
+        };
+        for (int k = 0; k < 2; k++) {
+            rays[i * 2 + k] = (struct Ray) {
+                .origin = {center[0], center[1], center[2]},
+                .direction = {targets[k][0] - center[0], targets[k][1] - center[1], targets[k][2] - center[2]},
+                .max_distance = MAX_DISTANCE,
+            };
+        }
+    }
+    raycast.cast(count, rays, hits);
+
+    uint32_t leaks = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        leaks += hits[i].triangle == RAYCAST_MISS;
+    }
+    printf("asset/mesh/cube.vertex: %u rays through vertices and edges, leaks: %u\n", count, leaks);
+
+    free(hits);
+    free(rays);
+    free_scene(&scene);
+    if (leaks) {
+        fprintf(stderr, "rays leaked out of the closed cube\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int
+main(void)
+{
+    srand(1);
+    jobs.init();
+    printf("threads: %u\n", jobs.get_thread_count());
+
+    run_watertight();
+    // map1 is seen from where the game starts, monkey from in front of it
+    run_scene("asset/mesh/map1.vertex", (float[3]) {0.0f, 9.5f, 0.0f});
+    run_scene("asset/mesh/monkey.vertex", (float[3]) {-38.6f, 14.8f, -22.0f});
+
+    jobs.deinit();
+
+    return EXIT_SUCCESS;
+}
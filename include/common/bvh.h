@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BVH_MAX_DEPTH 64
+
+struct BvhBounds {
+    float min[3];
+    float max[3];
+};
+
+// Nodes are stored depth first, so the left child of an inner node directly
+// follows it and right_or_first holds the right child. A leaf holds count
+// items from items[right_or_first], inner nodes have a count of 0.
+struct BvhNode {
+    float min[3];
+    uint32_t right_or_first;
+    float max[3];
+    uint32_t count;
+};
+
+// items maps leaf slots back to the caller's indices and item_bounds holds
+// their bounds in leaf order
+struct Bvh {
+    uint32_t node_count;
+    struct BvhNode *nodes;
+    uint32_t item_count;
+    uint32_t *items;
+    struct BvhBounds *item_bounds;
+};
+
+// Builds with the surface area heuristic over binned centroids
+void
+bvh_build(struct Bvh *bvh, uint32_t const count, struct BvhBounds const bounds[static const count]);
+
+void
+bvh_free(struct Bvh *bvh);
+
+// Updates the nodes to new bounds of the same items without changing the tree,
+// queries stay correct but slow down as the items move away from their build
+void
+bvh_refit(struct Bvh *bvh, uint32_t const count, struct BvhBounds const bounds[static const count]);
+
+// The queries write the indices of matching items to result, which has room
+// for every item, and return how many there are. Planes follow mat4_frustum.
+uint32_t
+bvh_query_frustum(struct Bvh const *bvh, float planes[static 6][4], uint32_t result[]);
+
+uint32_t
+bvh_query_range(struct Bvh const *bvh, struct BvhBounds const *range, uint32_t result[]);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#define JOB_MAX_NODES 64
+
+typedef void (*JobFunction)(void *data, uint32_t index);
+
+// A step of a job graph, called with its own index once the nodes in its
+// dependency mask have finished. Nodes only depend on earlier nodes.
+struct JobNode {
+    char const *name;
+    JobFunction function;
+    void *data;
+    uint64_t dependencies;
+    // runs on the thread calling run_graph, for work bound to that thread
+    int is_on_caller;
+    // set by run_graph, in microseconds since it started
+    double begin_us;
+    double end_us;
+};
+
+struct Jobs {
+    void (*init)(void);
+    void (*deinit)(void);
+    uint32_t (*get_thread_count)(void);
+    void (*parallel_for)(uint32_t count, JobFunction function, void *data);
+    // Runs independent nodes concurrently and returns once all of them
+    // have finished. Nodes must not call parallel_for or run_graph.
+    void (*run_graph)(uint32_t count, struct JobNode nodes[static count]);
+};
+
+extern const struct Jobs jobs;
@@ -6,6 +6,9 @@ void vec3_normalize(float v[static 3]);
 void vec3_cross(float v[static 3], float a[static 3], float b[static 3]);
 float vec3_dot(float a[static 3], float b[static 3]);
 
+void vec4_mul_mat4(float v[static 4], float a[static 4], float m[static 4][4]);
+
 void mat4_mul(float m[4][4], float a[4][4], float b[4][4]);
 void mat4_view(float m[static 4][4], float pos[static 3], float cos_yaw, float sin_yaw, float cos_pitch, float sin_pitch);
 void mat4_perspective(float m[static 4][4], float aspect, float fovy, float n, float f);
+void mat4_frustum(float planes[static 6][4], float m[static 4][4]);
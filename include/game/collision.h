@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "graphics/vertex.h"
+
+struct Collision {
+    void (*init)(void);
+    void (*deinit)(void);
+    // Copies the triangles of a vertex soup, build makes them collide
+    void (*add_collider)(uint32_t const count, struct Vertex const vertices[static const count]);
+    void (*build)(void);
+    // Moves a sphere by delta, sliding along the triangles in its way
+    void (*move_sphere)(float position[static 3], float const radius, float const delta[static 3]);
+};
+
+extern const struct Collision collision;
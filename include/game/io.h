@@ -3,10 +3,11 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include <graphics/mesh.h>
 #include <graphics/vertex.h>
 
-void
-io_get_triangle_count(FILE *file, uint32_t *count);
+int
+io_load_mesh(FILE *file, struct Mesh *mesh);
 
 void
-io_load_mesh(FILE *file, uint32_t *count, struct Vertex *vertices);
+io_free_mesh(struct Mesh *mesh);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "graphics/vertex.h"
+
+struct OcclusionBox {
+    float min[3];
+    float max[3];
+};
+
+struct Occlusion {
+    void (*init)(void);
+    void (*deinit)(void);
+    void (*add_occluder)(uint32_t const count, struct Vertex const vertices[static const count]);
+    void (*render)(float view_proj[static 4][4]);
+    void (*test)(
+        uint32_t const count,
+        struct OcclusionBox const boxes[static const count],
+        uint8_t visible[static const count]);
+};
+
+extern const struct Occlusion occlusion;
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "graphics/mesh.h"
+
+#define PVS_NO_CELL UINT32_MAX
+
+// Returns the cell holding position, or PVS_NO_CELL when the mesh has no
+// potentially visible sets or position lies outside of their grid
+uint32_t
+pvs_find_cell(struct Mesh const *mesh, float const position[static 3]);
+
+// Writes one byte per chunk of the mesh, 1 when the chunk may be visible from
+// cell. Every chunk may be visible from PVS_NO_CELL.
+void
+pvs_get_visible_chunks(struct Mesh const *mesh, uint32_t const cell, uint8_t visible[]);
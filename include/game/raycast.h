@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "graphics/vertex.h"
+
+#define RAYCAST_MISS UINT32_MAX
+
+// Hits lie at origin + direction * distance, so the direction needs no
+// normalizing but must not be zero
+struct Ray {
+    float origin[3];
+    float direction[3];
+    float max_distance;
+};
+
+// triangle counts the triangles of every add_geometry call in order, it is
+// RAYCAST_MISS and distance stays max_distance when nothing was hit. u and v
+// weigh the second and the third vertex of the triangle.
+struct RayHit {
+    float distance;
+    uint32_t triangle;
+    float u;
+    float v;
+};
+
+struct Raycast {
+    void (*init)(void);
+    void (*deinit)(void);
+    // Copies the triangles of a vertex soup, build makes them hittable
+    void (*add_geometry)(uint32_t const count, struct Vertex const vertices[static const count]);
+    void (*build)(void);
+    // Finds the closest hit of every ray across the job threads. Neighbouring
+    // rays travel together and are fastest when they point the same way.
+    void (*cast)(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count]);
+};
+
+extern const struct Raycast raycast;
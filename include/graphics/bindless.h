@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <volk/volk.h>
+
+#define BINDLESS_MAX_BUFFERS 4096
+#define BINDLESS_BUFFER_BINDING 0
+
+// One descriptor set holding every storage buffer the shaders reach by index,
+// bound once per pass instead of a set per resource. The array is update
+// after bind and partially bound, so slots are written while the set is in
+// use by frames in flight, as long as those frames do not read them. Only
+// buffers are bound so far, the layout leaves room for an image binding
+// next to them.
+struct Bindless {
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    uint32_t buffer_capacity;
+    uint32_t buffer_count;
+};
+
+// Needs the descriptor indexing features of the capabilities
+void
+bindless_init(struct Bindless *bindless, VkDevice const device, VkPhysicalDevice const physical_device);
+
+// Reserves the index of a buffer, so that it can go into data uploaded
+// before the buffer exists
+uint32_t
+bindless_add_buffer(struct Bindless *bindless);
+
+void
+bindless_write_buffer(struct Bindless const *bindless, VkDevice const device, uint32_t const index, VkBuffer const buffer);
+
+void
+bindless_destroy(struct Bindless *bindless, VkDevice const device);
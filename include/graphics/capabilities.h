@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <volk/volk.h>
+
+#include "graphics/vulkan_ext.h"
+
+#define CAPABILITIES_MAX_EXTENSIONS 16
+
+// The optional fast paths of a device. Query fills in what the device
+// supports, the renderer may clear what it does not want before enable
+// builds the extension list and feature chain for device creation from
+// what is left. The rest of the renderer branches on the flags.
+struct Capabilities {
+    // the lower of the instance and the device version
+    uint32_t api_version;
+    VkBool32 is_swapchain;
+    VkBool32 is_timeline_semaphore;
+    VkBool32 is_dynamic_rendering;
+    VkBool32 is_mesh_shading;
+    VkBool32 is_descriptor_indexing;
+    VkBool32 is_memory_budget;
+    VkBool32 is_present_wait;
+    // the supported core features, after enable those to enable
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features;
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features;
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features;
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features;
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features;
+    // set by enable
+    uint32_t extension_count;
+    char const *extensions[CAPABILITIES_MAX_EXTENSIONS];
+    void *next;
+};
+
+void
+capabilities_query(struct Capabilities *capabilities, uint32_t const instance_version, VkPhysicalDevice const gpu);
+
+// The chain points into the capabilities, so they must not be copied
+// between enable and device creation
+void
+capabilities_enable(struct Capabilities *capabilities);
+
+void
+capabilities_log(struct Capabilities const *capabilities);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <volk/volk.h>
+
+#define DESCRIPTOR_ALLOCATOR_MAX_FRAMES 4
+#define DESCRIPTOR_ALLOCATOR_MAX_POOLS 16
+
+// What one binding of a set refers to, a buffer or an image by its type
+struct DescriptorWrite {
+    uint32_t binding;
+    VkDescriptorType type;
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo image;
+};
+
+// Pools allocated from in turn, every pool holds twice the sets of the one
+// before it. Sets are never freed one by one, so allocating is a pointer
+// bump in the pool, and the whole chain is reset at once.
+struct DescriptorPoolChain {
+    uint32_t pool_count;
+    uint32_t current;
+    VkDescriptorPool pools[DESCRIPTOR_ALLOCATOR_MAX_POOLS];
+};
+
+struct DescriptorCacheEntry {
+    uint64_t hash;
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+    uint32_t write_count;
+    struct DescriptorWrite *writes;
+};
+
+// Sets of a frame in flight are allocated from its chain and live until the
+// frame comes around again. Immutable sets are cached by their layout and
+// what they refer to, found by hash and told apart by their writes, so that
+// asking for the same set twice returns the one written the first time.
+// They live until the cache is cleared.
+struct DescriptorAllocator {
+    uint32_t frame_count;
+    struct DescriptorPoolChain frames[DESCRIPTOR_ALLOCATOR_MAX_FRAMES];
+    struct DescriptorPoolChain cache_pools;
+    uint32_t cache_count;
+    uint32_t cache_capacity;
+    struct DescriptorCacheEntry *cache_entries;
+};
+
+void
+descriptor_allocator_init(struct DescriptorAllocator *allocator, uint32_t const frame_count);
+
+// The frame must be done on the device, its sets are invalid afterwards
+void
+descriptor_allocator_reset_frame(struct DescriptorAllocator *allocator, VkDevice const device, uint32_t const frame);
+
+// Allocates a set from the chain of the frame and writes it
+VkDescriptorSet
+descriptor_allocator_allocate(
+    struct DescriptorAllocator *allocator,
+    VkDevice const device,
+    uint32_t const frame,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count]);
+
+VkDescriptorSet
+descriptor_allocator_get_set(
+    struct DescriptorAllocator *allocator,
+    VkDevice const device,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count]);
+
+// The cached sets must not be in use on the device
+void
+descriptor_allocator_clear_cache(struct DescriptorAllocator *allocator, VkDevice const device);
+
+void
+descriptor_allocator_destroy(struct DescriptorAllocator *allocator, VkDevice const device);
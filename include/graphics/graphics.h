@@ -9,11 +9,106 @@ struct UBO {
     float proj[4][4];
 };
 
+enum DrawObjectFlag {
+    // drawn without back-face culling, for meshes of unverified winding
+    DRAW_OBJECT_FLAG_DOUBLE_SIDED = 1 << 0,
+};
+
+// A culling unit drawn from the map vertex buffer, laid out to match the
+// std430 DrawObject struct in the culling shaders. The cone follows the
+// struct Meshlet convention. The mesh shader path reads its local triangles
+// from first_vertex / 3 and its vertices from meshlet_vertex_offset.
+// Objects of one instance share its lod sphere and carry the error of their
+// level and of the next coarser one, INFINITY for the coarsest.
+struct DrawObject {
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t meshlet_vertex_offset;
+    uint32_t meshlet_vertex_count;
+    float lod_center[3];
+    float lod_radius;
+    float lod_error;
+    float coarser_lod_error;
+    uint32_t flags;
+    // set by load_map, the bindless index of the buffer holding the vertices
+    uint32_t vertex_buffer;
+};
+
+// Map wide meshlet tables for the mesh shader path, meshlet vertices index
+// the positions and triangles are in the order of the vertex buffer. Every
+// triangle has its baked color packed as RGBA8.
+struct MeshletData {
+    uint32_t position_count;
+    struct VertexPos const *positions;
+    uint32_t meshlet_vertex_count;
+    uint32_t const *meshlet_vertices;
+    uint32_t meshlet_triangle_count;
+    uint32_t const *meshlet_triangles;
+    uint32_t const *triangle_colors;
+};
+
+// Lights beyond this are ignored by set_lights
+#define GRAPHICS_MAX_LIGHTS 1024
+
+// A point light, laid out to match the std430 Light struct of
+// asset/shader/lighting/light.glsl. It fades out to nothing at radius.
+struct Light {
+    float position[3];
+    float radius;
+    float color[3];
+    float intensity;
+};
+
+// Tunables of the shading pipelines. They are specialization constants, so
+// changing them creates pipeline variants rather than adding uniform reads.
+struct Shading {
+    float baked_light_scale;
+    float dynamic_light_scale;
+    // without it fragments only take the lighting baked into the meshes
+    int is_dynamic_lighting;
+};
+
+// Objects count every level of every instance. Only the objects of the
+// selected levels are tested, and culled ones failed the frustum, cone or
+// occlusion test.
+struct FrameStats {
+    uint32_t object_count;
+    uint32_t selected_object_count;
+    uint32_t culled_object_count;
+};
+
 struct graphics {
+    // Loads Vulkan and creates the instance, which needs no window, so that
+    // it can run alongside window creation. Init creates it if it was not.
+    void (*create_instance)(void);
     void (*init)(void);
     void (*deinit)(void);
     void (*draw_frame)(struct UBO *ubo);
-    void (*load_map)(uint32_t const size, struct Vertex vertices[static const size]);
+    void (*load_map)(
+        uint32_t const size,
+        struct Vertex vertices[static const size],
+        uint32_t const object_count,
+        struct DrawObject const objects[static const object_count],
+        struct MeshletData const *meshlets);
+    void (*get_frame_stats)(struct FrameStats *stats);
+    void (*set_object_visibility)(uint32_t const count, uint8_t const mask[static const count]);
+    void (*set_gpu_occlusion)(int const is_enabled);
+    // order is a permutation of the objects, drawn in that order from the
+    // next frame on. Front to back keeps hidden fragments from being shaded.
+    void (*set_draw_order)(uint32_t const count, uint32_t const order[static const count]);
+    // Lays down depth with positions only before shading, so that every
+    // pixel is shaded once. The mesh shader path draws without it.
+    void (*set_depth_prepass)(int const is_enabled);
+    // Lights drawn from the next frame on, binned into view space clusters
+    // so that a fragment only evaluates the lights that reach it
+    void (*set_lights)(uint32_t const count, struct Light const lights[static const count]);
+    // Re-records everything against the pipeline variants of the settings,
+    // meant for loading a map rather than every frame
+    void (*set_shading)(struct Shading const *shading);
 };
 
 extern const struct graphics graphics;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "graphics/vertex.h"
+
+// Mesh container written by script/create_meshes.py
+//   struct MeshHeader
+//   struct MeshSection[section_count]
+//   section data, each section aligned to MESH_SECTION_ALIGNMENT bytes
+// Readers skip sections of unknown type
+#define MESH_MAGIC 0x534d4248u
+#define MESH_VERSION 5
+#define MESH_MAX_SECTIONS 16
+#define MESH_SECTION_ALIGNMENT 16
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESH_MAX_LODS 8
+
+enum MeshFlag {
+    // the mesh is rasterized into the software occlusion buffer
+    MESH_FLAG_OCCLUDER = 1 << 0,
+    // every triangle winds counter-clockwise around its outward normal and
+    // neighbours agree across shared edges, so back faces can be culled.
+    // Meshlets of other meshes have a cone cutoff of 1.
+    MESH_FLAG_CONSISTENT_WINDING = 1 << 1,
+};
+
+enum MeshSectionType {
+    // struct Vertex triangle soup with baked face colors, ordered meshlet by
+    // meshlet
+    MESH_SECTION_VERTICES = 1,
+    // struct Meshlet
+    MESH_SECTION_MESHLETS = 2,
+    // uint32_t index into the positions of every meshlet vertex
+    MESH_SECTION_MESHLET_VERTICES = 3,
+    // uint32_t holding three 8 bit meshlet local vertex indices per triangle
+    MESH_SECTION_MESHLET_TRIANGLES = 4,
+    // struct VertexPos without duplicates
+    MESH_SECTION_POSITIONS = 5,
+    // struct MeshLod, from full resolution to coarsest for every chunk
+    MESH_SECTION_LODS = 6,
+    // struct MeshChunk
+    MESH_SECTION_CHUNKS = 7,
+    // struct MeshPvs, only for meshes baked with potentially visible sets
+    MESH_SECTION_PVS = 8,
+    // uint32_t offset of the row of every cell into the PVS data
+    MESH_SECTION_PVS_CELLS = 9,
+    // uint8_t rows of one bit per chunk, every run of zero bytes is stored as
+    // a zero followed by the length of the run
+    MESH_SECTION_PVS_DATA = 10,
+};
+
+struct MeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t section_count;
+} __attribute__((__packed__));
+
+struct MeshSection {
+    uint32_t type;
+    uint32_t count;
+    uint32_t offset;
+    uint32_t size;
+} __attribute__((__packed__));
+
+// A cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES
+// triangles. All of its triangles face away from a camera at p when
+//   dot(center - p, cone_axis) >= cone_cutoff * length(center - p) + radius
+// so a cutoff of 1 never culls.
+struct Meshlet {
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+    uint32_t vertex_offset;
+    uint32_t triangle_offset;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+} __attribute__((__packed__));
+
+// A simplified level of the mesh. Every level indexes the same positions and
+// error is the largest distance its surface or face centroids moved from the
+// full resolution mesh, in mesh units.
+struct MeshLod {
+    float error;
+    uint32_t meshlet_offset;
+    uint32_t meshlet_count;
+    uint32_t triangle_count;
+} __attribute__((__packed__));
+
+// A grid cell of a large mesh, or the whole of a small one. Chunks simplify on
+// their own with the vertices on their borders kept in place.
+struct MeshChunk {
+    float min[3];
+    float max[3];
+    uint32_t lod_offset;
+    uint32_t lod_count;
+} __attribute__((__packed__));
+
+// Potentially visible sets of a grid of cells over the mesh, cells are stored
+// with x varying fastest and then y. A camera outside of the grid may see any
+// chunk.
+struct MeshPvs {
+    float origin[3];
+    float cell_size;
+    uint32_t cell_count[3];
+    uint32_t chunk_count;
+} __attribute__((__packed__));
+
+// A loaded container, the triangles of meshlet m are the soup vertices from
+// meshlets[m].triangle_offset * 3. Chunks, their levels and the meshlets of
+// each level follow each other in the soup, so a level is a contiguous range
+// of vertices starting at its first meshlet.
+struct Mesh {
+    uint32_t flags;
+    uint32_t vertex_count;
+    struct Vertex *vertices;
+    uint32_t meshlet_count;
+    struct Meshlet *meshlets;
+    uint32_t meshlet_vertex_count;
+    uint32_t *meshlet_vertices;
+    uint32_t meshlet_triangle_count;
+    uint32_t *meshlet_triangles;
+    uint32_t position_count;
+    struct VertexPos *positions;
+    uint32_t lod_count;
+    struct MeshLod *lods;
+    uint32_t chunk_count;
+    struct MeshChunk *chunks;
+    // 0 for meshes without potentially visible sets
+    struct MeshPvs *pvs;
+    uint32_t pvs_cell_count;
+    uint32_t *pvs_cells;
+    uint32_t pvs_data_size;
+    uint8_t *pvs_data;
+};
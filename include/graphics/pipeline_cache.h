@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <threads.h>
+
+#include <volk/volk.h>
+
+#include "graphics/render_graph.h"
+#include "graphics/vulkan_ext.h"
+
+#define PIPELINE_CACHE_MAX_STAGES 3
+#define PIPELINE_CACHE_MAX_ATTRIBUTES 4
+#define PIPELINE_CACHE_MAX_COLOR_FORMATS 4
+#define PIPELINE_CACHE_MAX_CONSTANTS 8
+#define PIPELINE_CACHE_THREAD_COUNT 2
+
+// Everything a graphics pipeline is created from. States are told apart by
+// the fields in use, entries past the counts are ignored.
+// Pipelines without a vertex stride take no vertex input, mesh pipelines no
+// input assembly either. Pipelines are created against the render pass when
+// there is one, and against the attachment formats with dynamic rendering.
+// Render passes are told apart by their pass layout rather than their
+// handle, as a pipeline works with every compatible render pass. Viewport
+// and scissor are dynamic, so pipelines do not depend on the extent.
+struct PipelineState {
+    VkPipelineLayout layout;
+    uint32_t stage_count;
+    VkShaderStageFlagBits stages[PIPELINE_CACHE_MAX_STAGES];
+    // hashed by their contents, they must outlive the cache
+    char const *shader_paths[PIPELINE_CACHE_MAX_STAGES];
+    uint32_t vertex_stride;
+    uint32_t attribute_count;
+    VkVertexInputAttributeDescription attributes[PIPELINE_CACHE_MAX_ATTRIBUTES];
+    VkPolygonMode polygon_mode;
+    VkCullModeFlags cull_mode;
+    VkBool32 is_depth_write;
+    VkCompareOp depth_compare;
+    // only needed until the pipeline is compiled
+    VkRenderPass render_pass;
+    struct RenderGraphPassLayout pass_layout;
+    uint32_t subpass;
+    uint32_t color_format_count;
+    VkFormat color_formats[PIPELINE_CACHE_MAX_COLOR_FORMATS];
+    VkFormat depth_format;
+    // specialization constants of every stage, ids a stage does not
+    // declare are ignored by it
+    uint32_t constant_count;
+    VkSpecializationMapEntry constants[PIPELINE_CACHE_MAX_CONSTANTS];
+    uint32_t constant_size;
+    uint8_t constant_data[PIPELINE_CACHE_MAX_CONSTANTS * sizeof(uint32_t)];
+};
+
+enum PipelineStatus {
+    PIPELINE_FREE,
+    PIPELINE_QUEUED,
+    PIPELINE_COMPILING,
+    PIPELINE_READY,
+};
+
+struct PipelineCacheEntry {
+    uint64_t hash;
+    struct PipelineState state;
+    VkPipeline pipeline;
+    enum PipelineStatus status;
+    // asked for since the last eviction
+    VkBool32 is_used;
+};
+
+// A pipeline compiling on the worker threads, valid until its entry is
+// evicted or the cache cleared
+struct PipelineFuture {
+    uint32_t entry;
+    uint64_t hash;
+};
+
+// Graphics pipelines by their state, found by its hash. Compiles are queued
+// in order to the worker threads, and a caller that needs a pipeline before
+// they get to it compiles it itself. Every compile goes through one Vulkan
+// pipeline cache. The entries and the queue grow when they run full, so
+// entries are only referred to by index outside of the mutex.
+struct PipelineCache {
+    VkDevice device;
+    VkPipelineCache vulkan_cache;
+    uint32_t entry_capacity;
+    struct PipelineCacheEntry *entries;
+    // a ring of entry indices, oldest first
+    uint32_t queue_first;
+    uint32_t queue_count;
+    uint32_t queue_capacity;
+    uint32_t *queue;
+    mtx_t mutex;
+    cnd_t queued;
+    cnd_t compiled;
+    int is_running;
+    thrd_t threads[PIPELINE_CACHE_THREAD_COUNT];
+};
+
+// Bools are VkBool32, so every constant takes 32 bits
+void
+pipeline_state_add_constant(struct PipelineState *state, uint32_t const constant_id, void const *value);
+
+void
+pipeline_cache_init(struct PipelineCache *cache, VkDevice const device);
+
+// Queues the pipeline unless it is cached already
+struct PipelineFuture
+pipeline_cache_compile(struct PipelineCache *cache, struct PipelineState const *state);
+
+VkBool32
+pipeline_cache_is_ready(struct PipelineCache *cache, struct PipelineFuture const *future);
+
+// Blocks until the pipeline is ready, compiling it on the calling thread if
+// no worker took it yet
+VkPipeline
+pipeline_cache_wait(struct PipelineCache *cache, struct PipelineFuture const *future);
+
+// Returns the fallback until the pipeline is ready
+VkPipeline
+pipeline_cache_request(struct PipelineCache *cache, struct PipelineState const *state, VkPipeline const fallback);
+
+// Destroys the ready pipelines nobody asked for since the last eviction,
+// they must not be in use on the device
+void
+pipeline_cache_evict(struct PipelineCache *cache);
+
+// Compiles what is queued on the calling thread alongside the workers and
+// waits until nothing is compiling, so that the render passes the states
+// refer to can be destroyed
+void
+pipeline_cache_finish(struct PipelineCache *cache);
+
+void
+pipeline_cache_destroy(struct PipelineCache *cache);
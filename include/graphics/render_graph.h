@@ -0,0 +1,213 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <volk/volk.h>
+
+#include "graphics/vulkan_ext.h"
+
+#define RENDER_GRAPH_MAX_PASSES 16
+#define RENDER_GRAPH_MAX_RESOURCES 16
+#define RENDER_GRAPH_MAX_USES 8
+#define RENDER_GRAPH_MAX_ATTACHMENTS 4
+
+// How a pass touches a resource, each usage implies its stages, accesses and
+// image layout. Attachment usages are only valid in graphics passes.
+enum RenderGraphUsage {
+    RENDER_GRAPH_COLOR_WRITE,
+    // depth tested and written
+    RENDER_GRAPH_DEPTH_WRITE,
+    // depth tested against what an earlier pass wrote, without writes
+    RENDER_GRAPH_DEPTH_READ,
+    // sampled by compute shaders in the read only layout
+    RENDER_GRAPH_SAMPLED_READ,
+    // storage image written by compute shaders, in the general layout
+    RENDER_GRAPH_STORAGE_WRITE,
+    // sampled by compute shaders in the general layout
+    RENDER_GRAPH_STORAGE_READ,
+    RENDER_GRAPH_TRANSFER_WRITE,
+    RENDER_GRAPH_COMPUTE_READ,
+    RENDER_GRAPH_COMPUTE_WRITE,
+    // read and written with atomics by task shaders
+    RENDER_GRAPH_TASK_WRITE,
+    RENDER_GRAPH_INDIRECT_READ,
+    RENDER_GRAPH_FRAGMENT_READ,
+    RENDER_GRAPH_USAGE_COUNT,
+};
+
+// An image owned by the graph. Its usage flags follow from the passes using
+// it, plus usage for descriptors written whether or not those passes run.
+// Attachments are cleared to clear_value at their first use of the frame
+// when is_cleared is set.
+struct RenderGraphImage {
+    VkFormat format;
+    VkImageAspectFlags aspect;
+    VkExtent2D extent;
+    uint32_t mip_levels;
+    VkImageUsageFlags usage;
+    VkBool32 is_cleared;
+    VkClearValue clear_value;
+};
+
+typedef void (*RenderGraphRecord)(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+struct RenderGraphUse {
+    uint32_t resource;
+    enum RenderGraphUsage usage;
+};
+
+struct RenderGraphPass {
+    char const *name;
+    VkBool32 is_graphics;
+    RenderGraphRecord record;
+    uint32_t use_count;
+    struct RenderGraphUse uses[RENDER_GRAPH_MAX_USES];
+    // set by compile, the render pass and subpass of graphics passes
+    uint32_t group;
+    uint32_t subpass;
+    // set by compile, the barrier recorded before passes outside render
+    // passes, the barriers of swapchain images get the image when recorded
+    VkPipelineStageFlags src_stages;
+    VkPipelineStageFlags dst_stages;
+    VkMemoryBarrier memory_barrier;
+    uint32_t image_barrier_count;
+    VkImageMemoryBarrier image_barriers[RENDER_GRAPH_MAX_USES];
+    uint32_t image_barrier_resources[RENDER_GRAPH_MAX_USES];
+};
+
+struct RenderGraphResource {
+    VkBool32 is_image;
+    VkBool32 is_swapchain;
+    // one copy per swapchain image, ordered across frames by the image fence
+    VkBool32 is_per_image;
+    struct RenderGraphImage desc;
+    VkImageUsageFlags usage;
+    VkBool32 is_transient;
+    VkBool32 is_lazily_allocated;
+    uint32_t first_pass;
+    uint32_t last_pass;
+    // resources sharing a slot share memory and are synchronized as one
+    uint32_t slot;
+    VkImage image;
+    VkImageView view;
+    // imported swapchain images and their views, one per swapchain image
+    VkImage const *swapchain_images;
+    VkImageView const *swapchain_views;
+};
+
+// Consecutive graphics passes, recorded as the subpasses of one render pass.
+// With dynamic rendering every graphics pass is a group of its own.
+struct RenderGraphGroup {
+    uint32_t first_pass;
+    uint32_t pass_count;
+    uint32_t attachment_count;
+    uint32_t attachments[RENDER_GRAPH_MAX_ATTACHMENTS];
+    VkClearValue clear_values[RENDER_GRAPH_MAX_ATTACHMENTS];
+    VkExtent2D extent;
+    VkRenderPass render_pass;
+    VkFramebuffer *framebuffers;
+    VkRenderingAttachmentInfoKHR rendering_attachments[RENDER_GRAPH_MAX_ATTACHMENTS];
+};
+
+// What render passes must agree on for a pipeline created against one to
+// work with the others: the formats of their attachments and which of them
+// every subpass uses how. Layouts and load and store operations may differ.
+// The dependencies between subpasses follow from the uses, those on passes
+// outside of the render pass are left out.
+struct RenderGraphPassLayout {
+    uint32_t attachment_count;
+    VkFormat formats[RENDER_GRAPH_MAX_ATTACHMENTS];
+    uint32_t subpass_count;
+    uint32_t color_counts[RENDER_GRAPH_MAX_PASSES];
+    uint8_t color_attachments[RENDER_GRAPH_MAX_PASSES][RENDER_GRAPH_MAX_ATTACHMENTS];
+    // UINT8_MAX for subpasses without depth
+    uint8_t depth_attachments[RENDER_GRAPH_MAX_PASSES];
+    uint8_t is_depth_read[RENDER_GRAPH_MAX_PASSES];
+};
+
+// What the pipelines of a graphics pass are created against, a subpass of a
+// render pass or with dynamic rendering the formats of its attachments. The
+// pass layout stays zero with dynamic rendering.
+struct RenderGraphTarget {
+    VkRenderPass render_pass;
+    uint32_t subpass;
+    struct RenderGraphPassLayout pass_layout;
+    VkPipelineRenderingCreateInfoKHR rendering;
+    VkFormat color_formats[RENDER_GRAPH_MAX_ATTACHMENTS];
+};
+
+// A frame declared as passes and the resources they use. Compile derives the
+// render passes, the barriers between the other passes, the image layouts and
+// attachment load and store operations, or with dynamic rendering a barrier
+// before every pass. Transient images whose lifetimes do
+// not overlap share memory, and depth that never leaves a render pass is
+// lazily allocated where the device supports it. Every frame runs the same
+// passes, so the first use of a resource in a frame waits for its last use
+// in the previous one.
+struct RenderGraph {
+    uint32_t pass_count;
+    struct RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    uint32_t resource_count;
+    struct RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t group_count;
+    struct RenderGraphGroup groups[RENDER_GRAPH_MAX_PASSES];
+    uint32_t slot_count;
+    VkDeviceMemory slot_memories[RENDER_GRAPH_MAX_RESOURCES];
+    VkDeviceSize memory_size;
+    uint32_t barrier_count;
+    uint32_t swapchain_resource;
+    uint32_t swapchain_length;
+    VkBool32 is_dynamic_rendering;
+    PFN_vkCmdBeginRenderingKHR begin_rendering;
+    PFN_vkCmdEndRenderingKHR end_rendering;
+    // moves the swapchain image to the present layout after dynamic rendering
+    VkImageMemoryBarrier present_barrier;
+};
+
+void
+render_graph_init(struct RenderGraph *graph);
+
+uint32_t
+render_graph_add_image(struct RenderGraph *graph, struct RenderGraphImage const *image);
+
+// The images are presented after the frame, so their last use must be an
+// attachment of a graphics pass
+uint32_t
+render_graph_import_swapchain(
+    struct RenderGraph *graph,
+    struct RenderGraphImage const *image,
+    uint32_t const swapchain_length,
+    VkImage const images[static const swapchain_length],
+    VkImageView const views[static const swapchain_length]);
+
+// Buffers are only tracked to place barriers, the passes bind their own
+uint32_t
+render_graph_add_buffer(struct RenderGraph *graph, VkBool32 const is_per_image);
+
+uint32_t
+render_graph_add_pass(struct RenderGraph *graph, char const *name, VkBool32 const is_graphics, RenderGraphRecord const record);
+
+void
+render_graph_use(struct RenderGraph *graph, uint32_t const pass, uint32_t const resource, enum RenderGraphUsage const usage);
+
+// Records graphics passes with dynamic rendering and barriers instead of
+// render passes and framebuffers, the commands come from the device as volk
+// does not load them
+void
+render_graph_set_dynamic_rendering(
+    struct RenderGraph *graph,
+    PFN_vkCmdBeginRenderingKHR const begin_rendering,
+    PFN_vkCmdEndRenderingKHR const end_rendering);
+
+void
+render_graph_compile(struct RenderGraph *graph, VkDevice const device, VkPhysicalDevice const physical_device);
+
+void
+render_graph_record(struct RenderGraph const *graph, VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+void
+render_graph_destroy(struct RenderGraph *graph, VkDevice const device);
+
+// The target keeps pointing into itself, so it must not be copied
+void
+render_graph_get_target(struct RenderGraph const *graph, uint32_t const pass, struct RenderGraphTarget *target);
@@ -12,13 +12,8 @@ struct VertexColor {
     float b;
 } __attribute__((__packed__));
 
-struct VertexCentroid {
-    float x;
-    float y;
-    float z;
-} __attribute__((__packed__));
-
 struct Vertex {
     struct VertexPos pos;
-    struct VertexCentroid centroid;
+    // Lighting baked for the whole face by the mesh converter
+    struct VertexColor color;
 } __attribute__((__packed__));
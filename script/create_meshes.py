@@ -1,43 +1,876 @@
-import io
+import argparse
+import heapq
+import math
+import multiprocessing
+import random
 import struct
-import sys
 
 from pathlib import PurePath
 
-for file_name in sys.argv[1:]:
-    vertex_file_name = PurePath(file_name)
-    vertex_file_name = vertex_file_name.with_suffix('.vertex')
+# Keep in sync with include/graphics/mesh.h
+MESH_MAGIC = 0x534d4248
+MESH_VERSION = 5
+MESH_SECTION_ALIGNMENT = 16
+MESH_FLAG_OCCLUDER = 1 << 0
+MESH_FLAG_CONSISTENT_WINDING = 1 << 1
 
-    with open(file_name, mode="rb") as stl, open(vertex_file_name, mode="wb") as vertex:
-        header = stl.read(80)
-        num_triangles_b = stl.read(4)
-        num_triangles = int.from_bytes(num_triangles_b, byteorder='little')
-        num_vertices_b = struct.pack('I', num_triangles * 3)
+MESH_SECTION_VERTICES = 1
+MESH_SECTION_MESHLETS = 2
+MESH_SECTION_MESHLET_VERTICES = 3
+MESH_SECTION_MESHLET_TRIANGLES = 4
+MESH_SECTION_POSITIONS = 5
+MESH_SECTION_LODS = 6
+MESH_SECTION_CHUNKS = 7
+MESH_SECTION_PVS = 8
+MESH_SECTION_PVS_CELLS = 9
+MESH_SECTION_PVS_DATA = 10
 
-        vertex.write(num_vertices_b)
+MESHLET_MAX_VERTICES = 64
+MESHLET_MAX_TRIANGLES = 124
+MESH_MAX_LODS = 8
 
-        for t in range(num_triangles):
-            normal_vector = struct.unpack('fff', stl.read(12))
-            vertex1_b = stl.read(12)
-            vertex1 = struct.unpack('fff', vertex1_b)
+# Every level halves the triangles of the previous one until a level is
+# this small or the simplifier gets stuck above LOD_MIN_REDUCTION of it
+LOD_MIN_TRIANGLES = 32
+LOD_MIN_REDUCTION = 0.9
+
+# Open borders are held in place by planes perpendicular to their faces
+LOD_BOUNDARY_WEIGHT = 100.0
+
+# Squared edge lengths are added at this weight to break ties between the
+# zero error collapses of flat ground in favour of short edges
+LOD_EDGE_WEIGHT = 0.001
+
+# Edge length of the grid cells large meshes are split into
+CHUNK_SIZE = 64.0
+
+# Potentially visible sets are baked for the cells of a grid over the mesh. A
+# chunk is visible from a cell when one of PVS_RAY_COUNT segments between
+# random points of the empty voxels of the cell and of the chunk surface
+# misses every other chunk.
+PVS_CELL_SIZE = 32.0
+PVS_RAY_COUNT = 64
 
-            vertex2_b = stl.read(12)
-            vertex2 = struct.unpack('fff', vertex2_b)
+# Edge length of the voxels the triangles are sorted into for those segments
+PVS_VOXEL_SIZE = 8.0
 
-            vertex3_b = stl.read(12)
-            vertex3 = struct.unpack('fff', vertex3_b)
+# Faces are lit at their centroid by a point light fading out over
+# LIGHT_DISTANCE, and darkened by the share of AO_RAY_COUNT cosine weighted
+# rays that hit the mesh within AO_DISTANCE
+LIGHT_POSITION = (0.0, 0.0, 0.0)
+LIGHT_COLOR = (1.0, 0.0, 0.0)
+LIGHT_DISTANCE = 90.0
+AO_RAY_COUNT = 32
+AO_DISTANCE = 8.0
+AO_BIAS = 1e-3
+GOLDEN_ANGLE = math.pi * (3.0 - math.sqrt(5.0))
 
-            centroid_x = (vertex1[0] + vertex2[0] + vertex3[0]) / 3
-            centroid_y = (vertex1[1] + vertex2[1] + vertex3[1]) / 3
-            centroid_z = (vertex1[2] + vertex2[2] + vertex3[2]) / 3
-            centroid_b = struct.pack('fff', centroid_x, centroid_y, centroid_z)
+# Faces handed to a lighting worker at once
+LIGHT_TASK_SIZE = 64
 
-            vertex.write(vertex1_b)
-            vertex.write(centroid_b)
-            vertex.write(vertex2_b)
-            vertex.write(centroid_b)
-            vertex.write(vertex3_b)
-            vertex.write(centroid_b)
+# Below this the normals of a meshlet spread over more than a hemisphere
+# minus a safety margin and its cone cannot cull anything
+MESHLET_MIN_CONE_DOT = 0.1
 
+
+def read_stl(file_name):
+    triangles = []
+    with open(file_name, mode='rb') as stl:
+        stl.read(80)
+        num_triangles = int.from_bytes(stl.read(4), byteorder='little')
+        for t in range(num_triangles):
+            normal = struct.unpack('fff', stl.read(12))
+            vertices = [struct.unpack('fff', stl.read(12)) for i in range(3)]
             num_attr = int.from_bytes(stl.read(2), byteorder='little')
             stl.read(num_attr)
+            triangles.append((normal, vertices))
+
+    return triangles
+
+
+def sub(a, b):
+    return (a[0] - b[0], a[1] - b[1], a[2] - b[2])
+
+
+def dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+
+def cross(a, b):
+    return (a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0])
+
+
+def normalize(a):
+    length = math.sqrt(dot(a, a))
+    if length == 0.0:
+        return (0.0, 0.0, 0.0)
+    return (a[0] / length, a[1] / length, a[2] / length)
+
+
+def face_normal(normal, vertices):
+    # fall back to the winding when the file has no normal
+    if dot(normal, normal) > 0.0:
+        return normalize(normal)
+    return normalize(cross(sub(vertices[1], vertices[0]), sub(vertices[2], vertices[0])))
+
+
+def orient_triangles(triangles):
+    """Winds every triangle counter-clockwise around its facet normal
+
+    Triangles without a normal keep their winding. Returns the flipped count
+    and the number of edges two triangles walk in the same direction, which
+    is 0 when neighbours agree and back faces can be culled.
+    """
+    flipped = 0
+    for t, (normal, vertices) in enumerate(triangles):
+        if dot(normal, cross(sub(vertices[1], vertices[0]), sub(vertices[2], vertices[0]))) < 0.0:
+            triangles[t] = (normal, [vertices[0], vertices[2], vertices[1]])
+            flipped += 1
+
+    edges = {}
+    for normal, vertices in triangles:
+        for k in range(3):
+            edge = (vertices[k], vertices[(k + 1) % 3])
+            edges[edge] = edges.get(edge, 0) + 1
+    conflicts = sum(count - 1 for count in edges.values())
+
+    return flipped, conflicts
+
+
+def triangle_normal(positions, triangle):
+    a, b, c = (positions[i] for i in triangle)
+    return cross(sub(b, a), sub(c, a))
+
+
+# Symmetric 4x4 error quadrics are stored as their upper triangle
+#   a2 ab ac ad b2 bc bd c2 cd d2
+def plane_quadric(normal, point, weight):
+    a, b, c = normal
+    d = -dot(normal, point)
+    return tuple(weight * x for x in (a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d))
+
+
+def quadric_add(p, q):
+    return tuple(x + y for x, y in zip(p, q))
+
+
+def quadric_error(q, v):
+    x, y, z = v
+    return (q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+            + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+            + q[7] * z * z + 2 * q[8] * z
+            + q[9])
+
+
+class Simplifier:
+    """Quadric error edge collapse after Garland and Heckbert
+
+    Collapses move one vertex of an edge onto the other, so every level
+    indexes the original positions. Collapses are ordered by their quadric
+    error with open borders weighted up, and short edges go first on flat
+    ground where that error is zero.
+    The error of a collapse is the distance it moves the surface in mesh
+    units, the largest distance of the new position from the planes of the
+    original faces and borders the moved vertex stands for. The error of a
+    level is the largest one so far, so it grows along the chain.
+    """
+
+    def __init__(self, positions, indices, locked):
+        self.positions = positions
+        self.locked = locked
+        self.triangles = [list(t) for t in indices]
+        self.triangle_count = len(indices)
+        self.vertex_triangles = [set() for p in positions]
+        self.quadrics = [(0.0,) * 10 for p in positions]
+        self.planes = []
+        self.vertex_planes = [set() for p in positions]
+        self.versions = [0] * len(positions)
+        self.error = 0.0
+
+        edge_triangles = {}
+        for t, triangle in enumerate(self.triangles):
+            normal = normalize(triangle_normal(positions, triangle))
+            quadric = plane_quadric(normal, positions[triangle[0]], 1.0)
+            self.planes.append((normal, -dot(normal, positions[triangle[0]])))
+            for k, i in enumerate(triangle):
+                self.vertex_triangles[i].add(t)
+                self.quadrics[i] = quadric_add(self.quadrics[i], quadric)
+                self.vertex_planes[i].add(len(self.planes) - 1)
+                edge = (min(i, triangle[k - 1]), max(i, triangle[k - 1]))
+                edge_triangles.setdefault(edge, []).append(normal)
+
+        for (a, b), normals in edge_triangles.items():
+            if len(normals) == 1:
+                border = normalize(cross(sub(positions[b], positions[a]), normals[0]))
+                quadric = plane_quadric(border, positions[a], LOD_BOUNDARY_WEIGHT)
+                for i in (a, b):
+                    self.quadrics[i] = quadric_add(self.quadrics[i], quadric)
+                    self.vertex_planes[i].add(len(self.planes))
+                self.planes.append((border, -dot(border, positions[a])))
+
+    def neighbours(self, v):
+        return {i for t in self.vertex_triangles[v] for i in self.triangles[t]} - {v}
+
+    def cost(self, a, b):
+        edge = sub(self.positions[b], self.positions[a])
+        quadric = quadric_add(self.quadrics[a], self.quadrics[b])
+        return quadric_error(quadric, self.positions[b]) + LOD_EDGE_WEIGHT * dot(edge, edge)
+
+    def distance(self, a, b):
+        p = self.positions[b]
+        return max((abs(dot(self.planes[i][0], p) + self.planes[i][1]) for i in self.vertex_planes[a]), default=0.0)
+
+    def push(self, heap, a, b):
+        heapq.heappush(heap, (self.cost(a, b), a, b, self.versions[a], self.versions[b]))
+
+    def is_valid(self, a, b):
+        # locked vertices are shared with other chunks and may not move, the
+        # link condition keeps the surface manifold and the rest rejects
+        # collapses that fold or degenerate a remaining triangle
+        if a in self.locked:
+            return False
+
+        shared = self.vertex_triangles[a] & self.vertex_triangles[b]
+        opposite = {i for t in shared for i in self.triangles[t]} - {a, b}
+        if self.neighbours(a) & self.neighbours(b) != opposite:
+            return False
+
+        for t in self.vertex_triangles[a] - shared:
+            triangle = self.triangles[t]
+            moved = [b if i == a else i for i in triangle]
+            old_normal = triangle_normal(self.positions, triangle)
+            new_normal = triangle_normal(self.positions, moved)
+            if dot(new_normal, new_normal) == 0.0 or dot(old_normal, new_normal) <= 0.0:
+                return False
+
+        return True
+
+    def collapse(self, a, b):
+        for t in list(self.vertex_triangles[a]):
+            triangle = self.triangles[t]
+            if b in triangle:
+                for i in triangle:
+                    self.vertex_triangles[i].discard(t)
+                self.triangles[t] = None
+                self.triangle_count -= 1
+            else:
+                triangle[triangle.index(a)] = b
+                self.vertex_triangles[b].add(t)
+        self.vertex_triangles[a] = set()
+        self.quadrics[b] = quadric_add(self.quadrics[a], self.quadrics[b])
+        self.vertex_planes[b] |= self.vertex_planes[a]
+        self.vertex_planes[a] = set()
+        self.versions[a] += 1
+        self.versions[b] += 1
+
+    def simplify(self, target):
+        heap = []
+        for a in range(len(self.positions)):
+            for b in self.neighbours(a):
+                self.push(heap, a, b)
+
+        while heap and self.triangle_count > target:
+            cost, a, b, version_a, version_b = heapq.heappop(heap)
+            if version_a != self.versions[a] or version_b != self.versions[b] or not self.is_valid(a, b):
+                continue
+
+            self.error = max(self.error, self.distance(a, b))
+            self.collapse(a, b)
+            for n in self.neighbours(b):
+                self.push(heap, b, n)
+                self.push(heap, n, b)
+
+    def indices(self):
+        return [tuple(t) for t in self.triangles if t is not None]
+
+
+class Meshlet:
+    def __init__(self):
+        self.vertices = []
+        self.vertex_index = {}
+        self.triangles = []
+        self.normal_sum = (0.0, 0.0, 0.0)
+        self.center_sum = (0.0, 0.0, 0.0)
+
+    def new_vertex_count(self, indices):
+        return len({i for i in indices if i not in self.vertex_index})
+
+    def can_add(self, indices):
+        return (len(self.triangles) < MESHLET_MAX_TRIANGLES
+                and len(self.vertices) + self.new_vertex_count(indices) <= MESHLET_MAX_VERTICES)
+
+    def add(self, triangle, indices, normal, centroid):
+        for i in indices:
+            if i not in self.vertex_index:
+                self.vertex_index[i] = len(self.vertices)
+                self.vertices.append(i)
+        self.triangles.append(triangle)
+        self.normal_sum = tuple(a + b for a, b in zip(self.normal_sum, normal))
+        self.center_sum = tuple(a + b for a, b in zip(self.center_sum, centroid))
+
+
+def build_meshlets(indices, normals, centroids):
+    """Greedily grows meshlets over shared vertices
+
+    The next triangle is the neighbour adding the fewest new vertices, then
+    the one closest to the average meshlet normal to keep normal cones tight.
+    A full meshlet or one without neighbours is closed and the next one is
+    seeded at the free triangle nearest to its center.
+    """
+    vertex_triangles = {}
+    for t, triangle in enumerate(indices):
+        for i in triangle:
+            vertex_triangles.setdefault(i, []).append(t)
+
+    is_assigned = [False] * len(indices)
+    remaining = len(indices)
+    meshlets = []
+    seed = 0
+    while remaining:
+        meshlet = Meshlet()
+        candidates = {seed}
+        while candidates:
+            axis = normalize(meshlet.normal_sum)
+            best = None
+            best_key = None
+            for t in candidates:
+                if not meshlet.can_add(indices[t]):
+                    continue
+                key = (meshlet.new_vertex_count(indices[t]), -dot(normals[t], axis), t)
+                if best_key is None or key < best_key:
+                    best = t
+                    best_key = key
+            if best is None:
+                break
+
+            meshlet.add(best, indices[best], normals[best], centroids[best])
+            is_assigned[best] = True
+            remaining -= 1
+            candidates.discard(best)
+            for i in indices[best]:
+                candidates.update(t for t in vertex_triangles[i] if not is_assigned[t])
+        meshlets.append(meshlet)
+
+        if remaining:
+            center = tuple(c / len(meshlet.triangles) for c in meshlet.center_sum)
+            seed = min((t for t in range(len(indices)) if not is_assigned[t]),
+                       key=lambda t: dot(sub(centroids[t], center), sub(centroids[t], center)))
+
+    return meshlets
+
+
+def meshlet_bounds(meshlet, positions, normals):
+    points = [positions[i] for i in meshlet.vertices]
+    low = [min(p[j] for p in points) for j in range(3)]
+    high = [max(p[j] for p in points) for j in range(3)]
+    center = tuple((low[j] + high[j]) * 0.5 for j in range(3))
+    radius = max(math.sqrt(dot(sub(p, center), sub(p, center))) for p in points)
+
+    axis = normalize(meshlet.normal_sum)
+    min_dot = min(dot(normals[t], axis) for t in meshlet.triangles)
+    if dot(axis, axis) == 0.0 or min_dot <= MESHLET_MIN_CONE_DOT:
+        cone_cutoff = 1.0
+    else:
+        # a normal spread of acos(min_dot) widens the backfacing cone to
+        # 90 degrees plus the spread, whose cosine is sin(spread)
+        cone_cutoff = math.sqrt(max(0.0, 1.0 - min_dot * min_dot))
+
+    return center, radius, axis, cone_cutoff
+
+
+class VoxelGrid:
+    """Triangles sorted into the voxels their bounds overlap, segments walk the
+    voxels along their way after Amanatides and Woo
+    """
+
+    def __init__(self, positions, indices, low, size):
+        self.positions = positions
+        self.indices = indices
+        self.low = low
+        self.size = size
+        self.voxels = {}
+        for t, triangle in enumerate(indices):
+            points = [positions[i] for i in triangle]
+            first = self.voxel([min(p[j] for p in points) for j in range(3)])
+            last = self.voxel([max(p[j] for p in points) for j in range(3)])
+            for x in range(first[0], last[0] + 1):
+                for y in range(first[1], last[1] + 1):
+                    for z in range(first[2], last[2] + 1):
+                        self.voxels.setdefault((x, y, z), []).append(t)
+
+    def voxel(self, p):
+        return tuple(int(math.floor((p[j] - self.low[j]) / self.size)) for j in range(3))
+
+    def empty_boxes(self, low, high):
+        """Returns the parts of the voxels no triangle overlaps inside the box
+        from low to high as (low, high) pairs
+        """
+        first = self.voxel(low)
+        last = self.voxel(high)
+        boxes = []
+        for x in range(first[0], last[0] + 1):
+            for y in range(first[1], last[1] + 1):
+                for z in range(first[2], last[2] + 1):
+                    if (x, y, z) in self.voxels:
+                        continue
+                    voxel_low = [self.low[j] + (x, y, z)[j] * self.size for j in range(3)]
+                    box_low = [max(low[j], voxel_low[j]) for j in range(3)]
+                    box_high = [min(high[j], voxel_low[j] + self.size) for j in range(3)]
+                    if all(box_low[j] < box_high[j] for j in range(3)):
+                        boxes.append((box_low, box_high))
+
+        return boxes
+
+    def walk(self, a, b):
+        d = sub(b, a)
+        voxel = list(self.voxel(a))
+        last = self.voxel(b)
+        step = [0, 0, 0]
+        t_next = [math.inf] * 3
+        t_delta = [math.inf] * 3
+        for j in range(3):
+            if d[j] > 0.0:
+                step[j] = 1
+                t_next[j] = (self.low[j] + (voxel[j] + 1) * self.size - a[j]) / d[j]
+                t_delta[j] = self.size / d[j]
+            elif d[j] < 0.0:
+                step[j] = -1
+                t_next[j] = (self.low[j] + voxel[j] * self.size - a[j]) / d[j]
+                t_delta[j] = -self.size / d[j]
+
+        while True:
+            yield tuple(voxel)
+            j = min(range(3), key=lambda k: t_next[k])
+            if tuple(voxel) == last or t_next[j] > 1.0:
+                return
+            voxel[j] += step[j]
+            t_next[j] += t_delta[j]
+
+    def is_blocked(self, a, b, ignore):
+        """Whether a triangle for which ignore is false lies between a and b"""
+        d = sub(b, a)
+        tested = set()
+        for voxel in self.walk(a, b):
+            for t in self.voxels.get(voxel, ()):
+                if t in tested or ignore(t):
+                    continue
+                tested.add(t)
+                if segment_hits_triangle(a, d, *(self.positions[i] for i in self.indices[t])):
+                    return True
+
+        return False
+
+
+def segment_hits_triangle(a, d, p0, p1, p2):
+    # Moeller and Trumbore, leaving out the very ends of the segment
+    e1 = sub(p1, p0)
+    e2 = sub(p2, p0)
+    h = cross(d, e2)
+    det = dot(e1, h)
+    if abs(det) < 1e-12:
+        return False
+
+    s = sub(a, p0)
+    u = dot(s, h) / det
+    if u < 0.0 or u > 1.0:
+        return False
+    q = cross(s, e1)
+    v = dot(d, q) / det
+    if v < 0.0 or u + v > 1.0:
+        return False
+    t = dot(e2, q) / det
+    return 1e-6 < t < 1.0 - 1e-6
+
+
+def random_surface_point(rng, positions, triangle):
+    # uniform over the triangle after Osada et al.
+    a, b, c = (positions[i] for i in triangle)
+    r1 = math.sqrt(rng.random())
+    r2 = rng.random()
+    return tuple((1.0 - r1) * a[j] + r1 * (1.0 - r2) * b[j] + r1 * r2 * c[j] for j in range(3))
+
+
+def compress_row(row):
+    """Stores every run of zero bytes as a zero followed by its length"""
+    data = bytearray()
+    i = 0
+    while i < len(row):
+        if row[i]:
+            data.append(row[i])
+            i += 1
+            continue
+        run = 0
+        while i < len(row) and row[i] == 0 and run < 255:
+            run += 1
+            i += 1
+        data += bytes((0, run))
+
+    return bytes(data)
+
+
+def bake_pvs(positions, indices, chunks, cell_size):
+    """Returns the PVS sections of a mesh and the number of chunks visible
+    from every cell
+
+    Segments start in the empty voxels of a cell, or anywhere in it when it
+    has none, so that they do not start inside walls. They are random and a
+    chunk seen only through a gap narrower than they sample can be missed,
+    bench/pvs.c checks the rows against segments from random cameras.
+    """
+    rng = random.Random(0)
+    points = [positions[i] for t in indices for i in t]
+    low = [min(p[j] for p in points) for j in range(3)]
+    high = [max(p[j] for p in points) for j in range(3)]
+    cell_count = [max(1, math.ceil((high[j] - low[j]) / cell_size)) for j in range(3)]
+
+    chunk_of = [0] * len(indices)
+    chunk_bounds = []
+    chunk_areas = []
+    for c, chunk in enumerate(chunks):
+        for t in chunk:
+            chunk_of[t] = c
+        chunk_points = [positions[i] for t in chunk for i in indices[t]]
+        chunk_bounds.append(([min(p[j] for p in chunk_points) for j in range(3)],
+                             [max(p[j] for p in chunk_points) for j in range(3)]))
+        chunk_areas.append([math.sqrt(dot(n, n)) for n in (triangle_normal(positions, indices[t]) for t in chunk)])
+    grid = VoxelGrid(positions, indices, low, PVS_VOXEL_SIZE)
+
+    row_size = (len(chunks) + 7) // 8
+    cells = [(x, y, z) for z in range(cell_count[2]) for y in range(cell_count[1]) for x in range(cell_count[0])]
+    cell_data = bytearray()
+    pvs_data = bytearray()
+    row_offsets = {}
+    visible_counts = []
+    for cell in cells:
+        cell_low = [low[j] + cell[j] * cell_size for j in range(3)]
+        cell_high = [cell_low[j] + cell_size for j in range(3)]
+        boxes = grid.empty_boxes(cell_low, cell_high) or [(cell_low, cell_high)]
+        volumes = [math.prod(box_high[j] - box_low[j] for j in range(3)) for box_low, box_high in boxes]
+        row = bytearray(row_size)
+        for c, chunk in enumerate(chunks):
+            chunk_low, chunk_high = chunk_bounds[c]
+            is_visible = all(cell_low[j] <= chunk_high[j] and chunk_low[j] <= cell_high[j] for j in range(3))
+            for ray in range(PVS_RAY_COUNT):
+                if is_visible:
+                    break
+                box_low, box_high = rng.choices(boxes, weights=volumes)[0]
+                a = tuple(rng.uniform(box_low[j], box_high[j]) for j in range(3))
+                triangle = rng.choices(chunk, weights=chunk_areas[c])[0]
+                b = random_surface_point(rng, positions, indices[triangle])
+                is_visible = not grid.is_blocked(a, b, lambda t: chunk_of[t] == c)
+            if is_visible:
+                row[c // 8] |= 1 << (c % 8)
+
+        # cells seeing the same chunks share their row
+        compressed = compress_row(row)
+        if compressed not in row_offsets:
+            row_offsets[compressed] = len(pvs_data)
+            pvs_data += compressed
+        cell_data += struct.pack('I', row_offsets[compressed])
+        visible_counts.append(sum(bin(byte).count('1') for byte in row))
+
+    sections = [
+        (MESH_SECTION_PVS, 1, struct.pack('ffffIIII', *low, cell_size, *cell_count, len(chunks))),
+        (MESH_SECTION_PVS_CELLS, len(visible_counts), bytes(cell_data)),
+        (MESH_SECTION_PVS_DATA, len(pvs_data), bytes(pvs_data)),
+    ]
+    return sections, visible_counts
+
+
+def hemisphere_directions(normal, rotation):
+    """Cosine weighted directions around normal from a Fibonacci spiral"""
+    helper = (1.0, 0.0, 0.0) if abs(normal[0]) < 0.9 else (0.0, 1.0, 0.0)
+    tangent = normalize(cross(normal, helper))
+    bitangent = cross(normal, tangent)
+    for k in range(AO_RAY_COUNT):
+        r = math.sqrt((k + 0.5) / AO_RAY_COUNT)
+        phi = k * GOLDEN_ANGLE + rotation
+        x, y, z = r * math.cos(phi), r * math.sin(phi), math.sqrt(1.0 - r * r)
+        yield tuple(x * tangent[j] + y * bitangent[j] + z * normal[j] for j in range(3))
+
+
+# Every lighting worker process keeps the levels of the mesh being converted
+# and builds the voxel grid of a level the first time it lights one of its
+# faces
+light_positions = None
+light_levels = None
+light_grids = {}
+
+
+def init_light_worker(positions, levels):
+    global light_positions, light_levels
+    light_positions = positions
+    light_levels = levels
+    light_grids.clear()
+
+
+def light_faces(task):
+    """Returns the colors of count faces of a level from first"""
+    level, first, count = task
+    indices, normals = light_levels[level]
+    if level not in light_grids:
+        low = [min(p[j] for p in light_positions) for j in range(3)]
+        area = sum(math.sqrt(dot(n, n)) * 0.5 for n in (triangle_normal(light_positions, t) for t in indices))
+        size = max(min(AO_DISTANCE, 2.0 * math.sqrt(area / len(indices))), AO_DISTANCE / 64)
+        light_grids[level] = VoxelGrid(light_positions, indices, low, size)
+    grid = light_grids[level]
+
+    colors = []
+    for t in range(first, first + count):
+        centroid = tuple(sum(light_positions[i][j] for i in indices[t]) / 3 for j in range(3))
+        distance = math.sqrt(dot(sub(centroid, LIGHT_POSITION), sub(centroid, LIGHT_POSITION)))
+        falloff = 1.0 - min(distance, LIGHT_DISTANCE) / LIGHT_DISTANCE
+
+        # faces the light does not reach stay black whatever occludes them
+        occlusion = 0.0
+        normal = normals[t]
+        if falloff > 0.0 and dot(normal, normal) > 0.0:
+            origin = tuple(centroid[j] + normal[j] * AO_BIAS for j in range(3))
+            for d in hemisphere_directions(normal, t * GOLDEN_ANGLE):
+                end = tuple(origin[j] + d[j] * AO_DISTANCE for j in range(3))
+                if grid.is_blocked(origin, end, lambda s: s == t):
+                    occlusion += 1.0 / AO_RAY_COUNT
+
+        colors.append(tuple(c * falloff * (1.0 - occlusion) for c in LIGHT_COLOR))
+
+    return colors
+
+
+def bake_lighting(positions, chunk_lods):
+    """Returns the colors of the faces of every level of every chunk
+
+    The faces of a level are traced against the same level of every chunk, or
+    its coarsest one, so that they are not shadowed by the surface they
+    simplify.
+    """
+    level_count = max(len(lods) for lods in chunk_lods)
+    levels = []
+    ranges = []
+    for level in range(level_count):
+        indices = []
+        normals = []
+        for c, lods in enumerate(chunk_lods):
+            error, lod_indices, lod_normals = lods[min(level, len(lods) - 1)]
+            if level < len(lods):
+                ranges.append((c, level, len(indices), len(lod_indices)))
+            indices += lod_indices
+            normals += lod_normals
+        levels.append((indices, normals))
+
+    tasks = []
+    for c, level, offset, count in ranges:
+        for first in range(offset, offset + count, LIGHT_TASK_SIZE):
+            tasks.append((level, first, min(LIGHT_TASK_SIZE, offset + count - first)))
+    with multiprocessing.Pool(initializer=init_light_worker, initargs=(positions, levels)) as pool:
+        results = pool.map(light_faces, tasks)
+
+    colors = {}
+    for (level, first, count), task_colors in zip(tasks, results):
+        for k, color in enumerate(task_colors):
+            colors[(level, first + k)] = color
+    chunk_colors = [[None] * len(lods) for lods in chunk_lods]
+    for c, level, offset, count in ranges:
+        chunk_colors[c][level] = [colors[(level, t)] for t in range(offset, offset + count)]
+
+    return chunk_colors
+
+
+def write_container(vertex_file_name, flags, sections):
+    header_size = 16 + 16 * len(sections)
+    offset = header_size
+    table = []
+    for section_type, count, data in sections:
+        offset = (offset + MESH_SECTION_ALIGNMENT - 1) // MESH_SECTION_ALIGNMENT * MESH_SECTION_ALIGNMENT
+        table.append((section_type, count, offset, len(data)))
+        offset += len(data)
+
+    with open(vertex_file_name, mode='wb') as vertex:
+        vertex.write(struct.pack('IIII', MESH_MAGIC, MESH_VERSION, flags, len(sections)))
+        for entry in table:
+            vertex.write(struct.pack('IIII', *entry))
+        for (section_type, count, data), (_, _, offset, _) in zip(sections, table):
+            vertex.write(b'\0' * (offset - vertex.tell()))
+            vertex.write(data)
+
+
+def split_chunks(positions, indices, chunk_size):
+    """Groups triangles by the grid cell of their centroid
+
+    Meshes fitting in one cell stay whole. Returns the triangle lists of the
+    chunks and the vertices shared between chunks.
+    """
+    low = [min(p[j] for p in positions) for j in range(3)]
+    high = [max(p[j] for p in positions) for j in range(3)]
+    if all(high[j] - low[j] <= chunk_size for j in range(3)):
+        return [list(range(len(indices)))], set()
+
+    cells = {}
+    for t, triangle in enumerate(indices):
+        centroid = [sum(positions[i][j] for i in triangle) / 3 for j in range(3)]
+        cell = tuple(int(math.floor((centroid[j] - low[j]) / chunk_size)) for j in range(3))
+        cells.setdefault(cell, []).append(t)
+    chunks = [cells[cell] for cell in sorted(cells)]
+
+    vertex_chunk = {}
+    locked = set()
+    for c, chunk in enumerate(chunks):
+        for t in chunk:
+            for i in indices[t]:
+                if vertex_chunk.setdefault(i, c) != c:
+                    locked.add(i)
+
+    return chunks, locked
+
+
+def build_lods(positions, indices, normals, locked):
+    """Returns (error, indices, normals) of every level, the first one being
+    the input with an error of 0
+    """
+    lods = [(0.0, indices, normals)]
+    simplifier = Simplifier(positions, indices, locked)
+    while len(lods) < MESH_MAX_LODS and simplifier.triangle_count > LOD_MIN_TRIANGLES:
+        previous_count = simplifier.triangle_count
+        simplifier.simplify(max(previous_count // 2, LOD_MIN_TRIANGLES))
+        if simplifier.triangle_count > previous_count * LOD_MIN_REDUCTION:
+            break
+
+        lod_indices = simplifier.indices()
+        lod_normals = [normalize(triangle_normal(positions, t)) for t in lod_indices]
+        lods.append((simplifier.error, lod_indices, lod_normals))
+
+    return lods
+
+
+def convert(file_name, flags, chunk_size, pvs_cell_size):
+    triangles = read_stl(file_name)
+    flipped, conflicts = orient_triangles(triangles)
+    if conflicts == 0:
+        flags |= MESH_FLAG_CONSISTENT_WINDING
+
+    positions = []
+    position_index = {}
+    indices = []
+    for normal, vertices in triangles:
+        triangle = []
+        for v in vertices:
+            if v not in position_index:
+                position_index[v] = len(positions)
+                positions.append(v)
+            triangle.append(position_index[v])
+        indices.append(tuple(triangle))
+
+    normals = [face_normal(normal, vertices) for normal, vertices in triangles]
+    chunks, locked = split_chunks(positions, indices, chunk_size)
+
+    # every chunk simplifies on its own, with the vertices on its borders
+    # locked so that neighbouring levels still meet
+    chunk_lods = []
+    for chunk in chunks:
+        chunk_indices = [indices[t] for t in chunk]
+        chunk_normals = [normals[t] for t in chunk]
+        chunk_lods.append(build_lods(positions, chunk_indices, chunk_normals, locked))
+    chunk_colors = bake_lighting(positions, chunk_lods)
+
+    vertex_data = bytearray()
+    meshlet_data = bytearray()
+    meshlet_vertex_data = bytearray()
+    meshlet_triangle_data = bytearray()
+    lod_data = bytearray()
+    chunk_data = bytearray()
+    vertex_offset = 0
+    triangle_offset = 0
+    meshlet_count = 0
+    lod_count = 0
+    for lods, lod_colors in zip(chunk_lods, chunk_colors):
+        points = [positions[i] for t in lods[0][1] for i in t]
+        low = [min(p[j] for p in points) for j in range(3)]
+        high = [max(p[j] for p in points) for j in range(3)]
+        chunk_data += struct.pack('ffffffII', *low, *high, lod_count, len(lods))
+        lod_count += len(lods)
+
+        for (error, lod_indices, lod_normals), colors in zip(lods, lod_colors):
+            centroids = [tuple(sum(positions[i][j] for i in t) / 3 for j in range(3)) for t in lod_indices]
+            meshlets = build_meshlets(lod_indices, lod_normals, centroids)
+            lod_data += struct.pack('fIII', error, meshlet_count, len(meshlets), len(lod_indices))
+            meshlet_count += len(meshlets)
+
+            for meshlet in meshlets:
+                center, radius, axis, cone_cutoff = meshlet_bounds(meshlet, positions, lod_normals)
+                # both sides of a mesh with conflicting winding are drawn
+                if not flags & MESH_FLAG_CONSISTENT_WINDING:
+                    cone_cutoff = 1.0
+                meshlet_data += struct.pack('ffffffffIIII', *center, radius, *axis, cone_cutoff,
+                                            vertex_offset, triangle_offset, len(meshlet.vertices), len(meshlet.triangles))
+
+                for i in meshlet.vertices:
+                    meshlet_vertex_data += struct.pack('I', i)
+
+                # the soup follows the meshlet triangle order so that a meshlet is
+                # also a contiguous vertex range for the traditional pipeline
+                for t in meshlet.triangles:
+                    local = [meshlet.vertex_index[i] for i in lod_indices[t]]
+                    meshlet_triangle_data += struct.pack('I', local[0] | local[1] << 8 | local[2] << 16)
+                    color_b = struct.pack('fff', *colors[t])
+                    for i in lod_indices[t]:
+                        vertex_data += struct.pack('fff', *positions[i]) + color_b
+
+                vertex_offset += len(meshlet.vertices)
+                triangle_offset += len(meshlet.triangles)
+
+    position_data = b''.join(struct.pack('fff', *p) for p in positions)
+
+    sections = [
+        (MESH_SECTION_VERTICES, triangle_offset * 3, vertex_data),
+        (MESH_SECTION_MESHLETS, meshlet_count, meshlet_data),
+        (MESH_SECTION_MESHLET_VERTICES, vertex_offset, meshlet_vertex_data),
+        (MESH_SECTION_MESHLET_TRIANGLES, triangle_offset, meshlet_triangle_data),
+        (MESH_SECTION_POSITIONS, len(positions), position_data),
+        (MESH_SECTION_LODS, lod_count, lod_data),
+        (MESH_SECTION_CHUNKS, len(chunks), chunk_data),
+    ]
+    visible_counts = None
+    if pvs_cell_size:
+        pvs_sections, visible_counts = bake_pvs(positions, indices, chunks, pvs_cell_size)
+        sections += pvs_sections
+
+    vertex_file_name = PurePath(file_name).with_suffix('.vertex')
+    write_container(vertex_file_name, flags, sections)
+
+    lod_stats = [[(error, len(lod_indices)) for error, lod_indices, lod_normals in lods] for lods in chunk_lods]
+    return len(triangles), meshlet_count, lod_stats, visible_counts, (flipped, conflicts)
+
+
+# lighting workers import this script, only the main process converts
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Convert binary STL files to the mesh container')
+    parser.add_argument('--occluder', action='append', default=[],
+                        help='stem of a mesh to rasterize into the software occlusion buffer')
+    parser.add_argument('--chunk-size', type=float, default=CHUNK_SIZE,
+                        help='edge length of the grid cells meshes larger than one are split into')
+    parser.add_argument('--pvs', action='append', default=[],
+                        help='stem of an interior mesh to bake potentially visible sets for')
+    parser.add_argument('--pvs-cell-size', type=float, default=PVS_CELL_SIZE,
+                        help='edge length of the cells potentially visible sets are baked for')
+    parser.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    for file_name in args.files:
+        flags = 0
+        if PurePath(file_name).stem in args.occluder:
+            flags |= MESH_FLAG_OCCLUDER
+
+        pvs_cell_size = args.pvs_cell_size if PurePath(file_name).stem in args.pvs else 0.0
+        triangle_count, meshlet_count, chunks, visible_counts, (flipped, conflicts) = convert(
+            file_name, flags, args.chunk_size, pvs_cell_size)
+        print('{}: {} triangles, {} meshlets, {} chunks'.format(file_name, triangle_count, meshlet_count, len(chunks)))
+        if conflicts:
+            print('  winding: {} flipped, {} edges disagree, drawn double sided'.format(flipped, conflicts))
+        else:
+            print('  winding: {} flipped, consistent'.format(flipped))
+        for lod in range(max(len(lods) for lods in chunks)):
+            levels = [lods[lod] for lods in chunks if lod < len(lods)]
+            print('  lod {}: {} triangles, max error {:.4f}'.format(
+                lod, sum(count for error, count in levels), max(error for error, count in levels)))
+        if visible_counts:
+            print('  pvs: {} cells, {:.1f} of {} chunks visible on average'.format(
+                len(visible_counts), sum(visible_counts) / len(visible_counts), len(chunks)))
@@ -0,0 +1,71 @@
+import argparse
+import struct
+
+# Two closed rooms side by side along x that share one partition wall, the
+# interior the potentially visible sets are checked on by bench/pvs.c
+ROOM_SIZE = (128.0, 32.0, 128.0)
+ROOM_COUNT = 2
+
+# Edge length of the quads every face is split into, so that the rooms span
+# several chunks
+QUAD_SIZE = 16.0
+
+
+def quad_grid(origin, u, v):
+    """Returns the triangles of the parallelogram at origin spanned by u and v,
+    split into quads of about QUAD_SIZE
+    """
+    u_count = max(1, round(max(abs(x) for x in u) / QUAD_SIZE))
+    v_count = max(1, round(max(abs(x) for x in v) / QUAD_SIZE))
+
+    def point(i, j):
+        return tuple(origin[k] + u[k] * i / u_count + v[k] * j / v_count for k in range(3))
+
+    triangles = []
+    for i in range(u_count):
+        for j in range(v_count):
+            a, b, c, d = point(i, j), point(i + 1, j), point(i + 1, j + 1), point(i, j + 1)
+            triangles += [(a, b, c), (a, c, d)]
+
+    return triangles
+
+
+def create_rooms():
+    sx, sy, sz = ROOM_SIZE
+    width = sx * ROOM_COUNT
+    triangles = []
+    # floor, ceiling and the walls along x run through all rooms
+    triangles += quad_grid((0.0, 0.0, 0.0), (0.0, 0.0, sz), (width, 0.0, 0.0))
+    triangles += quad_grid((0.0, sy, 0.0), (width, 0.0, 0.0), (0.0, 0.0, sz))
+    triangles += quad_grid((0.0, 0.0, 0.0), (width, 0.0, 0.0), (0.0, sy, 0.0))
+    triangles += quad_grid((0.0, 0.0, sz), (0.0, sy, 0.0), (width, 0.0, 0.0))
+    # the end walls and the partitions between rooms
+    for room in range(ROOM_COUNT + 1):
+        triangles += quad_grid((room * sx, 0.0, 0.0), (0.0, sy, 0.0), (0.0, 0.0, sz))
+
+    return triangles
+
+
+def write_stl(file_name, triangles):
+    with open(file_name, mode='wb') as stl:
+        stl.write(bytes(80))
+        stl.write(struct.pack('<I', len(triangles)))
+        for a, b, c in triangles:
+            e1 = tuple(b[k] - a[k] for k in range(3))
+            e2 = tuple(c[k] - a[k] for k in range(3))
+            normal = (e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0])
+            length = sum(x * x for x in normal) ** 0.5
+            stl.write(struct.pack('<3f', *(x / length for x in normal)))
+            for p in (a, b, c):
+                stl.write(struct.pack('<3f', *p))
+            stl.write(bytes(2))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Write the two room interior as a binary STL file')
+    parser.add_argument('file', nargs='?', default='asset/mesh/rooms.stl')
+    args = parser.parse_args()
+
+    triangles = create_rooms()
+    write_stl(args.file, triangles)
+    print('{}: {} triangles'.format(args.file, len(triangles)))
@@ -0,0 +1,375 @@
+#include "common/bvh.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_BIN_COUNT 16
+// nodes above this are always split, smaller ones only when the SAH says so
+#define BVH_MAX_LEAF_SIZE 8
+// cost of visiting a node relative to testing an item
+#define BVH_TRAVERSAL_COST 1.0f
+
+struct BuildContext {
+    struct Bvh *bvh;
+    float (*centroids)[3];
+};
+
+struct Bin {
+    struct BvhBounds bounds;
+    uint32_t count;
+};
+
+static void
+reset_bounds(struct BvhBounds *bounds)
+{
+    for (int j = 0; j < 3; j++) {
+        bounds->min[j] = FLT_MAX;
+        bounds->max[j] = -FLT_MAX;
+    }
+}
+
+static void
+grow_bounds(struct BvhBounds *bounds, float const min[static 3], float const max[static 3])
+{
+    for (int j = 0; j < 3; j++) {
+        bounds->min[j] = bounds->min[j] < min[j] ? bounds->min[j] : min[j];
+        bounds->max[j] = bounds->max[j] > max[j] ? bounds->max[j] : max[j];
+    }
+}
+
+// Half the surface area, which is all the heuristic needs
+static float
+get_area(struct BvhBounds const *bounds)
+{
+    float d[3];
+    for (int j = 0; j < 3; j++) {
+        d[j] = bounds->max[j] - bounds->min[j];
+        if (d[j] < 0.0f) {
+            return 0.0f;
+        }
+    }
+
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+}
+
+static void
+swap_items(struct BuildContext *context, uint32_t a, uint32_t b)
+{
+    struct Bvh *bvh = context->bvh;
+
+    uint32_t item = bvh->items[a];
+    bvh->items[a] = bvh->items[b];
+    bvh->items[b] = item;
+
+    struct BvhBounds bounds = bvh->item_bounds[a];
+    bvh->item_bounds[a] = bvh->item_bounds[b];
+    bvh->item_bounds[b] = bounds;
+
+    float centroid[3];
+    memcpy(centroid, context->centroids[a], sizeof centroid);
+    memcpy(context->centroids[a], context->centroids[b], sizeof centroid);
+    memcpy(context->centroids[b], centroid, sizeof centroid);
+}
+
+static uint32_t
+get_bin(float const centroid, float const min, float const scale)
+{
+    uint32_t bin = (uint32_t)((centroid - min) * scale);
+
+    return bin < BVH_BIN_COUNT ? bin : BVH_BIN_COUNT - 1;
+}
+
+// Emits the node for items [first, first + count) followed by its subtree and
+// returns its index
+static uint32_t
+build_node(struct BuildContext *context, uint32_t const first, uint32_t const count, uint32_t const depth)
+{
+    struct Bvh *bvh = context->bvh;
+    uint32_t const node_index = bvh->node_count++;
+    struct BvhNode *node = &bvh->nodes[node_index];
+
+    struct BvhBounds bounds;
+    struct BvhBounds centroid_bounds;
+    reset_bounds(&bounds);
+    reset_bounds(&centroid_bounds);
+    for (uint32_t i = first; i < first + count; i++) {
+        grow_bounds(&bounds, bvh->item_bounds[i].min, bvh->item_bounds[i].max);
+        grow_bounds(&centroid_bounds, context->centroids[i], context->centroids[i]);
+    }
+    memcpy(node->min, bounds.min, sizeof node->min);
+    memcpy(node->max, bounds.max, sizeof node->max);
+    node->right_or_first = first;
+    node->count = count;
+
+    if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH) {
+        return node_index;
+    }
+
+    // sweep the bins of every axis for the cheapest split plane
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    uint32_t best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float const extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float const scale = BVH_BIN_COUNT / extent;
+
+        struct Bin bins[BVH_BIN_COUNT];
+        for (uint32_t b = 0; b < BVH_BIN_COUNT; b++) {
+            reset_bounds(&bins[b].bounds);
+            bins[b].count = 0;
+        }
+        for (uint32_t i = first; i < first + count; i++) {
+            struct Bin *bin = &bins[get_bin(context->centroids[i][axis], centroid_bounds.min[axis], scale)];
+            grow_bounds(&bin->bounds, bvh->item_bounds[i].min, bvh->item_bounds[i].max);
+            bin->count++;
+        }
+
+        float right_areas[BVH_BIN_COUNT];
+        uint32_t right_counts[BVH_BIN_COUNT];
+        struct BvhBounds right;
+        reset_bounds(&right);
+        uint32_t right_count = 0;
+        for (uint32_t b = BVH_BIN_COUNT - 1; b > 0; b--) {
+            grow_bounds(&right, bins[b].bounds.min, bins[b].bounds.max);
+            right_count += bins[b].count;
+            right_areas[b] = get_area(&right);
+            right_counts[b] = right_count;
+        }
+
+        struct BvhBounds left;
+        reset_bounds(&left);
+        uint32_t left_count = 0;
+        for (uint32_t b = 1; b < BVH_BIN_COUNT; b++) {
+            grow_bounds(&left, bins[b - 1].bounds.min, bins[b - 1].bounds.max);
+            left_count += bins[b - 1].count;
+            if (left_count == 0 || right_counts[b] == 0) {
+                continue;
+            }
+
+            float const cost = get_area(&left) * left_count + right_areas[b] * right_counts[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    // items sharing one centroid cannot be told apart by any plane
+    if (best_axis < 0) {
+        return node_index;
+    }
+
+    float const area = get_area(&bounds);
+    float const split_cost = BVH_TRAVERSAL_COST + (area > 0.0f ? best_cost / area : 0.0f);
+    if (count <= BVH_MAX_LEAF_SIZE && split_cost >= count) {
+        return node_index;
+    }
+
+    float const scale = BVH_BIN_COUNT / (centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+    uint32_t middle = first;
+    for (uint32_t i = first; i < first + count; i++) {
+        if (get_bin(context->centroids[i][best_axis], centroid_bounds.min[best_axis], scale) < best_split) {
+            swap_items(context, i, middle++);
+        }
+    }
+    assert(middle > first && middle < first + count);
+
+    uint32_t const left_index = build_node(context, first, middle - first, depth + 1);
+    assert(left_index == node_index + 1);
+    (void)left_index;
+    uint32_t const right_index = build_node(context, middle, first + count - middle, depth + 1);
+
+    node = &bvh->nodes[node_index];
+    node->right_or_first = right_index;
+    node->count = 0;
+
+    return node_index;
+}
+
+void
+bvh_build(struct Bvh *bvh, uint32_t const count, struct BvhBounds const bounds[static const count])
+{
+    memset(bvh, 0, sizeof *bvh);
+    bvh->item_count = count;
+    bvh->items = malloc((count ? count : 1) * sizeof *bvh->items);
+    bvh->item_bounds = malloc((count ? count : 1) * sizeof *bvh->item_bounds);
+    bvh->nodes = malloc((count ? 2 * count - 1 : 1) * sizeof *bvh->nodes);
+    assert(bvh->items && bvh->item_bounds && bvh->nodes);
+    if (count == 0) {
+        return;
+    }
+
+    struct BuildContext context = {
+        .bvh = bvh,
+        .centroids = malloc(count * sizeof *context.centroids),
+    };
+    assert(context.centroids);
+    for (uint32_t i = 0; i < count; i++) {
+        bvh->items[i] = i;
+        bvh->item_bounds[i] = bounds[i];
+        for (int j = 0; j < 3; j++) {
+            context.centroids[i][j] = (bounds[i].min[j] + bounds[i].max[j]) * 0.5f;
+        }
+    }
+
+    build_node(&context, 0, count, 0);
+    free(context.centroids);
+}
+
+void
+bvh_free(struct Bvh *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->items);
+    free(bvh->item_bounds);
+    memset(bvh, 0, sizeof *bvh);
+}
+
+void
+bvh_refit(struct Bvh *bvh, uint32_t const count, struct BvhBounds const bounds[static const count])
+{
+    assert(count == bvh->item_count);
+    for (uint32_t i = 0; i < count; i++) {
+        bvh->item_bounds[i] = bounds[bvh->items[i]];
+    }
+
+    // children always follow their parent, so walking backwards visits them
+    // first
+    for (uint32_t n = bvh->node_count; n-- > 0;) {
+        struct BvhNode *node = &bvh->nodes[n];
+        struct BvhBounds node_bounds;
+        reset_bounds(&node_bounds);
+        if (node->count) {
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                grow_bounds(&node_bounds, bvh->item_bounds[i].min, bvh->item_bounds[i].max);
+            }
+        } else {
+            struct BvhNode const *left = &bvh->nodes[n + 1];
+            struct BvhNode const *right = &bvh->nodes[node->right_or_first];
+            grow_bounds(&node_bounds, left->min, left->max);
+            grow_bounds(&node_bounds, right->min, right->max);
+        }
+        memcpy(node->min, node_bounds.min, sizeof node->min);
+        memcpy(node->max, node_bounds.max, sizeof node->max);
+    }
+}
+
+// Clears the bit of every plane the box is fully inside of and returns 0 when
+// the box is fully outside of one
+static int
+cull_box(float planes[static 6][4], float const min[static 3], float const max[static 3], uint32_t *plane_mask)
+{
+    for (int p = 0; p < 6; p++) {
+        if (!(*plane_mask & (1u << p))) {
+            continue;
+        }
+
+        float const *plane = planes[p];
+        float farthest = plane[3];
+        float nearest = plane[3];
+        for (int j = 0; j < 3; j++) {
+            farthest += plane[j] * (plane[j] >= 0.0f ? max[j] : min[j]);
+            nearest += plane[j] * (plane[j] >= 0.0f ? min[j] : max[j]);
+        }
+        if (farthest < 0.0f) {
+            return 0;
+        }
+        if (nearest >= 0.0f) {
+            *plane_mask &= ~(1u << p);
+        }
+    }
+
+    return 1;
+}
+
+uint32_t
+bvh_query_frustum(struct Bvh const *bvh, float planes[static 6][4], uint32_t result[])
+{
+    if (bvh->item_count == 0) {
+        return 0;
+    }
+
+    // planes a node is fully inside of are not tested again below it
+    uint32_t stack[BVH_MAX_DEPTH + 1];
+    uint32_t stack_masks[BVH_MAX_DEPTH + 1];
+    uint32_t stack_size = 0;
+    stack[stack_size] = 0;
+    stack_masks[stack_size++] = 0x3f;
+
+    uint32_t result_count = 0;
+    while (stack_size) {
+        stack_size--;
+        struct BvhNode const *node = &bvh->nodes[stack[stack_size]];
+        uint32_t plane_mask = stack_masks[stack_size];
+        if (plane_mask && !cull_box(planes, node->min, node->max, &plane_mask)) {
+            continue;
+        }
+
+        if (node->count) {
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                uint32_t item_mask = plane_mask;
+                if (!item_mask || cull_box(planes, bvh->item_bounds[i].min, bvh->item_bounds[i].max, &item_mask)) {
+                    result[result_count++] = bvh->items[i];
+                }
+            }
+            continue;
+        }
+
+        stack[stack_size] = node->right_or_first;
+        stack_masks[stack_size++] = plane_mask;
+        stack[stack_size] = (uint32_t)(node - bvh->nodes) + 1;
+        stack_masks[stack_size++] = plane_mask;
+    }
+
+    return result_count;
+}
+
+static int
+is_overlapping(float const min[static 3], float const max[static 3], struct BvhBounds const *range)
+{
+    return min[0] <= range->max[0] && max[0] >= range->min[0]
+        && min[1] <= range->max[1] && max[1] >= range->min[1]
+        && min[2] <= range->max[2] && max[2] >= range->min[2];
+}
+
+uint32_t
+bvh_query_range(struct Bvh const *bvh, struct BvhBounds const *range, uint32_t result[])
+{
+    if (bvh->item_count == 0) {
+        return 0;
+    }
+
+    uint32_t stack[BVH_MAX_DEPTH + 1];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    uint32_t result_count = 0;
+    while (stack_size) {
+        uint32_t const node_index = stack[--stack_size];
+        struct BvhNode const *node = &bvh->nodes[node_index];
+        if (!is_overlapping(node->min, node->max, range)) {
+            continue;
+        }
+
+        if (node->count) {
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                if (is_overlapping(bvh->item_bounds[i].min, bvh->item_bounds[i].max, range)) {
+                    result[result_count++] = bvh->items[i];
+                }
+            }
+            continue;
+        }
+
+        stack[stack_size++] = node->right_or_first;
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return result_count;
+}
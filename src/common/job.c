@@ -0,0 +1,273 @@
+#include "common/job.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_JOB_THREADS 64
+
+struct JobBatch {
+    JobFunction function;
+    void *data;
+    uint32_t count;
+    atomic_uint next;
+    atomic_uint done;
+};
+
+static thrd_t threads[MAX_JOB_THREADS];
+static uint32_t thread_count;
+static mtx_t batch_mutex;
+static mtx_t submit_mutex;
+static cnd_t batch_posted;
+static cnd_t batch_done;
+static struct JobBatch batch;
+static uint64_t batch_generation;
+static uint32_t active_worker_count;
+static int is_running;
+static struct JobNode *graph_nodes;
+static double graph_begin_us;
+static uint64_t graph_done_mask;
+static mtx_t graph_mutex;
+static cnd_t graph_node_done;
+
+static uint32_t
+get_processor_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (count < 1) {
+        return 1;
+    }
+    if (count > MAX_JOB_THREADS) {
+        return MAX_JOB_THREADS;
+    }
+
+    return count;
+}
+
+// Takes indices of the current batch until it runs out
+static void
+run_batch(void)
+{
+    for (;;) {
+        uint32_t index = atomic_fetch_add(&batch.next, 1);
+        if (index >= batch.count) {
+            break;
+        }
+
+        batch.function(batch.data, index);
+        atomic_fetch_add(&batch.done, 1);
+    }
+}
+
+static int
+worker(void *arg)
+{
+    (void)arg;
+    uint64_t seen_generation = 0;
+
+    mtx_lock(&batch_mutex);
+    for (;;) {
+        while (is_running && seen_generation == batch_generation) {
+            cnd_wait(&batch_posted, &batch_mutex);
+        }
+        if (!is_running) {
+            break;
+        }
+        seen_generation = batch_generation;
+        active_worker_count++;
+        mtx_unlock(&batch_mutex);
+
+        run_batch();
+
+        mtx_lock(&batch_mutex);
+        active_worker_count--;
+        cnd_broadcast(&batch_done);
+    }
+    mtx_unlock(&batch_mutex);
+
+    return 0;
+}
+
+static void
+init(void)
+{
+    mtx_init(&batch_mutex, mtx_plain);
+    mtx_init(&submit_mutex, mtx_plain);
+    cnd_init(&batch_posted);
+    cnd_init(&batch_done);
+    mtx_init(&graph_mutex, mtx_plain);
+    cnd_init(&graph_node_done);
+    is_running = 1;
+
+    // the thread calling parallel_for works on the batch too
+    thread_count = get_processor_count();
+    for (uint32_t i = 0; i + 1 < thread_count; i++) {
+        int status = thrd_create(&threads[i], worker, 0);
+        assert(status == thrd_success);
+    }
+}
+
+static void
+deinit(void)
+{
+    mtx_lock(&batch_mutex);
+    is_running = 0;
+    cnd_broadcast(&batch_posted);
+    mtx_unlock(&batch_mutex);
+
+    for (uint32_t i = 0; i + 1 < thread_count; i++) {
+        thrd_join(threads[i], 0);
+    }
+
+    cnd_destroy(&graph_node_done);
+    mtx_destroy(&graph_mutex);
+    cnd_destroy(&batch_done);
+    cnd_destroy(&batch_posted);
+    mtx_destroy(&submit_mutex);
+    mtx_destroy(&batch_mutex);
+}
+
+static uint32_t
+get_thread_count(void)
+{
+    return thread_count;
+}
+
+// Hands the batch to the workers, the caller decides whether to work on it
+// too. Holds the submit mutex until wait_batch.
+static void
+post_batch(uint32_t count, JobFunction function, void *data)
+{
+    mtx_lock(&submit_mutex);
+
+    mtx_lock(&batch_mutex);
+    batch.function = function;
+    batch.data = data;
+    batch.count = count;
+    atomic_store(&batch.next, 0);
+    atomic_store(&batch.done, 0);
+    batch_generation++;
+    cnd_broadcast(&batch_posted);
+    mtx_unlock(&batch_mutex);
+}
+
+// The batch is only reused after every worker has left it
+static void
+wait_batch(uint32_t count)
+{
+    mtx_lock(&batch_mutex);
+    while (atomic_load(&batch.done) < count || active_worker_count) {
+        cnd_wait(&batch_done, &batch_mutex);
+    }
+    mtx_unlock(&batch_mutex);
+
+    mtx_unlock(&submit_mutex);
+}
+
+// Calls function(data, i) for every i below count across the job threads and
+// returns once all of them have finished
+static void
+parallel_for(uint32_t count, JobFunction function, void *data)
+{
+    if (count == 0) {
+        return;
+    }
+
+    post_batch(count, function, data);
+    run_batch();
+    wait_batch(count);
+}
+
+static double
+get_time_us(void)
+{
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+
+    return time.tv_sec * 1000000.0 + time.tv_nsec / 1000.0;
+}
+
+static void
+run_node(uint32_t index)
+{
+    struct JobNode *node = &graph_nodes[index];
+
+    mtx_lock(&graph_mutex);
+    while ((graph_done_mask & node->dependencies) != node->dependencies) {
+        cnd_wait(&graph_node_done, &graph_mutex);
+    }
+    mtx_unlock(&graph_mutex);
+
+    node->begin_us = get_time_us() - graph_begin_us;
+    node->function(node->data, index);
+    node->end_us = get_time_us() - graph_begin_us;
+
+    mtx_lock(&graph_mutex);
+    graph_done_mask |= 1ull << index;
+    cnd_broadcast(&graph_node_done);
+    mtx_unlock(&graph_mutex);
+}
+
+static void
+run_worker_node(void *data, uint32_t index)
+{
+    (void)data;
+    if (!graph_nodes[index].is_on_caller) {
+        run_node(index);
+    }
+}
+
+// Workers take the nodes in order and wait for their dependencies, so the
+// earliest unfinished node always has a thread on it or one free to take
+// it. Without workers the caller runs every node in order.
+static void
+run_graph(uint32_t count, struct JobNode nodes[static count])
+{
+    assert(count <= JOB_MAX_NODES);
+    for (uint32_t i = 0; i < count; i++) {
+        assert(nodes[i].dependencies >> i == 0);
+    }
+
+    graph_nodes = nodes;
+    graph_done_mask = 0;
+    graph_begin_us = get_time_us();
+    if (thread_count == 1) {
+        for (uint32_t i = 0; i < count; i++) {
+            run_node(i);
+        }
+        return;
+    }
+
+    post_batch(count, run_worker_node, 0);
+    for (uint32_t i = 0; i < count; i++) {
+        if (nodes[i].is_on_caller) {
+            run_node(i);
+        }
+    }
+    run_batch();
+    wait_batch(count);
+}
+
+const struct Jobs jobs = {
+    .init = init,
+    .deinit = deinit,
+    .get_thread_count = get_thread_count,
+    .parallel_for = parallel_for,
+    .run_graph = run_graph,
+};
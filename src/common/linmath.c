@@ -42,6 +42,16 @@ float vec3_dot(float a[static 3], float b[static 3]) {
     return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
 }
 
+// Transform a row vector by a matrix, matching the shader's m * v
+void vec4_mul_mat4(float v[static 4], float a[static 4], float m[static 4][4]) {
+    float temp[4];
+    for (size_t col = 0; col < 4; col++) {
+        temp[col] = a[0] * m[0][col] + a[1] * m[1][col] + a[2] * m[2][col] + a[3] * m[3][col];
+    }
+
+    memcpy(v, temp, sizeof temp);
+}
+
 // Multiply 2 matrixes together
 // assertions
 //   m is already zeroed
@@ -130,3 +140,25 @@ void mat4_perspective(float m[static 4][4], float aspect, float fovy, float n, f
 
     mat4_mul(m, p, c);
 }
+
+// Extract the world space frustum planes of a view projection matrix
+// planes are ordered left, right, bottom, top, near, far
+// a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+void mat4_frustum(float planes[static 6][4], float m[static 4][4]) {
+    for (size_t i = 0; i < 4; i++) {
+        planes[0][i] = m[i][3] + m[i][0];
+        planes[1][i] = m[i][3] - m[i][0];
+        planes[2][i] = m[i][3] + m[i][1];
+        planes[3][i] = m[i][3] - m[i][1];
+        planes[4][i] = m[i][2];
+        planes[5][i] = m[i][3] - m[i][2];
+    }
+
+    for (size_t i = 0; i < 6; i++) {
+        float l = vec3_length(planes[i]);
+        planes[i][0] /= l;
+        planes[i][1] /= l;
+        planes[i][2] /= l;
+        planes[i][3] /= l;
+    }
+}
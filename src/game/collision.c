@@ -0,0 +1,428 @@
+#include "game/collision.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/bvh.h"
+#include "graphics/vertex.h"
+
+// Swept sphere collision against static triangles
+//   Triangles are found through a BVH over their bounds. A move sweeps the
+//   sphere to its first contact, keeps the rest of the motion that runs along
+//   the contact plane and sweeps again. Triangles are two sided.
+#define MAX_SLIDE_ITERATIONS 4
+#define MAX_DEPENETRATION_ITERATIONS 4
+// gap kept to a contact so that the next sweep does not start touching it
+#define CONTACT_DISTANCE 0.001f
+
+struct Triangle {
+    float v[3][3];
+    float normal[3];
+};
+
+static struct Triangle *triangles;
+static uint32_t triangle_count;
+static struct Bvh triangle_bvh;
+static uint32_t *candidates;
+static int is_built;
+
+static float
+dot(float const a[static 3], float const b[static 3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void
+sub(float v[static 3], float const a[static 3], float const b[static 3])
+{
+    v[0] = a[0] - b[0];
+    v[1] = a[1] - b[1];
+    v[2] = a[2] - b[2];
+}
+
+// v = a + b * s
+static void
+add_scaled(float v[static 3], float const a[static 3], float const b[static 3], float const s)
+{
+    v[0] = a[0] + b[0] * s;
+    v[1] = a[1] + b[1] * s;
+    v[2] = a[2] + b[2] * s;
+}
+
+// Lowest root of a * t^2 + b * t + c when it lies in [0, max). Spheres never
+// start a sweep overlapping a feature, so the later root is not a contact.
+static int
+get_lowest_root(float const a, float const b, float const c, float const max, float *root)
+{
+    float const determinant = b * b - 4.0f * a * c;
+    if (determinant < 0.0f || a == 0.0f) {
+        return 0;
+    }
+
+    float const sqrt_determinant = sqrtf(determinant);
+    float const lowest = fminf((-b - sqrt_determinant) / (2.0f * a), (-b + sqrt_determinant) / (2.0f * a));
+    if (lowest < 0.0f || lowest >= max) {
+        return 0;
+    }
+
+    *root = lowest;
+    return 1;
+}
+
+// Closest point of a triangle to p, after Ericson's Real-Time Collision Detection
+static void
+get_closest_point(struct Triangle const *triangle, float const p[static 3], float closest[static 3])
+{
+    float const *a = triangle->v[0];
+    float const *b = triangle->v[1];
+    float const *c = triangle->v[2];
+    float ab[3], ac[3], ap[3], bp[3], cp[3];
+    sub(ab, b, a);
+    sub(ac, c, a);
+    sub(ap, p, a);
+
+    float const d1 = dot(ab, ap);
+    float const d2 = dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        memcpy(closest, a, 3 * sizeof *closest);
+        return;
+    }
+
+    sub(bp, p, b);
+    float const d3 = dot(ab, bp);
+    float const d4 = dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        memcpy(closest, b, 3 * sizeof *closest);
+        return;
+    }
+
+    float const vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        add_scaled(closest, a, ab, d1 / (d1 - d3));
+        return;
+    }
+
+    sub(cp, p, c);
+    float const d5 = dot(ab, cp);
+    float const d6 = dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        memcpy(closest, c, 3 * sizeof *closest);
+        return;
+    }
+
+    float const vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        add_scaled(closest, a, ac, d2 / (d2 - d6));
+        return;
+    }
+
+    float const va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        float bc[3];
+        sub(bc, c, b);
+        add_scaled(closest, b, bc, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        return;
+    }
+
+    float const denominator = 1.0f / (va + vb + vc);
+    float const v = vb * denominator;
+    float const w = vc * denominator;
+    for (int j = 0; j < 3; j++) {
+        closest[j] = a[j] + ab[j] * v + ac[j] * w;
+    }
+}
+
+static int
+is_inside_triangle(struct Triangle const *triangle, float const p[static 3])
+{
+    for (int k = 0; k < 3; k++) {
+        float edge[3], to_p[3], normal[3];
+        sub(edge, triangle->v[(k + 1) % 3], triangle->v[k]);
+        sub(to_p, p, triangle->v[k]);
+        normal[0] = edge[1] * to_p[2] - edge[2] * to_p[1];
+        normal[1] = edge[2] * to_p[0] - edge[0] * to_p[2];
+        normal[2] = edge[0] * to_p[1] - edge[1] * to_p[0];
+        if (dot(normal, triangle->normal) < 0.0f) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Lowers *t to the first time in [0, *t) at which the sphere moving from p
+// along v touches the triangle, after Fauerby's Improved Collision Detection
+// and Response. A sphere already touching the face and moving into it stops
+// at once.
+static int
+sweep_triangle(
+    struct Triangle const *triangle,
+    float const p[static 3],
+    float const v[static 3],
+    float const radius,
+    float *t,
+    float contact[static 3])
+{
+    float normal[3];
+    memcpy(normal, triangle->normal, sizeof normal);
+    float distance = dot(normal, p) - dot(normal, triangle->v[0]);
+    if (distance < 0.0f) {
+        distance = -distance;
+        for (int j = 0; j < 3; j++) {
+            normal[j] = -normal[j];
+        }
+    }
+
+    float const normal_speed = dot(normal, v);
+    if (distance >= radius && normal_speed >= 0.0f) {
+        return 0;
+    }
+
+    float plane_point[3];
+    if (distance < radius) {
+        add_scaled(plane_point, p, normal, -distance);
+        if (normal_speed < 0.0f && is_inside_triangle(triangle, plane_point)) {
+            *t = 0.0f;
+            memcpy(contact, plane_point, sizeof plane_point);
+            return 1;
+        }
+    } else {
+        float const t0 = (radius - distance) / normal_speed;
+        if (t0 >= *t) {
+            return 0;
+        }
+
+        add_scaled(plane_point, p, v, t0);
+        add_scaled(plane_point, plane_point, normal, -radius);
+        if (is_inside_triangle(triangle, plane_point)) {
+            *t = t0;
+            memcpy(contact, plane_point, sizeof plane_point);
+            return 1;
+        }
+    }
+
+    int is_hit = 0;
+    float const speed_squared = dot(v, v);
+    for (int k = 0; k < 3; k++) {
+        float const *vertex = triangle->v[k];
+        float to_p[3];
+        sub(to_p, p, vertex);
+        float root;
+        if (get_lowest_root(speed_squared, 2.0f * dot(v, to_p), dot(to_p, to_p) - radius * radius, *t, &root)) {
+            *t = root;
+            memcpy(contact, vertex, 3 * sizeof *contact);
+            is_hit = 1;
+        }
+    }
+
+    for (int k = 0; k < 3; k++) {
+        float const *start = triangle->v[k];
+        float edge[3], base[3];
+        sub(edge, triangle->v[(k + 1) % 3], start);
+        sub(base, start, p);
+        float const edge_squared = dot(edge, edge);
+        float const edge_dot_v = dot(edge, v);
+        float const edge_dot_base = dot(edge, base);
+
+        float const a = edge_squared * -speed_squared + edge_dot_v * edge_dot_v;
+        float const b = edge_squared * 2.0f * dot(v, base) - 2.0f * edge_dot_v * edge_dot_base;
+        float const c = edge_squared * (radius * radius - dot(base, base)) + edge_dot_base * edge_dot_base;
+        float root;
+        if (!get_lowest_root(a, b, c, *t, &root)) {
+            continue;
+        }
+
+        float const f = (edge_dot_v * root - edge_dot_base) / edge_squared;
+        if (f >= 0.0f && f <= 1.0f) {
+            *t = root;
+            add_scaled(contact, start, edge, f);
+            is_hit = 1;
+        }
+    }
+
+    return is_hit;
+}
+
+static uint32_t
+query_sphere(float const p[static 3], float const v[static 3], float const radius)
+{
+    struct BvhBounds range;
+    for (int j = 0; j < 3; j++) {
+        range.min[j] = fminf(p[j], p[j] + v[j]) - radius - CONTACT_DISTANCE;
+        range.max[j] = fmaxf(p[j], p[j] + v[j]) + radius + CONTACT_DISTANCE;
+    }
+
+    return bvh_query_range(&triangle_bvh, &range, candidates);
+}
+
+// Pushes the sphere out of the triangles it overlaps
+static void
+depenetrate(float p[static 3], float const radius)
+{
+    float const zero[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t iteration = 0; iteration < MAX_DEPENETRATION_ITERATIONS; iteration++) {
+        int is_overlapping = 0;
+        uint32_t const count = query_sphere(p, zero, radius);
+        for (uint32_t i = 0; i < count; i++) {
+            struct Triangle const *triangle = &triangles[candidates[i]];
+            float closest[3], away[3];
+            get_closest_point(triangle, p, closest);
+            sub(away, p, closest);
+            float const distance = sqrtf(dot(away, away));
+            if (distance >= radius) {
+                continue;
+            }
+
+            if (distance > 0.0f) {
+                add_scaled(p, p, away, (radius + CONTACT_DISTANCE - distance) / distance);
+            } else {
+                add_scaled(p, p, triangle->normal, radius + CONTACT_DISTANCE);
+            }
+            is_overlapping = 1;
+        }
+
+        if (!is_overlapping) {
+            break;
+        }
+    }
+}
+
+static void
+init(void)
+{
+    triangles = 0;
+    triangle_count = 0;
+    candidates = 0;
+    is_built = 0;
+}
+
+static void
+deinit(void)
+{
+    if (is_built) {
+        bvh_free(&triangle_bvh);
+    }
+    free(candidates);
+    free(triangles);
+    triangles = 0;
+    triangle_count = 0;
+    candidates = 0;
+    is_built = 0;
+}
+
+static void
+add_collider(uint32_t const count, struct Vertex const vertices[static const count])
+{
+    assert(!is_built);
+    struct Triangle *resized = realloc(triangles, (triangle_count + count / 3) * sizeof *triangles);
+    assert(resized != 0);
+    triangles = resized;
+
+    for (uint32_t i = 0; i + 2 < count; i += 3) {
+        struct Triangle *triangle = &triangles[triangle_count];
+        for (int k = 0; k < 3; k++) {
+            triangle->v[k][0] = vertices[i + k].pos.x;
+            triangle->v[k][1] = vertices[i + k].pos.y;
+            triangle->v[k][2] = vertices[i + k].pos.z;
+        }
+
+        float ab[3], ac[3];
+        sub(ab, triangle->v[1], triangle->v[0]);
+        sub(ac, triangle->v[2], triangle->v[0]);
+        float normal[3] = {
+            ab[1] * ac[2] - ab[2] * ac[1],
+            ab[2] * ac[0] - ab[0] * ac[2],
+            ab[0] * ac[1] - ab[1] * ac[0],
+        };
+        float const length = sqrtf(dot(normal, normal));
+        // degenerate triangles have no face and no area to touch
+        if (length == 0.0f) {
+            continue;
+        }
+        for (int j = 0; j < 3; j++) {
+            triangle->normal[j] = normal[j] / length;
+        }
+        triangle_count++;
+    }
+}
+
+static void
+build(void)
+{
+    assert(!is_built);
+    struct BvhBounds *bounds = malloc((triangle_count ? triangle_count : 1) * sizeof *bounds);
+    assert(bounds != 0);
+    for (uint32_t i = 0; i < triangle_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            bounds[i].min[j] = fminf(fminf(triangles[i].v[0][j], triangles[i].v[1][j]), triangles[i].v[2][j]);
+            bounds[i].max[j] = fmaxf(fmaxf(triangles[i].v[0][j], triangles[i].v[1][j]), triangles[i].v[2][j]);
+        }
+    }
+
+    bvh_build(&triangle_bvh, triangle_count, bounds);
+    free(bounds);
+
+    candidates = malloc((triangle_count ? triangle_count : 1) * sizeof *candidates);
+    assert(candidates != 0);
+    is_built = 1;
+}
+
+static void
+move_sphere(float position[static 3], float const radius, float const delta[static 3])
+{
+    assert(is_built);
+    depenetrate(position, radius);
+
+    float v[3];
+    memcpy(v, delta, sizeof v);
+    for (uint32_t iteration = 0; iteration < MAX_SLIDE_ITERATIONS; iteration++) {
+        float const length = sqrtf(dot(v, v));
+        if (length <= CONTACT_DISTANCE) {
+            break;
+        }
+
+        float t = 1.0f;
+        float contact[3];
+        int is_hit = 0;
+        uint32_t const count = query_sphere(position, v, radius);
+        for (uint32_t i = 0; i < count; i++) {
+            is_hit |= sweep_triangle(&triangles[candidates[i]], position, v, radius, &t, contact);
+        }
+
+        if (!is_hit) {
+            add_scaled(position, position, v, 1.0f);
+            break;
+        }
+
+        // stop short of the contact and slide what is left of the motion
+        // along the plane touching the sphere there
+        float touch[3], normal[3], target[3], rest[3];
+        add_scaled(touch, position, v, t);
+        add_scaled(target, position, v, 1.0f);
+        sub(normal, touch, contact);
+        float const normal_length = sqrtf(dot(normal, normal));
+        float const travel = fmaxf(t * length - CONTACT_DISTANCE, 0.0f);
+        add_scaled(position, position, v, travel / length);
+        if (normal_length == 0.0f) {
+            break;
+        }
+        for (int j = 0; j < 3; j++) {
+            normal[j] /= normal_length;
+        }
+
+        sub(rest, target, position);
+        add_scaled(v, rest, normal, -dot(rest, normal));
+    }
+}
+
+const struct Collision collision = {
+    .init = init,
+    .deinit = deinit,
+    .add_collider = add_collider,
+    .build = build,
+    .move_sphere = move_sphere,
+};
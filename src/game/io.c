@@ -3,17 +3,130 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "graphics/mesh.h"
 #include "graphics/vertex.h"
 
-void
-io_get_triangle_count(FILE *file, uint32_t *count)
+// Reads the first section of a type, or returns 0 when it is missing or its
+// size does not match the element size
+static void *
+read_section(
+    FILE *file,
+    uint32_t const section_count,
+    struct MeshSection const sections[static const section_count],
+    uint32_t const type,
+    size_t const element_size,
+    uint32_t *count)
+{
+    for (uint32_t i = 0; i < section_count; i++) {
+        if (sections[i].type != type) {
+            continue;
+        }
+
+        if (sections[i].size != sections[i].count * element_size) {
+            return 0;
+        }
+
+        void *data = malloc(sections[i].size ? sections[i].size : 1);
+        if (fseek(file, sections[i].offset, SEEK_SET) != 0 || fread(data, 1, sections[i].size, file) != sections[i].size) {
+            free(data);
+            return 0;
+        }
+
+        *count = sections[i].count;
+        return data;
+    }
+
+    return 0;
+}
+
+// The sets are optional, but when present they cover every cell and chunk
+static int
+is_pvs_valid(struct Mesh const *mesh, uint32_t const pvs_count)
+{
+    if (!mesh->pvs && !mesh->pvs_cells && !mesh->pvs_data) {
+        return 1;
+    }
+    if (!mesh->pvs || !mesh->pvs_cells || !mesh->pvs_data || pvs_count != 1) {
+        return 0;
+    }
+
+    struct MeshPvs const *pvs = mesh->pvs;
+    uint64_t const cell_count = (uint64_t)pvs->cell_count[0] * pvs->cell_count[1] * pvs->cell_count[2];
+    if (pvs->chunk_count != mesh->chunk_count || cell_count != mesh->pvs_cell_count || !(pvs->cell_size > 0.0f)) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < mesh->pvs_cell_count; i++) {
+        if (mesh->pvs_cells[i] >= mesh->pvs_data_size) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Returns 1 when the file is a mesh container of this version with every
+// section the renderer needs
+int
+io_load_mesh(FILE *file, struct Mesh *mesh)
 {
-    fread(count, sizeof *count, 1, file);
+    memset(mesh, 0, sizeof *mesh);
+
+    struct MeshHeader header;
+    if (fread(&header, sizeof header, 1, file) != 1) {
+        return 0;
+    }
+    if (header.magic != MESH_MAGIC || header.version != MESH_VERSION || header.section_count > MESH_MAX_SECTIONS) {
+        return 0;
+    }
+
+    struct MeshSection sections[MESH_MAX_SECTIONS];
+    if (fread(sections, sizeof *sections, header.section_count, file) != header.section_count) {
+        return 0;
+    }
+
+    mesh->flags = header.flags;
+    mesh->vertices = read_section(file, header.section_count, sections, MESH_SECTION_VERTICES, sizeof *mesh->vertices, &mesh->vertex_count);
+    mesh->meshlets = read_section(file, header.section_count, sections, MESH_SECTION_MESHLETS, sizeof *mesh->meshlets, &mesh->meshlet_count);
+    mesh->meshlet_vertices = read_section(file, header.section_count, sections, MESH_SECTION_MESHLET_VERTICES, sizeof *mesh->meshlet_vertices, &mesh->meshlet_vertex_count);
+    mesh->meshlet_triangles = read_section(file, header.section_count, sections, MESH_SECTION_MESHLET_TRIANGLES, sizeof *mesh->meshlet_triangles, &mesh->meshlet_triangle_count);
+    mesh->positions = read_section(file, header.section_count, sections, MESH_SECTION_POSITIONS, sizeof *mesh->positions, &mesh->position_count);
+    mesh->lods = read_section(file, header.section_count, sections, MESH_SECTION_LODS, sizeof *mesh->lods, &mesh->lod_count);
+    mesh->chunks = read_section(file, header.section_count, sections, MESH_SECTION_CHUNKS, sizeof *mesh->chunks, &mesh->chunk_count);
+    uint32_t pvs_count = 0;
+    mesh->pvs = read_section(file, header.section_count, sections, MESH_SECTION_PVS, sizeof *mesh->pvs, &pvs_count);
+    mesh->pvs_cells = read_section(file, header.section_count, sections, MESH_SECTION_PVS_CELLS, sizeof *mesh->pvs_cells, &mesh->pvs_cell_count);
+    mesh->pvs_data = read_section(file, header.section_count, sections, MESH_SECTION_PVS_DATA, sizeof *mesh->pvs_data, &mesh->pvs_data_size);
+
+    if (!mesh->vertices || !mesh->meshlets || !mesh->meshlet_vertices || !mesh->meshlet_triangles || !mesh->positions || !mesh->lods || !mesh->chunks || !is_pvs_valid(mesh, pvs_count)) {
+        io_free_mesh(mesh);
+        return 0;
+    }
+    for (uint32_t i = 0; i < mesh->chunk_count; i++) {
+        struct MeshChunk const *chunk = &mesh->chunks[i];
+        if (chunk->lod_count == 0 || chunk->lod_count > MESH_MAX_LODS || chunk->lod_offset + chunk->lod_count > mesh->lod_count) {
+            io_free_mesh(mesh);
+            return 0;
+        }
+    }
+
+    return 1;
 }
 
 void
-io_load_mesh(FILE *file, uint32_t *count, struct Vertex *vertices)
+io_free_mesh(struct Mesh *mesh)
 {
-    fread(vertices, sizeof *vertices, *count, file);
+    free(mesh->vertices);
+    free(mesh->meshlets);
+    free(mesh->meshlet_vertices);
+    free(mesh->meshlet_triangles);
+    free(mesh->positions);
+    free(mesh->lods);
+    free(mesh->chunks);
+    free(mesh->pvs);
+    free(mesh->pvs_cells);
+    free(mesh->pvs_data);
+    memset(mesh, 0, sizeof *mesh);
 }
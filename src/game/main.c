@@ -2,11 +2,19 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
+#include "game/collision.h"
 #include "game/io.h"
+#include "game/occlusion.h"
+#include "game/pvs.h"
+#include "game/raycast.h"
 #include "graphics/graphics.h"
+#include "graphics/mesh.h"
 #include "graphics/vertex.h"
+#include "common/bvh.h"
+#include "common/job.h"
 #include "common/linmath.h"
 #include "platform/platform.h"
 
@@ -14,6 +22,18 @@
 #define M_PI (3.14159265358979323846)
 #endif
 
+#define PLAYER_RADIUS 1.0f
+// dynamic lights hovering over the floor of map1 in a LIGHT_GRID_SIZE square
+#define LIGHT_GRID_SIZE 16
+#define LIGHT_COUNT (LIGHT_GRID_SIZE * LIGHT_GRID_SIZE)
+#define LIGHT_SPACING 12.0f
+#define LIGHT_RADIUS 10.0f
+
+struct ChunkDistance {
+    float distance;
+    uint32_t chunk;
+};
+
 static struct UBO ubo;
 static float camera_pos[3] = {0.0f, 9.5f, 0.0f};
 static float camera_dir[3] = {0.0f, 0.0f, 1.0f};
@@ -25,41 +45,470 @@ static float const init_mouse_yaw = 0.0f;
 static double xmouse_prev = 0.0f;
 static double ymouse_prev = 0.0f;
 static struct PlayerControlEvent control_event;
+static struct Light lights[LIGHT_COUNT];
 
-int
-main(void)
+// the map and what is derived from it, filled by the startup graph
+#define MAP1_SIZE 2
+static char const *map1[MAP1_SIZE] = {
+    "asset/mesh/map1.vertex",
+    "asset/mesh/monkey.vertex",
+};
+static struct Mesh mesh[MAP1_SIZE];
+static uint32_t total_vertex_count;
+static uint32_t vertex_offset[MAP1_SIZE+1];
+static uint32_t position_offset[MAP1_SIZE+1];
+static uint32_t meshlet_vertex_offset[MAP1_SIZE+1];
+static uint32_t chunk_offset[MAP1_SIZE+1];
+static uint32_t object_count;
+static uint32_t chunk_count;
+static struct Vertex *vertices;
+static struct VertexPos *positions;
+static uint32_t *meshlet_vertices;
+static uint32_t *meshlet_triangles;
+static uint32_t *triangle_colors;
+static struct MeshletData meshlet_data;
+static struct DrawObject *objects;
+static struct OcclusionBox *occlusion_boxes;
+static uint8_t *object_visibility;
+static uint8_t *object_mask;
+static struct BvhBounds *chunk_bounds;
+static uint32_t *chunk_first_object;
+static uint32_t *chunk_object_count;
+static uint32_t *visible_chunks;
+static uint8_t *chunk_pvs;
+static struct ChunkDistance *chunk_distances;
+static uint32_t *draw_order;
+static struct Bvh chunk_bvh;
+static int is_cpu_occlusion;
+
+static void
+init_draw_object(
+    uint32_t const first_vertex,
+    uint32_t const first_meshlet_vertex,
+    struct Meshlet const *meshlet,
+    struct DrawObject *object)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        object->center[j] = meshlet->center[j];
+        object->cone_axis[j] = meshlet->cone_axis[j];
+    }
+    object->radius = meshlet->radius;
+    object->cone_cutoff = meshlet->cone_cutoff;
+    object->first_vertex = first_vertex + meshlet->triangle_offset * 3;
+    object->vertex_count = meshlet->triangle_count * 3;
+    object->meshlet_vertex_offset = first_meshlet_vertex + meshlet->vertex_offset;
+    object->meshlet_vertex_count = meshlet->vertex_count;
+}
+
+// Bounding sphere of every level of a chunk, the renderer measures the screen
+// space error of the chunk from it
+static void
+init_lod_sphere(struct MeshChunk const *chunk, float center[static 3], float *radius)
+{
+    float d[3];
+    for (int j = 0; j < 3; j++)
+    {
+        center[j] = (chunk->min[j] + chunk->max[j]) * 0.5f;
+        d[j] = chunk->max[j] - chunk->min[j];
+    }
+    *radius = 0.5f * vec3_length(d);
+}
+
+static void
+init_occlusion_box(
+    uint32_t const first_vertex,
+    uint32_t const vertex_count,
+    struct Vertex const vertices[static const first_vertex + vertex_count],
+    struct OcclusionBox *box)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        box->min[j] = INFINITY;
+        box->max[j] = -INFINITY;
+    }
+    for (uint32_t i = first_vertex; i < first_vertex + vertex_count; i++)
+    {
+        float const pos[3] = {vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z};
+        for (int j = 0; j < 3; j++)
+        {
+            box->min[j] = fminf(box->min[j], pos[j]);
+            box->max[j] = fmaxf(box->max[j], pos[j]);
+        }
+    }
+}
+
+static int
+compare_chunk_distance(void const *a, void const *b)
+{
+    float const distance_a = ((struct ChunkDistance const *)a)->distance;
+    float const distance_b = ((struct ChunkDistance const *)b)->distance;
+
+    return (distance_a > distance_b) - (distance_a < distance_b);
+}
+
+// Squared distance from a point to the closest point of a chunk box
+static float
+get_chunk_distance(struct BvhBounds const *bounds, float const point[static 3])
+{
+    float distance = 0.0f;
+    for (int j = 0; j < 3; j++)
+    {
+        float const d = fmaxf(fmaxf(bounds->min[j] - point[j], point[j] - bounds->max[j]), 0.0f);
+        distance += d * d;
+    }
+
+    return distance;
+}
+
+// Every light bobs and cycles through the hues at its own phase
+static void
+update_lights(float const seconds)
+{
+    for (uint32_t i = 0; i < LIGHT_COUNT; i++)
+    {
+        float const phase = i * 2.39996f;
+        float const hue = seconds * 0.2f + phase;
+        lights[i] = (struct Light) {
+            .position = {
+                ((i % LIGHT_GRID_SIZE) - (LIGHT_GRID_SIZE - 1) * 0.5f) * LIGHT_SPACING,
+                2.0f + 1.5f * sinf(seconds + phase),
+                ((i / LIGHT_GRID_SIZE) - (LIGHT_GRID_SIZE - 1) * 0.5f) * LIGHT_SPACING,
+            },
+            .radius = LIGHT_RADIUS,
+            .color = {
+                0.5f + 0.5f * cosf(hue),
+                0.5f + 0.5f * cosf(hue - 2.0944f),
+                0.5f + 0.5f * cosf(hue + 2.0944f),
+            },
+            .intensity = 1.0f,
+        };
+    }
+}
+
+// Startup steps, run by the graph in main. The window stays on the main
+// thread, which owns its events.
+static void
+create_window(void *data, uint32_t index)
 {
+    (void)data;
+    (void)index;
     platform.create_window();
+}
+
+static void
+create_instance(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
+    graphics.create_instance();
+}
 
+static void
+load_mesh(void *data, uint32_t index)
+{
+    (void)index;
+    int const i = *(int const *)data;
+    FILE *file = fopen(map1[i], "rb");
+    if (!file || !io_load_mesh(file, &mesh[i]))
+    {
+        fprintf(stderr, "%s: not a mesh container of version %u\n", map1[i], MESH_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+}
+
+static void
+init_graphics(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
     graphics.init();
 
-    #define MAP1_SIZE 2
-    char const *map1[MAP1_SIZE] = {
-        "asset/mesh/map1.vertex",
-        "asset/mesh/monkey.vertex",
-    };
-    uint32_t vertex_count[MAP1_SIZE+1];
-    vertex_count[0] = 0;
-    uint32_t total_vertex_count = 0;
-    uint32_t vertex_offset[MAP1_SIZE+1];
+    // HB_DEPTH_PREPASS=1 lays down depth before shading anything
+    char const *depth_prepass_mode = getenv("HB_DEPTH_PREPASS");
+    if (depth_prepass_mode && strcmp(depth_prepass_mode, "1") == 0)
+    {
+        graphics.set_depth_prepass(1);
+    }
+    // HB_DYNAMIC_LIGHTS=0 shades with the baked lighting only
+    char const *dynamic_lights_mode = getenv("HB_DYNAMIC_LIGHTS");
+    if (dynamic_lights_mode && strcmp(dynamic_lights_mode, "0") == 0)
+    {
+        struct Shading shading = {
+            .baked_light_scale = 1.0f,
+            .dynamic_light_scale = 1.0f,
+            .is_dynamic_lighting = 0,
+        };
+        graphics.set_shading(&shading);
+    }
+}
+
+static void
+init_map(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
     vertex_offset[0] = 0;
-    FILE *file[MAP1_SIZE];
+    position_offset[0] = 0;
+    meshlet_vertex_offset[0] = 0;
+    chunk_offset[0] = 0;
     for (int i = 0; i < MAP1_SIZE; i++)
     {
-        file[i] = fopen(map1[i], "rb");
-        io_get_triangle_count(file[i], &vertex_count[i]);
-        total_vertex_count += vertex_count[i];
-        vertex_offset[i+1] = vertex_offset[i] + vertex_count[i];
-        printf("%u: %u\n", i,  vertex_count[i]);
+        total_vertex_count += mesh[i].vertex_count;
+        vertex_offset[i+1] = vertex_offset[i] + mesh[i].vertex_count;
+        position_offset[i+1] = position_offset[i] + mesh[i].position_count;
+        meshlet_vertex_offset[i+1] = meshlet_vertex_offset[i] + mesh[i].meshlet_vertex_count;
+        chunk_offset[i+1] = chunk_offset[i] + mesh[i].chunk_count;
+        object_count += mesh[i].meshlet_count;
+        chunk_count += mesh[i].chunk_count;
+        printf("%u: %u vertices, %u meshlets, %u chunks\n", i, mesh[i].vertex_count, mesh[i].meshlet_count, mesh[i].chunk_count);
     }
-    struct Vertex *vertices = malloc(total_vertex_count * sizeof *vertices);
+    vertices = malloc(total_vertex_count * sizeof *vertices);
     for (int i = 0; i < MAP1_SIZE; i++)
     {
-        io_load_mesh(file[i], &vertex_count[i], &vertices[vertex_offset[i]]);
-        fclose(file[i]);
+        memcpy(&vertices[vertex_offset[i]], mesh[i].vertices, mesh[i].vertex_count * sizeof *vertices);
     }
 
-    graphics.load_map(total_vertex_count, vertices);
+    // the mesh shader path indexes map wide tables, the triangles of every
+    // mesh already follow its vertices so only meshlet vertices are rebased
+    positions = malloc(position_offset[MAP1_SIZE] * sizeof *positions);
+    meshlet_vertices = malloc(meshlet_vertex_offset[MAP1_SIZE] * sizeof *meshlet_vertices);
+    meshlet_triangles = malloc(vertex_offset[MAP1_SIZE] / 3 * sizeof *meshlet_triangles);
+    triangle_colors = malloc(vertex_offset[MAP1_SIZE] / 3 * sizeof *triangle_colors);
+    for (int i = 0; i < MAP1_SIZE; i++)
+    {
+        memcpy(&positions[position_offset[i]], mesh[i].positions, mesh[i].position_count * sizeof *positions);
+        memcpy(&meshlet_triangles[vertex_offset[i] / 3], mesh[i].meshlet_triangles, mesh[i].meshlet_triangle_count * sizeof *meshlet_triangles);
+        for (uint32_t v = 0; v < mesh[i].meshlet_vertex_count; v++)
+        {
+            meshlet_vertices[meshlet_vertex_offset[i] + v] = position_offset[i] + mesh[i].meshlet_vertices[v];
+        }
+    }
+    for (uint32_t t = 0; t < vertex_offset[MAP1_SIZE] / 3; t++)
+    {
+        struct VertexColor const *color = &vertices[t * 3].color;
+        float const channels[3] = {color->r, color->g, color->b};
+        triangle_colors[t] = 0xffu << 24;
+        for (int j = 0; j < 3; j++)
+        {
+            float const c = channels[j] < 0.0f ? 0.0f : channels[j] > 1.0f ? 1.0f : channels[j];
+            triangle_colors[t] |= (uint32_t)(c * 255.0f + 0.5f) << (j * 8);
+        }
+    }
+    meshlet_data = (struct MeshletData) {
+        .position_count = position_offset[MAP1_SIZE],
+        .positions = positions,
+        .meshlet_vertex_count = meshlet_vertex_offset[MAP1_SIZE],
+        .meshlet_vertices = meshlet_vertices,
+        .meshlet_triangle_count = vertex_offset[MAP1_SIZE] / 3,
+        .meshlet_triangles = meshlet_triangles,
+        .triangle_colors = triangle_colors,
+    };
+
+    // every meshlet of every level is drawn and culled on its own, the
+    // renderer keeps the level of each chunk that fits its screen size
+    objects = malloc(object_count * sizeof *objects);
+    occlusion_boxes = malloc(object_count * sizeof *occlusion_boxes);
+    object_visibility = malloc(object_count * sizeof *object_visibility);
+    object_mask = malloc(object_count * sizeof *object_mask);
+    chunk_bounds = malloc(chunk_count * sizeof *chunk_bounds);
+    chunk_first_object = malloc(chunk_count * sizeof *chunk_first_object);
+    chunk_object_count = malloc(chunk_count * sizeof *chunk_object_count);
+    visible_chunks = malloc(chunk_count * sizeof *visible_chunks);
+    chunk_pvs = malloc(chunk_count * sizeof *chunk_pvs);
+    chunk_distances = malloc(chunk_count * sizeof *chunk_distances);
+    draw_order = malloc(object_count * sizeof *draw_order);
+    uint32_t object_index = 0;
+    uint32_t chunk_index = 0;
+    for (int i = 0; i < MAP1_SIZE; i++)
+    {
+        for (uint32_t c = 0; c < mesh[i].chunk_count; c++)
+        {
+            struct MeshChunk const *chunk = &mesh[i].chunks[c];
+            memcpy(chunk_bounds[chunk_index].min, chunk->min, sizeof chunk->min);
+            memcpy(chunk_bounds[chunk_index].max, chunk->max, sizeof chunk->max);
+            chunk_first_object[chunk_index] = object_index;
+
+            float lod_center[3];
+            float lod_radius;
+            init_lod_sphere(chunk, lod_center, &lod_radius);
+            for (uint32_t l = chunk->lod_offset; l < chunk->lod_offset + chunk->lod_count; l++)
+            {
+                struct MeshLod const *lod = &mesh[i].lods[l];
+                float const coarser_lod_error = l + 1 < chunk->lod_offset + chunk->lod_count ? mesh[i].lods[l+1].error : INFINITY;
+                for (uint32_t m = lod->meshlet_offset; m < lod->meshlet_offset + lod->meshlet_count; m++)
+                {
+                    struct DrawObject *object = &objects[object_index];
+                    init_draw_object(vertex_offset[i], meshlet_vertex_offset[i], &mesh[i].meshlets[m], object);
+                    memcpy(object->lod_center, lod_center, sizeof object->lod_center);
+                    object->lod_radius = lod_radius;
+                    object->lod_error = lod->error;
+                    object->coarser_lod_error = coarser_lod_error;
+                    object->flags = mesh[i].flags & MESH_FLAG_CONSISTENT_WINDING ? 0 : DRAW_OBJECT_FLAG_DOUBLE_SIDED;
+                    object->vertex_buffer = 0;
+                    init_occlusion_box(object->first_vertex, object->vertex_count, vertices, &occlusion_boxes[object_index]);
+                    object_index++;
+                }
+            }
+
+            chunk_object_count[chunk_index] = object_index - chunk_first_object[chunk_index];
+            chunk_index++;
+        }
+    }
+
+    // chunks outside the view or hidden from the PVS cell of the camera are
+    // skipped as a whole before the per meshlet tests on the GPU
+    bvh_build(&chunk_bvh, chunk_count, chunk_bounds);
+}
+
+// Waits for the pipelines when recording, which compiled meanwhile
+static void
+load_map(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
+    graphics.load_map(total_vertex_count, vertices, object_count, objects, &meshlet_data);
+    if (is_cpu_occlusion)
+    {
+        graphics.set_gpu_occlusion(0);
+    }
+}
+
+static void
+init_occlusion(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
+    if (!is_cpu_occlusion)
+    {
+        return;
+    }
+
+    occlusion.init();
+    for (int i = 0; i < MAP1_SIZE; i++)
+    {
+        if (!(mesh[i].flags & MESH_FLAG_OCCLUDER))
+        {
+            continue;
+        }
+        for (uint32_t c = 0; c < mesh[i].chunk_count; c++)
+        {
+            struct MeshLod const *lod = &mesh[i].lods[mesh[i].chunks[c].lod_offset];
+            uint32_t const first_vertex = vertex_offset[i] + mesh[i].meshlets[lod->meshlet_offset].triangle_offset * 3;
+            occlusion.add_occluder(lod->triangle_count * 3, &vertices[first_vertex]);
+        }
+    }
+}
+
+static void
+init_collision(void *data, uint32_t index)
+{
+    (void)data;
+    (void)index;
+    collision.init();
+    raycast.init();
+    for (int i = 0; i < MAP1_SIZE; i++)
+    {
+        for (uint32_t c = 0; c < mesh[i].chunk_count; c++)
+        {
+            struct MeshLod const *lod = &mesh[i].lods[mesh[i].chunks[c].lod_offset];
+            uint32_t const first_vertex = vertex_offset[i] + mesh[i].meshlets[lod->meshlet_offset].triangle_offset * 3;
+            collision.add_collider(lod->triangle_count * 3, &vertices[first_vertex]);
+            raycast.add_geometry(lod->triangle_count * 3, &vertices[first_vertex]);
+        }
+    }
+    collision.build();
+    raycast.build();
+}
+
+static void
+print_startup(uint32_t const count, struct JobNode const nodes[static const count])
+{
+    double end_us = 0.0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        end_us = fmax(end_us, nodes[i].end_us);
+    }
+    printf("startup: %.1f ms\n", end_us / 1000.0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf("  %-16s %7.1f - %7.1f ms\n", nodes[i].name, nodes[i].begin_us / 1000.0, nodes[i].end_us / 1000.0);
+    }
+}
+
+int
+main(void)
+{
+    jobs.init();
+
+    // HB_OCCLUSION=cpu replaces the depth pyramid with the software occlusion buffer
+    char const *occlusion_mode = getenv("HB_OCCLUSION");
+    is_cpu_occlusion = occlusion_mode && strcmp(occlusion_mode, "cpu") == 0;
+
+    // window, instance and mesh files first, then the renderer and the map
+    // data, then the uploads alongside the collision and occlusion builds
+    enum {
+        STARTUP_WINDOW,
+        STARTUP_INSTANCE,
+        STARTUP_MAP1,
+        STARTUP_MONKEY,
+        STARTUP_GRAPHICS,
+        STARTUP_MAP,
+        STARTUP_UPLOAD,
+        STARTUP_OCCLUSION,
+        STARTUP_COLLISION,
+        STARTUP_COUNT,
+    };
+    static int const mesh_indices[MAP1_SIZE] = {0, 1};
+    struct JobNode startup[STARTUP_COUNT] = {
+        [STARTUP_WINDOW] = {
+            .name = "window",
+            .function = create_window,
+            .is_on_caller = 1,
+        },
+        [STARTUP_INSTANCE] = {
+            .name = "instance",
+            .function = create_instance,
+        },
+        [STARTUP_MAP1] = {
+            .name = "load map1",
+            .function = load_mesh,
+            .data = (void *)&mesh_indices[0],
+        },
+        [STARTUP_MONKEY] = {
+            .name = "load monkey",
+            .function = load_mesh,
+            .data = (void *)&mesh_indices[1],
+        },
+        [STARTUP_GRAPHICS] = {
+            .name = "graphics",
+            .function = init_graphics,
+            .dependencies = 1ull << STARTUP_WINDOW | 1ull << STARTUP_INSTANCE,
+        },
+        [STARTUP_MAP] = {
+            .name = "map",
+            .function = init_map,
+            .dependencies = 1ull << STARTUP_MAP1 | 1ull << STARTUP_MONKEY,
+        },
+        [STARTUP_UPLOAD] = {
+            .name = "upload",
+            .function = load_map,
+            .dependencies = 1ull << STARTUP_GRAPHICS | 1ull << STARTUP_MAP,
+        },
+        [STARTUP_OCCLUSION] = {
+            .name = "occlusion",
+            .function = init_occlusion,
+            .dependencies = 1ull << STARTUP_MAP,
+        },
+        [STARTUP_COLLISION] = {
+            .name = "collision",
+            .function = init_collision,
+            .dependencies = 1ull << STARTUP_MAP,
+        },
+    };
+    jobs.run_graph(STARTUP_COUNT, startup);
+    print_startup(STARTUP_COUNT, startup);
 
     float cos_yaw = cosf(mouse_yaw);
     float sin_yaw = sinf(mouse_yaw);
@@ -69,6 +518,9 @@ main(void)
     mat4_perspective(ubo.proj, 16.0f/9.0f, 90.0f * M_PI / 180.0f, 0.01f, 1000.0f);
 
     platform.init_timestamp();
+    long stats_time;
+    platform.get_timestamp(&stats_time);
+    long const start_time = stats_time;
     while (platform.is_application_running())
     {
         platform.poll_events();
@@ -82,15 +534,119 @@ main(void)
         float forward[3] = { sin_yaw, 0.0f, cos_yaw, };
         float strafe[3];
         vec3_cross(strafe, forward, up_dir);
-        vec3_add(camera_pos, forward[0] * control_event.forward_time * 0.0000001f, forward[1], forward[2] * control_event.forward_time * 0.0000001f);
-        vec3_add(camera_pos, strafe[0] * control_event.strafe_time * 0.0000001f, strafe[1], strafe[2] * control_event.strafe_time * 0.0000001f);
+        float const forward_distance = control_event.forward_time * 0.0000001f;
+        float const strafe_distance = control_event.strafe_time * 0.0000001f;
+        float delta[3] = {
+            forward[0] * forward_distance + strafe[0] * strafe_distance,
+            0.0f,
+            forward[2] * forward_distance + strafe[2] * strafe_distance,
+        };
+        collision.move_sphere(camera_pos, PLAYER_RADIUS, delta);
         mat4_view(ubo.view, camera_pos, cos_yaw, sin_yaw, cos_pitch, sin_pitch);
+
+        float view_proj[4][4];
+        float frustum[6][4];
+        mat4_mul(view_proj, ubo.view, ubo.proj);
+        mat4_frustum(frustum, view_proj);
+        memset(object_mask, 0, object_count * sizeof *object_mask);
+        for (int i = 0; i < MAP1_SIZE; i++)
+        {
+            pvs_get_visible_chunks(&mesh[i], pvs_find_cell(&mesh[i], camera_pos), &chunk_pvs[chunk_offset[i]]);
+        }
+        uint32_t visible_chunk_count = bvh_query_frustum(&chunk_bvh, frustum, visible_chunks);
+        uint32_t drawn_chunk_count = 0;
+        for (uint32_t c = 0; c < visible_chunk_count; c++)
+        {
+            uint32_t const chunk = visible_chunks[c];
+            if (!chunk_pvs[chunk])
+            {
+                continue;
+            }
+            memset(&object_mask[chunk_first_object[chunk]], 1, chunk_object_count[chunk] * sizeof *object_mask);
+            chunk_distances[drawn_chunk_count++] = (struct ChunkDistance) {
+                .distance = get_chunk_distance(&chunk_bounds[chunk], camera_pos),
+                .chunk = chunk,
+            };
+        }
+
+        // drawing front to back lets the depth test reject hidden fragments,
+        // the culled objects follow in any order
+        qsort(chunk_distances, drawn_chunk_count, sizeof *chunk_distances, compare_chunk_distance);
+        uint32_t draw_count = 0;
+        for (uint32_t c = 0; c < drawn_chunk_count; c++)
+        {
+            uint32_t const chunk = chunk_distances[c].chunk;
+            for (uint32_t i = 0; i < chunk_object_count[chunk]; i++)
+            {
+                draw_order[draw_count++] = chunk_first_object[chunk] + i;
+            }
+        }
+        for (uint32_t i = 0; i < object_count; i++)
+        {
+            if (!object_mask[i])
+            {
+                draw_order[draw_count++] = i;
+            }
+        }
+        graphics.set_draw_order(object_count, draw_order);
+        if (is_cpu_occlusion)
+        {
+            occlusion.render(view_proj);
+            occlusion.test(object_count, occlusion_boxes, object_visibility);
+            for (uint32_t i = 0; i < object_count; i++)
+            {
+                object_mask[i] &= object_visibility[i];
+            }
+        }
+        graphics.set_object_visibility(object_count, object_mask);
+        long light_time;
+        platform.get_timestamp(&light_time);
+        update_lights((light_time - start_time) / 1e9f);
+        graphics.set_lights(LIGHT_COUNT, lights);
         graphics.draw_frame(&ubo);
+
+        long now;
+        platform.get_timestamp(&now);
+        if (now - stats_time >= 1000000000L)
+        {
+            struct FrameStats stats;
+            graphics.get_frame_stats(&stats);
+            printf("culled meshlets: %u/%u of %u\n", stats.culled_object_count, stats.selected_object_count, stats.object_count);
+            stats_time = now;
+        }
     }
 
+    graphics.deinit();
+
+    if (is_cpu_occlusion)
+    {
+        occlusion.deinit();
+    }
+    raycast.deinit();
+    collision.deinit();
+    bvh_free(&chunk_bvh);
+    free(draw_order);
+    free(chunk_distances);
+    free(chunk_pvs);
+    free(visible_chunks);
+    free(chunk_object_count);
+    free(chunk_first_object);
+    free(chunk_bounds);
+    free(object_mask);
+    free(object_visibility);
+    free(occlusion_boxes);
+    free(objects);
+    free(triangle_colors);
+    free(meshlet_triangles);
+    free(meshlet_vertices);
+    free(positions);
     free(vertices);
+    for (int i = 0; i < MAP1_SIZE; i++)
+    {
+        io_free_mesh(&mesh[i]);
+    }
 
-    graphics.deinit();
+    jobs.deinit();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,538 @@
+#include "game/occlusion.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OCCLUSION_X86
+#endif
+
+#include "common/job.h"
+#include "common/linmath.h"
+#include "graphics/vertex.h"
+
+// Masked software occlusion buffer
+//   The low resolution depth buffer is split into 8x4 pixel tiles. Each tile
+//   keeps a conservative far depth for the whole tile and a working layer made
+//   of a coverage mask and the far depth of the covered pixels. Once the
+//   working layer covers the tile it replaces the whole tile depth.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 144
+#define TILE_WIDTH 8
+#define TILE_HEIGHT 4
+#define TILE_COLUMNS (OCCLUSION_WIDTH / TILE_WIDTH)
+#define TILE_ROWS (OCCLUSION_HEIGHT / TILE_HEIGHT)
+#define TILE_FULL_MASK 0xffffffffu
+#define BAND_TILE_ROWS 4
+#define BAND_COUNT ((TILE_ROWS + BAND_TILE_ROWS - 1) / BAND_TILE_ROWS)
+#define SETUP_BATCH_SIZE 1024
+#define TEST_BATCH_SIZE 64
+
+struct Tile {
+    float zmax[2];
+    uint32_t mask;
+};
+
+struct Occluder {
+    struct Vertex const *vertices;
+    uint32_t vertex_count;
+};
+
+// Edges are oriented so that a pixel center is inside when all three edge
+// functions a * x + b * y + c are positive, depth is a plane over the screen
+struct RasterTriangle {
+    float edge[3][3];
+    float depth[3];
+    float zmax;
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+};
+
+struct SetupJob {
+    float (*view_proj)[4];
+    uint32_t triangle_count;
+};
+
+struct TestJob {
+    uint32_t count;
+    struct OcclusionBox const *boxes;
+    uint8_t *visible;
+};
+
+typedef uint32_t (*TileCoverageFunction)(struct RasterTriangle const *triangle, int32_t tile_x, int32_t tile_y);
+
+static struct Tile tiles[TILE_ROWS][TILE_COLUMNS];
+static struct Occluder *occluders;
+static uint32_t occluder_count;
+static uint32_t occluder_triangle_count;
+static struct RasterTriangle *triangles;
+static uint32_t triangle_capacity;
+static TileCoverageFunction tile_coverage;
+
+/* Tile Coverage */
+static uint32_t
+tile_coverage_scalar(struct RasterTriangle const *triangle, int32_t tile_x, int32_t tile_y)
+{
+    uint32_t mask = 0;
+    for (int32_t row = 0; row < TILE_HEIGHT; row++) {
+        float y = tile_y * TILE_HEIGHT + row + 0.5f;
+        for (int32_t column = 0; column < TILE_WIDTH; column++) {
+            float x = tile_x * TILE_WIDTH + column + 0.5f;
+            int is_inside = 1;
+            for (int e = 0; e < 3; e++) {
+                is_inside &= triangle->edge[e][0] * x + triangle->edge[e][1] * y + triangle->edge[e][2] >= 0.0f;
+            }
+            mask |= (uint32_t)is_inside << (row * TILE_WIDTH + column);
+        }
+    }
+
+    return mask;
+}
+
+#ifdef OCCLUSION_X86
+__attribute__((target("sse2")))
+static uint32_t
+tile_coverage_sse(struct RasterTriangle const *triangle, int32_t tile_x, int32_t tile_y)
+{
+    __m128 const zero = _mm_setzero_ps();
+    __m128 x[2];
+    x[0] = _mm_add_ps(_mm_set1_ps(tile_x * TILE_WIDTH + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+    x[1] = _mm_add_ps(x[0], _mm_set1_ps(4.0f));
+
+    __m128 ax[3][2];
+    for (int e = 0; e < 3; e++) {
+        __m128 a = _mm_set1_ps(triangle->edge[e][0]);
+        ax[e][0] = _mm_mul_ps(a, x[0]);
+        ax[e][1] = _mm_mul_ps(a, x[1]);
+    }
+
+    uint32_t mask = 0;
+    for (int32_t row = 0; row < TILE_HEIGHT; row++) {
+        float y = tile_y * TILE_HEIGHT + row + 0.5f;
+        for (int half = 0; half < 2; half++) {
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int e = 0; e < 3; e++) {
+                __m128 by_c = _mm_set1_ps(triangle->edge[e][1] * y + triangle->edge[e][2]);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(ax[e][half], by_c), zero));
+            }
+            mask |= (uint32_t)_mm_movemask_ps(inside) << (row * TILE_WIDTH + half * 4);
+        }
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint32_t
+tile_coverage_avx2(struct RasterTriangle const *triangle, int32_t tile_x, int32_t tile_y)
+{
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 x = _mm256_add_ps(
+        _mm256_set1_ps(tile_x * TILE_WIDTH + 0.5f),
+        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)
+    );
+
+    __m256 ax[3];
+    for (int e = 0; e < 3; e++) {
+        ax[e] = _mm256_mul_ps(_mm256_set1_ps(triangle->edge[e][0]), x);
+    }
+
+    uint32_t mask = 0;
+    for (int32_t row = 0; row < TILE_HEIGHT; row++) {
+        float y = tile_y * TILE_HEIGHT + row + 0.5f;
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int e = 0; e < 3; e++) {
+            __m256 by_c = _mm256_set1_ps(triangle->edge[e][1] * y + triangle->edge[e][2]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(ax[e], by_c), zero, _CMP_GE_OQ));
+        }
+        mask |= (uint32_t)_mm256_movemask_ps(inside) << (row * TILE_WIDTH);
+    }
+
+    return mask;
+}
+#endif
+
+/* Triangle Setup */
+static void
+setup_triangle(float const clip[static 3][4], struct RasterTriangle *triangle)
+{
+    float screen[3][3];
+    for (int i = 0; i < 3; i++) {
+        float inverse_w = 1.0f / clip[i][3];
+        screen[i][0] = (clip[i][0] * inverse_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+        screen[i][1] = (clip[i][1] * inverse_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+        screen[i][2] = clip[i][2] * inverse_w;
+    }
+
+    float dx1 = screen[1][0] - screen[0][0];
+    float dy1 = screen[1][1] - screen[0][1];
+    float dx2 = screen[2][0] - screen[0][0];
+    float dy2 = screen[2][1] - screen[0][1];
+    float area = dx1 * dy2 - dx2 * dy1;
+
+    // an empty bound marks the triangle as skipped
+    triangle->min_x = 0;
+    triangle->max_x = -1;
+    if (fabsf(area) < 1e-6f) {
+        return;
+    }
+
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < 3; i++) {
+        float const *v0 = screen[i];
+        float const *v1 = screen[(i + 1) % 3];
+        float a = (v0[1] - v1[1]) * sign;
+        float b = (v1[0] - v0[0]) * sign;
+        triangle->edge[i][0] = a;
+        triangle->edge[i][1] = b;
+        triangle->edge[i][2] = -(a * v0[0] + b * v0[1]);
+    }
+
+    float dz1 = screen[1][2] - screen[0][2];
+    float dz2 = screen[2][2] - screen[0][2];
+    triangle->depth[0] = (dz1 * dy2 - dz2 * dy1) / area;
+    triangle->depth[1] = (dz2 * dx1 - dz1 * dx2) / area;
+    triangle->depth[2] = screen[0][2] - triangle->depth[0] * screen[0][0] - triangle->depth[1] * screen[0][1];
+    triangle->zmax = fmaxf(screen[0][2], fmaxf(screen[1][2], screen[2][2]));
+
+    float min_x = fminf(screen[0][0], fminf(screen[1][0], screen[2][0]));
+    float max_x = fmaxf(screen[0][0], fmaxf(screen[1][0], screen[2][0]));
+    float min_y = fminf(screen[0][1], fminf(screen[1][1], screen[2][1]));
+    float max_y = fmaxf(screen[0][1], fmaxf(screen[1][1], screen[2][1]));
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= OCCLUSION_WIDTH || min_y >= OCCLUSION_HEIGHT) {
+        return;
+    }
+
+    triangle->min_x = min_x < 0.0f ? 0 : (int32_t)min_x;
+    triangle->min_y = min_y < 0.0f ? 0 : (int32_t)min_y;
+    triangle->max_x = max_x >= OCCLUSION_WIDTH ? OCCLUSION_WIDTH - 1 : (int32_t)max_x;
+    triangle->max_y = max_y >= OCCLUSION_HEIGHT ? OCCLUSION_HEIGHT - 1 : (int32_t)max_y;
+}
+
+// Clips against the near plane z = 0 and writes up to two raster triangles
+static void
+setup_clipped_triangle(float const clip[static 3][4], struct RasterTriangle out[static 2])
+{
+    out[0].min_x = 0;
+    out[0].max_x = -1;
+    out[1].min_x = 0;
+    out[1].max_x = -1;
+
+    float polygon[4][4];
+    int polygon_count = 0;
+    for (int i = 0; i < 3; i++) {
+        float const *a = clip[i];
+        float const *b = clip[(i + 1) % 3];
+        if (a[2] >= 0.0f) {
+            memcpy(polygon[polygon_count++], a, sizeof polygon[0]);
+        }
+        if ((a[2] >= 0.0f) != (b[2] >= 0.0f)) {
+            float t = a[2] / (a[2] - b[2]);
+            for (int j = 0; j < 4; j++) {
+                polygon[polygon_count][j] = a[j] + (b[j] - a[j]) * t;
+            }
+            polygon_count++;
+        }
+    }
+
+    if (polygon_count < 3) {
+        return;
+    }
+
+    float triangle[3][4];
+    memcpy(triangle[0], polygon[0], sizeof triangle[0]);
+    memcpy(triangle[1], polygon[1], sizeof triangle[1]);
+    memcpy(triangle[2], polygon[2], sizeof triangle[2]);
+    setup_triangle(triangle, &out[0]);
+
+    if (polygon_count == 4) {
+        memcpy(triangle[1], polygon[2], sizeof triangle[1]);
+        memcpy(triangle[2], polygon[3], sizeof triangle[2]);
+        setup_triangle(triangle, &out[1]);
+    }
+}
+
+static void
+setup_batch(void *data, uint32_t index)
+{
+    struct SetupJob const *job = data;
+    uint32_t begin = index * SETUP_BATCH_SIZE;
+    uint32_t end = begin + SETUP_BATCH_SIZE < job->triangle_count ? begin + SETUP_BATCH_SIZE : job->triangle_count;
+
+    // walk the occluders to the one holding the first triangle of the batch
+    uint32_t occluder = 0;
+    uint32_t occluder_first = 0;
+    while (begin >= occluder_first + occluders[occluder].vertex_count / 3) {
+        occluder_first += occluders[occluder].vertex_count / 3;
+        occluder++;
+    }
+
+    for (uint32_t t = begin; t < end; t++) {
+        while (t >= occluder_first + occluders[occluder].vertex_count / 3) {
+            occluder_first += occluders[occluder].vertex_count / 3;
+            occluder++;
+        }
+
+        struct Vertex const *vertices = &occluders[occluder].vertices[(t - occluder_first) * 3];
+        float clip[3][4];
+        for (int i = 0; i < 3; i++) {
+            float pos[4] = {vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z, 1.0f};
+            vec4_mul_mat4(clip[i], pos, job->view_proj);
+        }
+
+        setup_clipped_triangle(clip, &triangles[t * 2]);
+    }
+}
+
+/* Rasterization */
+static void
+update_tile(struct Tile *tile, uint32_t coverage, float z)
+{
+    if (z >= tile->zmax[0]) {
+        return;
+    }
+
+    // drop the working layer when the new triangle is much closer than it
+    float working_distance = tile->zmax[1] - z;
+    float layer_distance = tile->zmax[0] - tile->zmax[1];
+    if (working_distance > layer_distance) {
+        tile->zmax[1] = 0.0f;
+        tile->mask = 0;
+    }
+
+    tile->zmax[1] = fmaxf(tile->zmax[1], z);
+    tile->mask |= coverage;
+
+    if (tile->mask == TILE_FULL_MASK) {
+        tile->zmax[0] = fminf(tile->zmax[0], tile->zmax[1]);
+        tile->zmax[1] = 0.0f;
+        tile->mask = 0;
+    }
+}
+
+static void
+rasterize_band(void *data, uint32_t band)
+{
+    uint32_t const triangle_count = *(uint32_t const *)data;
+    int32_t const band_first_row = band * BAND_TILE_ROWS;
+    int32_t const band_last_row = band_first_row + BAND_TILE_ROWS - 1 < TILE_ROWS - 1 ? band_first_row + BAND_TILE_ROWS - 1 : TILE_ROWS - 1;
+
+    for (int32_t row = band_first_row; row <= band_last_row; row++) {
+        for (int32_t column = 0; column < TILE_COLUMNS; column++) {
+            tiles[row][column] = (struct Tile) {
+                .zmax = {1.0f, 0.0f},
+                .mask = 0,
+            };
+        }
+    }
+
+    for (uint32_t t = 0; t < triangle_count * 2; t++) {
+        struct RasterTriangle const *triangle = &triangles[t];
+        if (triangle->max_x < triangle->min_x) {
+            continue;
+        }
+
+        int32_t first_row = triangle->min_y / TILE_HEIGHT;
+        int32_t last_row = triangle->max_y / TILE_HEIGHT;
+        first_row = first_row < band_first_row ? band_first_row : first_row;
+        last_row = last_row > band_last_row ? band_last_row : last_row;
+        int32_t first_column = triangle->min_x / TILE_WIDTH;
+        int32_t last_column = triangle->max_x / TILE_WIDTH;
+
+        for (int32_t row = first_row; row <= last_row; row++) {
+            for (int32_t column = first_column; column <= last_column; column++) {
+                uint32_t coverage = tile_coverage(triangle, column, row);
+                if (!coverage) {
+                    continue;
+                }
+
+                // the depth plane is linear, so its far depth in the tile is at a corner
+                float x0 = column * TILE_WIDTH;
+                float y0 = row * TILE_HEIGHT;
+                float z00 = triangle->depth[0] * x0 + triangle->depth[1] * y0 + triangle->depth[2];
+                float dzx = triangle->depth[0] * TILE_WIDTH;
+                float dzy = triangle->depth[1] * TILE_HEIGHT;
+                float z = fmaxf(fmaxf(z00, z00 + dzx), fmaxf(z00 + dzy, z00 + dzx + dzy));
+                update_tile(&tiles[row][column], coverage, fminf(z, triangle->zmax));
+            }
+        }
+    }
+}
+
+/* Occludee Tests */
+static int
+is_box_visible(struct OcclusionBox const *box, float view_proj[static 4][4])
+{
+    float min_x = INFINITY;
+    float min_y = INFINITY;
+    float max_x = -INFINITY;
+    float max_y = -INFINITY;
+    float min_z = INFINITY;
+    for (int i = 0; i < 8; i++) {
+        float corner[4] = {
+            i & 1 ? box->max[0] : box->min[0],
+            i & 2 ? box->max[1] : box->min[1],
+            i & 4 ? box->max[2] : box->min[2],
+            1.0f,
+        };
+        float clip[4];
+        vec4_mul_mat4(clip, corner, view_proj);
+
+        // boxes crossing the near plane are never occluded
+        if (clip[2] < 0.0f) {
+            return 1;
+        }
+
+        float inverse_w = 1.0f / clip[3];
+        min_x = fminf(min_x, clip[0] * inverse_w);
+        max_x = fmaxf(max_x, clip[0] * inverse_w);
+        min_y = fminf(min_y, clip[1] * inverse_w);
+        max_y = fmaxf(max_y, clip[1] * inverse_w);
+        min_z = fminf(min_z, clip[2] * inverse_w);
+    }
+
+    if (max_x < -1.0f || max_y < -1.0f || min_x > 1.0f || min_y > 1.0f) {
+        return 0;
+    }
+
+    int32_t first_column = (int32_t)((fmaxf(min_x, -1.0f) * 0.5f + 0.5f) * OCCLUSION_WIDTH) / TILE_WIDTH;
+    int32_t last_column = (int32_t)((fminf(max_x, 1.0f) * 0.5f + 0.5f) * OCCLUSION_WIDTH) / TILE_WIDTH;
+    int32_t first_row = (int32_t)((fmaxf(min_y, -1.0f) * 0.5f + 0.5f) * OCCLUSION_HEIGHT) / TILE_HEIGHT;
+    int32_t last_row = (int32_t)((fminf(max_y, 1.0f) * 0.5f + 0.5f) * OCCLUSION_HEIGHT) / TILE_HEIGHT;
+    last_column = last_column >= TILE_COLUMNS ? TILE_COLUMNS - 1 : last_column;
+    last_row = last_row >= TILE_ROWS ? TILE_ROWS - 1 : last_row;
+
+    for (int32_t row = first_row; row <= last_row; row++) {
+        for (int32_t column = first_column; column <= last_column; column++) {
+            if (min_z <= tiles[row][column].zmax[0]) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+struct TestBatch {
+    struct TestJob const *job;
+    float (*view_proj)[4];
+};
+
+static void
+test_batch(void *data, uint32_t index)
+{
+    struct TestBatch const *batch = data;
+    uint32_t begin = index * TEST_BATCH_SIZE;
+    uint32_t end = begin + TEST_BATCH_SIZE < batch->job->count ? begin + TEST_BATCH_SIZE : batch->job->count;
+
+    for (uint32_t i = begin; i < end; i++) {
+        batch->job->visible[i] = is_box_visible(&batch->job->boxes[i], batch->view_proj);
+    }
+}
+
+/* Public Functions */
+static float last_view_proj[4][4];
+
+static void
+init(void)
+{
+    tile_coverage = tile_coverage_scalar;
+#ifdef OCCLUSION_X86
+    tile_coverage = tile_coverage_sse;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        tile_coverage = tile_coverage_avx2;
+    }
+#endif
+
+    for (int32_t row = 0; row < TILE_ROWS; row++) {
+        for (int32_t column = 0; column < TILE_COLUMNS; column++) {
+            tiles[row][column] = (struct Tile) {
+                .zmax = {1.0f, 0.0f},
+                .mask = 0,
+            };
+        }
+    }
+}
+
+static void
+deinit(void)
+{
+    free(triangles);
+    free(occluders);
+    triangles = 0;
+    occluders = 0;
+    triangle_capacity = 0;
+    occluder_count = 0;
+    occluder_triangle_count = 0;
+}
+
+// The vertices are referenced, not copied, and must outlive the occluder
+static void
+add_occluder(uint32_t const count, struct Vertex const vertices[static const count])
+{
+    struct Occluder *resized = realloc(occluders, (occluder_count + 1) * sizeof *occluders);
+    assert(resized != 0);
+    occluders = resized;
+    occluders[occluder_count++] = (struct Occluder) {
+        .vertices = vertices,
+        .vertex_count = count,
+    };
+    occluder_triangle_count += count / 3;
+
+    // every occluder triangle may be split in two by the near plane
+    if (occluder_triangle_count * 2 > triangle_capacity) {
+        triangle_capacity = occluder_triangle_count * 2;
+        struct RasterTriangle *resized_triangles = realloc(triangles, triangle_capacity * sizeof *triangles);
+        assert(resized_triangles != 0);
+        triangles = resized_triangles;
+    }
+}
+
+static void
+render(float view_proj[static 4][4])
+{
+    memcpy(last_view_proj, view_proj, sizeof last_view_proj);
+
+    struct SetupJob setup = {
+        .view_proj = last_view_proj,
+        .triangle_count = occluder_triangle_count,
+    };
+    jobs.parallel_for((occluder_triangle_count + SETUP_BATCH_SIZE - 1) / SETUP_BATCH_SIZE, setup_batch, &setup);
+
+    uint32_t triangle_count = occluder_triangle_count;
+    jobs.parallel_for(BAND_COUNT, rasterize_band, &triangle_count);
+}
+
+// Tests boxes against the occlusion buffer from the last render
+static void
+test(
+    uint32_t const count,
+    struct OcclusionBox const boxes[static const count],
+    uint8_t visible[static const count])
+{
+    struct TestJob job = {
+        .count = count,
+        .boxes = boxes,
+        .visible = visible,
+    };
+    struct TestBatch batch = {
+        .job = &job,
+        .view_proj = last_view_proj,
+    };
+    jobs.parallel_for((count + TEST_BATCH_SIZE - 1) / TEST_BATCH_SIZE, test_batch, &batch);
+}
+
+const struct Occlusion occlusion = {
+    .init = init,
+    .deinit = deinit,
+    .add_occluder = add_occluder,
+    .render = render,
+    .test = test,
+};
@@ -0,0 +1,61 @@
+#include "game/pvs.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "graphics/mesh.h"
+
+uint32_t
+pvs_find_cell(struct Mesh const *mesh, float const position[static 3])
+{
+    struct MeshPvs const *pvs = mesh->pvs;
+    if (!pvs) {
+        return PVS_NO_CELL;
+    }
+
+    uint32_t cell[3];
+    for (int j = 0; j < 3; j++) {
+        float const x = (position[j] - pvs->origin[j]) / pvs->cell_size;
+        if (!(x >= 0.0f && x < pvs->cell_count[j])) {
+            return PVS_NO_CELL;
+        }
+        cell[j] = (uint32_t)x;
+    }
+
+    return cell[0] + pvs->cell_count[0] * (cell[1] + pvs->cell_count[1] * cell[2]);
+}
+
+void
+pvs_get_visible_chunks(struct Mesh const *mesh, uint32_t const cell, uint8_t visible[])
+{
+    if (cell == PVS_NO_CELL) {
+        memset(visible, 1, mesh->chunk_count);
+        return;
+    }
+    assert(mesh->pvs && cell < mesh->pvs_cell_count);
+
+    uint8_t const *data = &mesh->pvs_data[mesh->pvs_cells[cell]];
+    uint8_t const *end = &mesh->pvs_data[mesh->pvs_data_size];
+    uint32_t chunk = 0;
+    while (chunk < mesh->chunk_count) {
+        // the chunks of a row cut off by the end of the data stay visible
+        if (data >= end) {
+            memset(&visible[chunk], 1, mesh->chunk_count - chunk);
+            return;
+        }
+
+        uint8_t const byte = *data++;
+        if (byte == 0) {
+            uint32_t const run = data < end ? *data++ * 8u : 0;
+            uint32_t const count = run < mesh->chunk_count - chunk ? run : mesh->chunk_count - chunk;
+            memset(&visible[chunk], 0, count);
+            chunk += count;
+            continue;
+        }
+
+        for (int bit = 0; bit < 8 && chunk < mesh->chunk_count; bit++) {
+            visible[chunk++] = byte >> bit & 1;
+        }
+    }
+}
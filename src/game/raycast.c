@@ -0,0 +1,639 @@
+#include "game/raycast.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RAYCAST_X86
+#endif
+
+#include "common/bvh.h"
+#include "common/job.h"
+#include "graphics/vertex.h"
+
+// Ray casting against static triangles
+//   Rays travel through a BVH over the triangles in packets, one ray per SIMD
+//   lane, and a node is entered when any ray of the packet hits its box.
+//   Triangles are two sided and tested watertight after Woop, Benthin and
+//   Wald: vertices are sheared into the space of each ray, so that rays
+//   through a shared edge or vertex always hit one of its triangles.
+#define PACKET_MAX_WIDTH 8
+#define RAY_BATCH_SIZE 256
+// stands in for zero direction components in the box test
+#define MIN_DIRECTION 1e-20f
+// widens the box exits by a few ulps so that rounding never loses a hit on
+// the boundary of a box (Ize, Robust BVH Ray Traversal)
+#define BOX_FAR_SCALE 1.0000004f
+
+struct Triangle {
+    float v[3][3];
+};
+
+// The rays of a packet with one lane per ray. row turns a vertex relative to
+// the origin into the sheared space where the ray runs along z from 0 to t.
+struct Packet {
+    float origin[3][PACKET_MAX_WIDTH];
+    float direction[3][PACKET_MAX_WIDTH];
+    float inv_direction[3][PACKET_MAX_WIDTH];
+    float row[3][3][PACKET_MAX_WIDTH];
+    float t[PACKET_MAX_WIDTH];
+};
+
+struct CastJob {
+    uint32_t count;
+    struct Ray const *rays;
+    struct RayHit *hits;
+};
+
+typedef void (*CastFunction)(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count]);
+
+// in leaf order once built
+static struct Triangle *triangles;
+static uint32_t triangle_count;
+static struct Bvh triangle_bvh;
+static int is_built;
+static CastFunction cast_rays;
+
+/* Shared */
+// The helpers of the packet loops are inlined into each of them, so that the
+// AVX loop runs them in AVX encoding instead of paying for transitions
+// Lanes past count repeat the first ray with a negative t and never hit
+__attribute__((always_inline))
+static inline void
+setup_packet(
+    uint32_t const count,
+    struct Ray const rays[static const count],
+    uint32_t const width,
+    struct Packet *packet)
+{
+    for (uint32_t lane = 0; lane < width; lane++) {
+        struct Ray const *ray = &rays[lane < count ? lane : 0];
+        float const *d = ray->direction;
+        assert(d[0] != 0.0f || d[1] != 0.0f || d[2] != 0.0f);
+
+        // z is the dominant axis, x and y keep the winding when it points back
+        int const kz = fabsf(d[0]) > fabsf(d[1])
+            ? (fabsf(d[0]) > fabsf(d[2]) ? 0 : 2)
+            : (fabsf(d[1]) > fabsf(d[2]) ? 1 : 2);
+        int kx = (kz + 1) % 3;
+        int ky = (kx + 1) % 3;
+        if (d[kz] < 0.0f) {
+            int const swap = kx;
+            kx = ky;
+            ky = swap;
+        }
+
+        for (int j = 0; j < 3; j++) {
+            packet->origin[j][lane] = ray->origin[j];
+            packet->direction[j][lane] = d[j];
+            packet->inv_direction[j][lane] = 1.0f / (fabsf(d[j]) > MIN_DIRECTION ? d[j] : copysignf(MIN_DIRECTION, d[j]));
+            for (int i = 0; i < 3; i++) {
+                packet->row[j][i][lane] = 0.0f;
+            }
+        }
+        packet->row[0][kx][lane] = 1.0f;
+        packet->row[0][kz][lane] = -d[kx] / d[kz];
+        packet->row[1][ky][lane] = 1.0f;
+        packet->row[1][kz][lane] = -d[ky] / d[kz];
+        packet->row[2][kz][lane] = 1.0f / d[kz];
+        packet->t[lane] = lane < count ? ray->max_distance : -1.0f;
+    }
+}
+
+// Tests a triangle already sheared into the space of the ray and keeps the
+// hit when it is closer than t. Edge functions that come out as zero in
+// float are decided again in double, as in the paper, so neighbours agree.
+__attribute__((always_inline))
+static inline int
+intersect_sheared(float const p[static 3][3], float *t, float *u, float *v)
+{
+    float e[3] = {
+        p[2][0] * p[1][1] - p[2][1] * p[1][0],
+        p[0][0] * p[2][1] - p[0][1] * p[2][0],
+        p[1][0] * p[0][1] - p[1][1] * p[0][0],
+    };
+    if (e[0] == 0.0f || e[1] == 0.0f || e[2] == 0.0f) {
+        e[0] = (float)((double)p[2][0] * p[1][1] - (double)p[2][1] * p[1][0]);
+        e[1] = (float)((double)p[0][0] * p[2][1] - (double)p[0][1] * p[2][0]);
+        e[2] = (float)((double)p[1][0] * p[0][1] - (double)p[1][1] * p[0][0]);
+    }
+
+    int const is_negative = e[0] < 0.0f || e[1] < 0.0f || e[2] < 0.0f;
+    int const is_positive = e[0] > 0.0f || e[1] > 0.0f || e[2] > 0.0f;
+    float const det = e[0] + e[1] + e[2];
+    if ((is_negative && is_positive) || det == 0.0f) {
+        return 0;
+    }
+
+    float const inv_det = 1.0f / det;
+    float const distance = (e[0] * p[0][2] + e[1] * p[1][2] + e[2] * p[2][2]) * inv_det;
+    if (!(distance >= 0.0f && distance < *t)) {
+        return 0;
+    }
+
+    *t = distance;
+    *u = e[1] * inv_det;
+    *v = e[2] * inv_det;
+
+    return 1;
+}
+
+// Visits the nearer child first along the direction of one ray
+__attribute__((always_inline))
+static inline void
+push_children(uint32_t const node_index, float const direction[static 3], uint32_t stack[], uint32_t *stack_size)
+{
+    struct BvhNode const *node = &triangle_bvh.nodes[node_index];
+    struct BvhNode const *left = &triangle_bvh.nodes[node_index + 1];
+    struct BvhNode const *right = &triangle_bvh.nodes[node->right_or_first];
+    float order = 0.0f;
+    for (int j = 0; j < 3; j++) {
+        order += (right->min[j] + right->max[j] - left->min[j] - left->max[j]) * direction[j];
+    }
+
+    if (order < 0.0f) {
+        stack[(*stack_size)++] = node_index + 1;
+        stack[(*stack_size)++] = node->right_or_first;
+    } else {
+        stack[(*stack_size)++] = node->right_or_first;
+        stack[(*stack_size)++] = node_index + 1;
+    }
+}
+
+__attribute__((always_inline))
+static inline void
+write_hits(
+    uint32_t const count,
+    uint32_t const width,
+    float const t[static const width],
+    float const u[static const width],
+    float const v[static const width],
+    uint32_t const slot[static const width],
+    struct RayHit hits[static const count])
+{
+    for (uint32_t lane = 0; lane < width && lane < count; lane++) {
+        hits[lane] = (struct RayHit) {
+            .distance = t[lane],
+            .triangle = slot[lane] == RAYCAST_MISS ? RAYCAST_MISS : triangle_bvh.items[slot[lane]],
+            .u = u[lane],
+            .v = v[lane],
+        };
+    }
+}
+
+/* Scalar */
+static void
+cast_rays_scalar(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count])
+{
+    for (uint32_t r = 0; r < count; r++) {
+        struct Packet packet;
+        setup_packet(1, &rays[r], 1, &packet);
+        float const direction[3] = {packet.direction[0][0], packet.direction[1][0], packet.direction[2][0]};
+        float t = packet.t[0];
+        float u = 0.0f;
+        float v = 0.0f;
+        uint32_t slot = RAYCAST_MISS;
+
+        uint32_t stack[BVH_MAX_DEPTH + 1];
+        uint32_t stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            uint32_t const node_index = stack[--stack_size];
+            struct BvhNode const *node = &triangle_bvh.nodes[node_index];
+            float near = 0.0f;
+            float far = t;
+            for (int j = 0; j < 3; j++) {
+                float const t0 = (node->min[j] - packet.origin[j][0]) * packet.inv_direction[j][0];
+                float const t1 = (node->max[j] - packet.origin[j][0]) * packet.inv_direction[j][0];
+                near = t0 < t1 ? (t0 > near ? t0 : near) : (t1 > near ? t1 : near);
+                float const exit = (t0 < t1 ? t1 : t0) * BOX_FAR_SCALE;
+                far = exit < far ? exit : far;
+            }
+            if (!(near <= far)) {
+                continue;
+            }
+
+            if (!node->count) {
+                push_children(node_index, direction, stack, &stack_size);
+                continue;
+            }
+
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                float p[3][3];
+                for (int k = 0; k < 3; k++) {
+                    float a[3];
+                    for (int j = 0; j < 3; j++) {
+                        a[j] = triangles[i].v[k][j] - packet.origin[j][0];
+                    }
+                    for (int j = 0; j < 3; j++) {
+                        p[k][j] = packet.row[j][0][0] * a[0] + packet.row[j][1][0] * a[1] + packet.row[j][2][0] * a[2];
+                    }
+                }
+                if (intersect_sheared(p, &t, &u, &v)) {
+                    slot = i;
+                }
+            }
+        }
+
+        write_hits(1, 1, &t, &u, &v, &slot, &hits[r]);
+    }
+}
+
+#ifdef RAYCAST_X86
+/* SSE */
+__attribute__((target("sse2")))
+static __m128
+select_sse(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+__attribute__((target("sse2")))
+static void
+cast_rays_sse(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count])
+{
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const far_scale = _mm_set1_ps(BOX_FAR_SCALE);
+    for (uint32_t first = 0; first < count; first += 4) {
+        struct Packet packet;
+        setup_packet(count - first, &rays[first], 4, &packet);
+        __m128 origin[3], inv_direction[3], row[3][3];
+        for (int j = 0; j < 3; j++) {
+            origin[j] = _mm_loadu_ps(packet.origin[j]);
+            inv_direction[j] = _mm_loadu_ps(packet.inv_direction[j]);
+            for (int i = 0; i < 3; i++) {
+                row[j][i] = _mm_loadu_ps(packet.row[j][i]);
+            }
+        }
+        __m128 t = _mm_loadu_ps(packet.t);
+        __m128 u = zero;
+        __m128 v = zero;
+        __m128 slot = _mm_castsi128_ps(_mm_set1_epi32(RAYCAST_MISS));
+
+        uint32_t stack[BVH_MAX_DEPTH + 1];
+        uint32_t stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            uint32_t const node_index = stack[--stack_size];
+            struct BvhNode const *node = &triangle_bvh.nodes[node_index];
+            __m128 near = zero;
+            __m128 far = t;
+            for (int j = 0; j < 3; j++) {
+                __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->min[j]), origin[j]), inv_direction[j]);
+                __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node->max[j]), origin[j]), inv_direction[j]);
+                near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+                far = _mm_min_ps(far, _mm_mul_ps(_mm_max_ps(t0, t1), far_scale));
+            }
+            int const mask = _mm_movemask_ps(_mm_cmple_ps(near, far));
+            if (!mask) {
+                continue;
+            }
+
+            if (!node->count) {
+                int const lane = __builtin_ctz(mask);
+                float const direction[3] = {packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]};
+                push_children(node_index, direction, stack, &stack_size);
+                continue;
+            }
+
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                __m128 p[3][3];
+                for (int k = 0; k < 3; k++) {
+                    __m128 a[3];
+                    for (int j = 0; j < 3; j++) {
+                        a[j] = _mm_sub_ps(_mm_set1_ps(triangles[i].v[k][j]), origin[j]);
+                    }
+                    for (int j = 0; j < 3; j++) {
+                        p[k][j] = _mm_add_ps(
+                            _mm_add_ps(_mm_mul_ps(row[j][0], a[0]), _mm_mul_ps(row[j][1], a[1])),
+                            _mm_mul_ps(row[j][2], a[2]));
+                    }
+                }
+
+                __m128 e[3];
+                e[0] = _mm_sub_ps(_mm_mul_ps(p[2][0], p[1][1]), _mm_mul_ps(p[2][1], p[1][0]));
+                e[1] = _mm_sub_ps(_mm_mul_ps(p[0][0], p[2][1]), _mm_mul_ps(p[0][1], p[2][0]));
+                e[2] = _mm_sub_ps(_mm_mul_ps(p[1][0], p[0][1]), _mm_mul_ps(p[1][1], p[0][0]));
+                __m128 is_zero = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(e[0], zero), _mm_cmpeq_ps(e[1], zero)), _mm_cmpeq_ps(e[2], zero));
+                __m128 is_negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(e[0], zero), _mm_cmplt_ps(e[1], zero)), _mm_cmplt_ps(e[2], zero));
+                __m128 is_positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(e[0], zero), _mm_cmpgt_ps(e[1], zero)), _mm_cmpgt_ps(e[2], zero));
+                __m128 det = _mm_add_ps(_mm_add_ps(e[0], e[1]), e[2]);
+                __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+                __m128 distance = _mm_mul_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], p[0][2]), _mm_mul_ps(e[1], p[1][2])), _mm_mul_ps(e[2], p[2][2])),
+                    inv_det);
+
+                __m128 is_hit = _mm_andnot_ps(_mm_and_ps(is_negative, is_positive), _mm_cmpneq_ps(det, zero));
+                is_hit = _mm_and_ps(is_hit, _mm_and_ps(_mm_cmpge_ps(distance, zero), _mm_cmplt_ps(distance, t)));
+                is_hit = _mm_andnot_ps(is_zero, is_hit);
+                t = select_sse(is_hit, distance, t);
+                u = select_sse(is_hit, _mm_mul_ps(e[1], inv_det), u);
+                v = select_sse(is_hit, _mm_mul_ps(e[2], inv_det), v);
+                slot = select_sse(is_hit, _mm_castsi128_ps(_mm_set1_epi32(i)), slot);
+
+                int zero_mask = _mm_movemask_ps(is_zero);
+                if (!zero_mask) {
+                    continue;
+                }
+
+                // rays through an edge or a vertex are rare, decide them one by one
+                float lane_p[3][3][4], lane_t[4], lane_u[4], lane_v[4];
+                uint32_t lane_slot[4];
+                for (int k = 0; k < 3; k++) {
+                    for (int j = 0; j < 3; j++) {
+                        _mm_storeu_ps(lane_p[k][j], p[k][j]);
+                    }
+                }
+                _mm_storeu_ps(lane_t, t);
+                _mm_storeu_ps(lane_u, u);
+                _mm_storeu_ps(lane_v, v);
+                _mm_storeu_ps((float *)lane_slot, slot);
+                while (zero_mask) {
+                    int const lane = __builtin_ctz(zero_mask);
+                    zero_mask &= zero_mask - 1;
+                    float sheared[3][3];
+                    for (int k = 0; k < 3; k++) {
+                        for (int j = 0; j < 3; j++) {
+                            sheared[k][j] = lane_p[k][j][lane];
+                        }
+                    }
+                    if (intersect_sheared(sheared, &lane_t[lane], &lane_u[lane], &lane_v[lane])) {
+                        lane_slot[lane] = i;
+                    }
+                }
+                t = _mm_loadu_ps(lane_t);
+                u = _mm_loadu_ps(lane_u);
+                v = _mm_loadu_ps(lane_v);
+                slot = _mm_loadu_ps((float *)lane_slot);
+            }
+        }
+
+        float out_t[4], out_u[4], out_v[4];
+        uint32_t out_slot[4];
+        _mm_storeu_ps(out_t, t);
+        _mm_storeu_ps(out_u, u);
+        _mm_storeu_ps(out_v, v);
+        _mm_storeu_ps((float *)out_slot, slot);
+        write_hits(count - first, 4, out_t, out_u, out_v, out_slot, &hits[first]);
+    }
+}
+
+/* AVX */
+__attribute__((target("avx")))
+static void
+cast_rays_avx(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count])
+{
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const far_scale = _mm256_set1_ps(BOX_FAR_SCALE);
+    for (uint32_t first = 0; first < count; first += 8) {
+        struct Packet packet;
+        setup_packet(count - first, &rays[first], 8, &packet);
+        __m256 origin[3], inv_direction[3], row[3][3];
+        for (int j = 0; j < 3; j++) {
+            origin[j] = _mm256_loadu_ps(packet.origin[j]);
+            inv_direction[j] = _mm256_loadu_ps(packet.inv_direction[j]);
+            for (int i = 0; i < 3; i++) {
+                row[j][i] = _mm256_loadu_ps(packet.row[j][i]);
+            }
+        }
+        __m256 t = _mm256_loadu_ps(packet.t);
+        __m256 u = zero;
+        __m256 v = zero;
+        __m256 slot = _mm256_castsi256_ps(_mm256_set1_epi32(RAYCAST_MISS));
+
+        uint32_t stack[BVH_MAX_DEPTH + 1];
+        uint32_t stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            uint32_t const node_index = stack[--stack_size];
+            struct BvhNode const *node = &triangle_bvh.nodes[node_index];
+            __m256 near = zero;
+            __m256 far = t;
+            for (int j = 0; j < 3; j++) {
+                __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node->min[j]), origin[j]), inv_direction[j]);
+                __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node->max[j]), origin[j]), inv_direction[j]);
+                near = _mm256_max_ps(near, _mm256_min_ps(t0, t1));
+                far = _mm256_min_ps(far, _mm256_mul_ps(_mm256_max_ps(t0, t1), far_scale));
+            }
+            int const mask = _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ));
+            if (!mask) {
+                continue;
+            }
+
+            if (!node->count) {
+                int const lane = __builtin_ctz(mask);
+                float const direction[3] = {packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]};
+                push_children(node_index, direction, stack, &stack_size);
+                continue;
+            }
+
+            for (uint32_t i = node->right_or_first; i < node->right_or_first + node->count; i++) {
+                __m256 p[3][3];
+                for (int k = 0; k < 3; k++) {
+                    __m256 a[3];
+                    for (int j = 0; j < 3; j++) {
+                        a[j] = _mm256_sub_ps(_mm256_set1_ps(triangles[i].v[k][j]), origin[j]);
+                    }
+                    for (int j = 0; j < 3; j++) {
+                        p[k][j] = _mm256_add_ps(
+                            _mm256_add_ps(_mm256_mul_ps(row[j][0], a[0]), _mm256_mul_ps(row[j][1], a[1])),
+                            _mm256_mul_ps(row[j][2], a[2]));
+                    }
+                }
+
+                __m256 e[3];
+                e[0] = _mm256_sub_ps(_mm256_mul_ps(p[2][0], p[1][1]), _mm256_mul_ps(p[2][1], p[1][0]));
+                e[1] = _mm256_sub_ps(_mm256_mul_ps(p[0][0], p[2][1]), _mm256_mul_ps(p[0][1], p[2][0]));
+                e[2] = _mm256_sub_ps(_mm256_mul_ps(p[1][0], p[0][1]), _mm256_mul_ps(p[1][1], p[0][0]));
+                __m256 is_zero = _mm256_or_ps(
+                    _mm256_or_ps(_mm256_cmp_ps(e[0], zero, _CMP_EQ_OQ), _mm256_cmp_ps(e[1], zero, _CMP_EQ_OQ)),
+                    _mm256_cmp_ps(e[2], zero, _CMP_EQ_OQ));
+                __m256 is_negative = _mm256_or_ps(
+                    _mm256_or_ps(_mm256_cmp_ps(e[0], zero, _CMP_LT_OQ), _mm256_cmp_ps(e[1], zero, _CMP_LT_OQ)),
+                    _mm256_cmp_ps(e[2], zero, _CMP_LT_OQ));
+                __m256 is_positive = _mm256_or_ps(
+                    _mm256_or_ps(_mm256_cmp_ps(e[0], zero, _CMP_GT_OQ), _mm256_cmp_ps(e[1], zero, _CMP_GT_OQ)),
+                    _mm256_cmp_ps(e[2], zero, _CMP_GT_OQ));
+                __m256 det = _mm256_add_ps(_mm256_add_ps(e[0], e[1]), e[2]);
+                __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+                __m256 distance = _mm256_mul_ps(
+                    _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(e[0], p[0][2]), _mm256_mul_ps(e[1], p[1][2])),
+                        _mm256_mul_ps(e[2], p[2][2])),
+                    inv_det);
+
+                __m256 is_hit = _mm256_andnot_ps(_mm256_and_ps(is_negative, is_positive), _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ));
+                is_hit = _mm256_and_ps(is_hit, _mm256_and_ps(
+                    _mm256_cmp_ps(distance, zero, _CMP_GE_OQ),
+                    _mm256_cmp_ps(distance, t, _CMP_LT_OQ)));
+                is_hit = _mm256_andnot_ps(is_zero, is_hit);
+                t = _mm256_blendv_ps(t, distance, is_hit);
+                u = _mm256_blendv_ps(u, _mm256_mul_ps(e[1], inv_det), is_hit);
+                v = _mm256_blendv_ps(v, _mm256_mul_ps(e[2], inv_det), is_hit);
+                slot = _mm256_blendv_ps(slot, _mm256_castsi256_ps(_mm256_set1_epi32(i)), is_hit);
+
+                int zero_mask = _mm256_movemask_ps(is_zero);
+                if (!zero_mask) {
+                    continue;
+                }
+
+                float lane_p[3][3][8], lane_t[8], lane_u[8], lane_v[8];
+                uint32_t lane_slot[8];
+                for (int k = 0; k < 3; k++) {
+                    for (int j = 0; j < 3; j++) {
+                        _mm256_storeu_ps(lane_p[k][j], p[k][j]);
+                    }
+                }
+                _mm256_storeu_ps(lane_t, t);
+                _mm256_storeu_ps(lane_u, u);
+                _mm256_storeu_ps(lane_v, v);
+                _mm256_storeu_ps((float *)lane_slot, slot);
+                while (zero_mask) {
+                    int const lane = __builtin_ctz(zero_mask);
+                    zero_mask &= zero_mask - 1;
+                    float sheared[3][3];
+                    for (int k = 0; k < 3; k++) {
+                        for (int j = 0; j < 3; j++) {
+                            sheared[k][j] = lane_p[k][j][lane];
+                        }
+                    }
+                    if (intersect_sheared(sheared, &lane_t[lane], &lane_u[lane], &lane_v[lane])) {
+                        lane_slot[lane] = i;
+                    }
+                }
+                t = _mm256_loadu_ps(lane_t);
+                u = _mm256_loadu_ps(lane_u);
+                v = _mm256_loadu_ps(lane_v);
+                slot = _mm256_loadu_ps((float *)lane_slot);
+            }
+        }
+
+        float out_t[8], out_u[8], out_v[8];
+        uint32_t out_slot[8];
+        _mm256_storeu_ps(out_t, t);
+        _mm256_storeu_ps(out_u, u);
+        _mm256_storeu_ps(out_v, v);
+        _mm256_storeu_ps((float *)out_slot, slot);
+        write_hits(count - first, 8, out_t, out_u, out_v, out_slot, &hits[first]);
+    }
+}
+#endif
+
+static void
+cast_batch(void *data, uint32_t index)
+{
+    struct CastJob const *job = data;
+    uint32_t begin = index * RAY_BATCH_SIZE;
+    uint32_t end = begin + RAY_BATCH_SIZE < job->count ? begin + RAY_BATCH_SIZE : job->count;
+
+    cast_rays(end - begin, &job->rays[begin], &job->hits[begin]);
+}
+
+/* Public Functions */
+static void
+init(void)
+{
+    cast_rays = cast_rays_scalar;
+#ifdef RAYCAST_X86
+    cast_rays = cast_rays_sse;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        cast_rays = cast_rays_avx;
+    }
+#endif
+
+    triangles = 0;
+    triangle_count = 0;
+    is_built = 0;
+}
+
+static void
+deinit(void)
+{
+    if (is_built) {
+        bvh_free(&triangle_bvh);
+    }
+    free(triangles);
+    triangles = 0;
+    triangle_count = 0;
+    is_built = 0;
+}
+
+static void
+add_geometry(uint32_t const count, struct Vertex const vertices[static const count])
+{
+    assert(!is_built);
+    struct Triangle *resized = realloc(triangles, (triangle_count + count / 3) * sizeof *triangles);
+    assert(resized != 0);
+    triangles = resized;
+
+    for (uint32_t i = 0; i + 2 < count; i += 3) {
+        struct Triangle *triangle = &triangles[triangle_count++];
+        for (int k = 0; k < 3; k++) {
+            triangle->v[k][0] = vertices[i + k].pos.x;
+            triangle->v[k][1] = vertices[i + k].pos.y;
+            triangle->v[k][2] = vertices[i + k].pos.z;
+        }
+    }
+}
+
+static void
+build(void)
+{
+    assert(!is_built);
+    struct BvhBounds *bounds = malloc((triangle_count ? triangle_count : 1) * sizeof *bounds);
+    assert(bounds != 0);
+    for (uint32_t i = 0; i < triangle_count; i++) {
+        for (int j = 0; j < 3; j++) {
+            bounds[i].min[j] = fminf(fminf(triangles[i].v[0][j], triangles[i].v[1][j]), triangles[i].v[2][j]);
+            bounds[i].max[j] = fmaxf(fmaxf(triangles[i].v[0][j], triangles[i].v[1][j]), triangles[i].v[2][j]);
+        }
+    }
+
+    bvh_build(&triangle_bvh, triangle_count, bounds);
+    free(bounds);
+
+    // leaves then read their triangles in a row
+    struct Triangle *ordered = malloc((triangle_count ? triangle_count : 1) * sizeof *ordered);
+    assert(ordered != 0);
+    for (uint32_t i = 0; i < triangle_count; i++) {
+        ordered[i] = triangles[triangle_bvh.items[i]];
+    }
+    free(triangles);
+    triangles = ordered;
+    is_built = 1;
+}
+
+static void
+cast(uint32_t const count, struct Ray const rays[static const count], struct RayHit hits[static const count])
+{
+    assert(is_built);
+    if (triangle_count == 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            hits[i] = (struct RayHit) {
+                .distance = rays[i].max_distance,
+                .triangle = RAYCAST_MISS,
+            };
+        }
+        return;
+    }
+
+    struct CastJob job = {
+        .count = count,
+        .rays = rays,
+        .hits = hits,
+    };
+    jobs.parallel_for((count + RAY_BATCH_SIZE - 1) / RAY_BATCH_SIZE, cast_batch, &job);
+}
+
+const struct Raycast raycast = {
+    .init = init,
+    .deinit = deinit,
+    .add_geometry = add_geometry,
+    .build = build,
+    .cast = cast,
+};
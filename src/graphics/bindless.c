@@ -0,0 +1,113 @@
+#include <assert.h>
+
+#include "graphics/bindless.h"
+
+void
+bindless_init(struct Bindless *bindless, VkDevice const device, VkPhysicalDevice const physical_device)
+{
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &indexing_properties,
+    };
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    *bindless = (struct Bindless) {
+        .buffer_capacity = BINDLESS_MAX_BUFFERS,
+    };
+    if (indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers < bindless->buffer_capacity) {
+        bindless->buffer_capacity = indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+    }
+    if (indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers < bindless->buffer_capacity) {
+        bindless->buffer_capacity = indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers;
+    }
+
+    VkDescriptorBindingFlagsEXT const binding_flags[] = {
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT,
+        .bindingCount = sizeof binding_flags / sizeof *binding_flags,
+        .pBindingFlags = binding_flags,
+    };
+    VkDescriptorSetLayoutBinding bindings[] = {
+        {
+            .binding = BINDLESS_BUFFER_BINDING,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = bindless->buffer_capacity,
+            .stageFlags = VK_SHADER_STAGE_ALL,
+        },
+    };
+    VkDescriptorSetLayoutCreateInfo layout_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &binding_flags_info,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+        .bindingCount = sizeof bindings / sizeof *bindings,
+        .pBindings = bindings,
+    };
+    VkResult result = vkCreateDescriptorSetLayout(device, &layout_info, 0, &bindless->layout);
+    assert(result == VK_SUCCESS);
+
+    VkDescriptorPoolSize pool_sizes[] = {
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = bindless->buffer_capacity,
+        },
+    };
+    VkDescriptorPoolCreateInfo pool_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT,
+        .maxSets = 1,
+        .poolSizeCount = sizeof pool_sizes / sizeof *pool_sizes,
+        .pPoolSizes = pool_sizes,
+    };
+    result = vkCreateDescriptorPool(device, &pool_info, 0, &bindless->pool);
+    assert(result == VK_SUCCESS);
+
+    VkDescriptorSetAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = bindless->pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &bindless->layout,
+    };
+    result = vkAllocateDescriptorSets(device, &alloc_info, &bindless->set);
+    assert(result == VK_SUCCESS);
+}
+
+uint32_t
+bindless_add_buffer(struct Bindless *bindless)
+{
+    assert(bindless->buffer_count < bindless->buffer_capacity);
+    return bindless->buffer_count++;
+}
+
+void
+bindless_write_buffer(struct Bindless const *bindless, VkDevice const device, uint32_t const index, VkBuffer const buffer)
+{
+    assert(index < bindless->buffer_count);
+
+    VkDescriptorBufferInfo buffer_info = {
+        .buffer = buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = bindless->set,
+        .dstBinding = BINDLESS_BUFFER_BINDING,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_info,
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, 0);
+}
+
+void
+bindless_destroy(struct Bindless *bindless, VkDevice const device)
+{
+    vkDestroyDescriptorPool(device, bindless->pool, 0);
+    vkDestroyDescriptorSetLayout(device, bindless->layout, 0);
+}
@@ -0,0 +1,248 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graphics/capabilities.h"
+
+static VkBool32
+has_extension(
+    uint32_t const count,
+    VkExtensionProperties const extensions[static const count],
+    char const *name)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (strcmp(extensions[i].extensionName, name) == 0) {
+            return VK_TRUE;
+        }
+    }
+
+    return VK_FALSE;
+}
+
+// Whether the device has every extension of the list
+static VkBool32
+has_extensions(
+    uint32_t const count,
+    VkExtensionProperties const extensions[static const count],
+    uint32_t const name_count,
+    char const *const names[static const name_count])
+{
+    for (uint32_t i = 0; i < name_count; i++) {
+        if (!has_extension(count, extensions, names[i])) {
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// The extensions each capability needs, on the Vulkan 1.1 instance the
+// promoted ones as well
+static char const *const timeline_semaphore_extensions[] = {
+    VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+};
+static char const *const dynamic_rendering_extensions[] = {
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+};
+// mesh shaders need SPIR-V 1.4
+static char const *const mesh_shading_extensions[] = {
+    VK_EXT_MESH_SHADER_EXTENSION_NAME,
+    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+    VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
+};
+static char const *const descriptor_indexing_extensions[] = {
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+};
+static char const *const memory_budget_extensions[] = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+};
+static char const *const present_wait_extensions[] = {
+    VK_KHR_PRESENT_ID_EXTENSION_NAME,
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+};
+
+#define COUNT(array) (sizeof array / sizeof *array)
+
+void
+capabilities_query(struct Capabilities *capabilities, uint32_t const instance_version, VkPhysicalDevice const gpu)
+{
+    *capabilities = (struct Capabilities) {
+        .timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+        .dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+        .mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+        .descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT,
+        .present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+        .present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+    };
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    capabilities->api_version = properties.apiVersion < instance_version ? properties.apiVersion : instance_version;
+
+    uint32_t extension_count = 0;
+    VkResult result = vkEnumerateDeviceExtensionProperties(gpu, 0, &extension_count, 0);
+    assert(result == VK_SUCCESS);
+    VkExtensionProperties *extensions = malloc(extension_count * sizeof *extensions);
+    result = vkEnumerateDeviceExtensionProperties(gpu, 0, &extension_count, extensions);
+    assert(result == VK_SUCCESS);
+
+    capabilities->is_swapchain = has_extension(extension_count, extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    capabilities->is_memory_budget = has_extensions(extension_count, extensions, COUNT(memory_budget_extensions), memory_budget_extensions);
+
+    // the feature structs of the extensions the device has are chained into
+    // one query, structs of missing extensions stay zero
+    struct {
+        VkBool32 is_supported;
+        VkBaseOutStructure *features;
+    } queries[] = {
+        {
+            has_extensions(extension_count, extensions, COUNT(timeline_semaphore_extensions), timeline_semaphore_extensions),
+            (VkBaseOutStructure *)&capabilities->timeline_semaphore_features,
+        },
+        {
+            has_extensions(extension_count, extensions, COUNT(dynamic_rendering_extensions), dynamic_rendering_extensions),
+            (VkBaseOutStructure *)&capabilities->dynamic_rendering_features,
+        },
+        {
+            has_extensions(extension_count, extensions, COUNT(mesh_shading_extensions), mesh_shading_extensions),
+            (VkBaseOutStructure *)&capabilities->mesh_shader_features,
+        },
+        {
+            has_extensions(extension_count, extensions, COUNT(descriptor_indexing_extensions), descriptor_indexing_extensions),
+            (VkBaseOutStructure *)&capabilities->descriptor_indexing_features,
+        },
+        {
+            has_extensions(extension_count, extensions, COUNT(present_wait_extensions), present_wait_extensions),
+            (VkBaseOutStructure *)&capabilities->present_id_features,
+        },
+        {
+            has_extensions(extension_count, extensions, COUNT(present_wait_extensions), present_wait_extensions),
+            (VkBaseOutStructure *)&capabilities->present_wait_features,
+        },
+    };
+    free(extensions);
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    };
+    for (size_t i = 0; i < COUNT(queries); i++) {
+        if (queries[i].is_supported) {
+            queries[i].features->pNext = features.pNext;
+            features.pNext = queries[i].features;
+        }
+    }
+    vkGetPhysicalDeviceFeatures2(gpu, &features);
+    for (size_t i = 0; i < COUNT(queries); i++) {
+        queries[i].features->pNext = 0;
+    }
+    capabilities->features = features.features;
+
+    capabilities->is_timeline_semaphore = capabilities->timeline_semaphore_features.timelineSemaphore;
+    capabilities->is_dynamic_rendering = capabilities->dynamic_rendering_features.dynamicRendering;
+    capabilities->is_mesh_shading = capabilities->mesh_shader_features.taskShader && capabilities->mesh_shader_features.meshShader;
+    // what the bindless descriptors need, the other indexing features are
+    // enabled where present
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT const *indexing = &capabilities->descriptor_indexing_features;
+    capabilities->is_descriptor_indexing = indexing->runtimeDescriptorArray &&
+        indexing->descriptorBindingPartiallyBound &&
+        indexing->descriptorBindingStorageBufferUpdateAfterBind &&
+        indexing->shaderStorageBufferArrayNonUniformIndexing;
+    capabilities->is_present_wait = capabilities->present_id_features.presentId && capabilities->present_wait_features.presentWait;
+}
+
+void
+capabilities_enable(struct Capabilities *capabilities)
+{
+    capabilities->extension_count = 0;
+    capabilities->next = 0;
+
+    // of the core features only those the renderer uses, robust buffer
+    // access and the like cost performance where they are on
+    capabilities->features = (VkPhysicalDeviceFeatures) {
+        .multiDrawIndirect = capabilities->features.multiDrawIndirect,
+        .drawIndirectFirstInstance = capabilities->features.drawIndirectFirstInstance,
+    };
+
+    // mesh shading features beyond the task and mesh stages depend on
+    // features the renderer does not enable
+    VkPhysicalDeviceMeshShaderFeaturesEXT *mesh = &capabilities->mesh_shader_features;
+    mesh->multiviewMeshShader = VK_FALSE;
+    mesh->primitiveFragmentShadingRateMeshShader = VK_FALSE;
+    mesh->meshShaderQueries = VK_FALSE;
+
+    struct {
+        VkBool32 is_enabled;
+        uint32_t extension_count;
+        char const *const *extensions;
+        VkBaseOutStructure *features;
+    } enables[] = {
+        {capabilities->is_swapchain, 1, (char const *const[]) {VK_KHR_SWAPCHAIN_EXTENSION_NAME}, 0},
+        {
+            capabilities->is_timeline_semaphore,
+            COUNT(timeline_semaphore_extensions),
+            timeline_semaphore_extensions,
+            (VkBaseOutStructure *)&capabilities->timeline_semaphore_features,
+        },
+        {
+            capabilities->is_dynamic_rendering,
+            COUNT(dynamic_rendering_extensions),
+            dynamic_rendering_extensions,
+            (VkBaseOutStructure *)&capabilities->dynamic_rendering_features,
+        },
+        {
+            capabilities->is_mesh_shading,
+            COUNT(mesh_shading_extensions),
+            mesh_shading_extensions,
+            (VkBaseOutStructure *)&capabilities->mesh_shader_features,
+        },
+        {
+            capabilities->is_descriptor_indexing,
+            COUNT(descriptor_indexing_extensions),
+            descriptor_indexing_extensions,
+            (VkBaseOutStructure *)&capabilities->descriptor_indexing_features,
+        },
+        {capabilities->is_memory_budget, COUNT(memory_budget_extensions), memory_budget_extensions, 0},
+        {
+            capabilities->is_present_wait,
+            COUNT(present_wait_extensions),
+            present_wait_extensions,
+            (VkBaseOutStructure *)&capabilities->present_wait_features,
+        },
+        {capabilities->is_present_wait, 0, 0, (VkBaseOutStructure *)&capabilities->present_id_features},
+    };
+    for (size_t i = 0; i < COUNT(enables); i++) {
+        if (!enables[i].is_enabled) {
+            continue;
+        }
+        for (uint32_t j = 0; j < enables[i].extension_count; j++) {
+            assert(capabilities->extension_count < CAPABILITIES_MAX_EXTENSIONS);
+            capabilities->extensions[capabilities->extension_count++] = enables[i].extensions[j];
+        }
+        if (enables[i].features) {
+            enables[i].features->pNext = capabilities->next;
+            capabilities->next = enables[i].features;
+        }
+    }
+}
+
+void
+capabilities_log(struct Capabilities const *capabilities)
+{
+    printf(
+        "capabilities: Vulkan %u.%u, timeline semaphores %s, dynamic rendering %s, mesh shading %s, "
+        "descriptor indexing %s, memory budget %s, present wait %s, multi draw indirect %s\n",
+        VK_VERSION_MAJOR(capabilities->api_version),
+        VK_VERSION_MINOR(capabilities->api_version),
+        capabilities->is_timeline_semaphore ? "on" : "off",
+        capabilities->is_dynamic_rendering ? "on" : "off",
+        capabilities->is_mesh_shading ? "on" : "off",
+        capabilities->is_descriptor_indexing ? "on" : "off",
+        capabilities->is_memory_budget ? "on" : "off",
+        capabilities->is_present_wait ? "on" : "off",
+        capabilities->features.multiDrawIndirect ? "on" : "off"
+    );
+}
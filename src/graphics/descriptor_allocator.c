@@ -0,0 +1,305 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graphics/descriptor_allocator.h"
+
+#define FIRST_POOL_SETS 64
+#define CACHE_FIRST_CAPACITY 64
+
+// Descriptors of each type per set of a pool, about what the sets of the
+// renderer use with room to spare
+static struct {
+    VkDescriptorType type;
+    uint32_t count;
+} const pool_ratios[] = {
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 12},
+    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+};
+
+static VkDescriptorSet
+allocate_from_chain(struct DescriptorPoolChain *chain, VkDevice const device, VkDescriptorSetLayout const layout)
+{
+    for (;;) {
+        if (chain->current == chain->pool_count) {
+            assert(chain->pool_count < DESCRIPTOR_ALLOCATOR_MAX_POOLS);
+            uint32_t const set_count = FIRST_POOL_SETS << chain->pool_count;
+            VkDescriptorPoolSize pool_sizes[sizeof pool_ratios / sizeof *pool_ratios];
+            for (size_t i = 0; i < sizeof pool_ratios / sizeof *pool_ratios; i++) {
+                pool_sizes[i] = (VkDescriptorPoolSize) {
+                    .type = pool_ratios[i].type,
+                    .descriptorCount = pool_ratios[i].count * set_count,
+                };
+            }
+            VkDescriptorPoolCreateInfo pool_info = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .maxSets = set_count,
+                .poolSizeCount = sizeof pool_sizes / sizeof *pool_sizes,
+                .pPoolSizes = pool_sizes,
+            };
+            VkResult result = vkCreateDescriptorPool(device, &pool_info, 0, &chain->pools[chain->pool_count]);
+            assert(result == VK_SUCCESS);
+            chain->pool_count++;
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = chain->pools[chain->current],
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        };
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(device, &alloc_info, &set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+
+        // the next pool is larger, a set that does not fit a fresh pool
+        // never will
+        assert(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL);
+        chain->current++;
+    }
+}
+
+static void
+reset_chain(struct DescriptorPoolChain *chain, VkDevice const device)
+{
+    for (uint32_t i = 0; i < chain->pool_count; i++) {
+        VkResult result = vkResetDescriptorPool(device, chain->pools[i], 0);
+        assert(result == VK_SUCCESS);
+    }
+    chain->current = 0;
+}
+
+static void
+destroy_chain(struct DescriptorPoolChain *chain, VkDevice const device)
+{
+    for (uint32_t i = 0; i < chain->pool_count; i++) {
+        vkDestroyDescriptorPool(device, chain->pools[i], 0);
+    }
+    *chain = (struct DescriptorPoolChain) {0};
+}
+
+// FNV-1a
+static uint64_t
+hash_bytes(uint64_t hash, void const *data, size_t const size)
+{
+    uint8_t const *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static VkBool32
+is_image_type(VkDescriptorType const type)
+{
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+        type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+        type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+        type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+}
+
+// Only what the type of a write uses goes into the hash, so that callers
+// need not clear the rest
+static uint64_t
+hash_set(VkDescriptorSetLayout const layout, uint32_t const write_count, struct DescriptorWrite const writes[static const write_count])
+{
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ull, &layout, sizeof layout);
+    for (uint32_t i = 0; i < write_count; i++) {
+        hash = hash_bytes(hash, &writes[i].binding, sizeof writes[i].binding);
+        hash = hash_bytes(hash, &writes[i].type, sizeof writes[i].type);
+        if (is_image_type(writes[i].type)) {
+            hash = hash_bytes(hash, &writes[i].image.sampler, sizeof writes[i].image.sampler);
+            hash = hash_bytes(hash, &writes[i].image.imageView, sizeof writes[i].image.imageView);
+            hash = hash_bytes(hash, &writes[i].image.imageLayout, sizeof writes[i].image.imageLayout);
+        } else {
+            hash = hash_bytes(hash, &writes[i].buffer.buffer, sizeof writes[i].buffer.buffer);
+            hash = hash_bytes(hash, &writes[i].buffer.offset, sizeof writes[i].buffer.offset);
+            hash = hash_bytes(hash, &writes[i].buffer.range, sizeof writes[i].buffer.range);
+        }
+    }
+    return hash;
+}
+
+// Compares what hash_set walks
+static VkBool32
+is_write_equal(struct DescriptorWrite const *a, struct DescriptorWrite const *b)
+{
+    if (a->binding != b->binding || a->type != b->type) {
+        return VK_FALSE;
+    }
+    if (is_image_type(a->type)) {
+        return a->image.sampler == b->image.sampler &&
+            a->image.imageView == b->image.imageView &&
+            a->image.imageLayout == b->image.imageLayout;
+    }
+    return a->buffer.buffer == b->buffer.buffer &&
+        a->buffer.offset == b->buffer.offset &&
+        a->buffer.range == b->buffer.range;
+}
+
+static VkBool32
+is_entry_of(
+    struct DescriptorCacheEntry const *entry,
+    uint64_t const hash,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count])
+{
+    if (entry->hash != hash || entry->layout != layout || entry->write_count != write_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < write_count; i++) {
+        if (!is_write_equal(&entry->writes[i], &writes[i])) {
+            return VK_FALSE;
+        }
+    }
+    return VK_TRUE;
+}
+
+// Open addressing with linear probing, kept at most half full
+static struct DescriptorCacheEntry *
+find_entry(
+    struct DescriptorCacheEntry *entries,
+    uint32_t const capacity,
+    uint64_t const hash,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count])
+{
+    uint32_t i = hash & (capacity - 1);
+    while (entries[i].set != VK_NULL_HANDLE && !is_entry_of(&entries[i], hash, layout, write_count, writes)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+static void
+write_set(VkDevice const device, VkDescriptorSet const set, uint32_t const write_count, struct DescriptorWrite const writes[static const write_count])
+{
+    VkWriteDescriptorSet *descriptor_writes = malloc(write_count * sizeof *descriptor_writes);
+    for (uint32_t i = 0; i < write_count; i++) {
+        descriptor_writes[i] = (VkWriteDescriptorSet) {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = writes[i].binding,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = writes[i].type,
+            .pBufferInfo = is_image_type(writes[i].type) ? 0 : &writes[i].buffer,
+            .pImageInfo = is_image_type(writes[i].type) ? &writes[i].image : 0,
+        };
+    }
+    vkUpdateDescriptorSets(device, write_count, descriptor_writes, 0, 0);
+    free(descriptor_writes);
+}
+
+static void
+grow_cache(struct DescriptorAllocator *allocator)
+{
+    uint32_t const capacity = allocator->cache_capacity ? 2 * allocator->cache_capacity : CACHE_FIRST_CAPACITY;
+    struct DescriptorCacheEntry *entries = calloc(capacity, sizeof *entries);
+    for (uint32_t i = 0; i < allocator->cache_capacity; i++) {
+        struct DescriptorCacheEntry const *entry = &allocator->cache_entries[i];
+        if (entry->set != VK_NULL_HANDLE) {
+            *find_entry(entries, capacity, entry->hash, entry->layout, entry->write_count, entry->writes) = *entry;
+        }
+    }
+    free(allocator->cache_entries);
+    allocator->cache_entries = entries;
+    allocator->cache_capacity = capacity;
+}
+
+void
+descriptor_allocator_init(struct DescriptorAllocator *allocator, uint32_t const frame_count)
+{
+    assert(frame_count <= DESCRIPTOR_ALLOCATOR_MAX_FRAMES);
+    *allocator = (struct DescriptorAllocator) {
+        .frame_count = frame_count,
+    };
+}
+
+void
+descriptor_allocator_reset_frame(struct DescriptorAllocator *allocator, VkDevice const device, uint32_t const frame)
+{
+    assert(frame < allocator->frame_count);
+    reset_chain(&allocator->frames[frame], device);
+}
+
+VkDescriptorSet
+descriptor_allocator_allocate(
+    struct DescriptorAllocator *allocator,
+    VkDevice const device,
+    uint32_t const frame,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count])
+{
+    assert(frame < allocator->frame_count);
+    VkDescriptorSet const set = allocate_from_chain(&allocator->frames[frame], device, layout);
+    write_set(device, set, write_count, writes);
+    return set;
+}
+
+VkDescriptorSet
+descriptor_allocator_get_set(
+    struct DescriptorAllocator *allocator,
+    VkDevice const device,
+    VkDescriptorSetLayout const layout,
+    uint32_t const write_count,
+    struct DescriptorWrite const writes[static const write_count])
+{
+    if (2 * (allocator->cache_count + 1) > allocator->cache_capacity) {
+        grow_cache(allocator);
+    }
+
+    uint64_t const hash = hash_set(layout, write_count, writes);
+    struct DescriptorCacheEntry *entry = find_entry(allocator->cache_entries, allocator->cache_capacity, hash, layout, write_count, writes);
+    if (entry->set != VK_NULL_HANDLE) {
+        return entry->set;
+    }
+
+    VkDescriptorSet const set = allocate_from_chain(&allocator->cache_pools, device, layout);
+    write_set(device, set, write_count, writes);
+
+    *entry = (struct DescriptorCacheEntry) {
+        .hash = hash,
+        .layout = layout,
+        .set = set,
+        .write_count = write_count,
+        .writes = malloc(write_count * sizeof *writes),
+    };
+    memcpy(entry->writes, writes, write_count * sizeof *writes);
+    allocator->cache_count++;
+    return set;
+}
+
+void
+descriptor_allocator_clear_cache(struct DescriptorAllocator *allocator, VkDevice const device)
+{
+    reset_chain(&allocator->cache_pools, device);
+    for (uint32_t i = 0; i < allocator->cache_capacity; i++) {
+        free(allocator->cache_entries[i].writes);
+    }
+    if (allocator->cache_entries) {
+        memset(allocator->cache_entries, 0, allocator->cache_capacity * sizeof *allocator->cache_entries);
+    }
+    allocator->cache_count = 0;
+}
+
+void
+descriptor_allocator_destroy(struct DescriptorAllocator *allocator, VkDevice const device)
+{
+    for (uint32_t i = 0; i < allocator->frame_count; i++) {
+        destroy_chain(&allocator->frames[i], device);
+    }
+    destroy_chain(&allocator->cache_pools, device);
+    for (uint32_t i = 0; i < allocator->cache_capacity; i++) {
+        free(allocator->cache_entries[i].writes);
+    }
+    free(allocator->cache_entries);
+    *allocator = (struct DescriptorAllocator) {0};
+}
@@ -1,25 +1,49 @@
 #include <volk/volk.h>
 
 #include <assert.h>
+#include <ctype.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#include "common/linmath.h"
+#include "graphics/bindless.h"
+#include "graphics/capabilities.h"
+#include "graphics/descriptor_allocator.h"
 #include "graphics/graphics.h"
 #include "graphics/io.h"
+#include "graphics/pipeline_cache.h"
+#include "graphics/render_graph.h"
 #include "graphics/triangles.h"
 #include "graphics/vertex.h"
+#include "graphics/vulkan_ext.h"
 #include "platform/platform.h"
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define CULL_GROUP_SIZE 64
+#define DEPTH_REDUCE_GROUP_SIZE 8
+#define TASK_GROUP_SIZE 32
+// light clusters, see asset/shader/lighting/light.glsl
+#define CLUSTER_COUNT (16 * 9 * 24)
+#define CLUSTER_MAX_LIGHTS 128
+#define CLUSTER_GROUP_SIZE 64
+// screen space error in pixels at which a coarser level is drawn
+#define LOD_MAX_PIXEL_ERROR 1.0f
+#define MAX_QUEUE_TRANSFER_BUFFERS 8
+#define MAX_SUBMIT_WAITS 2
 
 /* Private Structures */
 struct GfxPhysicalDevice {
     VkPhysicalDevice gpu;
     uint32_t graphics_family_index;
     VkQueueFamilyProperties graphics_family_properties;
+    // dedicated families where the device has them, the graphics family
+    // otherwise
+    uint32_t transfer_family_index;
+    uint32_t compute_family_index;
 };
 
 struct GfxResource {
@@ -27,13 +51,105 @@ struct GfxResource {
     VkDeviceMemory memory;
 };
 
+// A buffer handed from a queue family to another one, the release is
+// recorded on the source queue and the acquire on the destination queue
+// after a semaphore from the source
+struct QueueTransfer {
+    uint32_t src_family;
+    uint32_t dst_family;
+    VkPipelineStageFlags src_stages;
+    VkAccessFlags src_access;
+    VkPipelineStageFlags dst_stages;
+    VkAccessFlags dst_access;
+};
+
+// Data copied into a new device local buffer
+struct Upload {
+    void const *data;
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+    struct GfxResource *resource;
+};
+
+// A timeline semaphore the submissions of one queue signal, each with the
+// next value. GPU work is tracked by the value of the submission doing it.
+struct QueueTimeline {
+    VkQueue queue;
+    VkSemaphore semaphore;
+    // of the last submission
+    uint64_t value;
+    // as last read back, waits for values up to it return at once
+    uint64_t completed_value;
+};
+
+// A semaphore a submission waits for, binary semaphores ignore the value
+struct SemaphoreWait {
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stages;
+};
+
+// Freed once the graphics timeline reaches the value, the buffer or the
+// command buffer may be left zero
+struct RetiredResource {
+    uint64_t value;
+    struct GfxResource buffer;
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+};
+
+// Per swapchain image uniform data, the leading view and proj match struct UBO
+struct FrameUniforms {
+    float view[4][4];
+    float proj[4][4];
+    float frustum[6][4];
+    float camera_position[4];
+    float lod_scale;
+    float z_near;
+    float z_far;
+    uint32_t light_count;
+    float viewport[2];
+    float padding[2];
+};
+
+struct CullConstants {
+    float pyramid_width;
+    float pyramid_height;
+    uint32_t object_count;
+    uint32_t is_late;
+    uint32_t is_occlusion_enabled;
+    uint32_t is_object_instance;
+};
+
+struct MeshConstants {
+    uint32_t first_object;
+    uint32_t object_count;
+};
+
+// Bindless indices of the buffers the shading pipelines read, one per
+// swapchain image
+struct BindlessConstants {
+    uint32_t object_buffer;
+    uint32_t light_buffer;
+    uint32_t cluster_buffer;
+};
+
+struct DepthReduceConstants {
+    uint32_t source_width;
+    uint32_t source_height;
+    uint32_t destination_width;
+    uint32_t destination_height;
+};
+
 /* Private Data */
 static VkResult result;
 static VkInstance instance;
 static VkSurfaceKHR surface;
 static struct GfxPhysicalDevice physical_device;
 static VkDevice device;
-static VkQueue graphics_queue;
+static struct QueueTimeline graphics_timeline;
+static struct QueueTimeline transfer_timeline;
+static struct QueueTimeline compute_timeline;
 static VkSurfaceFormatKHR surface_format;
 static VkExtent2D extent;
 static VkSwapchainKHR swapchain;
@@ -41,23 +157,109 @@ static uint32_t swapchain_length;
 static VkImage *swapchain_images;
 static VkImageView *swapchain_image_views;
 static VkCommandPool graphics_command_pool;
-static VkDescriptorPool descriptor_pool;
+static VkCommandPool transfer_command_pool;
+static VkCommandPool compute_command_pool;
 static VkSemaphore *is_image_available_semaphore;
 static VkSemaphore *is_present_ready_semaphore;
-static VkFence *is_main_render_done;
+// graphics timeline values of the last frame of each frame in flight and of
+// the last frame rendering to each swapchain image
+static uint64_t frame_timeline_values[MAX_FRAMES_IN_FLIGHT];
+static uint64_t *image_timeline_values;
+static struct RetiredResource *retired_resources;
+static uint32_t retired_count;
+static uint32_t retired_capacity;
 static VkDescriptorSetLayout descriptor_layout;
+static struct DescriptorAllocator descriptor_allocator;
 static VkPipelineLayout pipeline_layout;
-static VkRenderPass render_pass;
-static VkBuffer vertex_buffer;
-static VkDeviceMemory vertex_memory;
+static struct GfxResource vertex_resource;
 static struct GfxResource *uniform_resources;
 static VkDescriptorSet *descriptor_sets;
-static VkImage depth_image;
-static VkDeviceMemory depth_image_memory;
-static VkImageView depth_image_view;
 static VkPipeline pipeline;
-static VkFramebuffer *framebuffers;
+static VkPipeline double_sided_pipeline;
 static VkCommandBuffer *command_buffers;
+static uint32_t object_count;
+static struct GfxResource object_resource;
+static struct GfxResource visibility_resource;
+static struct GfxResource *draw_command_resources;
+static struct GfxResource *stats_resources;
+static struct GfxResource *object_mask_resources;
+static uint32_t *object_mask;
+static struct GfxResource *draw_order_resources;
+static uint32_t *draw_order;
+static VkBool32 is_depth_prepass = VK_FALSE;
+static VkPipeline depth_pipeline;
+static VkPipeline double_sided_depth_pipeline;
+static uint8_t *is_object_double_sided;
+static uint32_t single_sided_count;
+static VkBool32 is_gpu_occlusion_enabled = VK_TRUE;
+static struct FrameStats frame_stats;
+static VkDescriptorSetLayout cull_descriptor_layout;
+static VkPipelineLayout cull_pipeline_layout;
+static VkPipeline cull_pipeline;
+static VkDescriptorSetLayout depth_reduce_descriptor_layout;
+static VkPipelineLayout depth_reduce_pipeline_layout;
+static VkPipeline depth_reduce_pipeline;
+static VkSampler depth_sampler;
+static VkExtent2D depth_pyramid_extent;
+static uint32_t depth_pyramid_levels;
+static VkImageView *depth_pyramid_level_views;
+static VkDescriptorSet *cull_descriptor_sets;
+static VkDescriptorSet *depth_reduce_descriptor_sets;
+static PFN_vkCmdDrawMeshTasksEXT cmd_draw_mesh_tasks;
+static PFN_vkCmdBeginRenderingKHR cmd_begin_rendering;
+static PFN_vkCmdEndRenderingKHR cmd_end_rendering;
+static VkDescriptorSetLayout mesh_descriptor_layout;
+static VkPipelineLayout mesh_pipeline_layout;
+static VkPipeline mesh_pipeline;
+static VkPipeline double_sided_mesh_pipeline;
+static VkDescriptorSet *mesh_descriptor_sets;
+static struct GfxResource position_resource;
+static struct GfxResource meshlet_vertex_resource;
+static struct GfxResource meshlet_triangle_resource;
+static struct GfxResource triangle_color_resource;
+static struct Light lights[GRAPHICS_MAX_LIGHTS];
+static uint32_t light_count;
+static struct GfxResource *light_resources;
+static struct GfxResource *cluster_resources;
+static VkPipelineLayout cluster_pipeline_layout;
+static VkPipeline cluster_pipeline;
+static struct RenderGraph render_graph;
+// what the device was created with, the renderer branches on it
+static struct Capabilities capabilities;
+// with descriptor indexing the shading pipelines pull their vertices and
+// read every storage buffer through the bindless set
+static struct Bindless bindless;
+// owns the graphics pipelines, which compile in the background. Recording
+// waits for the single sided ones, the objects of the double sided ones
+// draw with the single sided pipelines until they are ready. Each image
+// re-records once the ready count moves past the count it was recorded at.
+static struct PipelineCache pipeline_cache;
+// the constant_id of each tunable in light.glsl
+enum ShadingConstant {
+    SHADING_CONSTANT_DYNAMIC_LIGHTING,
+    SHADING_CONSTANT_BAKED_LIGHT_SCALE,
+    SHADING_CONSTANT_DYNAMIC_LIGHT_SCALE,
+};
+static struct Shading shading = {
+    .baked_light_scale = 1.0f,
+    .dynamic_light_scale = 1.0f,
+    .is_dynamic_lighting = 1,
+};
+static struct PipelineFuture shading_future;
+static struct PipelineFuture depth_future;
+static struct PipelineFuture mesh_future;
+static struct PipelineState double_sided_state;
+static struct PipelineState double_sided_depth_state;
+static struct PipelineState double_sided_mesh_state;
+static struct BindlessConstants *bindless_constants;
+static uint32_t depth_resource;
+static uint32_t depth_pyramid_resource;
+static uint32_t shading_pass;
+// light clusters are binned on the compute queue when the device has a
+// dedicated compute family, the graphics queue acquires them every frame
+static VkBool32 is_async_compute;
+static struct QueueTransfer cluster_transfer;
+static VkCommandBuffer *compute_command_buffers;
 
 /* Private Function Declarations */
 static void
@@ -73,9 +275,16 @@ init_surface(
     VkInstance const instance,
     VkSurfaceKHR *surface);
 
+static VkBool32
+find_queue_families(VkPhysicalDevice const gpu, struct GfxPhysicalDevice *physical_device);
+
+static uint64_t
+score_physical_device(VkPhysicalDevice const gpu, char const **reason);
+
 static void
 init_device(
     struct GfxPhysicalDevice const *physical_device,
+    struct Capabilities *capabilities,
     VkDevice *device);
 
 static void
@@ -107,12 +316,6 @@ init_swapchain_image_views(
     VkImage const swapchain_images[static const length],
     VkImageView swapchain_image_views[static const length]);
 
-static void
-init_descriptor_pool(
-    VkDevice const device,
-    uint32_t const swapchain_length,
-    VkDescriptorPool *descriptor_pool);
-
 static void
 init_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout);
 
@@ -120,15 +323,9 @@ static void
 init_pipeline_layout(
     VkDevice const device,
     VkDescriptorSetLayout const descriptor_layout,
+    struct Bindless const *bindless,
     VkPipelineLayout *pipeline_layout);
 
-static void
-init_render_pass(
-    VkPhysicalDevice const physical_device,
-    VkDevice const device,
-    VkFormat const format,
-    VkRenderPass *render_pass);
-
 static uint32_t
 get_memory_type(
     VkPhysicalDevice const physical_device,
@@ -136,21 +333,34 @@ get_memory_type(
     VkMemoryPropertyFlags const flags);
 
 static void
-init_uniform_resources(
+init_buffer(
     VkDevice const device,
     VkPhysicalDevice const physical_device,
     VkDeviceSize const size,
-    uint32_t const length,
-    struct GfxResource resources[static const length]);
+    VkBufferUsageFlags const usage,
+    VkMemoryPropertyFlags const flags,
+    struct GfxResource *resource);
+
+static void
+init_shared_buffer(
+    VkDevice const device,
+    VkPhysicalDevice const physical_device,
+    VkDeviceSize const size,
+    VkBufferUsageFlags const usage,
+    VkMemoryPropertyFlags const flags,
+    uint32_t const family_count,
+    uint32_t const *families,
+    struct GfxResource *resource);
 
 static void
-init_descriptor_sets(
+init_uniform_resources(
     VkDevice const device,
-    VkDescriptorSetLayout descriptor_layout,
-    VkDescriptorPool descriptor_pool,
+    VkPhysicalDevice const physical_device,
+    VkDeviceSize const size,
+    uint32_t const family_count,
+    uint32_t const *families,
     uint32_t const length,
-    struct GfxResource const uniform_resources[static const length],
-    VkDescriptorSet descriptor_sets[static const length]);
+    struct GfxResource resources[static const length]);
 
 static void
 init_with_extent(void);
@@ -162,12 +372,16 @@ static void
 reinit_swapchain(void);
 
 static void
-init_pipeline(
-    VkDevice const device,
-    struct VkExtent2D extent,
+init_pipeline_state(
     VkPipelineLayout const pipeline_layout,
-    VkRenderPass const render_pass,
-    VkPipeline *pipeline);
+    struct RenderGraphTarget const *target,
+    VkBool32 const is_mesh_shading,
+    VkBool32 const is_depth_only,
+    VkBool32 const is_double_sided,
+    struct PipelineState *state);
+
+static void
+request_pipelines(void);
 
 static void
 init_shader_module(
@@ -177,14 +391,36 @@ init_shader_module(
     VkShaderModule *shader_module);
 
 static void
-init_framebuffers(
+init_compute_pipeline(
+    VkDevice const device,
+    char const *relative_path,
+    VkPipelineLayout const pipeline_layout,
+    VkPipeline *pipeline);
+
+static void
+init_cull_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout);
+
+static void
+init_depth_reduce_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout);
+
+static void
+init_mesh_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout);
+
+static void
+init_compute_pipeline_layout(
     VkDevice const device,
-    VkExtent2D const extent,
-    VkImageView const depth_image_view,
-    VkRenderPass const render_pass,
-    uint32_t const image_view_length,
-    VkImageView const image_views[static const image_view_length],
-    VkFramebuffer framebuffers[static const image_view_length]);
+    VkDescriptorSetLayout const descriptor_layout,
+    uint32_t const push_constant_size,
+    VkPipelineLayout *pipeline_layout);
+
+static void
+init_depth_pyramid_views(VkDevice const device, VkImage const depth_pyramid);
+
+static void
+write_descriptor_sets(void);
+
+static void
+write_frame_descriptor_sets(uint32_t const frame, uint32_t const image_index);
 
 static void
 init_command_buffers(
@@ -194,17 +430,78 @@ init_command_buffers(
     VkCommandBuffer command_buffers[static const length]);
 
 static void
-record_command_buffers(
-    uint32_t const length,
-    VkCommandBuffer const command_buffers[static const length],
-    VkFramebuffer const framebuffers[static const length],
-    VkDescriptorSet const descriptor_sets[static const length],
-    VkRenderPass const render_pass,
-    VkPipeline const pipeline,
-    VkPipelineLayout const pipeline_layout,
-    uint32_t const vertex_count,
-    VkBuffer const vertex_buffer,
-    VkExtent2D const extent);
+record_command_buffer(uint32_t const image_index);
+
+static void
+record_queue_transfer(
+    VkCommandBuffer const command_buffer,
+    struct QueueTransfer const *transfer,
+    VkBool32 const is_acquire,
+    uint32_t const count,
+    VkBuffer const buffers[static const count]);
+
+static void
+init_timeline(uint32_t const family_index, struct QueueTimeline *timeline);
+
+static uint64_t
+submit_command_buffer(
+    struct QueueTimeline *timeline,
+    VkCommandBuffer const command_buffer,
+    uint32_t const wait_count,
+    struct SemaphoreWait const *waits,
+    VkSemaphore const binary_signal);
+
+static void
+wait_timeline(struct QueueTimeline *timeline, uint64_t const value);
+
+static void
+retire_resource(struct RetiredResource const *resource);
+
+static void
+reclaim_resources(void);
+
+static void
+upload_buffers(
+    uint32_t const count,
+    struct Upload const uploads[static const count],
+    struct QueueTransfer const *transfer);
+
+static void
+init_render_graph(void);
+
+static void
+record_draw_objects(
+    VkCommandBuffer const command_buffer,
+    VkBuffer const draw_command_buffer,
+    uint32_t const first_object,
+    uint32_t const count);
+
+static void
+record_stats_clear(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_early_cull(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_late_cull(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_depth_pyramid(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_light_clusters(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_viewport(VkCommandBuffer const command_buffer);
+
+static void
+record_depth_prepass(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_shading(VkCommandBuffer const command_buffer, uint32_t const image_index);
+
+static void
+record_mesh_draws(VkCommandBuffer const command_buffer, uint32_t const image_index);
 
 static void
 update_uniform_buffers(
@@ -212,6 +509,15 @@ update_uniform_buffers(
     VkDeviceMemory const memory,
     struct UBO const *ubo);
 
+static void
+read_frame_stats(
+    VkDevice const device,
+    VkDeviceMemory const memory,
+    struct FrameStats *stats);
+
+static void
+partition_draw_order(uint32_t const order[static const object_count]);
+
 /* Private Functions */
 static void
 init_instance(VkInstance *instance)
@@ -247,6 +553,150 @@ init_instance(VkInstance *instance)
     assert(result == VK_SUCCESS);
 }
 
+// Picks the graphics family presenting to the surface, families without
+// graphics run transfers and compute beside it. Returns whether the device
+// has such a graphics family.
+static VkBool32
+find_queue_families(VkPhysicalDevice const gpu, struct GfxPhysicalDevice *physical_device)
+{
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, 0);
+    VkQueueFamilyProperties *families = malloc(family_count * sizeof *families);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, families);
+
+    VkBool32 is_found = VK_FALSE;
+    for (uint32_t i = 0; i < family_count && !is_found; i++) {
+        if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            continue;
+        }
+        VkBool32 is_surface_supported = VK_FALSE;
+        result = vkGetPhysicalDeviceSurfaceSupportKHR(gpu, i, surface, &is_surface_supported);
+        assert(result == VK_SUCCESS);
+        if (!is_surface_supported) {
+            continue;
+        }
+
+        physical_device->gpu = gpu;
+        physical_device->graphics_family_index = i;
+        physical_device->graphics_family_properties = families[i];
+        physical_device->transfer_family_index = i;
+        physical_device->compute_family_index = i;
+        is_found = VK_TRUE;
+    }
+
+    for (uint32_t i = 0; i < family_count && is_found; i++) {
+        VkQueueFlags const flags = families[i].queueFlags;
+        if (flags & VK_QUEUE_GRAPHICS_BIT) {
+            continue;
+        }
+        if (flags & VK_QUEUE_COMPUTE_BIT) {
+            if (physical_device->compute_family_index == physical_device->graphics_family_index) {
+                physical_device->compute_family_index = i;
+            }
+        } else if (flags & VK_QUEUE_TRANSFER_BIT) {
+            if (physical_device->transfer_family_index == physical_device->graphics_family_index) {
+                physical_device->transfer_family_index = i;
+            }
+        }
+    }
+
+    free(families);
+    return is_found;
+}
+
+// The device type outweighs everything else, so that hybrid laptops and multi
+// GPU machines land on the discrete GPU rather than the integrated one or a
+// software rasterizer. The largest device local heap comes next, then the
+// features and limits the renderer makes use of. Devices missing what the
+// renderer requires score zero, with the reason.
+static uint64_t
+score_physical_device(VkPhysicalDevice const gpu, char const **reason)
+{
+    struct Capabilities supported;
+    capabilities_query(&supported, VK_API_VERSION_1_1, gpu);
+    if (!supported.is_swapchain) {
+        *reason = "no swapchain";
+        return 0;
+    }
+    if (!supported.is_timeline_semaphore) {
+        *reason = "no timeline semaphores";
+        return 0;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    uint64_t type_rank;
+    switch (properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        type_rank = 4;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        type_rank = 3;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        type_rank = 2;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        type_rank = 1;
+        break;
+    default:
+        type_rank = 0;
+        break;
+    }
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memory_properties);
+    VkDeviceSize heap_size = 0;
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        VkMemoryHeap const *heap = &memory_properties.memoryHeaps[i];
+        if ((heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap->size > heap_size) {
+            heap_size = heap->size;
+        }
+    }
+
+    *reason = "highest score";
+    uint64_t score = type_rank << 48;
+    score += (heap_size >> 20) << 8;
+    score += supported.features.multiDrawIndirect ? 2 : 0;
+    score += properties.limits.maxImageDimension2D >= 16384 ? 1 : 0;
+    return score;
+}
+
+// Formats the UUID as 32 hex digits
+static void
+format_device_uuid(uint8_t const uuid[static VK_UUID_SIZE], char string[static 2 * VK_UUID_SIZE + 1])
+{
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        snprintf(&string[2 * i], 3, "%02x", uuid[i]);
+    }
+}
+
+// Whether HB_DEVICE names the device by its index or its UUID, dashes in the
+// UUID are ignored
+static VkBool32
+is_device_override(char const *override, uint32_t const index, char const uuid[static 2 * VK_UUID_SIZE + 1])
+{
+    char *end;
+    unsigned long const override_index = strtoul(override, &end, 10);
+    if (end != override && *end == '\0') {
+        return override_index == index;
+    }
+
+    uint32_t digit_count = 0;
+    for (char const *c = override; *c; c++) {
+        if (*c == '-') {
+            continue;
+        }
+        if (digit_count == 2 * VK_UUID_SIZE || tolower((unsigned char)*c) != uuid[digit_count]) {
+            return VK_FALSE;
+        }
+        digit_count++;
+    }
+    return digit_count == 2 * VK_UUID_SIZE;
+}
+
+// Every device is logged with its score, HB_DEVICE picks one by index or
+// UUID over the scores
 static void
 init_physical_device(
     VkInstance const instance,
@@ -256,69 +706,60 @@ init_physical_device(
     result = vkEnumeratePhysicalDevices(instance, &physical_device_count, 0);
     assert(result == VK_SUCCESS);
     VkPhysicalDevice *physical_devices = malloc(physical_device_count * sizeof *physical_devices);
-    if (!physical_devices) {
-        // TODO: handle malloc
-        goto fail_physical_devices_alloc;
-    }
     result = vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices);
     assert(result == VK_SUCCESS);
-    // TODO: abstract the sequential array allocation to different struct
-    // TODO: is the sequential array allocation faster?
-    //       - many mallocs vs pointer math to get offset
-    // TODO: storing extra property_count
-    uint32_t *property_counts = malloc((physical_device_count + 1) * sizeof *property_counts);
-    if (!property_counts) {
-        // TODO handle malloc
-        goto fail_property_counts_alloc;
-    }
-
-    uint32_t total_property_count = 0;
-    property_counts[0] = 0;
-    for (size_t i = 0; i < physical_device_count; i++) {
-        uint32_t property_count = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &property_count, 0);
-        total_property_count += property_count;
-        property_counts[i + 1] = total_property_count;
-    }
-
-    VkQueueFamilyProperties *queue_family_properties = malloc(total_property_count * sizeof *queue_family_properties);
-    if (!queue_family_properties) {
-        // TODO: handle queue_family_properties
-        goto fail_queue_family_properties_alloc;
-    }
-
-    for (size_t i = 0; i < physical_device_count; i++) {
-        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &property_counts[i + 1], &queue_family_properties[property_counts[i]]);
-
-        for (size_t j = 0; j < property_counts[i + 1]; j++) {
-            if (queue_family_properties[property_counts[i] + j].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                VkBool32 is_surface_supported = VK_FALSE;
-                result = vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, surface, &is_surface_supported);
-                assert(result == VK_SUCCESS);
-
-                if (is_surface_supported == VK_TRUE) {
-                    memcpy(&physical_device->gpu, &physical_devices[i], sizeof physical_device->gpu);
-                    physical_device->graphics_family_index = j;
-                    memcpy(
-                        &physical_device->graphics_family_properties,
-                        &queue_family_properties[property_counts[i] + j],
-                        sizeof *queue_family_properties
-                    );
-                    goto break_physical_device_found;
-                }
-            }
+
+    char const *override = getenv("HB_DEVICE");
+    uint64_t best_score = 0;
+    uint32_t best_index = UINT32_MAX;
+    char const *best_reason = 0;
+    for (uint32_t i = 0; i < physical_device_count; i++) {
+        VkPhysicalDeviceIDProperties id_properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+        };
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &id_properties,
+        };
+        vkGetPhysicalDeviceProperties2(physical_devices[i], &properties);
+        char uuid[2 * VK_UUID_SIZE + 1];
+        format_device_uuid(id_properties.deviceUUID, uuid);
+
+        struct GfxPhysicalDevice candidate;
+        char const *reason;
+        uint64_t score = 0;
+        if (find_queue_families(physical_devices[i], &candidate)) {
+            score = score_physical_device(physical_devices[i], &reason);
+        } else {
+            reason = "no graphics queue presenting to the surface";
+        }
+        if (!score) {
+            printf("device %u: %s, %s, skipped: %s\n", i, properties.properties.deviceName, uuid, reason);
+            continue;
+        }
+        printf("device %u: %s, %s, score %llu\n", i, properties.properties.deviceName, uuid, (unsigned long long)score);
+
+        if (override && is_device_override(override, i, uuid)) {
+            score = UINT64_MAX;
+            reason = "HB_DEVICE";
+        }
+        if (score > best_score) {
+            best_score = score;
+            best_index = i;
+            best_reason = reason;
+            *physical_device = candidate;
         }
     }
-  break_physical_device_found:
-    // how to check if physical device was found
+    assert(best_index != UINT32_MAX);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device->gpu, &properties);
+    if (override && strcmp(best_reason, "HB_DEVICE") != 0) {
+        printf("HB_DEVICE=%s matches no usable device\n", override);
+    }
+    printf("using device %u: %s (%s)\n", best_index, properties.deviceName, best_reason);
 
-    free(queue_family_properties);
-  fail_queue_family_properties_alloc:
-    free(property_counts);
-  fail_property_counts_alloc:
     free(physical_devices);
-  fail_physical_devices_alloc:
-    ;
 }
 
 static void
@@ -333,6 +774,7 @@ init_surface(
 static void
 init_device(
     struct GfxPhysicalDevice const *physical_device,
+    struct Capabilities *capabilities,
     VkDevice *device)
 {
     float *queue_priorities = calloc(physical_device->graphics_family_properties.queueCount, sizeof *queue_priorities);
@@ -340,7 +782,7 @@ init_device(
         // TODO: malloc fails
     }
 
-    VkDeviceQueueCreateInfo queue_create_info[] = {
+    VkDeviceQueueCreateInfo queue_create_info[3] = {
         {
             .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
             .queueFamilyIndex = physical_device->graphics_family_index,
@@ -348,17 +790,69 @@ init_device(
             .pQueuePriorities = queue_priorities,
         }
     };
+    uint32_t queue_family_count = 1;
 
-    char const *extensions[] = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
+    // one queue of each dedicated family
+    uint32_t const dedicated_families[] = {
+        physical_device->transfer_family_index,
+        physical_device->compute_family_index,
     };
+    for (size_t i = 0; i < sizeof dedicated_families / sizeof *dedicated_families; i++) {
+        if (dedicated_families[i] != physical_device->graphics_family_index) {
+            queue_create_info[queue_family_count++] = (VkDeviceQueueCreateInfo) {
+                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = dedicated_families[i],
+                .queueCount = 1,
+                .pQueuePriorities = queue_priorities,
+            };
+        }
+    }
+
+    // frames and uploads are tracked with timeline semaphores, device
+    // selection skips devices without them
+    capabilities_query(capabilities, VK_API_VERSION_1_1, physical_device->gpu);
+
+    // the mesh shader path is opt in with HB_MESH_SHADER=1
+    char const *mesh_shader_mode = getenv("HB_MESH_SHADER");
+    if (!mesh_shader_mode || strcmp(mesh_shader_mode, "1") != 0) {
+        capabilities->is_mesh_shading = VK_FALSE;
+    } else if (!capabilities->is_mesh_shading) {
+        printf("mesh shaders are not supported, falling back to the vertex pipeline\n");
+    }
+
+    // dynamic rendering replaces render passes and framebuffers where the
+    // device has it, HB_DYNAMIC_RENDERING=0 keeps the render passes
+    char const *dynamic_rendering_mode = getenv("HB_DYNAMIC_RENDERING");
+    if (dynamic_rendering_mode && strcmp(dynamic_rendering_mode, "0") == 0) {
+        capabilities->is_dynamic_rendering = VK_FALSE;
+    } else if (!capabilities->is_dynamic_rendering) {
+        printf("dynamic rendering is not supported, falling back to render passes\n");
+    }
+
+    // bindless descriptors replace binding the vertex buffer where the
+    // device indexes descriptors, HB_BINDLESS=0 keeps the bound buffers. The
+    // draws pass the object as their first instance.
+    char const *bindless_mode = getenv("HB_BINDLESS");
+    if (bindless_mode && strcmp(bindless_mode, "0") == 0) {
+        capabilities->is_descriptor_indexing = VK_FALSE;
+    } else if (!capabilities->is_descriptor_indexing || !capabilities->features.drawIndirectFirstInstance) {
+        capabilities->is_descriptor_indexing = VK_FALSE;
+        printf("descriptor indexing is not supported, falling back to bound vertex buffers\n");
+    }
+
+    // the rest is enabled where supported and the renderer falls back where
+    // not, indirect draws to one call per object without multiDrawIndirect
+    capabilities_enable(capabilities);
+    capabilities_log(capabilities);
 
     VkDeviceCreateInfo device_create_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = sizeof queue_create_info / sizeof *queue_create_info,
+        .pNext = capabilities->next,
+        .queueCreateInfoCount = queue_family_count,
         .pQueueCreateInfos = queue_create_info,
-        .enabledExtensionCount = sizeof extensions / sizeof *extensions,
-        .ppEnabledExtensionNames = extensions,
+        .enabledExtensionCount = capabilities->extension_count,
+        .ppEnabledExtensionNames = capabilities->extensions,
+        .pEnabledFeatures = &capabilities->features,
     };
 
     result = vkCreateDevice(physical_device->gpu, &device_create_info, 0, device);
@@ -558,165 +1052,71 @@ init_swapchain_image_views(
   fail_image_views_alloc: ;
 }
 
-static void
-init_descriptor_pool(
-    VkDevice const device,
-    uint32_t const swapchain_length,
-    VkDescriptorPool *descriptor_pool)
-{
-    VkDescriptorPoolSize descriptor_pool_sizes[] = {
-        {
-            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = swapchain_length,
-        }
-    };
-
-    VkDescriptorPoolCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = swapchain_length,
-        .poolSizeCount = sizeof descriptor_pool_sizes / sizeof descriptor_pool_sizes[0],
-        .pPoolSizes = &descriptor_pool_sizes[0],
-    };
-
-    result = vkCreateDescriptorPool(device, &create_info, 0, descriptor_pool);
-    assert(result == VK_SUCCESS);
-}
-
+// The light binning pass shares the sets of the vertex pipeline, it writes
+// the clusters its fragment shader reads
 static void
 init_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout)
 {
-    VkDescriptorSetLayoutBinding ubo_layout_binding = {
-        .binding = 0,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = 1,
-        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    VkDescriptorSetLayoutBinding bindings[] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        },
     };
 
     VkDescriptorSetLayoutCreateInfo create_info = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = 1,
-        .pBindings = &ubo_layout_binding,
+        .bindingCount = sizeof bindings / sizeof *bindings,
+        .pBindings = bindings,
     };
     result = vkCreateDescriptorSetLayout(device, &create_info, 0, descriptor_layout);
     assert(result == VK_SUCCESS);
 }
 
+// Bindless pipelines take the bindless set after the frame set and the
+// indices of the frame buffers as push constants
 static void
 init_pipeline_layout(
     VkDevice const device,
     VkDescriptorSetLayout const descriptor_layout,
+    struct Bindless const *bindless,
     VkPipelineLayout *pipeline_layout)
 {
+    VkDescriptorSetLayout const set_layouts[] = {
+        descriptor_layout,
+        bindless ? bindless->layout : VK_NULL_HANDLE,
+    };
+    VkPushConstantRange push_constant_range = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset = 0,
+        .size = sizeof(struct BindlessConstants),
+    };
     VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 1,
-        .pSetLayouts = &descriptor_layout,
-        .pushConstantRangeCount = 0,
+        .setLayoutCount = bindless ? 2 : 1,
+        .pSetLayouts = set_layouts,
+        .pushConstantRangeCount = bindless ? 1 : 0,
+        .pPushConstantRanges = &push_constant_range,
     };
 
     result = vkCreatePipelineLayout(device, &pipeline_layout_create_info, 0, pipeline_layout);
     assert(result == VK_SUCCESS);
 }
 
-static void
-init_render_pass(
-    VkPhysicalDevice const physical_device,
-    VkDevice const device,
-    VkFormat const format,
-    VkRenderPass *render_pass)
-{
-    VkFormat depth_formats[3] = {VK_FORMAT_D16_UNORM};
-    VkFormat depth_format = VK_FORMAT_UNDEFINED;
-    for (size_t i = 0; i < 3; i++) {
-        VkFormatProperties props;
-        vkGetPhysicalDeviceFormatProperties(physical_device, depth_formats[i], &props);
-
-        if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-            depth_format = depth_formats[i];
-            break;
-        }
-    }
-    assert(depth_format != VK_FORMAT_UNDEFINED);
-
-    VkAttachmentDescription attachment_descriptions[] = {
-        {
-            .format = format,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        },
-        {
-            .format = depth_format,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-        }
-    };
-
-    VkAttachmentReference color_attachment_refs[] = {
-        {
-            .attachment = 0,
-            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        }
-    };
-
-    VkAttachmentReference depth_attachment_ref = {
-        .attachment = 1,
-        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-    };
-
-    VkSubpassDescription subpasses[] = {
-         {
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-            .colorAttachmentCount = sizeof color_attachment_refs / sizeof color_attachment_refs[0],
-            .pColorAttachments = color_attachment_refs,
-            .pDepthStencilAttachment = &depth_attachment_ref
-        },
-    };
-
-    VkSubpassDependency dependencies[] = {
-        {
-            .srcSubpass = VK_SUBPASS_EXTERNAL,
-            .dstSubpass = 0,
-            .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-            .dependencyFlags = 0,
-        },
-        {
-            .srcSubpass = VK_SUBPASS_EXTERNAL,
-            .dstSubpass = 0,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            .dependencyFlags = 0,
-        },
-    };
-
-    VkRenderPassCreateInfo create_info =  {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = sizeof attachment_descriptions / sizeof attachment_descriptions[0],
-        .pAttachments = attachment_descriptions,
-        .subpassCount = sizeof subpasses / sizeof *subpasses,
-        .pSubpasses = subpasses,
-        .dependencyCount = sizeof dependencies / sizeof *dependencies,
-        .pDependencies = dependencies,
-    };
-
-    result = vkCreateRenderPass(device, &create_info, 0, render_pass);
-    assert(result == VK_SUCCESS);
-}
-
 static uint32_t
 get_memory_type(
     VkPhysicalDevice const physical_device,
@@ -740,331 +1140,605 @@ get_memory_type(
 }
 
 static void
-init_uniform_resources(
+init_buffer(
     VkDevice const device,
     VkPhysicalDevice const physical_device,
     VkDeviceSize const size,
-    uint32_t const length,
-    struct GfxResource resources[static const length])
+    VkBufferUsageFlags const usage,
+    VkMemoryPropertyFlags const flags,
+    struct GfxResource *resource)
 {
-    for (size_t i = 0; i < length; i++) {
-        VkBufferCreateInfo create_info = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .size = size,
-            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        };
-
-        result = vkCreateBuffer(device, &create_info, 0, &resources[i].buffer);
-        assert(result == VK_SUCCESS);
-
-        VkMemoryRequirements memory_requirements;
-        vkGetBufferMemoryRequirements(device, resources[i].buffer, &memory_requirements);
-        VkMemoryAllocateInfo buffer_alloc_info = {
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = memory_requirements.size,
-            .memoryTypeIndex = get_memory_type(
-                physical_device,
-                memory_requirements.memoryTypeBits,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-            ),
-        };
-
-        result = vkAllocateMemory(device, &buffer_alloc_info, 0, &resources[i].memory);
-        assert(result == VK_SUCCESS);
-
-        vkBindBufferMemory(device, resources[i].buffer, resources[i].memory, 0);
-    }
+    init_shared_buffer(device, physical_device, size, usage, flags, 1, 0, resource);
 }
 
+// Buffers the host writes and more than one queue family reads are shared by
+// the families instead of changing owner every frame
 static void
-init_descriptor_sets(
+init_shared_buffer(
     VkDevice const device,
-    VkDescriptorSetLayout descriptor_layout,
-    VkDescriptorPool descriptor_pool,
-    uint32_t const length,
-    struct GfxResource const uniform_resources[static const length],
-    VkDescriptorSet descriptor_sets[static const length])
-{
-    VkDescriptorSetLayout *layouts = malloc(length * sizeof *layouts);
-    if (!layouts) {
-        goto fail_layouts_alloc;
-    }
-    for (size_t i = 0; i < length; i++) {
-        layouts[i] = descriptor_layout;
-    }
-
-    VkDescriptorSetAllocateInfo descriptor_alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pool,
-        .descriptorSetCount = length,
-        .pSetLayouts = layouts,
+    VkPhysicalDevice const physical_device,
+    VkDeviceSize const size,
+    VkBufferUsageFlags const usage,
+    VkMemoryPropertyFlags const flags,
+    uint32_t const family_count,
+    uint32_t const *families,
+    struct GfxResource *resource)
+{
+    VkBufferCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = family_count > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = family_count > 1 ? family_count : 0,
+        .pQueueFamilyIndices = family_count > 1 ? families : 0,
     };
 
-    result = vkAllocateDescriptorSets(device, &descriptor_alloc_info, descriptor_sets);
+    result = vkCreateBuffer(device, &create_info, 0, &resource->buffer);
     assert(result == VK_SUCCESS);
 
-    for (size_t i = 0; i < length; i++) {
-        VkDescriptorBufferInfo buffer_info = {
-            .buffer = uniform_resources[i].buffer,
-            .offset = 0,
-            .range = VK_WHOLE_SIZE,
-        };
-
-        VkWriteDescriptorSet descriptor_write = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptor_sets[i],
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .pBufferInfo = &buffer_info,
-        };
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, resource->buffer, &memory_requirements);
+    VkMemoryAllocateInfo buffer_alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memory_requirements.size,
+        .memoryTypeIndex = get_memory_type(
+            physical_device,
+            memory_requirements.memoryTypeBits,
+            flags
+        ),
+    };
 
-        vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, 0);
-    }
+    result = vkAllocateMemory(device, &buffer_alloc_info, 0, &resource->memory);
+    assert(result == VK_SUCCESS);
 
-    free(layouts);
-  fail_layouts_alloc:;
+    vkBindBufferMemory(device, resource->buffer, resource->memory, 0);
 }
 
 static void
-init_pipeline(
+init_uniform_resources(
     VkDevice const device,
-    struct VkExtent2D extent,
+    VkPhysicalDevice const physical_device,
+    VkDeviceSize const size,
+    uint32_t const family_count,
+    uint32_t const *families,
+    uint32_t const length,
+    struct GfxResource resources[static const length])
+{
+    for (size_t i = 0; i < length; i++) {
+        init_shared_buffer(
+            device,
+            physical_device,
+            size,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            family_count,
+            families,
+            &resources[i]
+        );
+    }
+}
+
+// Depth only pipelines draw positions without a fragment shader for the
+// depth prepass, with a prepass the other pipelines only shade the fragments
+// whose depth it kept
+static void
+init_pipeline_state(
     VkPipelineLayout const pipeline_layout,
-    VkRenderPass const render_pass,
-    VkPipeline *pipeline)
+    struct RenderGraphTarget const *target,
+    VkBool32 const is_mesh_shading,
+    VkBool32 const is_depth_only,
+    VkBool32 const is_double_sided,
+    struct PipelineState *state)
 {
     // TODO change cwd() to install path
-    uint32_t vert_shader_code_size = 0;
-    uint32_t *vert_shader_code = 0;
-    io_read_spirv("./build/vert.spv", &vert_shader_code_size, &vert_shader_code);
-    uint32_t frag_shader_code_size = 0;
-    uint32_t *frag_shader_code = 0;
-    io_read_spirv("./build/frag.spv", &frag_shader_code_size, &frag_shader_code);
-    VkShaderModule vert_shader_module;
-    init_shader_module(device, vert_shader_code_size, vert_shader_code, &vert_shader_module);
-    VkShaderModule frag_shader_module;
-    init_shader_module(device, frag_shader_code_size, frag_shader_code, &frag_shader_module);
-
-    VkPipelineShaderStageCreateInfo vert_shader_stage_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_VERTEX_BIT,
-        .module = vert_shader_module,
-        .pName = "main",
-    };
-
-    VkPipelineShaderStageCreateInfo frag_shader_stage_info = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-        .module = frag_shader_module,
-        .pName = "main",
-    };
-
-    VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_stage_info, frag_shader_stage_info };
-
-    VkVertexInputBindingDescription binding_description = {
-        .binding = 0,
-        .stride = sizeof(struct Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+    static char const *vertex_shader_paths[] = {"./build/vert.spv", "./build/frag.spv"};
+    static VkShaderStageFlagBits const vertex_shader_stages[] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+    static char const *depth_shader_paths[] = {"./build/depth_vert.spv"};
+    static char const *bindless_shader_paths[] = {"./build/bindless_vert.spv", "./build/bindless_frag.spv"};
+    static char const *bindless_depth_shader_paths[] = {"./build/bindless_depth_vert.spv"};
+    static char const *mesh_shader_paths[] = {"./build/task.spv", "./build/mesh.spv", "./build/mesh_frag.spv"};
+    static VkShaderStageFlagBits const mesh_shader_stages[] = {VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT};
+    VkBool32 const is_bindless = capabilities.is_descriptor_indexing;
+
+    char const **shader_paths = is_mesh_shading ? mesh_shader_paths :
+        is_bindless ? (is_depth_only ? bindless_depth_shader_paths : bindless_shader_paths) :
+        is_depth_only ? depth_shader_paths : vertex_shader_paths;
+    VkShaderStageFlagBits const *stages = is_mesh_shading ? mesh_shader_stages : vertex_shader_stages;
+
+    *state = (struct PipelineState) {
+        .layout = pipeline_layout,
+        .stage_count = is_mesh_shading ? 3 : is_depth_only ? 1 : 2,
+        .polygon_mode = VK_POLYGON_MODE_FILL,
+        .cull_mode = is_double_sided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT,
+        .is_depth_write = is_depth_only || !is_depth_prepass ? VK_TRUE : VK_FALSE,
+        .depth_compare = is_depth_only || !is_depth_prepass ? VK_COMPARE_OP_LESS : VK_COMPARE_OP_EQUAL,
+        .render_pass = target->render_pass,
+        .pass_layout = target->pass_layout,
+        .subpass = target->subpass,
+        .color_format_count = is_depth_only ? 0 : target->rendering.colorAttachmentCount,
+        .depth_format = target->rendering.depthAttachmentFormat,
     };
+    for (uint32_t i = 0; i < state->stage_count; i++) {
+        state->stages[i] = stages[i];
+        state->shader_paths[i] = shader_paths[i];
+    }
+    for (uint32_t i = 0; i < state->color_format_count; i++) {
+        state->color_formats[i] = target->color_formats[i];
+    }
+    if (!is_depth_only) {
+        VkBool32 const is_dynamic_lighting = shading.is_dynamic_lighting ? VK_TRUE : VK_FALSE;
+        pipeline_state_add_constant(state, SHADING_CONSTANT_DYNAMIC_LIGHTING, &is_dynamic_lighting);
+        pipeline_state_add_constant(state, SHADING_CONSTANT_BAKED_LIGHT_SCALE, &shading.baked_light_scale);
+        pipeline_state_add_constant(state, SHADING_CONSTANT_DYNAMIC_LIGHT_SCALE, &shading.dynamic_light_scale);
+    }
 
-    VkVertexInputAttributeDescription attribute_descriptions[] = {
-         {
+    // bindless shaders pull their vertices from storage buffers
+    if (!is_mesh_shading && !is_bindless) {
+        state->vertex_stride = sizeof(struct Vertex);
+        state->attribute_count = is_depth_only ? 1 : 2;
+        state->attributes[0] = (VkVertexInputAttributeDescription) {
             .binding = 0,
             .location = 0,
             .format = VK_FORMAT_R32G32B32_SFLOAT,
             .offset = offsetof(struct Vertex, pos),
-         },
-         {
-             .binding = 0,
-             .location = 1,
-             .format = VK_FORMAT_R32G32B32_SFLOAT,
-             .offset = offsetof(struct Vertex, centroid),
-         },
-    };
+        };
+        state->attributes[1] = (VkVertexInputAttributeDescription) {
+            .binding = 0,
+            .location = 1,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
+            .offset = offsetof(struct Vertex, color),
+        };
+    }
+}
 
-    VkPipelineVertexInputStateCreateInfo vertex_input = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &binding_description,
-        .vertexAttributeDescriptionCount = sizeof attribute_descriptions / sizeof attribute_descriptions[0],
-        .pVertexAttributeDescriptions = attribute_descriptions,
-    };
+// Waits for the single sided pipelines and picks up the double sided ones
+// that became ready since the last call
+static void
+request_pipelines(void)
+{
+    pipeline = pipeline_cache_wait(&pipeline_cache, &shading_future);
+    if (is_depth_prepass) {
+        depth_pipeline = pipeline_cache_wait(&pipeline_cache, &depth_future);
+    }
+    if (capabilities.is_mesh_shading) {
+        mesh_pipeline = pipeline_cache_wait(&pipeline_cache, &mesh_future);
+    }
+
+    double_sided_pipeline = pipeline_cache_request(&pipeline_cache, &double_sided_state, pipeline);
+    if (is_depth_prepass) {
+        double_sided_depth_pipeline = pipeline_cache_request(&pipeline_cache, &double_sided_depth_state, depth_pipeline);
+    }
+    if (capabilities.is_mesh_shading) {
+        double_sided_mesh_pipeline = pipeline_cache_request(&pipeline_cache, &double_sided_mesh_state, mesh_pipeline);
+    }
+}
 
-    VkPipelineInputAssemblyStateCreateInfo input_assembly = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        .primitiveRestartEnable = VK_FALSE,
+static void
+init_shader_module(
+    VkDevice const device,
+    uint32_t const size,
+    uint32_t const *code,
+    VkShaderModule *shader_module)
+{
+    VkShaderModuleCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = size,
+        .pCode = code,
     };
 
-    VkViewport viewports[] = {
-        {
-            .x = 0.0,
-            .y = 0.0,
-            .width = extent.width,
-            .height = extent.height,
-            .minDepth = 0.0,
-            .maxDepth = 1.0,
+    result = vkCreateShaderModule(device, &create_info, 0, shader_module);
+    assert(result == VK_SUCCESS);
+}
+
+static void
+init_compute_pipeline(
+    VkDevice const device,
+    char const *relative_path,
+    VkPipelineLayout const pipeline_layout,
+    VkPipeline *pipeline)
+{
+    uint32_t shader_code_size = 0;
+    uint32_t *shader_code = 0;
+    io_read_spirv(relative_path, &shader_code_size, &shader_code);
+    VkShaderModule shader_module;
+    init_shader_module(device, shader_code_size, shader_code, &shader_module);
+
+    VkComputePipelineCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module,
+            .pName = "main",
         },
+        .layout = pipeline_layout,
+        .basePipelineHandle = 0,
+        .basePipelineIndex = -1,
     };
 
-    VkRect2D scissors[] = {
+    result = vkCreateComputePipelines(device, 0, 1, &create_info, 0, pipeline);
+    assert(result == VK_SUCCESS);
+
+#ifdef _WIN32
+    _aligned_free(shader_code);
+#else
+    free(shader_code);
+#endif
+    vkDestroyShaderModule(device, shader_module, 0);
+}
+
+static void
+init_cull_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout)
+{
+    VkDescriptorSetLayoutBinding bindings[] = {
         {
-            .offset.x = 0.0,
-            .offset.y = 0.0,
-            .extent = extent,
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 4,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 5,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 6,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 7,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
         },
     };
 
-    VkPipelineViewportStateCreateInfo viewport = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = sizeof viewports / sizeof viewports[0],
-        .pViewports = &viewports[0],
-        .scissorCount = sizeof scissors / sizeof scissors[0],
-        .pScissors = &scissors[0],
+    VkDescriptorSetLayoutCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = sizeof bindings / sizeof *bindings,
+        .pBindings = bindings,
     };
+    result = vkCreateDescriptorSetLayout(device, &create_info, 0, descriptor_layout);
+    assert(result == VK_SUCCESS);
+}
 
-    VkPipelineRasterizationStateCreateInfo rasterization = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = VK_FALSE,
-        .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_NONE,
-        .frontFace = VK_FRONT_FACE_CLOCKWISE,
-        .depthBiasEnable = VK_FALSE,
-        .depthBiasConstantFactor = 0.0,
-        .depthBiasClamp = 0.0,
-        .depthBiasSlopeFactor = 0.0,
-        .lineWidth = 1.0,
+static void
+init_depth_reduce_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout)
+{
+    VkDescriptorSetLayoutBinding bindings[] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        },
     };
 
-    VkPipelineMultisampleStateCreateInfo multisample = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        .sampleShadingEnable = VK_FALSE,
-        .minSampleShading = 0.0,
-        .pSampleMask = 0,
-        .alphaToCoverageEnable = VK_FALSE,
-        .alphaToOneEnable = VK_FALSE,
+    VkDescriptorSetLayoutCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = sizeof bindings / sizeof *bindings,
+        .pBindings = bindings,
     };
+    result = vkCreateDescriptorSetLayout(device, &create_info, 0, descriptor_layout);
+    assert(result == VK_SUCCESS);
+}
 
-    VkPipelineDepthStencilStateCreateInfo depth_stencil = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
-        .depthCompareOp = VK_COMPARE_OP_LESS,
-        .depthBoundsTestEnable = VK_FALSE,
-        .stencilTestEnable = VK_FALSE,
+// Bindings of asset/shader/mesh/meshlet.glsl and the task and mesh shaders
+static void
+init_mesh_descriptor_layout(VkDevice const device, VkDescriptorSetLayout *descriptor_layout)
+{
+    VkShaderStageFlags const task_mesh_stages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    VkDescriptorSetLayoutBinding bindings[] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = task_mesh_stages | VK_SHADER_STAGE_FRAGMENT_BIT,
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = task_mesh_stages,
+        },
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT,
+        },
+        {
+            .binding = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT,
+        },
+        {
+            .binding = 4,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT,
+        },
+        {
+            .binding = 5,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT,
+        },
+        {
+            .binding = 6,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT,
+        },
+        {
+            .binding = 7,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT,
+        },
+        {
+            .binding = 8,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+        },
+        {
+            .binding = 9,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+        },
+        {
+            .binding = 10,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT,
+        },
     };
 
-    VkPipelineColorBlendAttachmentState color_blend_attachments[] = {
-         {
-            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-            .blendEnable = VK_FALSE,
-            .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-            .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-            .colorBlendOp = VK_BLEND_OP_ADD,
-            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-            .alphaBlendOp = VK_BLEND_OP_ADD,
-        },
+    VkDescriptorSetLayoutCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = sizeof bindings / sizeof *bindings,
+        .pBindings = bindings,
     };
+    result = vkCreateDescriptorSetLayout(device, &create_info, 0, descriptor_layout);
+    assert(result == VK_SUCCESS);
+}
 
-    VkPipelineColorBlendStateCreateInfo color_blend = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = VK_FALSE,
-        .logicOp = VK_LOGIC_OP_COPY,
-        .attachmentCount = sizeof color_blend_attachments / sizeof color_blend_attachments[0],
-        .pAttachments = &color_blend_attachments[0],
-        .blendConstants = { 0.0, 0.0, 0.0, 0.0 },
+static void
+init_compute_pipeline_layout(
+    VkDevice const device,
+    VkDescriptorSetLayout const descriptor_layout,
+    uint32_t const push_constant_size,
+    VkPipelineLayout *pipeline_layout)
+{
+    VkPushConstantRange push_constant_range = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = push_constant_size,
     };
 
-    // TODO: dynamic state
-
-    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = sizeof shader_stages / sizeof shader_stages[0],
-        .pStages = &shader_stages[0],
-        .pVertexInputState = &vertex_input,
-        .pInputAssemblyState = &input_assembly,
-        .pTessellationState = 0,
-        .pViewportState = &viewport,
-        .pRasterizationState = &rasterization,
-        .pMultisampleState = &multisample,
-        .pDepthStencilState = &depth_stencil,
-        .pColorBlendState = &color_blend,
-        .pDynamicState = 0,
-        .layout = pipeline_layout,
-        .renderPass = render_pass,
-        .subpass = 0,
-        .basePipelineHandle = 0,
-        .basePipelineIndex = -1,
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_layout,
+        .pushConstantRangeCount = push_constant_size ? 1 : 0,
+        .pPushConstantRanges = &push_constant_range,
     };
 
-    result = vkCreateGraphicsPipelines(device, 0, 1, &graphics_pipeline_create_info, 0, pipeline);
+    result = vkCreatePipelineLayout(device, &pipeline_layout_create_info, 0, pipeline_layout);
     assert(result == VK_SUCCESS);
+}
 
-#ifdef _WIN32
-    _aligned_free(vert_shader_code);
-    _aligned_free(frag_shader_code);
-#else
-    free(vert_shader_code);
-    free(frag_shader_code);
-#endif
-    vkDestroyShaderModule(device, vert_shader_module, 0);
-    vkDestroyShaderModule(device, frag_shader_module, 0);
+static uint32_t
+previous_power_of_two(uint32_t const value)
+{
+    uint32_t power = 1;
+    while (power * 2 <= value) {
+        power *= 2;
+    }
+
+    return power;
 }
 
+// The depth pyramid is a max reduction of the depth attachment rounded down
+// to a power of two, each reduction pass writes one level through its view
 static void
-init_shader_module(
-    VkDevice const device,
-    uint32_t const size,
-    uint32_t const *code,
-    VkShaderModule *shader_module)
+init_depth_pyramid_views(VkDevice const device, VkImage const depth_pyramid)
 {
-    VkShaderModuleCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = size,
-        .pCode = code,
+    VkImageViewCreateInfo view_create_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = depth_pyramid,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = VK_FORMAT_R32_SFLOAT,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
     };
 
-    result = vkCreateShaderModule(device, &create_info, 0, shader_module);
-    assert(result == VK_SUCCESS);
+    depth_pyramid_level_views = malloc(depth_pyramid_levels * sizeof *depth_pyramid_level_views);
+    for (uint32_t i = 0; i < depth_pyramid_levels; i++) {
+        view_create_info.subresourceRange.baseMipLevel = i;
+
+        result = vkCreateImageView(device, &view_create_info, 0, &depth_pyramid_level_views[i]);
+        assert(result == VK_SUCCESS);
+    }
 }
 
+// Binds the buffers in order, the first one as the uniform buffer
 static void
-init_framebuffers(
-    VkDevice const device,
-    VkExtent2D const extent,
-    VkImageView const depth_image_view,
-    VkRenderPass const render_pass,
-    uint32_t const image_view_length,
-    VkImageView const image_views[static const image_view_length],
-    VkFramebuffer framebuffers[static const image_view_length])
-{
-    VkFramebufferCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .renderPass = render_pass,
-        .width = extent.width,
-        .height = extent.height,
-        .layers = 1,
-    };
+fill_buffer_writes(uint32_t const count, VkBuffer const buffers[static const count], struct DescriptorWrite writes[static const count])
+{
+    for (uint32_t i = 0; i < count; i++) {
+        writes[i] = (struct DescriptorWrite) {
+            .binding = i,
+            .type = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .buffer = {
+                .buffer = buffers[i],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE,
+            },
+        };
+    }
+}
+
+// The depth reduce sets refer to nothing but the images of the extent, so
+// they are cached until the extent is recreated
+static void
+write_descriptor_sets(void)
+{
+    // mesh shading builds no pyramid and keeps its depth in the render pass
+    uint32_t const reduce_level_count = capabilities.is_mesh_shading ? 0 : depth_pyramid_levels;
+    for (uint32_t i = 0; i < reduce_level_count; i++) {
+        struct DescriptorWrite writes[] = {
+            {
+                .binding = 0,
+                .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .image = {
+                    .sampler = depth_sampler,
+                    .imageView = i == 0 ? render_graph.resources[depth_resource].view : depth_pyramid_level_views[i - 1],
+                    .imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
+                },
+            },
+            {
+                .binding = 1,
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .image = {
+                    .imageView = depth_pyramid_level_views[i],
+                    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+                },
+            },
+        };
+        depth_reduce_descriptor_sets[i] = descriptor_allocator_get_set(
+            &descriptor_allocator,
+            device,
+            depth_reduce_descriptor_layout,
+            sizeof writes / sizeof *writes,
+            writes
+        );
+    }
+}
 
-    for (size_t i = 0; i < image_view_length; i++)
+// The sets the commands of an image bind are allocated from the pools of
+// the frame it is drawn in, so they are written every frame and recorded
+// with the commands right after
+static void
+write_frame_descriptor_sets(uint32_t const frame, uint32_t const image_index)
+{
+    uint32_t const i = image_index;
     {
-        VkImageView attachments[2] = {
-            image_views[i],
-            depth_image_view
+        VkBuffer const buffers[] = {
+            uniform_resources[i].buffer,
+            light_resources[i].buffer,
+            cluster_resources[i].buffer,
         };
+        struct DescriptorWrite writes[sizeof buffers / sizeof *buffers];
+        fill_buffer_writes(sizeof buffers / sizeof *buffers, buffers, writes);
+        descriptor_sets[i] = descriptor_allocator_allocate(
+            &descriptor_allocator,
+            device,
+            frame,
+            descriptor_layout,
+            sizeof writes / sizeof *writes,
+            writes
+        );
+    }
 
-        create_info.attachmentCount = sizeof attachments / sizeof attachments[0];
-        create_info.pAttachments = attachments;
+    {
+        VkBuffer const buffers[] = {
+            uniform_resources[i].buffer,
+            object_resource.buffer,
+            draw_command_resources[i].buffer,
+            visibility_resource.buffer,
+            stats_resources[i].buffer,
+            object_mask_resources[i].buffer,
+            draw_order_resources[i].buffer,
+        };
+        uint32_t const buffer_count = sizeof buffers / sizeof *buffers;
+        struct DescriptorWrite writes[sizeof buffers / sizeof *buffers + 1];
+        fill_buffer_writes(buffer_count, buffers, writes);
+        writes[buffer_count] = (struct DescriptorWrite) {
+            .binding = buffer_count,
+            .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .image = {
+                .sampler = depth_sampler,
+                .imageView = render_graph.resources[depth_pyramid_resource].view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+            },
+        };
+        cull_descriptor_sets[i] = descriptor_allocator_allocate(
+            &descriptor_allocator,
+            device,
+            frame,
+            cull_descriptor_layout,
+            sizeof writes / sizeof *writes,
+            writes
+        );
+    }
 
-        result = vkCreateFramebuffer(device, &create_info, 0, &framebuffers[i]);
-        assert(result == VK_SUCCESS);
+    if (capabilities.is_mesh_shading) {
+        VkBuffer const buffers[] = {
+            uniform_resources[i].buffer,
+            object_resource.buffer,
+            position_resource.buffer,
+            meshlet_vertex_resource.buffer,
+            meshlet_triangle_resource.buffer,
+            object_mask_resources[i].buffer,
+            stats_resources[i].buffer,
+            triangle_color_resource.buffer,
+            light_resources[i].buffer,
+            cluster_resources[i].buffer,
+            draw_order_resources[i].buffer,
+        };
+        struct DescriptorWrite writes[sizeof buffers / sizeof *buffers];
+        fill_buffer_writes(sizeof buffers / sizeof *buffers, buffers, writes);
+        mesh_descriptor_sets[i] = descriptor_allocator_allocate(
+            &descriptor_allocator,
+            device,
+            frame,
+            mesh_descriptor_layout,
+            sizeof writes / sizeof *writes,
+            writes
+        );
     }
 }
 
@@ -1086,61 +1760,526 @@ init_command_buffers(
 }
 
 static void
-record_command_buffers(
-    uint32_t const length,
-    VkCommandBuffer const command_buffers[static const length],
-    VkFramebuffer const framebuffers[static const length],
-    VkDescriptorSet const descriptor_sets[static const length],
-    VkRenderPass const render_pass,
-    VkPipeline const pipeline,
-    VkPipelineLayout const pipeline_layout,
-    uint32_t const vertex_count,
-    VkBuffer const vertex_buffer,
-    VkExtent2D const extent)
+record_draw_objects(
+    VkCommandBuffer const command_buffer,
+    VkBuffer const draw_command_buffer,
+    uint32_t const first_object,
+    uint32_t const count)
 {
-    VkCommandBufferBeginInfo begin_info = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    if (capabilities.features.multiDrawIndirect) {
+        vkCmdDrawIndirect(command_buffer, draw_command_buffer, first_object * sizeof(VkDrawIndirectCommand), count, sizeof(VkDrawIndirectCommand));
+        return;
+    }
+
+    for (uint32_t i = first_object; i < first_object + count; i++) {
+        vkCmdDrawIndirect(command_buffer, draw_command_buffer, i * sizeof(VkDrawIndirectCommand), 1, sizeof(VkDrawIndirectCommand));
+    }
+}
+
+static void
+record_stats_clear(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    vkCmdFillBuffer(command_buffer, stats_resources[image_index].buffer, 0, VK_WHOLE_SIZE, 0);
+}
+
+static void
+record_cull(VkCommandBuffer const command_buffer, uint32_t const image_index, uint32_t const is_late)
+{
+    struct CullConstants cull_constants = {
+        .pyramid_width = depth_pyramid_extent.width,
+        .pyramid_height = depth_pyramid_extent.height,
+        .object_count = object_count,
+        .is_late = is_late,
+        .is_occlusion_enabled = is_gpu_occlusion_enabled,
+        .is_object_instance = capabilities.is_descriptor_indexing,
     };
 
-    VkClearValue clear_color[2] = {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout, 0, 1, &cull_descriptor_sets[image_index], 0, 0);
+    vkCmdPushConstants(command_buffer, cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof cull_constants, &cull_constants);
+    vkCmdDispatch(command_buffer, (object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+static void
+record_early_cull(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    record_cull(command_buffer, image_index, 0);
+}
+
+static void
+record_late_cull(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    record_cull(command_buffer, image_index, 1);
+}
+
+// Reduces the early pass depth into every level of the depth pyramid, the
+// render graph moves the whole pyramid in and out of the general layout and
+// each level is made visible to the reduction of the next one here
+static void
+record_depth_pyramid(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    (void)image_index;
+
+    VkImageMemoryBarrier pyramid_barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = render_graph.resources[depth_pyramid_resource].image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_reduce_pipeline);
+    VkExtent2D source_extent = extent;
+    for (uint32_t level = 0; level < depth_pyramid_levels; level++) {
+        struct DepthReduceConstants reduce_constants = {
+            .source_width = source_extent.width,
+            .source_height = source_extent.height,
+            .destination_width = depth_pyramid_extent.width >> level ? depth_pyramid_extent.width >> level : 1,
+            .destination_height = depth_pyramid_extent.height >> level ? depth_pyramid_extent.height >> level : 1,
+        };
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_reduce_pipeline_layout, 0, 1, &depth_reduce_descriptor_sets[level], 0, 0);
+        vkCmdPushConstants(command_buffer, depth_reduce_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof reduce_constants, &reduce_constants);
+        vkCmdDispatch(
+            command_buffer,
+            (reduce_constants.destination_width + DEPTH_REDUCE_GROUP_SIZE - 1) / DEPTH_REDUCE_GROUP_SIZE,
+            (reduce_constants.destination_height + DEPTH_REDUCE_GROUP_SIZE - 1) / DEPTH_REDUCE_GROUP_SIZE,
+            1
+        );
+
+        if (level + 1 < depth_pyramid_levels) {
+            pyramid_barrier.subresourceRange.baseMipLevel = level;
+            vkCmdPipelineBarrier(
+                command_buffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                0, 0,
+                0, 0,
+                1, &pyramid_barrier
+            );
+        }
+
+        source_extent.width = reduce_constants.destination_width;
+        source_extent.height = reduce_constants.destination_height;
+    }
+}
+
+// Bins the lights into the clusters the fragment shaders of the frame read
+static void
+record_light_clusters(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cluster_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cluster_pipeline_layout, 0, 1, &descriptor_sets[image_index], 0, 0);
+    vkCmdDispatch(command_buffer, CLUSTER_COUNT / CLUSTER_GROUP_SIZE, 1, 1);
+}
+
+// The draw order puts the single sided objects first, so that each half is
+// one range of draw commands for its own pipeline
+static void
+record_sided_draws(
+    VkCommandBuffer const command_buffer,
+    uint32_t const image_index,
+    VkPipeline const single_sided_pipeline,
+    VkPipeline const double_sided_pipeline)
+{
+    record_viewport(command_buffer);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets[image_index], 0, 0);
+    if (capabilities.is_descriptor_indexing) {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &bindless.set, 0, 0);
+        vkCmdPushConstants(
+            command_buffer,
+            pipeline_layout,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof *bindless_constants,
+            &bindless_constants[image_index]
+        );
+    } else {
+        VkDeviceSize offsets[1] = {0};
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_resource.buffer, offsets);
+    }
+
+    VkBuffer const draw_command_buffer = draw_command_resources[image_index].buffer;
+    if (single_sided_count) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, single_sided_pipeline);
+        record_draw_objects(command_buffer, draw_command_buffer, 0, single_sided_count);
+    }
+    if (single_sided_count < object_count) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, double_sided_pipeline);
+        record_draw_objects(command_buffer, draw_command_buffer, single_sided_count, object_count - single_sided_count);
+    }
+}
+
+// The graphics pipelines take viewport and scissor as dynamic state, so that
+// they outlive the extent
+static void
+record_viewport(VkCommandBuffer const command_buffer)
+{
+    VkViewport const viewport = {
+        .x = 0.0,
+        .y = 0.0,
+        .width = extent.width,
+        .height = extent.height,
+        .minDepth = 0.0,
+        .maxDepth = 1.0,
+    };
+    VkRect2D const scissor = {
+        .offset.x = 0,
+        .offset.y = 0,
+        .extent = extent,
+    };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+// Lays down the depth of the objects the cull pass left in the draw commands
+// of the image, so that shading runs one fragment per pixel
+static void
+record_depth_prepass(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    record_sided_draws(command_buffer, image_index, depth_pipeline, double_sided_depth_pipeline);
+}
+
+// Draws the objects the cull pass left in the draw commands of the image
+static void
+record_shading(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    record_sided_draws(command_buffer, image_index, pipeline, double_sided_pipeline);
+}
+
+// Meshlets are culled in the task stage of a single pass
+static void
+record_mesh_draws(VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    struct MeshConstants mesh_constants[] = {
         {
-            .color = {
-                .float32 = {0.0f, 0.0f, 0.0f, 1.0f}
-            }
+            .first_object = 0,
+            .object_count = single_sided_count,
         },
         {
-            .depthStencil = {1.0f, 0.0f}
+            .first_object = single_sided_count,
+            .object_count = object_count - single_sided_count,
+        },
+    };
+    VkPipeline const mesh_pipelines[] = {mesh_pipeline, double_sided_mesh_pipeline};
+
+    record_viewport(command_buffer);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline_layout, 0, 1, &mesh_descriptor_sets[image_index], 0, 0);
+    for (size_t j = 0; j < sizeof mesh_constants / sizeof *mesh_constants; j++) {
+        if (!mesh_constants[j].object_count) {
+            continue;
         }
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipelines[j]);
+        vkCmdPushConstants(command_buffer, mesh_pipeline_layout, VK_SHADER_STAGE_TASK_BIT_EXT, 0, sizeof mesh_constants[j], &mesh_constants[j]);
+        cmd_draw_mesh_tasks(command_buffer, (mesh_constants[j].object_count + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE, 1, 1);
+    }
+}
+
+// Records the commands of an image with the pipelines ready by now and the
+// sets of the frame
+static void
+record_command_buffer(uint32_t const image_index)
+{
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
     };
 
-    for (size_t i = 0; i < length; i++)
-    {
-        result = vkBeginCommandBuffer(command_buffers[i], &begin_info);
+    request_pipelines();
+
+    // the clusters of the previous frame are overwritten, so the compute
+    // queue takes them without an acquire
+    if (is_async_compute) {
+        VkCommandBuffer const compute_command_buffer = compute_command_buffers[image_index];
+        result = vkBeginCommandBuffer(compute_command_buffer, &begin_info);
         assert(result == VK_SUCCESS);
 
-        VkRenderPassBeginInfo render_pass_begin_info = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = render_pass,
-            .framebuffer = framebuffers[i],
-            .renderArea = {
-                .offset = { 0.0f, 0.0f },
-                .extent = extent,
-            },
-            .clearValueCount = sizeof clear_color / sizeof clear_color[0],
-            .pClearValues = clear_color,
+        record_light_clusters(compute_command_buffer, image_index);
+        record_queue_transfer(compute_command_buffer, &cluster_transfer, VK_FALSE, 1, &cluster_resources[image_index].buffer);
+
+        result = vkEndCommandBuffer(compute_command_buffer);
+        assert(result == VK_SUCCESS);
+    }
+
+    VkCommandBuffer const command_buffer = command_buffers[image_index];
+    result = vkBeginCommandBuffer(command_buffer, &begin_info);
+    assert(result == VK_SUCCESS);
+
+    if (is_async_compute) {
+        record_queue_transfer(command_buffer, &cluster_transfer, VK_TRUE, 1, &cluster_resources[image_index].buffer);
+    }
+    render_graph_record(&render_graph, command_buffer, image_index);
+
+    result = vkEndCommandBuffer(command_buffer);
+    assert(result == VK_SUCCESS);
+}
+
+// The release and the acquire of a transfer take the same barrier. Within
+// one family the release is a plain barrier and there is nothing to acquire.
+static void
+record_queue_transfer(
+    VkCommandBuffer const command_buffer,
+    struct QueueTransfer const *transfer,
+    VkBool32 const is_acquire,
+    uint32_t const count,
+    VkBuffer const buffers[static const count])
+{
+    VkBool32 const is_same_family = transfer->src_family == transfer->dst_family;
+    if (is_same_family && is_acquire) {
+        return;
+    }
+
+    assert(count <= MAX_QUEUE_TRANSFER_BUFFERS);
+    VkBufferMemoryBarrier barriers[MAX_QUEUE_TRANSFER_BUFFERS];
+    for (uint32_t i = 0; i < count; i++) {
+        barriers[i] = (VkBufferMemoryBarrier) {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = is_acquire ? 0 : transfer->src_access,
+            .dstAccessMask = is_acquire || is_same_family ? transfer->dst_access : 0,
+            .srcQueueFamilyIndex = is_same_family ? VK_QUEUE_FAMILY_IGNORED : transfer->src_family,
+            .dstQueueFamilyIndex = is_same_family ? VK_QUEUE_FAMILY_IGNORED : transfer->dst_family,
+            .buffer = buffers[i],
+            .offset = 0,
+            .size = VK_WHOLE_SIZE,
         };
+    }
 
-        VkDeviceSize offsets[1] = {0};
+    // the acquire starts in the stages the semaphore from the source queue
+    // waits in, the release ends where the source queue can
+    VkPipelineStageFlags const src_stages = is_acquire ? transfer->dst_stages : transfer->src_stages;
+    VkPipelineStageFlags const dst_stages = is_acquire || is_same_family ? transfer->dst_stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, 0, 0, 0, count, barriers, 0, 0);
+}
 
-        vkCmdBeginRenderPass(command_buffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindVertexBuffers(command_buffers[i], 0, 1, &vertex_buffer, offsets);
-        vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets[i], 0, 0);
-        vkCmdDraw(command_buffers[i], vertex_count, 1, 0, 0);
-        vkCmdEndRenderPass(command_buffers[i]);
+// Takes the first queue of the family
+static void
+init_timeline(uint32_t const family_index, struct QueueTimeline *timeline)
+{
+    vkGetDeviceQueue(device, family_index, 0, &timeline->queue);
+
+    VkSemaphoreTypeCreateInfoKHR type_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+        .initialValue = 0,
+    };
+    VkSemaphoreCreateInfo semaphore_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+    };
+    result = vkCreateSemaphore(device, &semaphore_info, 0, &timeline->semaphore);
+    assert(result == VK_SUCCESS);
+    timeline->value = 0;
+    timeline->completed_value = 0;
+}
+
+// Signals the next value of the timeline of the queue, and the binary
+// semaphore if there is one. Returns the value signaled.
+static uint64_t
+submit_command_buffer(
+    struct QueueTimeline *timeline,
+    VkCommandBuffer const command_buffer,
+    uint32_t const wait_count,
+    struct SemaphoreWait const *waits,
+    VkSemaphore const binary_signal)
+{
+    assert(wait_count <= MAX_SUBMIT_WAITS);
+    VkSemaphore wait_semaphores[MAX_SUBMIT_WAITS];
+    uint64_t wait_values[MAX_SUBMIT_WAITS];
+    VkPipelineStageFlags wait_stages[MAX_SUBMIT_WAITS];
+    for (uint32_t i = 0; i < wait_count; i++) {
+        wait_semaphores[i] = waits[i].semaphore;
+        wait_values[i] = waits[i].value;
+        wait_stages[i] = waits[i].stages;
+    }
+
+    timeline->value++;
+    VkSemaphore const signal_semaphores[] = {timeline->semaphore, binary_signal};
+    uint64_t const signal_values[] = {timeline->value, 0};
+
+    VkTimelineSemaphoreSubmitInfoKHR timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+        .waitSemaphoreValueCount = wait_count,
+        .pWaitSemaphoreValues = wait_values,
+        .signalSemaphoreValueCount = binary_signal ? 2 : 1,
+        .pSignalSemaphoreValues = signal_values,
+    };
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = wait_count,
+        .pWaitSemaphores = wait_semaphores,
+        .pWaitDstStageMask = wait_stages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+        .signalSemaphoreCount = binary_signal ? 2 : 1,
+        .pSignalSemaphores = signal_semaphores,
+    };
+
+    result = vkQueueSubmit(timeline->queue, 1, &submit_info, 0);
+    assert(result == VK_SUCCESS);
+
+    return timeline->value;
+}
+
+// Blocks until the submission that signaled the value is done
+static void
+wait_timeline(struct QueueTimeline *timeline, uint64_t const value)
+{
+    if (value <= timeline->completed_value) {
+        return;
+    }
+
+    VkSemaphoreWaitInfoKHR wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline->semaphore,
+        .pValues = &value,
+    };
+    result = vkWaitSemaphoresKHR(device, &wait_info, UINT64_MAX);
+    assert(result == VK_SUCCESS);
+    timeline->completed_value = value;
+}
+
+// Frees the resource once the graphics timeline reaches its value
+static void
+retire_resource(struct RetiredResource const *resource)
+{
+    if (retired_count == retired_capacity) {
+        retired_capacity = retired_capacity ? 2 * retired_capacity : 8;
+        retired_resources = realloc(retired_resources, retired_capacity * sizeof *retired_resources);
+    }
+    retired_resources[retired_count++] = *resource;
+}
+
+// Frees the retired resources the GPU is done with, without waiting
+static void
+reclaim_resources(void)
+{
+    if (!retired_count) {
+        return;
+    }
+
+    uint64_t completed_value;
+    result = vkGetSemaphoreCounterValueKHR(device, graphics_timeline.semaphore, &completed_value);
+    assert(result == VK_SUCCESS);
+    if (completed_value > graphics_timeline.completed_value) {
+        graphics_timeline.completed_value = completed_value;
+    }
+
+    uint32_t kept_count = 0;
+    for (uint32_t i = 0; i < retired_count; i++) {
+        struct RetiredResource const *resource = &retired_resources[i];
+        if (resource->value > graphics_timeline.completed_value) {
+            retired_resources[kept_count++] = *resource;
+            continue;
+        }
+        if (resource->buffer.buffer) {
+            vkFreeMemory(device, resource->buffer.memory, 0);
+            vkDestroyBuffer(device, resource->buffer.buffer, 0);
+        }
+        if (resource->command_buffer) {
+            vkFreeCommandBuffers(device, resource->command_pool, 1, &resource->command_buffer);
+        }
+    }
+    retired_count = kept_count;
+}
+
+// Copies the data into new device local buffers on the transfer queue, the
+// graphics queue acquires them once the copies are done. Later graphics
+// submissions see the buffers, the staging memory is retired with the
+// acquire.
+static void
+upload_buffers(
+    uint32_t const count,
+    struct Upload const uploads[static const count],
+    struct QueueTransfer const *transfer)
+{
+    VkDeviceSize staging_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        staging_size += uploads[i].size;
+    }
+    struct GfxResource staging;
+    init_buffer(
+        device,
+        physical_device.gpu,
+        staging_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &staging
+    );
+    VkCommandBuffer transfer_command_buffer;
+    VkCommandBuffer graphics_command_buffer;
+    init_command_buffers(device, transfer_command_pool, 1, &transfer_command_buffer);
+    init_command_buffers(device, graphics_command_pool, 1, &graphics_command_buffer);
+
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    result = vkBeginCommandBuffer(transfer_command_buffer, &begin_info);
+    assert(result == VK_SUCCESS);
+
+    char *data;
+    vkMapMemory(device, staging.memory, 0, staging_size, 0, (void **)&data);
+    VkDeviceSize offset = 0;
+    VkBuffer buffers[MAX_QUEUE_TRANSFER_BUFFERS];
+    assert(count <= MAX_QUEUE_TRANSFER_BUFFERS);
+    for (uint32_t i = 0; i < count; i++) {
+        init_buffer(
+            device,
+            physical_device.gpu,
+            uploads[i].size,
+            uploads[i].usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            uploads[i].resource
+        );
+        memcpy(&data[offset], uploads[i].data, uploads[i].size);
+        VkBufferCopy region = {
+            .srcOffset = offset,
+            .dstOffset = 0,
+            .size = uploads[i].size,
+        };
+        vkCmdCopyBuffer(transfer_command_buffer, staging.buffer, uploads[i].resource->buffer, 1, &region);
+        buffers[i] = uploads[i].resource->buffer;
+        offset += uploads[i].size;
+    }
+    vkUnmapMemory(device, staging.memory);
+
+    record_queue_transfer(transfer_command_buffer, transfer, VK_FALSE, count, buffers);
+    result = vkEndCommandBuffer(transfer_command_buffer);
+    assert(result == VK_SUCCESS);
+
+    result = vkBeginCommandBuffer(graphics_command_buffer, &begin_info);
+    assert(result == VK_SUCCESS);
+    record_queue_transfer(graphics_command_buffer, transfer, VK_TRUE, count, buffers);
+    result = vkEndCommandBuffer(graphics_command_buffer);
+    assert(result == VK_SUCCESS);
+
+    struct SemaphoreWait copied = {
+        .semaphore = transfer_timeline.semaphore,
+        .value = submit_command_buffer(&transfer_timeline, transfer_command_buffer, 0, 0, 0),
+        .stages = transfer->dst_stages,
+    };
+    uint64_t const acquired_value = submit_command_buffer(&graphics_timeline, graphics_command_buffer, 1, &copied, 0);
 
-        result = vkEndCommandBuffer(command_buffers[i]);
-        assert(result == VK_SUCCESS);
+    // the acquire waited for the copies, so its value covers both queues
+    struct RetiredResource const retired[] = {
+        {.value = acquired_value, .buffer = staging},
+        {.value = acquired_value, .command_pool = transfer_command_pool, .command_buffer = transfer_command_buffer},
+        {.value = acquired_value, .command_pool = graphics_command_pool, .command_buffer = graphics_command_buffer},
+    };
+    for (size_t i = 0; i < sizeof retired / sizeof *retired; i++) {
+        retire_resource(&retired[i]);
     }
 }
 
@@ -1161,10 +2300,44 @@ reinit_swapchain(void)
 
     deinit_with_extent();
     init_with_extent();
+
+    for (size_t i = 0; i < swapchain_length; i++)
+    {
+        image_timeline_values[i] = 0;
+    }
+}
+
+// Adds the optional depth prepass and the shading pass, drawing what the cull
+// pass before them left in the draw commands
+static uint32_t
+add_geometry_passes(uint32_t const color, uint32_t const draw_commands, uint32_t const clusters)
+{
+    if (is_depth_prepass) {
+        uint32_t pass = render_graph_add_pass(&render_graph, "depth prepass", VK_TRUE, record_depth_prepass);
+        render_graph_use(&render_graph, pass, depth_resource, RENDER_GRAPH_DEPTH_WRITE);
+        render_graph_use(&render_graph, pass, draw_commands, RENDER_GRAPH_INDIRECT_READ);
+    }
+
+    uint32_t pass = render_graph_add_pass(&render_graph, "shading", VK_TRUE, record_shading);
+    render_graph_use(&render_graph, pass, color, RENDER_GRAPH_COLOR_WRITE);
+    render_graph_use(&render_graph, pass, depth_resource, is_depth_prepass ? RENDER_GRAPH_DEPTH_READ : RENDER_GRAPH_DEPTH_WRITE);
+    render_graph_use(&render_graph, pass, draw_commands, RENDER_GRAPH_INDIRECT_READ);
+    render_graph_use(&render_graph, pass, clusters, RENDER_GRAPH_FRAGMENT_READ);
+
+    return pass;
 }
 
+// Two phase occlusion culling
+//   1. draw the objects that were visible last frame
+//   2. reduce that depth into the depth pyramid
+//   3. test every object against the pyramid and draw the newly visible ones
+// Without GPU occlusion the pyramid is not built and the late pass only
+// applies the frustum and the CPU object mask. Mesh shading culls meshlets
+// in the task stage of a single pass, so its depth never leaves the render
+// pass. With async compute the light clusters are binned on the compute
+// queue and only read here.
 static void
-init_with_extent(void)
+init_render_graph(void)
 {
     VkFormat depth_formats[3] = {VK_FORMAT_D16_UNORM};
     VkFormat depth_format = VK_FORMAT_UNDEFINED;
@@ -1181,73 +2354,150 @@ init_with_extent(void)
     }
     assert(depth_format != VK_FORMAT_UNDEFINED);
 
-    VkImageCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .extent.width = extent.width,
-        .extent.height = extent.height,
-        .extent.depth = 1,
-        .mipLevels = 1,
-        .arrayLayers = 1,
+    depth_pyramid_extent.width = previous_power_of_two(extent.width);
+    depth_pyramid_extent.height = previous_power_of_two(extent.height);
+    depth_pyramid_levels = 1;
+    while ((depth_pyramid_extent.width | depth_pyramid_extent.height) >> depth_pyramid_levels) {
+        depth_pyramid_levels++;
+    }
+
+    render_graph_init(&render_graph);
+    if (capabilities.is_dynamic_rendering) {
+        render_graph_set_dynamic_rendering(&render_graph, cmd_begin_rendering, cmd_end_rendering);
+    }
+    struct RenderGraphImage color_image = {
+        .format = surface_format.format,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .extent = extent,
+        .mip_levels = 1,
+        .is_cleared = VK_TRUE,
+        .clear_value.color.float32 = {0.0f, 0.0f, 0.0f, 1.0f},
+    };
+    uint32_t const color = render_graph_import_swapchain(&render_graph, &color_image, swapchain_length, swapchain_images, swapchain_image_views);
+
+    // the depth reduction sets sample the depth also when the pyramid is off
+    struct RenderGraphImage depth_image = {
         .format = depth_format,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .aspect = VK_IMAGE_ASPECT_DEPTH_BIT,
+        .extent = extent,
+        .mip_levels = 1,
+        .usage = capabilities.is_mesh_shading ? 0 : VK_IMAGE_USAGE_SAMPLED_BIT,
+        .is_cleared = VK_TRUE,
+        .clear_value.depthStencil = {1.0f, 0},
+    };
+    depth_resource = render_graph_add_image(&render_graph, &depth_image);
+
+    // and the cull sets bind the pyramid
+    struct RenderGraphImage depth_pyramid_image = {
+        .format = VK_FORMAT_R32_SFLOAT,
+        .aspect = VK_IMAGE_ASPECT_COLOR_BIT,
+        .extent = depth_pyramid_extent,
+        .mip_levels = depth_pyramid_levels,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
     };
+    depth_pyramid_resource = render_graph_add_image(&render_graph, &depth_pyramid_image);
 
-    result = vkCreateImage(device, &create_info, 0, &depth_image);
-    assert(result == VK_SUCCESS);
+    uint32_t const stats = render_graph_add_buffer(&render_graph, VK_TRUE);
+    uint32_t const clusters = render_graph_add_buffer(&render_graph, VK_TRUE);
+    uint32_t const draw_commands = render_graph_add_buffer(&render_graph, VK_TRUE);
+    uint32_t const visibility = render_graph_add_buffer(&render_graph, VK_FALSE);
 
-    VkMemoryRequirements memory_requirements;
-    vkGetImageMemoryRequirements(device, depth_image, &memory_requirements);
+    uint32_t pass = render_graph_add_pass(&render_graph, "clear stats", VK_FALSE, record_stats_clear);
+    render_graph_use(&render_graph, pass, stats, RENDER_GRAPH_TRANSFER_WRITE);
 
-    VkMemoryAllocateInfo alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memory_requirements.size,
-        .memoryTypeIndex = get_memory_type(
-            physical_device.gpu,
-            memory_requirements.memoryTypeBits,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-        ),
-    };
+    if (capabilities.is_mesh_shading) {
+        if (!is_async_compute) {
+            pass = render_graph_add_pass(&render_graph, "light clusters", VK_FALSE, record_light_clusters);
+            render_graph_use(&render_graph, pass, clusters, RENDER_GRAPH_COMPUTE_WRITE);
+        }
 
-    result = vkAllocateMemory(device, &alloc_info, 0, &depth_image_memory);
-    assert(result == VK_SUCCESS);
+        shading_pass = render_graph_add_pass(&render_graph, "mesh shading", VK_TRUE, record_mesh_draws);
+        render_graph_use(&render_graph, shading_pass, color, RENDER_GRAPH_COLOR_WRITE);
+        render_graph_use(&render_graph, shading_pass, depth_resource, RENDER_GRAPH_DEPTH_WRITE);
+        render_graph_use(&render_graph, shading_pass, stats, RENDER_GRAPH_TASK_WRITE);
+        render_graph_use(&render_graph, shading_pass, clusters, RENDER_GRAPH_FRAGMENT_READ);
+
+        render_graph_compile(&render_graph, device, physical_device.gpu);
+        return;
+    }
 
-    vkBindImageMemory(device, depth_image, depth_image_memory, 0);
+    pass = render_graph_add_pass(&render_graph, "early cull", VK_FALSE, record_early_cull);
+    render_graph_use(&render_graph, pass, draw_commands, RENDER_GRAPH_COMPUTE_WRITE);
+    render_graph_use(&render_graph, pass, visibility, RENDER_GRAPH_COMPUTE_WRITE);
+    render_graph_use(&render_graph, pass, stats, RENDER_GRAPH_COMPUTE_WRITE);
 
-    VkImageViewCreateInfo view_create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = depth_image,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = depth_format,
-        .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-    };
+    if (!is_async_compute) {
+        pass = render_graph_add_pass(&render_graph, "light clusters", VK_FALSE, record_light_clusters);
+        render_graph_use(&render_graph, pass, clusters, RENDER_GRAPH_COMPUTE_WRITE);
+    }
 
-    result = vkCreateImageView(device, &view_create_info, 0, &depth_image_view);
-    assert(result == VK_SUCCESS);
+    shading_pass = add_geometry_passes(color, draw_commands, clusters);
 
-    init_pipeline(device, extent, pipeline_layout, render_pass, &pipeline);
-    framebuffers = malloc(swapchain_length * sizeof *framebuffers);
-    init_framebuffers(
-        device,
-        extent,
-        depth_image_view,
-        render_pass,
-        swapchain_length,
-        swapchain_image_views,
-        framebuffers
-    );
+    if (is_gpu_occlusion_enabled) {
+        pass = render_graph_add_pass(&render_graph, "depth pyramid", VK_FALSE, record_depth_pyramid);
+        render_graph_use(&render_graph, pass, depth_resource, RENDER_GRAPH_SAMPLED_READ);
+        render_graph_use(&render_graph, pass, depth_pyramid_resource, RENDER_GRAPH_STORAGE_WRITE);
+    }
+
+    pass = render_graph_add_pass(&render_graph, "late cull", VK_FALSE, record_late_cull);
+    render_graph_use(&render_graph, pass, draw_commands, RENDER_GRAPH_COMPUTE_WRITE);
+    render_graph_use(&render_graph, pass, visibility, RENDER_GRAPH_COMPUTE_WRITE);
+    render_graph_use(&render_graph, pass, stats, RENDER_GRAPH_COMPUTE_WRITE);
+    if (is_gpu_occlusion_enabled) {
+        render_graph_use(&render_graph, pass, depth_pyramid_resource, RENDER_GRAPH_STORAGE_READ);
+    }
+
+    add_geometry_passes(color, draw_commands, clusters);
+
+    render_graph_compile(&render_graph, device, physical_device.gpu);
+}
+
+static void
+init_with_extent(void)
+{
+    init_render_graph();
+    init_depth_pyramid_views(device, render_graph.resources[depth_pyramid_resource].image);
+
+    cull_descriptor_sets = malloc(swapchain_length * sizeof *cull_descriptor_sets);
+    depth_reduce_descriptor_sets = malloc(depth_pyramid_levels * sizeof *depth_reduce_descriptor_sets);
+    write_descriptor_sets();
+
+    // The pipelines are only queued, recording waits for them. Until then
+    // they compile on the workers while the caller goes on, at startup
+    // while the game loads its map. The single sided pipelines are queued
+    // first, as recording cannot go without them.
+    struct RenderGraphTarget target;
+    struct RenderGraphTarget depth_target;
+    struct PipelineState state;
+    render_graph_get_target(&render_graph, shading_pass, &target);
+    init_pipeline_state(pipeline_layout, &target, VK_FALSE, VK_FALSE, VK_FALSE, &state);
+    shading_future = pipeline_cache_compile(&pipeline_cache, &state);
+    if (is_depth_prepass) {
+        // the prepass is added right before shading
+        render_graph_get_target(&render_graph, shading_pass - 1, &depth_target);
+        init_pipeline_state(pipeline_layout, &depth_target, VK_FALSE, VK_TRUE, VK_FALSE, &state);
+        depth_future = pipeline_cache_compile(&pipeline_cache, &state);
+        init_pipeline_state(pipeline_layout, &depth_target, VK_FALSE, VK_TRUE, VK_TRUE, &double_sided_depth_state);
+    }
+    if (capabilities.is_mesh_shading) {
+        init_pipeline_state(mesh_pipeline_layout, &target, VK_TRUE, VK_FALSE, VK_FALSE, &state);
+        mesh_future = pipeline_cache_compile(&pipeline_cache, &state);
+        init_pipeline_state(mesh_pipeline_layout, &target, VK_TRUE, VK_FALSE, VK_TRUE, &double_sided_mesh_state);
+        pipeline_cache_compile(&pipeline_cache, &double_sided_mesh_state);
+    }
+    init_pipeline_state(pipeline_layout, &target, VK_FALSE, VK_FALSE, VK_TRUE, &double_sided_state);
+    pipeline_cache_compile(&pipeline_cache, &double_sided_state);
+    if (is_depth_prepass) {
+        pipeline_cache_compile(&pipeline_cache, &double_sided_depth_state);
+    }
+    // the pipelines of earlier settings are idle by now
+    pipeline_cache_evict(&pipeline_cache);
     command_buffers = malloc(swapchain_length * sizeof *command_buffers);
     init_command_buffers(device, graphics_command_pool, swapchain_length, command_buffers);
+    if (is_async_compute) {
+        compute_command_buffers = malloc(swapchain_length * sizeof *compute_command_buffers);
+        init_command_buffers(device, compute_command_pool, swapchain_length, compute_command_buffers);
+    }
 }
 
 static void
@@ -1255,14 +2505,24 @@ deinit_with_extent(void)
 {
     vkFreeCommandBuffers(device, graphics_command_pool, swapchain_length, command_buffers);
     free(command_buffers);
-    for (size_t i = 0; i < swapchain_length; i++) {
-        vkDestroyFramebuffer(device, framebuffers[i], 0);
+    if (is_async_compute) {
+        vkFreeCommandBuffers(device, compute_command_pool, swapchain_length, compute_command_buffers);
+        free(compute_command_buffers);
+    }
+    // pipelines outlive the extent in the cache and work with the
+    // compatible render passes of the next one, only those still queued
+    // need the render passes about to be destroyed
+    if (!render_graph.is_dynamic_rendering) {
+        pipeline_cache_finish(&pipeline_cache);
     }
-    free(framebuffers);
-    vkDestroyPipeline(device, pipeline, 0);
-    vkDestroyImageView(device, depth_image_view, 0);
-    vkFreeMemory(device, depth_image_memory, 0);
-    vkDestroyImage(device, depth_image, 0);
+    descriptor_allocator_clear_cache(&descriptor_allocator, device);
+    free(cull_descriptor_sets);
+    free(depth_reduce_descriptor_sets);
+    for (size_t i = 0; i < depth_pyramid_levels; i++) {
+        vkDestroyImageView(device, depth_pyramid_level_views[i], 0);
+    }
+    free(depth_pyramid_level_views);
+    render_graph_destroy(&render_graph, device);
 }
 
 static void
@@ -1271,29 +2531,116 @@ update_uniform_buffers(
     VkDeviceMemory const memory,
     struct UBO const *ubo)
 {
+    struct FrameUniforms uniforms;
+    memcpy(uniforms.view, ubo->view, sizeof uniforms.view);
+    memcpy(uniforms.proj, ubo->proj, sizeof uniforms.proj);
+
+    float view_proj[4][4];
+    mat4_mul(view_proj, uniforms.view, uniforms.proj);
+    mat4_frustum(uniforms.frustum, view_proj);
+
+    // the view rotation is orthonormal, so the camera is at -t * R^T
+    for (int i = 0; i < 3; i++) {
+        uniforms.camera_position[i] = -(
+            uniforms.view[3][0] * uniforms.view[i][0] +
+            uniforms.view[3][1] * uniforms.view[i][1] +
+            uniforms.view[3][2] * uniforms.view[i][2]
+        );
+    }
+    uniforms.camera_position[3] = 1.0f;
+
+    // an error e at distance d spans e / d * proj[1][1] * height / 2 pixels
+    uniforms.lod_scale = fabsf(uniforms.proj[1][1]) * 0.5f * extent.height / LOD_MAX_PIXEL_ERROR;
+
+    // the depth of a view space z is proj[2][2] + proj[3][2] / z, it is 0 at
+    // the near plane and 1 at the far one
+    uniforms.z_near = -uniforms.proj[3][2] / uniforms.proj[2][2];
+    uniforms.z_far = -uniforms.proj[3][2] / (uniforms.proj[2][2] - 1.0f);
+    uniforms.light_count = light_count;
+    uniforms.viewport[0] = extent.width;
+    uniforms.viewport[1] = extent.height;
+    memset(uniforms.padding, 0, sizeof uniforms.padding);
+
     void *data;
-    vkMapMemory(device, memory, 0, sizeof *ubo, 0, &data);
-    memcpy(data, ubo, sizeof *ubo);
+    vkMapMemory(device, memory, 0, sizeof uniforms, 0, &data);
+    memcpy(data, &uniforms, sizeof uniforms);
+    vkUnmapMemory(device, memory);
+}
+
+static void
+read_frame_stats(
+    VkDevice const device,
+    VkDeviceMemory const memory,
+    struct FrameStats *stats)
+{
+    // laid out as the Stats buffer of the culling shaders
+    uint32_t *data;
+    vkMapMemory(device, memory, 0, 2 * sizeof *data, 0, (void **)&data);
+    stats->culled_object_count = data[0];
+    stats->selected_object_count = data[1];
     vkUnmapMemory(device, memory);
+
+    stats->object_count = object_count;
 }
 
+// Stable, so that both halves keep the order the game asked for
+static void
+partition_draw_order(uint32_t const order[static const object_count])
+{
+    uint32_t single_sided = 0;
+    uint32_t double_sided = single_sided_count;
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (is_object_double_sided[order[i]]) {
+            draw_order[double_sided++] = order[i];
+        } else {
+            draw_order[single_sided++] = order[i];
+        }
+    }
+}
 
 /* Public Functions */
 static void
-init(void)
+create_instance(void)
 {
+    if (instance) {
+        return;
+    }
+
     result = volkInitialize();
     assert(result == VK_SUCCESS);
 
     init_instance(&instance);
     volkLoadInstance(instance);
+}
 
+static void
+init(void)
+{
+    create_instance();
     init_surface(instance, &surface);
     init_physical_device(instance, &physical_device);
-    init_device(&physical_device, &device);
+    init_device(&physical_device, &capabilities, &device);
     volkLoadDevice(device);
+    if (capabilities.is_mesh_shading) {
+        cmd_draw_mesh_tasks = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+        assert(cmd_draw_mesh_tasks != 0);
+    }
+    if (capabilities.is_dynamic_rendering) {
+        cmd_begin_rendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+        cmd_end_rendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+        assert(cmd_begin_rendering != 0 && cmd_end_rendering != 0);
+    }
 
-    vkGetDeviceQueue(device, physical_device.graphics_family_index, 0, &graphics_queue);
+    init_timeline(physical_device.graphics_family_index, &graphics_timeline);
+    init_timeline(physical_device.transfer_family_index, &transfer_timeline);
+    init_timeline(physical_device.compute_family_index, &compute_timeline);
+    is_async_compute = physical_device.compute_family_index != physical_device.graphics_family_index;
+    printf(
+        "queue families: graphics %u, transfer %u, compute %u\n",
+        physical_device.graphics_family_index,
+        physical_device.transfer_family_index,
+        physical_device.compute_family_index
+    );
     get_surface_format(physical_device.gpu, surface, &surface_format);
     get_extent(physical_device.gpu, surface, &extent);
 
@@ -1313,33 +2660,84 @@ init(void)
     };
     result = vkCreateCommandPool(device, &graphics_command_pool_info, 0, &graphics_command_pool);
     assert(result == VK_SUCCESS);
+    VkCommandPoolCreateInfo transfer_command_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = physical_device.transfer_family_index,
+    };
+    result = vkCreateCommandPool(device, &transfer_command_pool_info, 0, &transfer_command_pool);
+    assert(result == VK_SUCCESS);
+    VkCommandPoolCreateInfo compute_command_pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = physical_device.compute_family_index,
+    };
+    result = vkCreateCommandPool(device, &compute_command_pool_info, 0, &compute_command_pool);
+    assert(result == VK_SUCCESS);
 
-    init_descriptor_pool(device, swapchain_length, &descriptor_pool);
+    descriptor_allocator_init(&descriptor_allocator, MAX_FRAMES_IN_FLIGHT);
+    pipeline_cache_init(&pipeline_cache, device);
 
     VkSemaphoreCreateInfo semaphore_info = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
     };
 
-    VkFenceCreateInfo fence_info = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-    };
-
+    // the swapchain only takes binary semaphores
     is_image_available_semaphore = malloc(MAX_FRAMES_IN_FLIGHT * sizeof *is_image_available_semaphore);
     is_present_ready_semaphore = malloc(MAX_FRAMES_IN_FLIGHT * sizeof *is_present_ready_semaphore);
-    is_main_render_done = malloc(MAX_FRAMES_IN_FLIGHT * sizeof *is_main_render_done);
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         result = vkCreateSemaphore(device, &semaphore_info, 0, &is_image_available_semaphore[i]);
         assert(result == VK_SUCCESS);
         result = vkCreateSemaphore(device, &semaphore_info, 0, &is_present_ready_semaphore[i]);
         assert(result == VK_SUCCESS);
-        result = vkCreateFence(device, &fence_info, 0, &is_main_render_done[i]);
-        assert(result == VK_SUCCESS);
     }
 
     init_descriptor_layout(device, &descriptor_layout);
-    init_pipeline_layout(device, descriptor_layout, &pipeline_layout);
-    init_render_pass(physical_device.gpu, device, surface_format.format, &render_pass);
+    if (capabilities.is_descriptor_indexing) {
+        bindless_init(&bindless, device, physical_device.gpu);
+    }
+    init_pipeline_layout(device, descriptor_layout, capabilities.is_descriptor_indexing ? &bindless : 0, &pipeline_layout);
+
+    init_cull_descriptor_layout(device, &cull_descriptor_layout);
+    init_compute_pipeline_layout(device, cull_descriptor_layout, sizeof(struct CullConstants), &cull_pipeline_layout);
+    init_compute_pipeline(device, "./build/cull.spv", cull_pipeline_layout, &cull_pipeline);
+    init_compute_pipeline_layout(device, descriptor_layout, 0, &cluster_pipeline_layout);
+    init_compute_pipeline(device, "./build/cluster.spv", cluster_pipeline_layout, &cluster_pipeline);
+    init_depth_reduce_descriptor_layout(device, &depth_reduce_descriptor_layout);
+    init_compute_pipeline_layout(device, depth_reduce_descriptor_layout, sizeof(struct DepthReduceConstants), &depth_reduce_pipeline_layout);
+    init_compute_pipeline(device, "./build/depth_reduce.spv", depth_reduce_pipeline_layout, &depth_reduce_pipeline);
+
+    if (capabilities.is_mesh_shading) {
+        init_mesh_descriptor_layout(device, &mesh_descriptor_layout);
+        VkPushConstantRange push_constant_range = {
+            .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT,
+            .offset = 0,
+            .size = sizeof(struct MeshConstants),
+        };
+        VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &mesh_descriptor_layout,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &push_constant_range,
+        };
+        result = vkCreatePipelineLayout(device, &pipeline_layout_create_info, 0, &mesh_pipeline_layout);
+        assert(result == VK_SUCCESS);
+    }
+
+    VkSamplerCreateInfo sampler_info = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .minLod = 0.0f,
+        .maxLod = VK_LOD_CLAMP_NONE,
+    };
+    result = vkCreateSampler(device, &sampler_info, 0, &depth_sampler);
+    assert(result == VK_SUCCESS);
 
 
 
@@ -1393,18 +2791,78 @@ init(void)
     // }
     // vkUnmapMemory(engine.device, engine.vertex_memory);
 
-    uniform_resources = malloc(swapchain_length * sizeof *uniform_resources);
-    init_uniform_resources(device, physical_device.gpu, sizeof(struct UBO), swapchain_length, uniform_resources);
-    descriptor_sets = malloc(swapchain_length * sizeof *descriptor_sets);
+    // the cluster pass on the compute queue reads the uniforms and lights
+    // the graphics queue reads as well
+    uint32_t const shared_families[] = {
+        physical_device.graphics_family_index,
+        physical_device.compute_family_index,
+    };
+    uint32_t const shared_family_count = is_async_compute ? 2 : 1;
+    cluster_transfer = (struct QueueTransfer) {
+        .src_family = physical_device.compute_family_index,
+        .dst_family = physical_device.graphics_family_index,
+        .src_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .src_access = VK_ACCESS_SHADER_WRITE_BIT,
+        .dst_stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        .dst_access = VK_ACCESS_SHADER_READ_BIT,
+    };
 
-    init_descriptor_sets(
+    uniform_resources = malloc(swapchain_length * sizeof *uniform_resources);
+    init_uniform_resources(
         device,
-        descriptor_layout,
-        descriptor_pool,
+        physical_device.gpu,
+        sizeof(struct FrameUniforms),
+        shared_family_count,
+        shared_families,
         swapchain_length,
-        uniform_resources,
-        descriptor_sets
+        uniform_resources
     );
+    stats_resources = malloc(swapchain_length * sizeof *stats_resources);
+    for (size_t i = 0; i < swapchain_length; i++) {
+        init_buffer(
+            device,
+            physical_device.gpu,
+            2 * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &stats_resources[i]
+        );
+    }
+    light_resources = malloc(swapchain_length * sizeof *light_resources);
+    cluster_resources = malloc(swapchain_length * sizeof *cluster_resources);
+    for (size_t i = 0; i < swapchain_length; i++) {
+        init_shared_buffer(
+            device,
+            physical_device.gpu,
+            sizeof lights,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            shared_family_count,
+            shared_families,
+            &light_resources[i]
+        );
+        init_buffer(
+            device,
+            physical_device.gpu,
+            CLUSTER_COUNT * (1 + CLUSTER_MAX_LIGHTS) * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &cluster_resources[i]
+        );
+    }
+    image_timeline_values = calloc(swapchain_length, sizeof *image_timeline_values);
+    descriptor_sets = malloc(swapchain_length * sizeof *descriptor_sets);
+
+    // the object buffer gets its index when the map is loaded
+    if (capabilities.is_descriptor_indexing) {
+        bindless_constants = malloc(swapchain_length * sizeof *bindless_constants);
+        for (size_t i = 0; i < swapchain_length; i++) {
+            bindless_constants[i].light_buffer = bindless_add_buffer(&bindless);
+            bindless_write_buffer(&bindless, device, bindless_constants[i].light_buffer, light_resources[i].buffer);
+            bindless_constants[i].cluster_buffer = bindless_add_buffer(&bindless);
+            bindless_write_buffer(&bindless, device, bindless_constants[i].cluster_buffer, cluster_resources[i].buffer);
+        }
+    }
 
     init_with_extent();
 }
@@ -1422,19 +2880,99 @@ deinit(void)
         vkDestroyBuffer(device, uniform_resources[i].buffer, 0);
     }
     free(uniform_resources);
-    vkFreeMemory(device, vertex_memory, 0);
-    vkDestroyBuffer(device, vertex_buffer, 0);
-    vkDestroyRenderPass(device, render_pass, 0);
+    for (size_t i = 0; i < swapchain_length; i++)
+    {
+        vkFreeMemory(device, stats_resources[i].memory, 0);
+        vkDestroyBuffer(device, stats_resources[i].buffer, 0);
+    }
+    free(stats_resources);
+    for (size_t i = 0; i < swapchain_length; i++)
+    {
+        vkFreeMemory(device, cluster_resources[i].memory, 0);
+        vkDestroyBuffer(device, cluster_resources[i].buffer, 0);
+        vkFreeMemory(device, light_resources[i].memory, 0);
+        vkDestroyBuffer(device, light_resources[i].buffer, 0);
+    }
+    free(cluster_resources);
+    free(light_resources);
+    free(image_timeline_values);
+    if (object_count)
+    {
+        for (size_t i = 0; i < swapchain_length; i++)
+        {
+            vkFreeMemory(device, draw_command_resources[i].memory, 0);
+            vkDestroyBuffer(device, draw_command_resources[i].buffer, 0);
+        }
+        free(draw_command_resources);
+        for (size_t i = 0; i < swapchain_length; i++)
+        {
+            vkFreeMemory(device, object_mask_resources[i].memory, 0);
+            vkDestroyBuffer(device, object_mask_resources[i].buffer, 0);
+        }
+        free(object_mask_resources);
+        free(object_mask);
+        for (size_t i = 0; i < swapchain_length; i++)
+        {
+            vkFreeMemory(device, draw_order_resources[i].memory, 0);
+            vkDestroyBuffer(device, draw_order_resources[i].buffer, 0);
+        }
+        free(draw_order_resources);
+        free(draw_order);
+        free(is_object_double_sided);
+        vkFreeMemory(device, visibility_resource.memory, 0);
+        vkDestroyBuffer(device, visibility_resource.buffer, 0);
+        vkFreeMemory(device, object_resource.memory, 0);
+        vkDestroyBuffer(device, object_resource.buffer, 0);
+        if (capabilities.is_mesh_shading)
+        {
+            free(mesh_descriptor_sets);
+            vkFreeMemory(device, triangle_color_resource.memory, 0);
+            vkDestroyBuffer(device, triangle_color_resource.buffer, 0);
+            vkFreeMemory(device, meshlet_triangle_resource.memory, 0);
+            vkDestroyBuffer(device, meshlet_triangle_resource.buffer, 0);
+            vkFreeMemory(device, meshlet_vertex_resource.memory, 0);
+            vkDestroyBuffer(device, meshlet_vertex_resource.buffer, 0);
+            vkFreeMemory(device, position_resource.memory, 0);
+            vkDestroyBuffer(device, position_resource.buffer, 0);
+        }
+    }
+    vkFreeMemory(device, vertex_resource.memory, 0);
+    vkDestroyBuffer(device, vertex_resource.buffer, 0);
+    vkDestroySampler(device, depth_sampler, 0);
+    vkDestroyPipeline(device, depth_reduce_pipeline, 0);
+    vkDestroyPipelineLayout(device, depth_reduce_pipeline_layout, 0);
+    vkDestroyDescriptorSetLayout(device, depth_reduce_descriptor_layout, 0);
+    if (capabilities.is_mesh_shading)
+    {
+        vkDestroyPipelineLayout(device, mesh_pipeline_layout, 0);
+        vkDestroyDescriptorSetLayout(device, mesh_descriptor_layout, 0);
+    }
+    vkDestroyPipeline(device, cluster_pipeline, 0);
+    vkDestroyPipelineLayout(device, cluster_pipeline_layout, 0);
+    vkDestroyPipeline(device, cull_pipeline, 0);
+    vkDestroyPipelineLayout(device, cull_pipeline_layout, 0);
+    vkDestroyDescriptorSetLayout(device, cull_descriptor_layout, 0);
     vkDestroyPipelineLayout(device, pipeline_layout, 0);
     vkDestroyDescriptorSetLayout(device, descriptor_layout, 0);
+    if (capabilities.is_descriptor_indexing) {
+        bindless_destroy(&bindless, device);
+        free(bindless_constants);
+    }
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
     {
         vkDestroySemaphore(device, is_image_available_semaphore[i], 0);
         vkDestroySemaphore(device, is_present_ready_semaphore[i], 0);
-        vkDestroyFence(device, is_main_render_done[i], 0);
     }
-    vkDestroyDescriptorPool(device, descriptor_pool, 0);
+    reclaim_resources();
+    free(retired_resources);
+    vkDestroySemaphore(device, compute_timeline.semaphore, 0);
+    vkDestroySemaphore(device, transfer_timeline.semaphore, 0);
+    vkDestroySemaphore(device, graphics_timeline.semaphore, 0);
+    descriptor_allocator_destroy(&descriptor_allocator, device);
+    pipeline_cache_destroy(&pipeline_cache);
     free(descriptor_sets);
+    vkDestroyCommandPool(device, compute_command_pool, 0);
+    vkDestroyCommandPool(device, transfer_command_pool, 0);
     vkDestroyCommandPool(device, graphics_command_pool, 0);
     for (size_t i = 0; i < swapchain_length; i++)
     {
@@ -1453,11 +2991,9 @@ draw_frame(struct UBO *ubo)
 {
     static uint32_t current_frame = 0;
 
-    result = vkWaitForFences(device, 1, &is_main_render_done[current_frame], VK_TRUE, UINT64_MAX);
-    assert(result == VK_SUCCESS);
-
-    result = vkResetFences(device, 1, &is_main_render_done[current_frame]);
-    assert(result == VK_SUCCESS);
+    wait_timeline(&graphics_timeline, frame_timeline_values[current_frame]);
+    reclaim_resources();
+    descriptor_allocator_reset_frame(&descriptor_allocator, device, current_frame);
 
     uint32_t image_index;
     result = vkAcquireNextImageKHR(
@@ -1468,29 +3004,65 @@ draw_frame(struct UBO *ubo)
         0,
         &image_index
     );
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         reinit_swapchain();
+        return;
     }
 
-    update_uniform_buffers(device, uniform_resources[current_frame].memory, ubo);
+    // the command buffer and per image resources may still be in use by an
+    // earlier frame that rendered to the same image
+    if (image_timeline_values[image_index]) {
+        wait_timeline(&graphics_timeline, image_timeline_values[image_index]);
+        read_frame_stats(device, stats_resources[image_index].memory, &frame_stats);
+    }
+    if (object_count) {
+        write_frame_descriptor_sets(current_frame, image_index);
+        record_command_buffer(image_index);
+    }
 
-    VkPipelineStageFlags wait_stages[] = {
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-    };
+    update_uniform_buffers(device, uniform_resources[image_index].memory, ubo);
+    if (object_count) {
+        void *data;
+        vkMapMemory(device, object_mask_resources[image_index].memory, 0, object_count * sizeof *object_mask, 0, &data);
+        memcpy(data, object_mask, object_count * sizeof *object_mask);
+        vkUnmapMemory(device, object_mask_resources[image_index].memory);
+        vkMapMemory(device, draw_order_resources[image_index].memory, 0, object_count * sizeof *draw_order, 0, &data);
+        memcpy(data, draw_order, object_count * sizeof *draw_order);
+        vkUnmapMemory(device, draw_order_resources[image_index].memory);
+    }
+    if (light_count) {
+        void *data;
+        vkMapMemory(device, light_resources[image_index].memory, 0, light_count * sizeof *lights, 0, &data);
+        memcpy(data, lights, light_count * sizeof *lights);
+        vkUnmapMemory(device, light_resources[image_index].memory);
+    }
 
-    VkSubmitInfo submit_info = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &is_image_available_semaphore[current_frame],
-        .pWaitDstStageMask = wait_stages,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffers[image_index],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &is_present_ready_semaphore[current_frame],
+    struct SemaphoreWait waits[] = {
+        {
+            .semaphore = is_image_available_semaphore[current_frame],
+            .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        },
+        {
+            .semaphore = compute_timeline.semaphore,
+            .stages = cluster_transfer.dst_stages,
+        },
     };
 
-    result = vkQueueSubmit(graphics_queue, 1, &submit_info, is_main_render_done[current_frame]);
-    assert(result == VK_SUCCESS);
+    // the clusters are binned beside the culling and geometry that come
+    // before the first fragment shader
+    if (is_async_compute) {
+        waits[1].value = submit_command_buffer(&compute_timeline, compute_command_buffers[image_index], 0, 0, 0);
+    }
+
+    uint64_t const value = submit_command_buffer(
+        &graphics_timeline,
+        command_buffers[image_index],
+        is_async_compute ? 2 : 1,
+        waits,
+        is_present_ready_semaphore[current_frame]
+    );
+    frame_timeline_values[current_frame] = value;
+    image_timeline_values[image_index] = value;
 
     VkPresentInfoKHR present_info = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -1501,7 +3073,7 @@ draw_frame(struct UBO *ubo)
         .pImageIndices = &image_index,
     };
 
-    result = vkQueuePresentKHR(graphics_queue, &present_info);
+    result = vkQueuePresentKHR(graphics_timeline.queue, &present_info);
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
         reinit_swapchain();
     }
@@ -1510,58 +3082,250 @@ draw_frame(struct UBO *ubo)
 }
 
 static void
-load_map(uint32_t const count, struct Vertex vertices[static const count])
+load_map(
+    uint32_t const count,
+    struct Vertex vertices[static const count],
+    uint32_t const draw_object_count,
+    struct DrawObject const objects[static const draw_object_count],
+    struct MeshletData const *meshlets)
 {
     VkDeviceSize size = count * sizeof *vertices;
     printf("size: %ld\n", size);
 
-    VkBufferCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = size,
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-    };
-    result = vkCreateBuffer(device, &create_info, 0, &vertex_buffer);
-    assert(result == VK_SUCCESS);
+    // bindless draws find the vertices of an object through its index of
+    // the vertex buffer
+    object_count = draw_object_count;
+    struct DrawObject *uploaded_objects = malloc(object_count * sizeof *uploaded_objects);
+    memcpy(uploaded_objects, objects, object_count * sizeof *uploaded_objects);
+    uint32_t vertex_buffer = 0;
+    uint32_t object_buffer = 0;
+    if (capabilities.is_descriptor_indexing) {
+        vertex_buffer = bindless_add_buffer(&bindless);
+        object_buffer = bindless_add_buffer(&bindless);
+    }
+    for (uint32_t i = 0; i < object_count; i++) {
+        uploaded_objects[i].vertex_buffer = vertex_buffer;
+    }
 
-    VkMemoryRequirements memory_requirements;
-    vkGetBufferMemoryRequirements(device, vertex_buffer, &memory_requirements);
-    VkMemoryAllocateInfo alloc_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memory_requirements.size,
-        .memoryTypeIndex = get_memory_type(
-            physical_device.gpu,
-            memory_requirements.memoryTypeBits,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        ),
+    // the static map goes to device local memory through the transfer queue
+    VkBufferUsageFlags const vertex_usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+        (capabilities.is_descriptor_indexing ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+    struct Upload uploads[6] = {
+        {vertices, size, vertex_usage, &vertex_resource},
+        {uploaded_objects, object_count * sizeof *uploaded_objects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &object_resource},
     };
-    result = vkAllocateMemory(device, &alloc_info, 0, &vertex_memory);
-    assert(result == VK_SUCCESS);
+    uint32_t upload_count = 2;
+    if (capabilities.is_mesh_shading) {
+        uploads[upload_count++] = (struct Upload) {
+            meshlets->positions,
+            meshlets->position_count * sizeof *meshlets->positions,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            &position_resource,
+        };
+        uploads[upload_count++] = (struct Upload) {
+            meshlets->meshlet_vertices,
+            meshlets->meshlet_vertex_count * sizeof *meshlets->meshlet_vertices,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            &meshlet_vertex_resource,
+        };
+        uploads[upload_count++] = (struct Upload) {
+            meshlets->meshlet_triangles,
+            meshlets->meshlet_triangle_count * sizeof *meshlets->meshlet_triangles,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            &meshlet_triangle_resource,
+        };
+        uploads[upload_count++] = (struct Upload) {
+            meshlets->triangle_colors,
+            meshlets->meshlet_triangle_count * sizeof *meshlets->triangle_colors,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            &triangle_color_resource,
+        };
+    }
+    struct QueueTransfer upload_transfer = {
+        .src_family = physical_device.transfer_family_index,
+        .dst_family = physical_device.graphics_family_index,
+        .src_stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+        .src_access = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dst_stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+            (capabilities.is_mesh_shading ? VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : 0) |
+            (capabilities.is_descriptor_indexing ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : 0),
+        .dst_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+    };
+    upload_buffers(upload_count, uploads, &upload_transfer);
+    free(uploaded_objects);
+
+    if (capabilities.is_descriptor_indexing) {
+        bindless_write_buffer(&bindless, device, vertex_buffer, vertex_resource.buffer);
+        bindless_write_buffer(&bindless, device, object_buffer, object_resource.buffer);
+        for (size_t i = 0; i < swapchain_length; i++) {
+            bindless_constants[i].object_buffer = object_buffer;
+        }
+    }
 
     void *data;
-    vkBindBufferMemory(device, vertex_buffer, vertex_memory, 0);
-    vkMapMemory(device, vertex_memory, 0, size, 0, &data);
-    memcpy(data, vertices, size);
-    vkUnmapMemory(device, vertex_memory);
 
-    record_command_buffers(
-        swapchain_length,
-        command_buffers,
-        framebuffers,
-        descriptor_sets,
-        render_pass,
-        pipeline,
-        pipeline_layout,
-        count,
-        vertex_buffer,
-        extent
+    // nothing was visible before the first frame, so it is drawn by the late pass
+    VkDeviceSize visibility_size = object_count * sizeof(uint32_t);
+    init_buffer(
+        device,
+        physical_device.gpu,
+        visibility_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &visibility_resource
     );
+    vkMapMemory(device, visibility_resource.memory, 0, visibility_size, 0, &data);
+    memset(data, 0, visibility_size);
+    vkUnmapMemory(device, visibility_resource.memory);
+
+    draw_command_resources = malloc(swapchain_length * sizeof *draw_command_resources);
+    for (size_t i = 0; i < swapchain_length; i++) {
+        init_buffer(
+            device,
+            physical_device.gpu,
+            object_count * sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &draw_command_resources[i]
+        );
+    }
+
+    // every object passes the CPU mask until the game sets one
+    object_mask = malloc(visibility_size);
+    for (uint32_t i = 0; i < object_count; i++) {
+        object_mask[i] = 1;
+    }
+    object_mask_resources = malloc(swapchain_length * sizeof *object_mask_resources);
+    for (size_t i = 0; i < swapchain_length; i++) {
+        init_buffer(
+            device,
+            physical_device.gpu,
+            visibility_size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &object_mask_resources[i]
+        );
+        vkMapMemory(device, object_mask_resources[i].memory, 0, visibility_size, 0, &data);
+        memcpy(data, object_mask, visibility_size);
+        vkUnmapMemory(device, object_mask_resources[i].memory);
+    }
+
+    // objects are drawn in map order until the game sets another one
+    is_object_double_sided = malloc(object_count * sizeof *is_object_double_sided);
+    single_sided_count = 0;
+    for (uint32_t i = 0; i < object_count; i++) {
+        is_object_double_sided[i] = (objects[i].flags & DRAW_OBJECT_FLAG_DOUBLE_SIDED) != 0;
+        single_sided_count += !is_object_double_sided[i];
+    }
+    uint32_t *map_order = malloc(object_count * sizeof *map_order);
+    for (uint32_t i = 0; i < object_count; i++) {
+        map_order[i] = i;
+    }
+    draw_order = malloc(object_count * sizeof *draw_order);
+    partition_draw_order(map_order);
+    free(map_order);
+    draw_order_resources = malloc(swapchain_length * sizeof *draw_order_resources);
+    for (size_t i = 0; i < swapchain_length; i++) {
+        init_buffer(
+            device,
+            physical_device.gpu,
+            object_count * sizeof *draw_order,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &draw_order_resources[i]
+        );
+        vkMapMemory(device, draw_order_resources[i].memory, 0, object_count * sizeof *draw_order, 0, &data);
+        memcpy(data, draw_order, object_count * sizeof *draw_order);
+        vkUnmapMemory(device, draw_order_resources[i].memory);
+    }
+
+    if (capabilities.is_mesh_shading) {
+        mesh_descriptor_sets = malloc(swapchain_length * sizeof *mesh_descriptor_sets);
+    }
+}
+
+static void
+get_frame_stats(struct FrameStats *stats)
+{
+    *stats = frame_stats;
+}
+
+// Objects with a zero mask entry are culled from the next frame drawn
+static void
+set_object_visibility(uint32_t const count, uint8_t const mask[static const count])
+{
+    assert(count == object_count);
+    for (uint32_t i = 0; i < count; i++) {
+        object_mask[i] = mask[i];
+    }
+}
+
+static void
+set_gpu_occlusion(int const is_enabled)
+{
+    if (!is_enabled == !is_gpu_occlusion_enabled) {
+        return;
+    }
+
+    // the pyramid pass comes and goes with it, so the graph is rebuilt
+    wait_timeline(&graphics_timeline, graphics_timeline.value);
+    deinit_with_extent();
+    is_gpu_occlusion_enabled = is_enabled ? VK_TRUE : VK_FALSE;
+    init_with_extent();
+}
+
+static void
+set_draw_order(uint32_t const count, uint32_t const order[static const count])
+{
+    assert(count == object_count);
+    partition_draw_order(order);
+}
+
+// Render passes with and without the prepass are not compatible, so the graph
+// and everything recorded against it is rebuilt
+static void
+set_depth_prepass(int const is_enabled)
+{
+    if (!is_enabled == !is_depth_prepass || capabilities.is_mesh_shading) {
+        return;
+    }
+
+    wait_timeline(&graphics_timeline, graphics_timeline.value);
+    deinit_with_extent();
+    is_depth_prepass = is_enabled ? VK_TRUE : VK_FALSE;
+    init_with_extent();
+}
+
+static void
+set_lights(uint32_t const count, struct Light const new_lights[static const count])
+{
+    light_count = count < GRAPHICS_MAX_LIGHTS ? count : GRAPHICS_MAX_LIGHTS;
+    memcpy(lights, new_lights, light_count * sizeof *lights);
+}
+
+// Rebuilt like the other settings, the variants of earlier settings are
+// evicted from the pipeline cache afterwards
+static void
+set_shading(struct Shading const *new_shading)
+{
+    wait_timeline(&graphics_timeline, graphics_timeline.value);
+    deinit_with_extent();
+    shading = *new_shading;
+    init_with_extent();
 }
 
 /* Export Graphics Library */
 const struct graphics graphics = {
+    .create_instance = create_instance,
     .init = init,
     .deinit = deinit,
     .draw_frame = draw_frame,
     .load_map = load_map,
+    .get_frame_stats = get_frame_stats,
+    .set_object_visibility = set_object_visibility,
+    .set_gpu_occlusion = set_gpu_occlusion,
+    .set_lights = set_lights,
+    .set_draw_order = set_draw_order,
+    .set_depth_prepass = set_depth_prepass,
+    .set_shading = set_shading,
 };
@@ -0,0 +1,588 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graphics/io.h"
+#include "graphics/pipeline_cache.h"
+
+#define FIRST_CAPACITY 64
+
+// FNV-1a
+static uint64_t
+hash_bytes(uint64_t hash, void const *data, size_t const size)
+{
+    uint8_t const *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#define HASH_FIELD(hash, field) hash_bytes((hash), &(field), sizeof (field))
+
+static uint64_t
+hash_state(struct PipelineState const *state)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HASH_FIELD(hash, state->layout);
+    hash = HASH_FIELD(hash, state->stage_count);
+    for (uint32_t i = 0; i < state->stage_count; i++) {
+        hash = HASH_FIELD(hash, state->stages[i]);
+        hash = hash_bytes(hash, state->shader_paths[i], strlen(state->shader_paths[i]) + 1);
+    }
+    hash = HASH_FIELD(hash, state->vertex_stride);
+    hash = HASH_FIELD(hash, state->attribute_count);
+    for (uint32_t i = 0; i < state->attribute_count; i++) {
+        hash = HASH_FIELD(hash, state->attributes[i].location);
+        hash = HASH_FIELD(hash, state->attributes[i].format);
+        hash = HASH_FIELD(hash, state->attributes[i].offset);
+    }
+    hash = HASH_FIELD(hash, state->polygon_mode);
+    hash = HASH_FIELD(hash, state->cull_mode);
+    hash = HASH_FIELD(hash, state->is_depth_write);
+    hash = HASH_FIELD(hash, state->depth_compare);
+    VkBool32 const is_render_pass = state->render_pass != VK_NULL_HANDLE;
+    hash = HASH_FIELD(hash, is_render_pass);
+    if (is_render_pass) {
+        struct RenderGraphPassLayout const *layout = &state->pass_layout;
+        hash = HASH_FIELD(hash, layout->attachment_count);
+        hash = hash_bytes(hash, layout->formats, layout->attachment_count * sizeof *layout->formats);
+        hash = HASH_FIELD(hash, layout->subpass_count);
+        for (uint32_t s = 0; s < layout->subpass_count; s++) {
+            hash = HASH_FIELD(hash, layout->color_counts[s]);
+            hash = hash_bytes(hash, layout->color_attachments[s], layout->color_counts[s]);
+            hash = HASH_FIELD(hash, layout->depth_attachments[s]);
+            hash = HASH_FIELD(hash, layout->is_depth_read[s]);
+        }
+    }
+    hash = HASH_FIELD(hash, state->subpass);
+    hash = HASH_FIELD(hash, state->color_format_count);
+    for (uint32_t i = 0; i < state->color_format_count; i++) {
+        hash = HASH_FIELD(hash, state->color_formats[i]);
+    }
+    hash = HASH_FIELD(hash, state->depth_format);
+    hash = HASH_FIELD(hash, state->constant_count);
+    for (uint32_t i = 0; i < state->constant_count; i++) {
+        hash = HASH_FIELD(hash, state->constants[i].constantID);
+    }
+    hash = hash_bytes(hash, state->constant_data, state->constant_size);
+    return hash;
+}
+
+static VkBool32
+is_pass_layout_equal(struct RenderGraphPassLayout const *a, struct RenderGraphPassLayout const *b)
+{
+    if (a->attachment_count != b->attachment_count ||
+        memcmp(a->formats, b->formats, a->attachment_count * sizeof *a->formats) ||
+        a->subpass_count != b->subpass_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t s = 0; s < a->subpass_count; s++) {
+        if (a->color_counts[s] != b->color_counts[s] ||
+            memcmp(a->color_attachments[s], b->color_attachments[s], a->color_counts[s]) ||
+            a->depth_attachments[s] != b->depth_attachments[s] ||
+            a->is_depth_read[s] != b->is_depth_read[s]) {
+            return VK_FALSE;
+        }
+    }
+    return VK_TRUE;
+}
+
+// Compares the fields hash_state walks
+static VkBool32
+is_state_equal(struct PipelineState const *a, struct PipelineState const *b)
+{
+    if (a->layout != b->layout || a->stage_count != b->stage_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < a->stage_count; i++) {
+        if (a->stages[i] != b->stages[i] || strcmp(a->shader_paths[i], b->shader_paths[i])) {
+            return VK_FALSE;
+        }
+    }
+    if (a->vertex_stride != b->vertex_stride || a->attribute_count != b->attribute_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < a->attribute_count; i++) {
+        if (a->attributes[i].location != b->attributes[i].location ||
+            a->attributes[i].format != b->attributes[i].format ||
+            a->attributes[i].offset != b->attributes[i].offset) {
+            return VK_FALSE;
+        }
+    }
+    if (a->polygon_mode != b->polygon_mode ||
+        a->cull_mode != b->cull_mode ||
+        a->is_depth_write != b->is_depth_write ||
+        a->depth_compare != b->depth_compare ||
+        !a->render_pass != !b->render_pass ||
+        (a->render_pass && !is_pass_layout_equal(&a->pass_layout, &b->pass_layout)) ||
+        a->subpass != b->subpass ||
+        a->color_format_count != b->color_format_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < a->color_format_count; i++) {
+        if (a->color_formats[i] != b->color_formats[i]) {
+            return VK_FALSE;
+        }
+    }
+    if (a->depth_format != b->depth_format || a->constant_count != b->constant_count) {
+        return VK_FALSE;
+    }
+    for (uint32_t i = 0; i < a->constant_count; i++) {
+        if (a->constants[i].constantID != b->constants[i].constantID) {
+            return VK_FALSE;
+        }
+    }
+    return a->constant_size == b->constant_size && !memcmp(a->constant_data, b->constant_data, a->constant_size);
+}
+
+void
+pipeline_state_add_constant(struct PipelineState *state, uint32_t const constant_id, void const *value)
+{
+    assert(state->constant_count < PIPELINE_CACHE_MAX_CONSTANTS);
+    state->constants[state->constant_count++] = (VkSpecializationMapEntry) {
+        .constantID = constant_id,
+        .offset = state->constant_size,
+        .size = sizeof(uint32_t),
+    };
+    memcpy(&state->constant_data[state->constant_size], value, sizeof(uint32_t));
+    state->constant_size += sizeof(uint32_t);
+}
+
+// Triangles wind counter-clockwise around their normal in the right handed
+// world, which the view flips to clockwise
+static VkPipeline
+create_pipeline(VkDevice const device, VkPipelineCache const vulkan_cache, struct PipelineState const *state)
+{
+    VkSpecializationInfo specialization = {
+        .mapEntryCount = state->constant_count,
+        .pMapEntries = state->constants,
+        .dataSize = state->constant_size,
+        .pData = state->constant_data,
+    };
+
+    VkShaderModule shader_modules[PIPELINE_CACHE_MAX_STAGES];
+    VkPipelineShaderStageCreateInfo shader_stages[PIPELINE_CACHE_MAX_STAGES];
+    VkBool32 is_mesh = VK_FALSE;
+    for (uint32_t i = 0; i < state->stage_count; i++) {
+        uint32_t shader_code_size = 0;
+        uint32_t *shader_code = 0;
+        io_read_spirv(state->shader_paths[i], &shader_code_size, &shader_code);
+        VkShaderModuleCreateInfo module_info = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = shader_code_size,
+            .pCode = shader_code,
+        };
+        VkResult result = vkCreateShaderModule(device, &module_info, 0, &shader_modules[i]);
+        assert(result == VK_SUCCESS);
+#ifdef _WIN32
+        _aligned_free(shader_code);
+#else
+        free(shader_code);
+#endif
+
+        shader_stages[i] = (VkPipelineShaderStageCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = state->stages[i],
+            .module = shader_modules[i],
+            .pName = "main",
+            .pSpecializationInfo = state->constant_count ? &specialization : 0,
+        };
+        is_mesh = is_mesh || state->stages[i] == VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+
+    VkVertexInputBindingDescription binding_description = {
+        .binding = 0,
+        .stride = state->vertex_stride,
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = state->vertex_stride ? 1 : 0,
+        .pVertexBindingDescriptions = &binding_description,
+        .vertexAttributeDescriptionCount = state->attribute_count,
+        .pVertexAttributeDescriptions = state->attributes,
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+
+    // set when recording
+    VkPipelineViewportStateCreateInfo viewport = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterization = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = state->polygon_mode,
+        .cullMode = state->cull_mode,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .depthBiasConstantFactor = 0.0,
+        .depthBiasClamp = 0.0,
+        .depthBiasSlopeFactor = 0.0,
+        .lineWidth = 1.0,
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisample = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE,
+        .minSampleShading = 0.0,
+        .pSampleMask = 0,
+        .alphaToCoverageEnable = VK_FALSE,
+        .alphaToOneEnable = VK_FALSE,
+    };
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = state->is_depth_write,
+        .depthCompareOp = state->depth_compare,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE,
+    };
+
+    VkPipelineColorBlendAttachmentState color_blend_attachments[PIPELINE_CACHE_MAX_COLOR_FORMATS];
+    for (uint32_t i = 0; i < state->color_format_count; i++) {
+        color_blend_attachments[i] = (VkPipelineColorBlendAttachmentState) {
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            .blendEnable = VK_FALSE,
+            .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+        };
+    }
+
+    VkPipelineColorBlendStateCreateInfo color_blend = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .logicOp = VK_LOGIC_OP_COPY,
+        .attachmentCount = state->color_format_count,
+        .pAttachments = &color_blend_attachments[0],
+        .blendConstants = { 0.0, 0.0, 0.0, 0.0 },
+    };
+
+    VkPipelineRenderingCreateInfoKHR rendering = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount = state->color_format_count,
+        .pColorAttachmentFormats = state->color_formats,
+        .depthAttachmentFormat = state->depth_format,
+    };
+
+    VkDynamicState const dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = sizeof dynamic_states / sizeof dynamic_states[0],
+        .pDynamicStates = dynamic_states,
+    };
+
+    // mesh pipelines have no vertex input or input assembly
+    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = state->render_pass ? 0 : &rendering,
+        .stageCount = state->stage_count,
+        .pStages = &shader_stages[0],
+        .pVertexInputState = is_mesh ? 0 : &vertex_input,
+        .pInputAssemblyState = is_mesh ? 0 : &input_assembly,
+        .pTessellationState = 0,
+        .pViewportState = &viewport,
+        .pRasterizationState = &rasterization,
+        .pMultisampleState = &multisample,
+        .pDepthStencilState = &depth_stencil,
+        .pColorBlendState = &color_blend,
+        .pDynamicState = &dynamic,
+        .layout = state->layout,
+        .renderPass = state->render_pass,
+        .subpass = state->subpass,
+        .basePipelineHandle = 0,
+        .basePipelineIndex = -1,
+    };
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(device, vulkan_cache, 1, &graphics_pipeline_create_info, 0, &pipeline);
+    assert(result == VK_SUCCESS);
+
+    for (uint32_t i = 0; i < state->stage_count; i++) {
+        vkDestroyShaderModule(device, shader_modules[i], 0);
+    }
+
+    return pipeline;
+}
+
+// Takes queued entries until the cache is destroyed, entries that a waiting
+// caller took over in the meantime are skipped
+static int
+worker(void *arg)
+{
+    struct PipelineCache *cache = arg;
+
+    mtx_lock(&cache->mutex);
+    for (;;) {
+        while (cache->is_running && !cache->queue_count) {
+            cnd_wait(&cache->queued, &cache->mutex);
+        }
+        if (!cache->is_running) {
+            break;
+        }
+        uint32_t const index = cache->queue[cache->queue_first];
+        cache->queue_first = (cache->queue_first + 1) % cache->queue_capacity;
+        cache->queue_count--;
+        struct PipelineCacheEntry *entry = &cache->entries[index];
+        if (entry->status != PIPELINE_QUEUED) {
+            continue;
+        }
+        entry->status = PIPELINE_COMPILING;
+        struct PipelineState const state = entry->state;
+        mtx_unlock(&cache->mutex);
+
+        VkPipeline pipeline = create_pipeline(cache->device, cache->vulkan_cache, &state);
+
+        mtx_lock(&cache->mutex);
+        entry = &cache->entries[index];
+        entry->pipeline = pipeline;
+        entry->status = PIPELINE_READY;
+        cnd_broadcast(&cache->compiled);
+    }
+    mtx_unlock(&cache->mutex);
+
+    return 0;
+}
+
+// Doubles the entries, the new ones are free. The caller holds the mutex.
+static void
+grow_entries(struct PipelineCache *cache)
+{
+    uint32_t const capacity = cache->entry_capacity ? 2 * cache->entry_capacity : FIRST_CAPACITY;
+    struct PipelineCacheEntry *entries = realloc(cache->entries, capacity * sizeof *entries);
+    assert(entries);
+    memset(&entries[cache->entry_capacity], 0, (capacity - cache->entry_capacity) * sizeof *entries);
+    cache->entries = entries;
+    cache->entry_capacity = capacity;
+}
+
+// Doubles the ring, moving its indices to the front. The caller holds the
+// mutex.
+static void
+grow_queue(struct PipelineCache *cache)
+{
+    uint32_t const capacity = cache->queue_capacity ? 2 * cache->queue_capacity : FIRST_CAPACITY;
+    uint32_t *queue = malloc(capacity * sizeof *queue);
+    assert(queue);
+    for (uint32_t i = 0; i < cache->queue_count; i++) {
+        queue[i] = cache->queue[(cache->queue_first + i) % cache->queue_capacity];
+    }
+    free(cache->queue);
+    cache->queue = queue;
+    cache->queue_first = 0;
+    cache->queue_capacity = capacity;
+}
+
+// Returns the index of the entry of the state, or of a free one with
+// is_found cleared. The caller holds the mutex.
+static uint32_t
+find_entry(struct PipelineCache *cache, uint64_t const hash, struct PipelineState const *state, VkBool32 *is_found)
+{
+    uint32_t free_entry = cache->entry_capacity;
+    for (uint32_t i = 0; i < cache->entry_capacity; i++) {
+        struct PipelineCacheEntry const *entry = &cache->entries[i];
+        if (entry->status == PIPELINE_FREE) {
+            free_entry = free_entry == cache->entry_capacity ? i : free_entry;
+        } else if (entry->hash == hash && is_state_equal(&entry->state, state)) {
+            *is_found = VK_TRUE;
+            return i;
+        }
+    }
+
+    // every entry is taken, the first of the new ones is free
+    if (free_entry == cache->entry_capacity) {
+        grow_entries(cache);
+    }
+    *is_found = VK_FALSE;
+    return free_entry;
+}
+
+void
+pipeline_cache_init(struct PipelineCache *cache, VkDevice const device)
+{
+    *cache = (struct PipelineCache) {
+        .device = device,
+        .is_running = 1,
+    };
+    grow_entries(cache);
+    grow_queue(cache);
+
+    VkPipelineCacheCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    };
+    VkResult result = vkCreatePipelineCache(device, &create_info, 0, &cache->vulkan_cache);
+    assert(result == VK_SUCCESS);
+
+    mtx_init(&cache->mutex, mtx_plain);
+    cnd_init(&cache->queued);
+    cnd_init(&cache->compiled);
+    for (uint32_t i = 0; i < PIPELINE_CACHE_THREAD_COUNT; i++) {
+        int status = thrd_create(&cache->threads[i], worker, cache);
+        assert(status == thrd_success);
+    }
+}
+
+struct PipelineFuture
+pipeline_cache_compile(struct PipelineCache *cache, struct PipelineState const *state)
+{
+    uint64_t const hash = hash_state(state);
+
+    mtx_lock(&cache->mutex);
+    VkBool32 is_found;
+    uint32_t const index = find_entry(cache, hash, state, &is_found);
+    struct PipelineCacheEntry *entry = &cache->entries[index];
+    if (!is_found) {
+        *entry = (struct PipelineCacheEntry) {
+            .hash = hash,
+            .state = *state,
+            .status = PIPELINE_QUEUED,
+        };
+        // entries a caller took over stay in the queue until a worker skips
+        // them, so it can hold more indices than there are entries
+        if (cache->queue_count == cache->queue_capacity) {
+            grow_queue(cache);
+        }
+        uint32_t const last = (cache->queue_first + cache->queue_count++) % cache->queue_capacity;
+        cache->queue[last] = index;
+        cnd_signal(&cache->queued);
+    } else if (entry->status == PIPELINE_QUEUED) {
+        // the render pass it was queued with may be gone
+        entry->state.render_pass = state->render_pass;
+    }
+    entry->is_used = VK_TRUE;
+    mtx_unlock(&cache->mutex);
+
+    return (struct PipelineFuture) {
+        .entry = index,
+        .hash = hash,
+    };
+}
+
+VkBool32
+pipeline_cache_is_ready(struct PipelineCache *cache, struct PipelineFuture const *future)
+{
+    mtx_lock(&cache->mutex);
+    struct PipelineCacheEntry const *entry = &cache->entries[future->entry];
+    assert(entry->hash == future->hash && entry->status != PIPELINE_FREE);
+    VkBool32 const is_ready = entry->status == PIPELINE_READY;
+    mtx_unlock(&cache->mutex);
+
+    return is_ready;
+}
+
+VkPipeline
+pipeline_cache_wait(struct PipelineCache *cache, struct PipelineFuture const *future)
+{
+    mtx_lock(&cache->mutex);
+    struct PipelineCacheEntry *entry = &cache->entries[future->entry];
+    assert(entry->hash == future->hash && entry->status != PIPELINE_FREE);
+
+    // a queued pipeline is taken from the workers rather than waited for,
+    // they skip it when its index comes up
+    if (entry->status == PIPELINE_QUEUED) {
+        entry->status = PIPELINE_COMPILING;
+        struct PipelineState const state = entry->state;
+        mtx_unlock(&cache->mutex);
+
+        VkPipeline pipeline = create_pipeline(cache->device, cache->vulkan_cache, &state);
+
+        mtx_lock(&cache->mutex);
+        entry = &cache->entries[future->entry];
+        entry->pipeline = pipeline;
+        entry->status = PIPELINE_READY;
+        cnd_broadcast(&cache->compiled);
+    }
+    while (cache->entries[future->entry].status != PIPELINE_READY) {
+        cnd_wait(&cache->compiled, &cache->mutex);
+    }
+    VkPipeline pipeline = cache->entries[future->entry].pipeline;
+    mtx_unlock(&cache->mutex);
+
+    return pipeline;
+}
+
+VkPipeline
+pipeline_cache_request(struct PipelineCache *cache, struct PipelineState const *state, VkPipeline const fallback)
+{
+    struct PipelineFuture const future = pipeline_cache_compile(cache, state);
+
+    return pipeline_cache_is_ready(cache, &future) ? pipeline_cache_wait(cache, &future) : fallback;
+}
+
+void
+pipeline_cache_evict(struct PipelineCache *cache)
+{
+    mtx_lock(&cache->mutex);
+    for (uint32_t i = 0; i < cache->entry_capacity; i++) {
+        struct PipelineCacheEntry *entry = &cache->entries[i];
+        if (entry->status == PIPELINE_READY && !entry->is_used) {
+            vkDestroyPipeline(cache->device, entry->pipeline, 0);
+            entry->status = PIPELINE_FREE;
+        }
+        entry->is_used = VK_FALSE;
+    }
+    mtx_unlock(&cache->mutex);
+}
+
+void
+pipeline_cache_finish(struct PipelineCache *cache)
+{
+    mtx_lock(&cache->mutex);
+    for (uint32_t i = 0; i < cache->entry_capacity; i++) {
+        if (cache->entries[i].status == PIPELINE_QUEUED) {
+            struct PipelineFuture const future = {
+                .entry = i,
+                .hash = cache->entries[i].hash,
+            };
+            mtx_unlock(&cache->mutex);
+            pipeline_cache_wait(cache, &future);
+            mtx_lock(&cache->mutex);
+        }
+        while (cache->entries[i].status == PIPELINE_COMPILING) {
+            cnd_wait(&cache->compiled, &cache->mutex);
+        }
+    }
+    mtx_unlock(&cache->mutex);
+}
+
+void
+pipeline_cache_destroy(struct PipelineCache *cache)
+{
+    mtx_lock(&cache->mutex);
+    cache->is_running = 0;
+    cnd_broadcast(&cache->queued);
+    mtx_unlock(&cache->mutex);
+    for (uint32_t i = 0; i < PIPELINE_CACHE_THREAD_COUNT; i++) {
+        thrd_join(cache->threads[i], 0);
+    }
+
+    for (uint32_t i = 0; i < cache->entry_capacity; i++) {
+        if (cache->entries[i].status == PIPELINE_READY) {
+            vkDestroyPipeline(cache->device, cache->entries[i].pipeline, 0);
+        }
+    }
+    vkDestroyPipelineCache(cache->device, cache->vulkan_cache, 0);
+    free(cache->queue);
+    free(cache->entries);
+
+    cnd_destroy(&cache->compiled);
+    cnd_destroy(&cache->queued);
+    mtx_destroy(&cache->mutex);
+}
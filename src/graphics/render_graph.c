@@ -0,0 +1,1133 @@
+#include "graphics/render_graph.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONE UINT32_MAX
+
+struct UsageInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    // zero for usages that only read
+    VkAccessFlags write_access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+    VkBool32 is_attachment;
+};
+
+static struct UsageInfo const usage_infos[RENDER_GRAPH_USAGE_COUNT] = {
+    [RENDER_GRAPH_COLOR_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .write_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .is_attachment = VK_TRUE,
+    },
+    [RENDER_GRAPH_DEPTH_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .write_access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .image_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .is_attachment = VK_TRUE,
+    },
+    [RENDER_GRAPH_DEPTH_READ] = {
+        .stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .image_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .is_attachment = VK_TRUE,
+    },
+    [RENDER_GRAPH_SAMPLED_READ] = {
+        .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT,
+        .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .image_usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+    },
+    [RENDER_GRAPH_STORAGE_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .write_access = VK_ACCESS_SHADER_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+        .image_usage = VK_IMAGE_USAGE_STORAGE_BIT,
+    },
+    [RENDER_GRAPH_STORAGE_READ] = {
+        .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+        .image_usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+    },
+    [RENDER_GRAPH_TRANSFER_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_TRANSFER_BIT,
+        .access = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .write_access = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .image_usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    },
+    [RENDER_GRAPH_COMPUTE_READ] = {
+        .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT,
+    },
+    [RENDER_GRAPH_COMPUTE_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .write_access = VK_ACCESS_SHADER_WRITE_BIT,
+    },
+    [RENDER_GRAPH_TASK_WRITE] = {
+        .stages = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT,
+        .access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .write_access = VK_ACCESS_SHADER_WRITE_BIT,
+    },
+    [RENDER_GRAPH_INDIRECT_READ] = {
+        .stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        .access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+    },
+    [RENDER_GRAPH_FRAGMENT_READ] = {
+        .stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        .access = VK_ACCESS_SHADER_READ_BIT,
+    },
+};
+
+struct Access {
+    uint32_t position;
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkBool32 is_attachment;
+};
+
+// What the next use of a slot waits for. Positions count the passes of two
+// consecutive frames from 1, the position before a frame is its acquire.
+struct SyncState {
+    VkImageLayout layout;
+    VkBool32 has_write;
+    struct Access write;
+    uint32_t read_count;
+    struct Access reads[2 * RENDER_GRAPH_MAX_PASSES];
+    // stages a pipeline barrier made wait for the write, later commands in
+    // them need no further barrier to read
+    VkPipelineStageFlags barrier_stages;
+};
+
+struct Dependency {
+    VkPipelineStageFlags src_stages;
+    VkPipelineStageFlags dst_stages;
+    VkAccessFlags src_access;
+    VkAccessFlags dst_access;
+    VkBool32 is_by_region;
+};
+
+// Dependencies of the render passes, indexed by pass
+struct Dependencies {
+    struct Dependency external[RENDER_GRAPH_MAX_PASSES];
+    struct Dependency internal[RENDER_GRAPH_MAX_PASSES][RENDER_GRAPH_MAX_PASSES];
+    VkImageLayout initial_layouts[RENDER_GRAPH_MAX_PASSES][RENDER_GRAPH_MAX_ATTACHMENTS];
+};
+
+static uint32_t
+find_memory_type(
+    VkPhysicalDevice const physical_device,
+    uint32_t const type_filter,
+    VkMemoryPropertyFlags const flags)
+{
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_filter & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
+            return i;
+        }
+    }
+
+    return NONE;
+}
+
+static uint32_t
+add_resource(struct RenderGraph *graph)
+{
+    assert(graph->resource_count < RENDER_GRAPH_MAX_RESOURCES);
+    uint32_t resource = graph->resource_count++;
+    graph->resources[resource] = (struct RenderGraphResource) {
+        .first_pass = NONE,
+        .last_pass = NONE,
+        .slot = NONE,
+    };
+
+    return resource;
+}
+
+static uint32_t
+find_attachment(struct RenderGraphGroup const *group, uint32_t const resource)
+{
+    for (uint32_t a = 0; a < group->attachment_count; a++) {
+        if (group->attachments[a] == resource) {
+            return a;
+        }
+    }
+
+    return NONE;
+}
+
+// Runs of consecutive graphics passes become the subpasses of one render pass
+static void
+assign_groups(struct RenderGraph *graph)
+{
+    graph->group_count = 0;
+    for (uint32_t p = 0; p < graph->pass_count; p++) {
+        struct RenderGraphPass *pass = &graph->passes[p];
+        if (!pass->is_graphics) {
+            pass->group = NONE;
+            continue;
+        }
+
+        if (p == 0 || !graph->passes[p - 1].is_graphics || graph->is_dynamic_rendering) {
+            graph->groups[graph->group_count++] = (struct RenderGraphGroup) {
+                .first_pass = p,
+            };
+        }
+        struct RenderGraphGroup *group = &graph->groups[graph->group_count - 1];
+        pass->group = graph->group_count - 1;
+        pass->subpass = group->pass_count++;
+
+        for (uint32_t u = 0; u < pass->use_count; u++) {
+            struct RenderGraphResource const *resource = &graph->resources[pass->uses[u].resource];
+            if (!resource->is_image) {
+                continue;
+            }
+
+            assert(usage_infos[pass->uses[u].usage].is_attachment);
+            if (find_attachment(group, pass->uses[u].resource) == NONE) {
+                assert(group->attachment_count < RENDER_GRAPH_MAX_ATTACHMENTS);
+                assert(group->attachment_count == 0 || (
+                    group->extent.width == resource->desc.extent.width &&
+                    group->extent.height == resource->desc.extent.height));
+                group->extent = resource->desc.extent;
+                group->clear_values[group->attachment_count] = resource->desc.clear_value;
+                group->attachments[group->attachment_count++] = pass->uses[u].resource;
+            }
+        }
+    }
+}
+
+// Images used by a single render pass never leave tile memory
+static void
+find_lifetimes(struct RenderGraph *graph)
+{
+    for (uint32_t p = 0; p < graph->pass_count; p++) {
+        struct RenderGraphPass const *pass = &graph->passes[p];
+        for (uint32_t u = 0; u < pass->use_count; u++) {
+            struct RenderGraphResource *resource = &graph->resources[pass->uses[u].resource];
+            if (resource->first_pass == NONE) {
+                resource->first_pass = p;
+            }
+            resource->last_pass = p;
+            resource->usage |= usage_infos[pass->uses[u].usage].image_usage;
+        }
+    }
+
+    for (uint32_t r = 0; r < graph->resource_count; r++) {
+        struct RenderGraphResource *resource = &graph->resources[r];
+        resource->is_transient = resource->is_image && !resource->is_swapchain
+            && resource->first_pass != NONE
+            && graph->passes[resource->first_pass].is_graphics
+            && graph->passes[resource->first_pass].group == graph->passes[resource->last_pass].group;
+    }
+}
+
+static uint32_t
+get_lifetime_mask(struct RenderGraphResource const *resource)
+{
+    if (resource->first_pass == NONE) {
+        return 0;
+    }
+
+    uint32_t const end = resource->last_pass + 1 < 32 ? (1u << (resource->last_pass + 1)) - 1 : UINT32_MAX;
+    return end & ~((1u << resource->first_pass) - 1);
+}
+
+// Transient images go to lazily allocated memory when the device has it,
+// the others are placed largest first into slots whose images are never
+// alive at once, and every image of a slot is bound to its memory
+static void
+init_images(struct RenderGraph *graph, VkDevice const device, VkPhysicalDevice const physical_device)
+{
+    VkResult result;
+    VkMemoryRequirements requirements[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t order[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t order_count = 0;
+    uint32_t slot_masks[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t slot_type_bits[RENDER_GRAPH_MAX_RESOURCES];
+    VkDeviceSize slot_sizes[RENDER_GRAPH_MAX_RESOURCES];
+    VkMemoryPropertyFlags slot_flags[RENDER_GRAPH_MAX_RESOURCES];
+
+    graph->slot_count = 0;
+    graph->memory_size = 0;
+    for (uint32_t r = 0; r < graph->resource_count; r++) {
+        struct RenderGraphResource *resource = &graph->resources[r];
+        if (!resource->is_image || resource->is_swapchain) {
+            resource->slot = graph->slot_count;
+            slot_sizes[graph->slot_count] = 0;
+            graph->slot_memories[graph->slot_count++] = VK_NULL_HANDLE;
+            continue;
+        }
+
+        VkImageCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .extent.width = resource->desc.extent.width,
+            .extent.height = resource->desc.extent.height,
+            .extent.depth = 1,
+            .mipLevels = resource->desc.mip_levels,
+            .arrayLayers = 1,
+            .format = resource->desc.format,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .usage = resource->usage | (resource->is_transient ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0),
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        result = vkCreateImage(device, &create_info, 0, &resource->image);
+        assert(result == VK_SUCCESS);
+        vkGetImageMemoryRequirements(device, resource->image, &requirements[r]);
+
+        uint32_t const lazy_type = resource->is_transient
+            ? find_memory_type(physical_device, requirements[r].memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+            : NONE;
+        if (lazy_type != NONE) {
+            resource->is_lazily_allocated = VK_TRUE;
+            resource->slot = graph->slot_count;
+            slot_masks[graph->slot_count] = UINT32_MAX;
+            slot_type_bits[graph->slot_count] = 1u << lazy_type;
+            slot_sizes[graph->slot_count] = requirements[r].size;
+            slot_flags[graph->slot_count++] = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            continue;
+        }
+
+        uint32_t i = order_count++;
+        while (i > 0 && requirements[order[i - 1]].size < requirements[r].size) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = r;
+    }
+
+    for (uint32_t i = 0; i < order_count; i++) {
+        struct RenderGraphResource *resource = &graph->resources[order[i]];
+        VkMemoryRequirements const *requirement = &requirements[order[i]];
+        uint32_t const mask = get_lifetime_mask(resource);
+        uint32_t slot = 0;
+        for (; slot < graph->slot_count; slot++) {
+            if (slot_sizes[slot] && slot_flags[slot] == VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                && !(slot_masks[slot] & mask) && (slot_type_bits[slot] & requirement->memoryTypeBits)) {
+                break;
+            }
+        }
+
+        if (slot == graph->slot_count) {
+            graph->slot_memories[graph->slot_count++] = VK_NULL_HANDLE;
+            slot_masks[slot] = 0;
+            slot_type_bits[slot] = requirement->memoryTypeBits;
+            slot_sizes[slot] = 0;
+            slot_flags[slot] = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
+        resource->slot = slot;
+        slot_masks[slot] |= mask;
+        slot_type_bits[slot] &= requirement->memoryTypeBits;
+        // the largest image of a slot comes first and sets its size, the
+        // others bind to its start and need no more than its alignment
+        if (!slot_sizes[slot]) {
+            slot_sizes[slot] = requirement->size;
+        }
+        assert(requirement->size <= slot_sizes[slot]);
+    }
+
+    for (uint32_t slot = 0; slot < graph->slot_count; slot++) {
+        if (!slot_sizes[slot]) {
+            continue;
+        }
+
+        VkMemoryAllocateInfo alloc_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = slot_sizes[slot],
+            .memoryTypeIndex = find_memory_type(physical_device, slot_type_bits[slot], slot_flags[slot]),
+        };
+        assert(alloc_info.memoryTypeIndex != NONE);
+        result = vkAllocateMemory(device, &alloc_info, 0, &graph->slot_memories[slot]);
+        assert(result == VK_SUCCESS);
+        if (slot_flags[slot] != VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+            graph->memory_size += slot_sizes[slot];
+        }
+    }
+
+    for (uint32_t r = 0; r < graph->resource_count; r++) {
+        struct RenderGraphResource *resource = &graph->resources[r];
+        if (!resource->is_image || resource->is_swapchain) {
+            continue;
+        }
+
+        vkBindImageMemory(device, resource->image, graph->slot_memories[resource->slot], 0);
+
+        VkImageViewCreateInfo view_create_info = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = resource->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = resource->desc.format,
+            .subresourceRange = {
+                .aspectMask = resource->desc.aspect,
+                .baseMipLevel = 0,
+                .levelCount = resource->desc.mip_levels,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = vkCreateImageView(device, &view_create_info, 0, &resource->view);
+        assert(result == VK_SUCCESS);
+    }
+}
+
+static void
+add_dependency(struct Dependency *dependency, struct Access const *source, struct UsageInfo const *info)
+{
+    if (!dependency->src_stages) {
+        dependency->is_by_region = VK_TRUE;
+    }
+    dependency->src_stages |= source->stages;
+    dependency->dst_stages |= info->stages;
+    dependency->src_access |= source->access;
+    dependency->dst_access |= info->access;
+    dependency->is_by_region &= source->is_attachment && info->is_attachment;
+}
+
+// Makes a use wait for the accesses of its slot that it conflicts with. Uses
+// in render passes get subpass dependencies, the others a pipeline barrier
+// recorded before their pass, as do all uses with dynamic rendering.
+static void
+sync_use(
+    struct RenderGraph *graph,
+    struct SyncState states[static RENDER_GRAPH_MAX_RESOURCES],
+    struct Dependencies *dependencies,
+    uint32_t const base,
+    uint32_t const p,
+    struct RenderGraphUse const *use,
+    VkBool32 const is_recorded)
+{
+    struct RenderGraphPass *pass = &graph->passes[p];
+    struct RenderGraphResource const *resource = &graph->resources[use->resource];
+    struct UsageInfo const *info = &usage_infos[use->usage];
+    struct SyncState *state = &states[resource->slot];
+    uint32_t const position = base + p;
+    VkBool32 const is_in_render_pass = pass->is_graphics && !graph->is_dynamic_rendering;
+
+    // images are not kept from one frame to the next
+    VkImageLayout const old_layout = resource->is_image && p == resource->first_pass ? VK_IMAGE_LAYOUT_UNDEFINED : state->layout;
+    VkBool32 const is_transition = resource->is_image && old_layout != info->layout;
+    VkBool32 const is_write = info->write_access || is_transition;
+
+    struct Access sources[1 + 2 * RENDER_GRAPH_MAX_PASSES];
+    uint32_t source_count = 0;
+    if (state->has_write) {
+        if (is_write || (info->stages & ~state->barrier_stages)) {
+            sources[source_count++] = state->write;
+        }
+    }
+    if (is_write) {
+        for (uint32_t i = 0; i < state->read_count; i++) {
+            sources[source_count] = state->reads[i];
+            sources[source_count++].access = 0;
+        }
+    }
+
+    if (is_recorded && is_in_render_pass) {
+        struct RenderGraphGroup const *group = &graph->groups[pass->group];
+        uint32_t const attachment = find_attachment(group, use->resource);
+        if (attachment != NONE && dependencies->initial_layouts[pass->group][attachment] == VK_IMAGE_LAYOUT_MAX_ENUM) {
+            dependencies->initial_layouts[pass->group][attachment] = old_layout;
+        }
+
+        for (uint32_t i = 0; i < source_count; i++) {
+            if (sources[i].position >= base + group->first_pass) {
+                add_dependency(&dependencies->internal[sources[i].position - base][p], &sources[i], info);
+            } else {
+                add_dependency(&dependencies->external[p], &sources[i], info);
+            }
+        }
+    } else if (is_recorded && (source_count || is_transition)) {
+        VkPipelineStageFlags src_stages = 0;
+        VkAccessFlags src_access = 0;
+        for (uint32_t i = 0; i < source_count; i++) {
+            src_stages |= sources[i].stages;
+            src_access |= sources[i].access;
+        }
+        pass->src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        pass->dst_stages |= info->stages;
+
+        if (is_transition) {
+            pass->image_barrier_resources[pass->image_barrier_count] = use->resource;
+            pass->image_barriers[pass->image_barrier_count++] = (VkImageMemoryBarrier) {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = src_access,
+                .dstAccessMask = info->access,
+                .oldLayout = old_layout,
+                .newLayout = info->layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = resource->image,
+                .subresourceRange = {
+                    .aspectMask = resource->desc.aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = resource->desc.mip_levels,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+            };
+        } else if (src_access) {
+            pass->memory_barrier.srcAccessMask |= src_access;
+            pass->memory_barrier.dstAccessMask |= info->access;
+        }
+    }
+
+    if (is_write) {
+        state->has_write = VK_TRUE;
+        state->write = (struct Access) {
+            .position = position,
+            .stages = info->stages,
+            .access = info->write_access,
+            .is_attachment = info->is_attachment,
+        };
+        state->read_count = 0;
+        state->barrier_stages = 0;
+    } else {
+        assert(state->read_count < sizeof state->reads / sizeof *state->reads);
+        state->reads[state->read_count++] = (struct Access) {
+            .position = position,
+            .stages = info->stages,
+            .access = info->access,
+            .is_attachment = info->is_attachment,
+        };
+        if (source_count && !is_in_render_pass) {
+            state->barrier_stages |= info->stages;
+        }
+    }
+    state->layout = info->layout;
+}
+
+// Walks two frames, the first one only leaves the state that the uses of the
+// second one wait for
+static void
+derive_sync(struct RenderGraph *graph, struct Dependencies *dependencies)
+{
+    struct SyncState states[RENDER_GRAPH_MAX_RESOURCES] = {0};
+    for (uint32_t g = 0; g < graph->group_count; g++) {
+        for (uint32_t a = 0; a < RENDER_GRAPH_MAX_ATTACHMENTS; a++) {
+            dependencies->initial_layouts[g][a] = VK_IMAGE_LAYOUT_MAX_ENUM;
+        }
+    }
+
+    for (uint32_t frame = 0; frame < 2; frame++) {
+        uint32_t const base = 1 + frame * graph->pass_count;
+        // resources of the image start over, and acquiring it waits for the
+        // semaphore in the color output stage
+        for (uint32_t r = 0; r < graph->resource_count; r++) {
+            if (graph->resources[r].is_per_image) {
+                states[graph->resources[r].slot] = (struct SyncState) {
+                    .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .has_write = graph->resources[r].is_swapchain,
+                    .write = {
+                        .position = base - 1,
+                        .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    },
+                };
+            }
+        }
+
+        for (uint32_t p = 0; p < graph->pass_count; p++) {
+            struct RenderGraphPass *pass = &graph->passes[p];
+            if (frame == 1) {
+                pass->src_stages = 0;
+                pass->dst_stages = 0;
+                pass->memory_barrier = (VkMemoryBarrier) {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                };
+                pass->image_barrier_count = 0;
+            }
+            for (uint32_t u = 0; u < pass->use_count; u++) {
+                sync_use(graph, states, dependencies, base, p, &pass->uses[u], frame == 1);
+            }
+        }
+    }
+
+    graph->barrier_count = 0;
+    for (uint32_t p = 0; p < graph->pass_count; p++) {
+        graph->barrier_count += graph->passes[p].src_stages != 0;
+    }
+}
+
+// Attachments are cleared or discarded at their first use of the frame and
+// stored while a later group or the presentation needs them. The final
+// layout is the one of their last use in the group.
+static void
+describe_attachment(
+    struct RenderGraph const *graph,
+    uint32_t const g,
+    uint32_t const a,
+    VkAttachmentDescription *description)
+{
+    struct RenderGraphGroup const *group = &graph->groups[g];
+    struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+    uint32_t const last_pass = group->first_pass + group->pass_count - 1;
+    VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    enum RenderGraphUsage first_usage = RENDER_GRAPH_USAGE_COUNT;
+    uint32_t first_pass = NONE;
+    for (uint32_t p = group->first_pass; p <= last_pass; p++) {
+        for (uint32_t u = 0; u < graph->passes[p].use_count; u++) {
+            if (graph->passes[p].uses[u].resource == group->attachments[a]) {
+                if (first_pass == NONE) {
+                    first_pass = p;
+                    first_usage = graph->passes[p].uses[u].usage;
+                }
+                final_layout = usage_infos[graph->passes[p].uses[u].usage].layout;
+            }
+        }
+    }
+
+    VkBool32 const is_first_in_frame = first_pass == resource->first_pass;
+    VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+    if (is_first_in_frame) {
+        load_op = resource->desc.is_cleared && usage_infos[first_usage].write_access
+            ? VK_ATTACHMENT_LOAD_OP_CLEAR
+            : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+
+    *description = (VkAttachmentDescription) {
+        .format = resource->desc.format,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = load_op,
+        .storeOp = resource->is_swapchain || resource->last_pass > last_pass
+            ? VK_ATTACHMENT_STORE_OP_STORE
+            : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = final_layout,
+    };
+}
+
+static void
+init_render_pass(
+    struct RenderGraph *graph,
+    VkDevice const device,
+    struct Dependencies const *dependencies,
+    uint32_t const g)
+{
+    struct RenderGraphGroup *group = &graph->groups[g];
+    uint32_t const last_pass = group->first_pass + group->pass_count - 1;
+
+    VkAttachmentDescription attachments[RENDER_GRAPH_MAX_ATTACHMENTS];
+    for (uint32_t a = 0; a < group->attachment_count; a++) {
+        struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+        describe_attachment(graph, g, a, &attachments[a]);
+        if (attachments[a].loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+            attachments[a].initialLayout = dependencies->initial_layouts[g][a];
+        }
+        if (resource->is_swapchain && resource->last_pass == last_pass) {
+            attachments[a].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        }
+    }
+
+    VkAttachmentReference color_refs[RENDER_GRAPH_MAX_PASSES][RENDER_GRAPH_MAX_ATTACHMENTS];
+    VkAttachmentReference depth_refs[RENDER_GRAPH_MAX_PASSES];
+    uint32_t preserve_refs[RENDER_GRAPH_MAX_PASSES][RENDER_GRAPH_MAX_ATTACHMENTS];
+    VkSubpassDescription subpasses[RENDER_GRAPH_MAX_PASSES];
+    for (uint32_t s = 0; s < group->pass_count; s++) {
+        struct RenderGraphPass const *pass = &graph->passes[group->first_pass + s];
+        subpasses[s] = (VkSubpassDescription) {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .pColorAttachments = color_refs[s],
+            .pPreserveAttachments = preserve_refs[s],
+        };
+
+        uint32_t used_mask = 0;
+        for (uint32_t u = 0; u < pass->use_count; u++) {
+            uint32_t const a = find_attachment(group, pass->uses[u].resource);
+            if (a == NONE) {
+                continue;
+            }
+
+            used_mask |= 1u << a;
+            VkAttachmentReference const reference = {
+                .attachment = a,
+                .layout = usage_infos[pass->uses[u].usage].layout,
+            };
+            if (pass->uses[u].usage == RENDER_GRAPH_COLOR_WRITE) {
+                color_refs[s][subpasses[s].colorAttachmentCount++] = reference;
+            } else {
+                depth_refs[s] = reference;
+                subpasses[s].pDepthStencilAttachment = &depth_refs[s];
+            }
+        }
+
+        // attachments a subpass skips keep their contents for later ones
+        for (uint32_t a = 0; a < group->attachment_count; a++) {
+            struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+            uint32_t const p = group->first_pass + s;
+            if (!(used_mask & (1u << a)) && resource->first_pass < p && resource->last_pass > p) {
+                preserve_refs[s][subpasses[s].preserveAttachmentCount++] = a;
+            }
+        }
+    }
+
+    VkSubpassDependency subpass_dependencies[RENDER_GRAPH_MAX_PASSES * (RENDER_GRAPH_MAX_PASSES + 1)];
+    uint32_t dependency_count = 0;
+    for (uint32_t dst = 0; dst < group->pass_count; dst++) {
+        for (uint32_t src = 0; src <= dst; src++) {
+            struct Dependency const *dependency = src == dst
+                ? &dependencies->external[group->first_pass + dst]
+                : &dependencies->internal[group->first_pass + src][group->first_pass + dst];
+            if (!dependency->src_stages) {
+                continue;
+            }
+
+            subpass_dependencies[dependency_count++] = (VkSubpassDependency) {
+                .srcSubpass = src == dst ? VK_SUBPASS_EXTERNAL : src,
+                .dstSubpass = dst,
+                .srcStageMask = dependency->src_stages,
+                .dstStageMask = dependency->dst_stages,
+                .srcAccessMask = dependency->src_access,
+                .dstAccessMask = dependency->dst_access,
+                .dependencyFlags = src != dst && dependency->is_by_region ? VK_DEPENDENCY_BY_REGION_BIT : 0,
+            };
+        }
+    }
+
+    VkRenderPassCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = group->attachment_count,
+        .pAttachments = attachments,
+        .subpassCount = group->pass_count,
+        .pSubpasses = subpasses,
+        .dependencyCount = dependency_count,
+        .pDependencies = subpass_dependencies,
+    };
+    VkResult result = vkCreateRenderPass(device, &create_info, 0, &group->render_pass);
+    assert(result == VK_SUCCESS);
+}
+
+static void
+init_framebuffers(struct RenderGraph *graph, VkDevice const device, uint32_t const g)
+{
+    struct RenderGraphGroup *group = &graph->groups[g];
+    group->framebuffers = malloc(graph->swapchain_length * sizeof *group->framebuffers);
+    for (uint32_t i = 0; i < graph->swapchain_length; i++) {
+        VkImageView views[RENDER_GRAPH_MAX_ATTACHMENTS];
+        for (uint32_t a = 0; a < group->attachment_count; a++) {
+            struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+            views[a] = resource->is_swapchain ? resource->swapchain_views[i] : resource->view;
+        }
+
+        VkFramebufferCreateInfo create_info = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .renderPass = group->render_pass,
+            .attachmentCount = group->attachment_count,
+            .pAttachments = views,
+            .width = group->extent.width,
+            .height = group->extent.height,
+            .layers = 1,
+        };
+        VkResult result = vkCreateFramebuffer(device, &create_info, 0, &group->framebuffers[i]);
+        assert(result == VK_SUCCESS);
+    }
+}
+
+// A group of dynamic rendering holds a single pass, whose barrier already
+// moved its attachments to the layouts they are rendered in
+static void
+init_rendering(struct RenderGraph *graph, uint32_t const g)
+{
+    struct RenderGraphGroup *group = &graph->groups[g];
+    for (uint32_t a = 0; a < group->attachment_count; a++) {
+        struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+        VkAttachmentDescription description;
+        describe_attachment(graph, g, a, &description);
+        group->rendering_attachments[a] = (VkRenderingAttachmentInfoKHR) {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .imageView = resource->view,
+            .imageLayout = description.finalLayout,
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .loadOp = description.loadOp,
+            .storeOp = description.storeOp,
+            .clearValue = resource->desc.clear_value,
+        };
+    }
+}
+
+// After dynamic rendering nothing moves the swapchain image to the present
+// layout, so the graph does once its last pass is done
+static void
+init_present_barrier(struct RenderGraph *graph)
+{
+    struct RenderGraphResource const *resource = &graph->resources[graph->swapchain_resource];
+    struct RenderGraphPass const *pass = &graph->passes[resource->last_pass];
+    enum RenderGraphUsage usage = RENDER_GRAPH_USAGE_COUNT;
+    for (uint32_t u = 0; u < pass->use_count; u++) {
+        if (pass->uses[u].resource == graph->swapchain_resource) {
+            usage = pass->uses[u].usage;
+        }
+    }
+    assert(usage_infos[usage].is_attachment);
+
+    graph->present_barrier = (VkImageMemoryBarrier) {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = usage_infos[usage].write_access,
+        .dstAccessMask = 0,
+        .oldLayout = usage_infos[usage].layout,
+        .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .subresourceRange = {
+            .aspectMask = resource->desc.aspect,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+}
+
+static void
+record_barrier(
+    struct RenderGraph const *graph,
+    struct RenderGraphPass const *pass,
+    VkCommandBuffer const command_buffer,
+    uint32_t const image_index)
+{
+    if (!pass->src_stages) {
+        return;
+    }
+
+    VkImageMemoryBarrier image_barriers[RENDER_GRAPH_MAX_USES];
+    for (uint32_t i = 0; i < pass->image_barrier_count; i++) {
+        struct RenderGraphResource const *resource = &graph->resources[pass->image_barrier_resources[i]];
+        image_barriers[i] = pass->image_barriers[i];
+        if (resource->is_swapchain) {
+            image_barriers[i].image = resource->swapchain_images[image_index];
+        }
+    }
+
+    VkBool32 const has_memory_barrier = pass->memory_barrier.srcAccessMask != 0;
+    vkCmdPipelineBarrier(
+        command_buffer,
+        pass->src_stages,
+        pass->dst_stages,
+        0,
+        has_memory_barrier ? 1 : 0, has_memory_barrier ? &pass->memory_barrier : 0,
+        0, 0,
+        pass->image_barrier_count, image_barriers
+    );
+}
+
+static void
+record_rendering(
+    struct RenderGraph const *graph,
+    struct RenderGraphPass const *pass,
+    VkCommandBuffer const command_buffer,
+    uint32_t const image_index)
+{
+    struct RenderGraphGroup const *group = &graph->groups[pass->group];
+    VkRenderingAttachmentInfoKHR color_attachments[RENDER_GRAPH_MAX_ATTACHMENTS];
+    VkRenderingInfoKHR rendering_info = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+        .renderArea = {
+            .offset = {0, 0},
+            .extent = group->extent,
+        },
+        .layerCount = 1,
+        .pColorAttachments = color_attachments,
+    };
+    for (uint32_t a = 0; a < group->attachment_count; a++) {
+        struct RenderGraphResource const *resource = &graph->resources[group->attachments[a]];
+        if (resource->desc.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) {
+            rendering_info.pDepthAttachment = &group->rendering_attachments[a];
+            continue;
+        }
+
+        color_attachments[rendering_info.colorAttachmentCount] = group->rendering_attachments[a];
+        if (resource->is_swapchain) {
+            color_attachments[rendering_info.colorAttachmentCount].imageView = resource->swapchain_views[image_index];
+        }
+        rendering_info.colorAttachmentCount++;
+    }
+
+    graph->begin_rendering(command_buffer, &rendering_info);
+    pass->record(command_buffer, image_index);
+    graph->end_rendering(command_buffer);
+}
+
+void
+render_graph_init(struct RenderGraph *graph)
+{
+    memset(graph, 0, sizeof *graph);
+    graph->swapchain_resource = NONE;
+    graph->swapchain_length = 1;
+}
+
+uint32_t
+render_graph_add_image(struct RenderGraph *graph, struct RenderGraphImage const *image)
+{
+    uint32_t resource = add_resource(graph);
+    graph->resources[resource].is_image = VK_TRUE;
+    graph->resources[resource].desc = *image;
+    graph->resources[resource].usage = image->usage;
+
+    return resource;
+}
+
+uint32_t
+render_graph_import_swapchain(
+    struct RenderGraph *graph,
+    struct RenderGraphImage const *image,
+    uint32_t const swapchain_length,
+    VkImage const images[static const swapchain_length],
+    VkImageView const views[static const swapchain_length])
+{
+    uint32_t resource = add_resource(graph);
+    graph->resources[resource].is_image = VK_TRUE;
+    graph->resources[resource].is_swapchain = VK_TRUE;
+    graph->resources[resource].is_per_image = VK_TRUE;
+    graph->resources[resource].desc = *image;
+    graph->resources[resource].swapchain_images = images;
+    graph->resources[resource].swapchain_views = views;
+    graph->swapchain_resource = resource;
+    graph->swapchain_length = swapchain_length;
+
+    return resource;
+}
+
+uint32_t
+render_graph_add_buffer(struct RenderGraph *graph, VkBool32 const is_per_image)
+{
+    uint32_t resource = add_resource(graph);
+    graph->resources[resource].is_per_image = is_per_image;
+
+    return resource;
+}
+
+uint32_t
+render_graph_add_pass(struct RenderGraph *graph, char const *name, VkBool32 const is_graphics, RenderGraphRecord const record)
+{
+    assert(graph->pass_count < RENDER_GRAPH_MAX_PASSES);
+    uint32_t pass = graph->pass_count++;
+    graph->passes[pass] = (struct RenderGraphPass) {
+        .name = name,
+        .is_graphics = is_graphics,
+        .record = record,
+    };
+
+    return pass;
+}
+
+void
+render_graph_use(struct RenderGraph *graph, uint32_t const pass, uint32_t const resource, enum RenderGraphUsage const usage)
+{
+    struct RenderGraphPass *graph_pass = &graph->passes[pass];
+    assert(graph_pass->use_count < RENDER_GRAPH_MAX_USES);
+    assert(resource < graph->resource_count);
+    for (uint32_t u = 0; u < graph_pass->use_count; u++) {
+        assert(graph_pass->uses[u].resource != resource);
+    }
+
+    graph_pass->uses[graph_pass->use_count++] = (struct RenderGraphUse) {
+        .resource = resource,
+        .usage = usage,
+    };
+}
+
+void
+render_graph_set_dynamic_rendering(
+    struct RenderGraph *graph,
+    PFN_vkCmdBeginRenderingKHR const begin_rendering,
+    PFN_vkCmdEndRenderingKHR const end_rendering)
+{
+    graph->is_dynamic_rendering = VK_TRUE;
+    graph->begin_rendering = begin_rendering;
+    graph->end_rendering = end_rendering;
+}
+
+void
+render_graph_compile(struct RenderGraph *graph, VkDevice const device, VkPhysicalDevice const physical_device)
+{
+    assign_groups(graph);
+    find_lifetimes(graph);
+    init_images(graph, device, physical_device);
+
+    struct Dependencies *dependencies = calloc(1, sizeof *dependencies);
+    derive_sync(graph, dependencies);
+    for (uint32_t g = 0; g < graph->group_count; g++) {
+        if (graph->is_dynamic_rendering) {
+            init_rendering(graph, g);
+        } else {
+            init_render_pass(graph, device, dependencies, g);
+            init_framebuffers(graph, device, g);
+        }
+    }
+    free(dependencies);
+    if (graph->is_dynamic_rendering && graph->swapchain_resource != NONE) {
+        init_present_barrier(graph);
+        graph->barrier_count++;
+    }
+
+    uint32_t image_count = 0;
+    uint32_t lazy_count = 0;
+    for (uint32_t r = 0; r < graph->resource_count; r++) {
+        image_count += graph->resources[r].is_image && !graph->resources[r].is_swapchain;
+        lazy_count += graph->resources[r].is_lazily_allocated;
+    }
+    printf(
+        "render graph: %u passes in %u %s, %u barriers, %u images in %.1f MiB, %u lazily allocated\n",
+        graph->pass_count,
+        graph->group_count,
+        graph->is_dynamic_rendering ? "rendering scopes" : "render passes",
+        graph->barrier_count,
+        image_count,
+        graph->memory_size / (1024.0 * 1024.0),
+        lazy_count
+    );
+}
+
+void
+render_graph_record(struct RenderGraph const *graph, VkCommandBuffer const command_buffer, uint32_t const image_index)
+{
+    for (uint32_t p = 0; p < graph->pass_count; p++) {
+        struct RenderGraphPass const *pass = &graph->passes[p];
+        if (!pass->is_graphics) {
+            record_barrier(graph, pass, command_buffer, image_index);
+            pass->record(command_buffer, image_index);
+            continue;
+        }
+
+        if (graph->is_dynamic_rendering) {
+            record_barrier(graph, pass, command_buffer, image_index);
+            record_rendering(graph, pass, command_buffer, image_index);
+            continue;
+        }
+
+        struct RenderGraphGroup const *group = &graph->groups[pass->group];
+        if (pass->subpass == 0) {
+            VkRenderPassBeginInfo begin_info = {
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+                .renderPass = group->render_pass,
+                .framebuffer = group->framebuffers[image_index % graph->swapchain_length],
+                .renderArea = {
+                    .offset = {0, 0},
+                    .extent = group->extent,
+                },
+                .clearValueCount = group->attachment_count,
+                .pClearValues = group->clear_values,
+            };
+            vkCmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        } else {
+            vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
+        pass->record(command_buffer, image_index);
+
+        if (pass->subpass == group->pass_count - 1) {
+            vkCmdEndRenderPass(command_buffer);
+        }
+    }
+
+    if (graph->is_dynamic_rendering && graph->swapchain_resource != NONE) {
+        VkImageMemoryBarrier present_barrier = graph->present_barrier;
+        present_barrier.image = graph->resources[graph->swapchain_resource].swapchain_images[image_index];
+        vkCmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, 0,
+            0, 0,
+            1, &present_barrier
+        );
+    }
+}
+
+void
+render_graph_destroy(struct RenderGraph *graph, VkDevice const device)
+{
+    for (uint32_t g = 0; g < graph->group_count && !graph->is_dynamic_rendering; g++) {
+        for (uint32_t i = 0; i < graph->swapchain_length; i++) {
+            vkDestroyFramebuffer(device, graph->groups[g].framebuffers[i], 0);
+        }
+        free(graph->groups[g].framebuffers);
+        vkDestroyRenderPass(device, graph->groups[g].render_pass, 0);
+    }
+    for (uint32_t r = 0; r < graph->resource_count; r++) {
+        struct RenderGraphResource const *resource = &graph->resources[r];
+        if (resource->is_image && !resource->is_swapchain) {
+            vkDestroyImageView(device, resource->view, 0);
+            vkDestroyImage(device, resource->image, 0);
+        }
+    }
+    for (uint32_t slot = 0; slot < graph->slot_count; slot++) {
+        if (graph->slot_memories[slot]) {
+            vkFreeMemory(device, graph->slot_memories[slot], 0);
+        }
+    }
+
+    render_graph_init(graph);
+}
+
+void
+render_graph_get_target(struct RenderGraph const *graph, uint32_t const pass, struct RenderGraphTarget *target)
+{
+    assert(graph->passes[pass].is_graphics);
+    struct RenderGraphGroup const *group = &graph->groups[graph->passes[pass].group];
+    *target = (struct RenderGraphTarget) {
+        .render_pass = group->render_pass,
+        .subpass = graph->passes[pass].subpass,
+        .rendering = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+            .pColorAttachmentFormats = target->color_formats,
+        },
+    };
+
+    for (uint32_t u = 0; u < graph->passes[pass].use_count; u++) {
+        struct RenderGraphUse const *use = &graph->passes[pass].uses[u];
+        if (use->usage == RENDER_GRAPH_COLOR_WRITE) {
+            target->color_formats[target->rendering.colorAttachmentCount++] = graph->resources[use->resource].desc.format;
+        } else if (use->usage == RENDER_GRAPH_DEPTH_WRITE || use->usage == RENDER_GRAPH_DEPTH_READ) {
+            target->rendering.depthAttachmentFormat = graph->resources[use->resource].desc.format;
+        }
+    }
+
+    // the references every subpass of the render pass makes, as in
+    // init_render_pass
+    if (!group->render_pass) {
+        return;
+    }
+    struct RenderGraphPassLayout *layout = &target->pass_layout;
+    layout->attachment_count = group->attachment_count;
+    for (uint32_t a = 0; a < group->attachment_count; a++) {
+        layout->formats[a] = graph->resources[group->attachments[a]].desc.format;
+    }
+    layout->subpass_count = group->pass_count;
+    for (uint32_t s = 0; s < group->pass_count; s++) {
+        struct RenderGraphPass const *subpass = &graph->passes[group->first_pass + s];
+        layout->depth_attachments[s] = UINT8_MAX;
+        for (uint32_t u = 0; u < subpass->use_count; u++) {
+            uint32_t const a = find_attachment(group, subpass->uses[u].resource);
+            if (a == NONE) {
+                continue;
+            }
+
+            if (subpass->uses[u].usage == RENDER_GRAPH_COLOR_WRITE) {
+                layout->color_attachments[s][layout->color_counts[s]++] = (uint8_t)a;
+            } else {
+                layout->depth_attachments[s] = (uint8_t)a;
+                layout->is_depth_read[s] = subpass->uses[u].usage == RENDER_GRAPH_DEPTH_READ;
+            }
+        }
+    }
+}